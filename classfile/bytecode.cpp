@@ -0,0 +1,43 @@
+#include "bytecode.h"
+
+// 0 = tamanho variável
+static const u1 opcode_length[] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 0, 0, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1,
+    3, 3, 1, 1, 0, 4, 3, 3, 5, 5,
+};
+
+u4 instruction_length(const std::vector<u1> &code, u4 pc) {
+  u1 op = code[pc];
+  if (op < sizeof(opcode_length) && opcode_length[op] != 0)
+    return opcode_length[op];
+
+  switch (op) {
+  case OP_tableswitch: {
+    // Operandos alinhados a 4 bytes a partir do início do código
+    u4 base = (pc + 4) & ~3u;
+    int32_t low = static_cast<int32_t>(read_code_u4(code, base + 4));
+    int32_t high = static_cast<int32_t>(read_code_u4(code, base + 8));
+    return base + 12 + static_cast<u4>(high - low + 1) * 4 - pc;
+  }
+  case OP_lookupswitch: {
+    u4 base = (pc + 4) & ~3u;
+    u4 npairs = read_code_u4(code, base + 4);
+    return base + 8 + npairs * 8 - pc;
+  }
+  case OP_wide:
+    return code[pc + 1] == OP_iinc ? 6 : 4;
+  default:
+    return 1;
+  }
+}
@@ -126,8 +126,22 @@ ConstantPoolEntry ClassParser::readConstantPoolEntry() {
     info.double_info.high_bytes = read_u4();
     info.double_info.low_bytes = read_u4();
     break;
+  case ConstantTag::CONSTANT_MethodHandle:
+    info.method_handle_info.reference_kind = read_u1();
+    info.method_handle_info.reference_index = read_u2();
+    break;
+  case ConstantTag::CONSTANT_MethodType:
+    info.method_type_info.descriptor_index = read_u2();
+    break;
+  case ConstantTag::CONSTANT_Dynamic:
+  case ConstantTag::CONSTANT_InvokeDynamic:
+    info.invoke_dynamic_info.bootstrap_method_attr_index = read_u2();
+    info.invoke_dynamic_info.name_and_type_index = read_u2();
+    break;
   default:
-    info.empty = EmptyInfo{};
+    // Sem saber o tamanho da entrada, o resto do arquivo seria lido errado
+    throw std::runtime_error("Invalid constant pool tag " +
+                             std::to_string(static_cast<int>(tag)));
   }
 
   return std::make_pair(tag, info);
@@ -294,6 +308,18 @@ std::vector<AttributeInfo> ClassParser::readAttributes(u2 count) {
       }
     }
 
+    else if (a.attribute_name == "BootstrapMethods") {
+      a.bootstrapmethods_info.num_bootstrap_methods = read_u2();
+      for (u2 j = 0; j < a.bootstrapmethods_info.num_bootstrap_methods; j++) {
+        BootstrapMethod bm{};
+        bm.bootstrap_method_ref = read_u2();
+        u2 num_arguments = read_u2();
+        for (u2 k = 0; k < num_arguments; k++)
+          bm.bootstrap_arguments.push_back(read_u2());
+        a.bootstrapmethods_info.bootstrap_methods.push_back(bm);
+      }
+    }
+
     else if (a.attribute_name == "Synthetic") {
       // Não possui conteúdo
     } else if (a.attribute_name == "SourceFile") {
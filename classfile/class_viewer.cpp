@@ -236,6 +236,33 @@ void ClassFileViewer::print_constant_entry(u2 index) {
     break;
   }
 
+  case ConstantTag::CONSTANT_MethodHandle: {
+    const auto &v = info.method_handle_info;
+    std::cout << "MethodHandle	reference_kind = "
+              << static_cast<int>(v.reference_kind) << " "
+              << "reference_index = " << v.reference_index;
+    break;
+  }
+
+  case ConstantTag::CONSTANT_MethodType: {
+    const auto &v = info.method_type_info;
+    std::cout << "MethodType		descriptor_index = " << v.descriptor_index
+              << " " << resolve_utf8(v.descriptor_index, cf.constant_pool);
+    break;
+  }
+
+  case ConstantTag::CONSTANT_Dynamic:
+  case ConstantTag::CONSTANT_InvokeDynamic: {
+    const auto &v = info.invoke_dynamic_info;
+    std::cout << (tag == ConstantTag::CONSTANT_Dynamic ? "Dynamic		"
+                                                       : "InvokeDynamic	")
+              << "bootstrap_method_attr_index = "
+              << v.bootstrap_method_attr_index << " "
+              << "name_and_type_index = " << v.name_and_type_index << " "
+              << resolve_name_and_type(v.name_and_type_index, cf.constant_pool);
+    break;
+  }
+
   case ConstantTag::None:
     std::cout << "(empty)";
     break;
@@ -1740,6 +1767,17 @@ void ClassFileViewer::print_attributes(
                   << inner_class.inner_class_access_flags << std::dec
                   << std::endl;
       }
+    } else if (attribute.attribute_name == "BootstrapMethods") {
+      const auto &bm_info = attribute.bootstrapmethods_info;
+      std::cout << "\t\tBootstrapMethods count: "
+                << bm_info.num_bootstrap_methods << std::endl;
+      for (u2 j = 0; j < bm_info.num_bootstrap_methods; j++) {
+        const auto &bm = bm_info.bootstrap_methods[j];
+        std::cout << "\t\t  BootstrapMethod #" << j << ": MethodHandle #"
+                  << bm.bootstrap_method_ref << std::endl;
+        for (u2 arg : bm.bootstrap_arguments)
+          std::cout << "\t\t    argument: #" << arg << std::endl;
+      }
     } else if (attribute.attribute_name == "LineNumberTable") {
       const auto &ln_info = attribute.linenumbertable_info;
 
@@ -29,6 +29,7 @@ enum class ConstantTag : u1 {
   CONSTANT_Utf8 = 1,
   CONSTANT_MethodHandle = 15,
   CONSTANT_MethodType = 16,
+  CONSTANT_Dynamic = 17,
   CONSTANT_InvokeDynamic = 18,
   None = 0,
 };
@@ -86,6 +87,34 @@ struct ConstantDoubleInfo {
   u4 low_bytes;
 };
 
+// reference_kind de CONSTANT_MethodHandle (JVMS §5.4.3.5)
+enum MethodHandleKind : u1 {
+  REF_getField = 1,
+  REF_getStatic = 2,
+  REF_putField = 3,
+  REF_putStatic = 4,
+  REF_invokeVirtual = 5,
+  REF_invokeStatic = 6,
+  REF_invokeSpecial = 7,
+  REF_newInvokeSpecial = 8,
+  REF_invokeInterface = 9,
+};
+
+struct ConstantMethodHandleInfo {
+  u1 reference_kind;
+  u2 reference_index; // Fieldref, Methodref ou InterfaceMethodref
+};
+
+struct ConstantMethodTypeInfo {
+  u2 descriptor_index;
+};
+
+// CONSTANT_InvokeDynamic e CONSTANT_Dynamic
+struct ConstantInvokeDynamicInfo {
+  u2 bootstrap_method_attr_index; // índice no atributo BootstrapMethods
+  u2 name_and_type_index;
+};
+
 struct EmptyInfo // Índice 0 do pool de constantes
 {};
 
@@ -102,6 +131,9 @@ union ConstantInfo {
   ConstantDoubleInfo double_info;
   ConstantNameAndTypeInfo name_and_type_info;
   ConstantUTF8Info utf8_info;
+  ConstantMethodHandleInfo method_handle_info;
+  ConstantMethodTypeInfo method_type_info;
+  ConstantInvokeDynamicInfo invoke_dynamic_info;
 };
 
 using ConstantPoolEntry = std::pair<ConstantTag, ConstantInfo>;
@@ -241,6 +273,16 @@ struct LocalVariableTableEntry {
   u2 index;
 };
 
+struct BootstrapMethod {
+  u2 bootstrap_method_ref; // CONSTANT_MethodHandle
+  std::vector<u2> bootstrap_arguments;
+};
+
+struct BootstrapMethodsAttribute {
+  u2 num_bootstrap_methods = 0;
+  std::vector<BootstrapMethod> bootstrap_methods;
+};
+
 struct LocalVariableTableInfo {
   u2 local_variable_table_length;
   std::vector<LocalVariableTableEntry> local_variable_table;
@@ -261,6 +303,7 @@ struct AttributeInfo {
   UnknownAttribute unknown_info;
   ExceptionsAttribute exceptions_info;
   InnerClassesAttribute innerclasses_info;
+  BootstrapMethodsAttribute bootstrapmethods_info;
 };
 
 struct FieldInfo {
@@ -306,6 +349,18 @@ struct MethodInfo {
 };
 
 // ClassFile
+
+enum ClassAccessFlag : u2 {
+  ACC_Public_Class = 0x0001,
+  ACC_Final_Class = 0x0010,
+  ACC_Super_Class = 0x0020,
+  ACC_Interface_Class = 0x0200,
+  ACC_Abstract_Class = 0x0400,
+  ACC_Synthetic_Class = 0x1000,
+  ACC_Annotation_Class = 0x2000,
+  ACC_Enum_Class = 0x4000,
+};
+
 struct ClassFile {
   u4 magic;
   u2 minor_version;
@@ -340,6 +395,11 @@ struct ClassFile {
     case ConstantTag::CONSTANT_InterfaceMethodref:
       return resolve_utf8(
           entry.second.interface_methodref_info.name_and_type_index);
+    case ConstantTag::CONSTANT_InvokeDynamic:
+    case ConstantTag::CONSTANT_Dynamic:
+      return resolve_utf8(entry.second.invoke_dynamic_info.name_and_type_index);
+    case ConstantTag::CONSTANT_MethodType:
+      return resolve_utf8(entry.second.method_type_info.descriptor_index);
     case ConstantTag::CONSTANT_NameAndType:
       return resolve_utf8(entry.second.name_and_type_info.descriptor_index) +
              " " + resolve_utf8(entry.second.name_and_type_info.name_index);
@@ -353,4 +413,12 @@ struct ClassFile {
 
     return "";
   }
+
+  // Atributo BootstrapMethods da classe, ou nullptr se não houver
+  const BootstrapMethodsAttribute *bootstrap_methods() const {
+    for (const auto &attr : attributes)
+      if (attr.attribute_name == "BootstrapMethods")
+        return &attr.bootstrapmethods_info;
+    return nullptr;
+  }
 };
@@ -1,10 +1,13 @@
 #include "./classfile/class_parser.h"
 #include "./classfile/class_viewer.h"
 #include "./classfile/classfile_types.h"
+#include "./runtime/gc.h"
 #include "./runtime/runtime_class_types.h"
+#include "./runtime/tiering.h"
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 
 void printHelp(const std::string &progName) {
@@ -14,22 +17,101 @@ void printHelp(const std::string &progName) {
             << "  -f, --filepath <path>   Path to the .class file\n"
             << "  -i, --interactive       Execute the JVM (run main) instead "
                "of just showing\n"
+            << "  --quicken-threshold <n> Calls + loop iterations before "
+               "resolving a method's\n"
+            << "                          constant pool references (default "
+            << DEFAULT_QUICKEN_THRESHOLD << ")\n"
+            << "  --profile-threshold <n> Calls + loop iterations before "
+               "collecting type\n"
+            << "                          profiles (default "
+            << DEFAULT_PROFILE_THRESHOLD << ")\n"
+            << "  --compile-threshold <n> Calls before JIT compilation "
+               "(default "
+            << DEFAULT_COMPILE_THRESHOLD << ")\n"
+            << "  --backedge-threshold <n>\n"
+            << "                          Iterations of a single loop before "
+               "JIT compilation\n"
+            << "                          (default "
+            << DEFAULT_BACKEDGE_THRESHOLD << ")\n"
+            << "  --optimize-threshold <n>\n"
+            << "                          Calls before recompiling with the "
+               "optimizing JIT\n"
+            << "                          (default "
+            << DEFAULT_OPTIMIZE_THRESHOLD << "); 0 disables a threshold\n"
+            << "  --gc-workers <n>        Parallel marking threads of the "
+               "collector (default:\n"
+            << "                          one per core)\n"
+            << "  --concurrent-gc         Collect the old generation in "
+               "concurrent SATB cycles\n"
+            << "  --print-call-sites      Print the inline cache state of "
+               "every call site\n"
+            << "                          after execution\n"
             << "  -h, --help              Show this help message\n\n"
             << "Examples:\n"
             << "  " << progName << " -f Test.class\n"
             << "  " << progName << " -f Test.class -i\n";
 }
 
+// "--name <n>" ou "--name=<n>"; false se `arg` não é a opção `name`
+static bool parse_number(const std::string &name, const std::string &arg,
+                         int argc, char *argv[], int &i, u4 &value) {
+  std::string text;
+  if (arg == name) {
+    if (i + 1 >= argc)
+      throw std::runtime_error("Missing value for " + name);
+    text = argv[++i];
+  } else if (arg.rfind(name + "=", 0) == 0) {
+    text = arg.substr(name.size() + 1);
+  } else {
+    return false;
+  }
+
+  size_t end = 0;
+  unsigned long parsed = 0;
+  try {
+    parsed = std::stoul(text, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  if (text.empty() || end != text.size() || text[0] == '-' ||
+      parsed > 0xFFFFFFFFul)
+    throw std::runtime_error("Invalid value for " + name + ": " + text);
+  value = static_cast<u4>(parsed);
+  return true;
+}
+
 int main(int argc, char *argv[]) {
 
   bool execMode = false; // changed: "interactive" → "execution mode"
   std::string filepath = "";
   std::string progName = argv[0];
+  TieringThresholds thresholds;
+  u4 gcWorkers = 0;
+  bool concurrentGc = false;
+  bool printCallSites = false;
 
   // Parse CLI args
   for (int i = 1; i < argc; i++) {
     std::string arg(argv[i]);
 
+    try {
+      if (parse_number("--quicken-threshold", arg, argc, argv, i,
+                       thresholds.quicken) ||
+          parse_number("--profile-threshold", arg, argc, argv, i,
+                       thresholds.profile) ||
+          parse_number("--compile-threshold", arg, argc, argv, i,
+                       thresholds.compile) ||
+          parse_number("--backedge-threshold", arg, argc, argv, i,
+                       thresholds.backedge) ||
+          parse_number("--optimize-threshold", arg, argc, argv, i,
+                       thresholds.optimize) ||
+          parse_number("--gc-workers", arg, argc, argv, i, gcWorkers))
+        continue;
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << "\n";
+      return 1;
+    }
+
     if (arg == "--help" || arg == "-h") {
       printHelp(progName);
       return 0;
@@ -37,6 +119,12 @@ int main(int argc, char *argv[]) {
     } else if (arg == "--interactive" || arg == "-i") {
       execMode = true;
 
+    } else if (arg == "--concurrent-gc") {
+      concurrentGc = true;
+
+    } else if (arg == "--print-call-sites") {
+      printCallSites = true;
+
     } else if (arg == "--filepath" || arg == "-f") {
       if (i + 1 < argc) {
         filepath = argv[++i];
@@ -60,10 +148,14 @@ int main(int argc, char *argv[]) {
       ClassFileViewer viewer(cf);
       viewer.show_class_file();
     } else {
-      Runtime rt;
+      Runtime rt(gcWorkers);
+      rt.tiering->set_thresholds(thresholds);
+      rt.gc->set_concurrent(concurrentGc);
       rt.start(filepath);
 
       std::cout << "Execution finished.\n";
+      if (printCallSites)
+        rt.method_area->printCallSiteProfile(std::cout);
     }
 
   } catch (const std::exception &e) {
@@ -0,0 +1,328 @@
+#include "./array_ops.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Kernels. Cada um processa blocos de 32 bytes (AVX2), depois de 16 (SSE2),
+// e termina o resto de forma escalar; sem SIMD só a parte escalar roda.
+
+// Cópia com semântica de memmove
+void copy_bytes(u1 *dst, const u1 *src, size_t n) {
+  if (dst == src || n == 0)
+    return;
+
+  if (dst < src || dst >= src + n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32)
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(dst + i),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)));
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(dst + i),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+#endif
+    for (; i + 8 <= n; i += 8) {
+      u8 word;
+      std::memcpy(&word, src + i, 8);
+      std::memcpy(dst + i, &word, 8);
+    }
+    for (; i < n; i++)
+      dst[i] = src[i];
+    return;
+  }
+
+  // Destino depois da origem, com sobreposição: de trás para frente
+  size_t i = n;
+#if defined(__AVX2__)
+  for (; i >= 32; i -= 32)
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(dst + i - 32),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - 32)));
+#endif
+#if defined(__SSE2__)
+  for (; i >= 16; i -= 16)
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + i - 16),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - 16)));
+#endif
+  for (; i >= 8; i -= 8) {
+    u8 word;
+    std::memcpy(&word, src + i - 8, 8);
+    std::memcpy(dst + i - 8, &word, 8);
+  }
+  for (; i > 0; i--)
+    dst[i - 1] = src[i - 1];
+}
+
+// Preenche `count` elementos de `element_size` bytes com o valor `bits`
+void fill_elements(u1 *dst, size_t count, u8 bits, size_t element_size) {
+  // 32 bytes com o elemento repetido: como 32 e 16 são múltiplos do tamanho
+  // do elemento, todo bloco começa numa fronteira de elemento
+  alignas(32) u1 pattern[32];
+  for (size_t i = 0; i < sizeof(pattern); i += element_size) {
+    switch (element_size) {
+    case 1: {
+      u1 v = static_cast<u1>(bits);
+      std::memcpy(pattern + i, &v, 1);
+      break;
+    }
+    case 2: {
+      u2 v = static_cast<u2>(bits);
+      std::memcpy(pattern + i, &v, 2);
+      break;
+    }
+    case 4: {
+      u4 v = static_cast<u4>(bits);
+      std::memcpy(pattern + i, &v, 4);
+      break;
+    }
+    default:
+      std::memcpy(pattern + i, &bits, 8);
+      break;
+    }
+  }
+
+  size_t n = count * element_size;
+  size_t i = 0;
+#if defined(__AVX2__)
+  __m256i wide = _mm256_load_si256(reinterpret_cast<const __m256i *>(pattern));
+  for (; i + 32 <= n; i += 32)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), wide);
+#endif
+#if defined(__SSE2__)
+  __m128i narrow = _mm_load_si128(reinterpret_cast<const __m128i *>(pattern));
+  for (; i + 16 <= n; i += 16)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), narrow);
+#endif
+  for (; i < n; i += element_size)
+    std::memcpy(dst + i, pattern, element_size);
+}
+
+// Offset do primeiro byte diferente, ou `n` se os blocos são iguais
+size_t mismatch(const u1 *a, const u1 *b, size_t n) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m256i eq = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+    unsigned differ = ~static_cast<unsigned>(_mm256_movemask_epi8(eq));
+    if (differ)
+      return i + static_cast<size_t>(__builtin_ctz(differ));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i eq = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    unsigned differ = ~static_cast<unsigned>(_mm_movemask_epi8(eq)) & 0xFFFF;
+    if (differ)
+      return i + static_cast<size_t>(__builtin_ctz(differ));
+  }
+#endif
+  for (; i < n; i++)
+    if (a[i] != b[i])
+      return i;
+  return n;
+}
+
+// Barreiras para escritas em bloco num array de referências: a pré-barreira
+// SATB para cada elemento sobrescrito e os cards de toda a faixa escrita
+void pre_barrier(RuntimeObject *array, u4 from, u4 count) {
+  if (!SatbQueue::active.load(std::memory_order_relaxed))
+    return;
+  for (u4 i = 0; i < count; i++)
+    SatbQueue::enqueue(array->array_load_ref(from + i));
+}
+
+void post_barrier(const u1 *start, size_t bytes) {
+  if (bytes == 0)
+    return;
+  for (const u1 *p = start; p < start + bytes; p += CARD_SIZE)
+    write_barrier(p);
+  write_barrier(start + bytes - 1);
+}
+
+void check_range(const RuntimeObject *array, int32_t from, int32_t to) {
+  if (from > to)
+    throw std::runtime_error("IllegalArgumentException: fromIndex(" +
+                             std::to_string(from) + ") > toIndex(" +
+                             std::to_string(to) + ")");
+  if (from < 0)
+    throw std::runtime_error("ArrayIndexOutOfBoundsException: Array index "
+                             "out of range: " +
+                             std::to_string(from));
+  if (static_cast<u4>(to) > array->array_length())
+    throw std::runtime_error("ArrayIndexOutOfBoundsException: Array index "
+                             "out of range: " +
+                             std::to_string(to));
+}
+
+} // namespace
+
+void array_copy(RuntimeObject *src, int32_t src_pos, RuntimeObject *dst,
+                int32_t dst_pos, int32_t length) {
+  if (!src || !dst)
+    throw std::runtime_error("NullPointerException: arraycopy");
+
+  RuntimeClass *src_class = src->klass;
+  RuntimeClass *dst_class = dst->klass;
+  if (!src_class->is_array() || !dst_class->is_array())
+    throw std::runtime_error("ArrayStoreException: arraycopy: " +
+                             (src_class->is_array() ? dst_class->name
+                                                    : src_class->name) +
+                             " is not an array");
+  bool refs = src_class->is_reference_array();
+  if (refs != dst_class->is_reference_array() ||
+      (!refs && src_class != dst_class))
+    throw std::runtime_error("ArrayStoreException: arraycopy: type mismatch: "
+                             "can not copy " +
+                             src_class->name + " into " + dst_class->name);
+
+  if (length < 0 || src_pos < 0 || dst_pos < 0 ||
+      static_cast<u8>(src_pos) + length > src->array_length() ||
+      static_cast<u8>(dst_pos) + length > dst->array_length())
+    throw std::runtime_error(
+        "ArrayIndexOutOfBoundsException: arraycopy: " + std::to_string(length) +
+        " elements from " + std::to_string(src_pos) + " to " +
+        std::to_string(dst_pos) + " out of bounds");
+  if (length == 0)
+    return;
+
+  size_t element_size = src_class->element_size;
+  size_t bytes = static_cast<size_t>(length) * element_size;
+  u1 *to = dst->array_data() + static_cast<size_t>(dst_pos) * element_size;
+  const u1 *from =
+      src->array_data() + static_cast<size_t>(src_pos) * element_size;
+
+  if (!refs) {
+    copy_bytes(to, from, bytes);
+    return;
+  }
+
+  u4 first = static_cast<u4>(dst_pos);
+  u4 count = static_cast<u4>(length);
+  if (src_class->component->is_assignable_to(dst_class->component)) {
+    pre_barrier(dst, first, count);
+    copy_bytes(to, from, bytes);
+    post_barrier(to, bytes);
+    return;
+  }
+
+  // Tipos diferentes: src != dst, então não há sobreposição
+  for (u4 i = 0; i < count; i++) {
+    RuntimeObject *value = src->array_load_ref(static_cast<u4>(src_pos) + i);
+    if (value && !value->klass->is_assignable_to(dst_class->component))
+      throw std::runtime_error("ArrayStoreException: arraycopy: element "
+                               "type mismatch: " +
+                               value->klass->name + " into " +
+                               dst_class->name);
+    dst->array_store_ref(first + i, value);
+  }
+}
+
+void array_fill(RuntimeObject *array, int32_t from, int32_t to, u8 bits) {
+  if (!array)
+    throw std::runtime_error("NullPointerException: fill");
+  if (!array->klass->is_array() || array->klass->is_reference_array())
+    throw std::runtime_error("array_fill: " + array->klass->name +
+                             " is not a primitive array");
+  check_range(array, from, to);
+
+  size_t element_size = array->klass->element_size;
+  fill_elements(array->array_data() + static_cast<size_t>(from) * element_size,
+                static_cast<size_t>(to - from), bits, element_size);
+}
+
+void array_fill_ref(RuntimeObject *array, int32_t from, int32_t to,
+                    RuntimeObject *value) {
+  if (!array)
+    throw std::runtime_error("NullPointerException: fill");
+  if (!array->klass->is_reference_array())
+    throw std::runtime_error("array_fill_ref: " + array->klass->name +
+                             " is not a reference array");
+  check_range(array, from, to);
+  array->check_store(value);
+
+  u4 first = static_cast<u4>(from);
+  u4 count = static_cast<u4>(to - from);
+  u1 *start = array->array_data() + first * sizeof(NarrowRef);
+  pre_barrier(array, first, count);
+  fill_elements(start, count, encode_ref(value), sizeof(NarrowRef));
+  post_barrier(start, count * sizeof(NarrowRef));
+}
+
+bool array_equals(const RuntimeObject *a, const RuntimeObject *b) {
+  if (a == b)
+    return true;
+  if (!a || !b || a->klass != b->klass)
+    return false;
+
+  RuntimeClass *klass = a->klass;
+  if (!klass->is_array() || klass->is_reference_array())
+    throw std::runtime_error("array_equals: " + klass->name +
+                             " is not a primitive array");
+
+  u4 length = a->array_length();
+  if (length != b->array_length())
+    return false;
+
+  size_t element_size = klass->element_size;
+  size_t n = static_cast<size_t>(length) * element_size;
+  const u1 *x = a->array_data();
+  const u1 *y = b->array_data();
+
+  // Bits diferentes só são iguais no caso de dois NaN de float/double
+  for (size_t offset = mismatch(x, y, n); offset < n;) {
+    u4 index = static_cast<u4>(offset / element_size);
+    bool both_nan =
+        (klass->element_type == 'F' &&
+         std::isnan(a->array_get<float>(index)) &&
+         std::isnan(b->array_get<float>(index))) ||
+        (klass->element_type == 'D' &&
+         std::isnan(a->array_get<double>(index)) &&
+         std::isnan(b->array_get<double>(index)));
+    if (!both_nan)
+      return false;
+
+    size_t next = (static_cast<size_t>(index) + 1) * element_size;
+    offset = next + mismatch(x + next, y + next, n - next);
+  }
+  return true;
+}
+
+RuntimeObject *array_clone(Thread *thread, RuntimeObject *array) {
+  if (!array->klass->is_array())
+    throw std::runtime_error("array_clone: " + array->klass->name +
+                             " is not an array");
+
+  // A alocação pode mover o array original
+  Handle source(thread, array);
+  u4 length = array->array_length();
+  RuntimeObject *copy = RuntimeObject::allocate_array(
+      thread, array->klass, static_cast<int32_t>(length));
+  array = source.get();
+
+  size_t bytes = static_cast<size_t>(length) * array->klass->element_size;
+  copy_bytes(copy->array_data(), array->array_data(), bytes);
+  // Um array grande nasce na geração velha: seus elementos podem apontar
+  // para a jovem
+  if (array->klass->is_reference_array())
+    post_barrier(copy->array_data(), bytes);
+  return copy;
+}
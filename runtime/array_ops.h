@@ -0,0 +1,33 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+// Operações em bloco sobre arrays: System.arraycopy, Arrays.fill,
+// Arrays.equals e clone. Os elementos são contíguos, então tudo vira cópia,
+// preenchimento ou comparação de bytes, feitos por kernels SIMD (AVX2 ou
+// SSE2, conforme o alvo da compilação) com alternativa escalar.
+//
+// Erros seguem a semântica da JDK e saem como std::runtime_error com o nome
+// da exceção Java na mensagem.
+
+// System.arraycopy. Regiões sobrepostas no mesmo array são copiadas como se
+// passassem por um buffer temporário. Entre arrays de referência de tipos
+// diferentes cada elemento é checado; no primeiro que não cabe, o que já foi
+// copiado fica e ArrayStoreException é lançada.
+void array_copy(RuntimeObject *src, int32_t src_pos, RuntimeObject *dst,
+                int32_t dst_pos, int32_t length);
+
+// Arrays.fill(array, from, to, value) de arrays primitivos. `bits` são os
+// bytes do valor no tamanho do elemento (um float passa pelos bits dele).
+void array_fill(RuntimeObject *array, int32_t from, int32_t to, u8 bits);
+void array_fill_ref(RuntimeObject *array, int32_t from, int32_t to,
+                    RuntimeObject *value);
+
+// Arrays.equals de arrays primitivos: mesma classe, mesmo comprimento e
+// elementos iguais. float e double comparam como floatToIntBits e
+// doubleToLongBits (NaN == NaN). Arrays de referência dependem de equals()
+// de cada elemento e ficam com o interpretador.
+bool array_equals(const RuntimeObject *a, const RuntimeObject *b);
+
+// clone() de array: cópia rasa, mesma classe e comprimento
+RuntimeObject *array_clone(Thread *thread, RuntimeObject *array);
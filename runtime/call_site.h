@@ -0,0 +1,15 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+// Alvo ligado de um sítio invokedynamic. O bootstrap roda uma única vez por
+// instrução, na primeira execução (Runtime::resolve_call_site); o resultado
+// fica em RuntimeMethod::call_sites e as execuções seguintes chamam
+// invoke() direto.
+struct CallSite {
+  virtual ~CallSite() {}
+
+  // Tira os argumentos do sítio de `stack` e empilha o resultado, como um
+  // invokestatic com o descritor do sítio
+  virtual void invoke(Thread *thread, OperandStack &stack) const = 0;
+};
@@ -1,4 +1,9 @@
 #include "../classfile/class_parser.h"
+#include "./gc.h"
+#include "./java_string.h"
+#include "./jit.h"
+#include "./tiering.h"
+#include "./native.h"
 #include "./runtime_class_types.h"
 
 #include <iostream>
@@ -7,34 +12,404 @@
 #include <unordered_map>
 #include <vector>
 
-u4 RuntimeClass::data_size() {
-  u4 bytes = 0;
-  for (auto field : fields)
-    bytes += field.second.size_in_bytes();
+u4 RuntimeClass::data_size() { return instance_size; }
 
-  return bytes;
+MethodSignature MethodSignature::parse(const std::string &descriptor) {
+  MethodSignature sig;
+  size_t i = 1; // pula '('
+  while (i < descriptor.size() && descriptor[i] != ')') {
+    char c = descriptor[i];
+    if (c == '[' || c == 'L') {
+      while (i < descriptor.size() && descriptor[i] == '[')
+        i++;
+      if (i < descriptor.size() && descriptor[i] == 'L')
+        i = descriptor.find(';', i);
+      if (i == std::string::npos)
+        break;
+      c = 'L';
+    } else if (c == 'Z' || c == 'B' || c == 'C' || c == 'S') {
+      c = 'I';
+    }
+    sig.args.push_back(c);
+    bool wide = c == 'J' || c == 'D';
+    sig.arg_locals += wide ? 2 : 1;
+    sig.arg_stack_slots += wide ? CATEGORY2_STACK_SLOTS : 1;
+    i++;
+  }
+  if (i + 1 >= descriptor.size() || descriptor[0] != '(')
+    throw std::runtime_error("ClassFormatError: malformed method descriptor " +
+                             descriptor);
+
+  char ret = descriptor[i + 1];
+  sig.ret = ret == '[' ? 'L'
+            : (ret == 'Z' || ret == 'B' || ret == 'C' || ret == 'S') ? 'I'
+                                                                     : ret;
+  return sig;
 }
 
 RuntimeMethod *RuntimeClass::find_method(const std::string &name,
                                          const std::string &descriptor) {
-  for (auto &method : methods) {
-    if (method.second.name == name && method.second.descriptor == descriptor)
-      return &method.second;
-  }
-  return nullptr;
+  // Nome ou descritor nunca internado: nenhuma classe declara esse membro
+  Symbol name_sym = SymbolTable::lookup(name);
+  Symbol desc_sym = SymbolTable::lookup(descriptor);
+  if (!name_sym || !desc_sym)
+    return nullptr;
+  return find_method(MemberKey(name_sym, desc_sym));
 }
 
 RuntimeField *RuntimeClass::find_field(const std::string &name,
                                        const std::string &descriptor) {
-  for (auto &field : fields) {
-    if (field.second.name == name && field.second.descriptor == descriptor)
-      return &field.second;
+  Symbol name_sym = SymbolTable::lookup(name);
+  Symbol desc_sym = SymbolTable::lookup(descriptor);
+  if (!name_sym || !desc_sym)
+    return nullptr;
+  return find_field(MemberKey(name_sym, desc_sym));
+}
+
+RuntimeMethod *RuntimeClass::find_declared_method(const MemberKey &key) {
+  auto it = methods.find(key);
+  return it == methods.end() ? nullptr : &it->second;
+}
+
+RuntimeField *RuntimeClass::find_declared_field(const MemberKey &key) {
+  auto it = fields.find(key);
+  return it == fields.end() ? nullptr : &it->second;
+}
+
+// Resolução de método (JVMS §5.4.3.3): a própria classe e a cadeia de
+// superclasses; se nenhuma declara `key`, o método maximamente específico
+// das superinterfaces
+RuntimeMethod *RuntimeClass::find_method(const MemberKey &key) {
+  RuntimeMethod *found = find_class_method(key);
+  if (found)
+    return found;
+
+  auto cached = interface_method_cache.find(key);
+  if (cached != interface_method_cache.end())
+    return cached->second;
+
+  // O único default, se houver; senão qualquer um dos candidatos
+  std::vector<RuntimeMethod *> candidates = maximally_specific(key);
+  size_t defaults = 0;
+  for (RuntimeMethod *m : candidates)
+    if (!m->is_abstract()) {
+      found = m;
+      defaults++;
+    }
+  if (defaults != 1)
+    found = candidates.empty() ? nullptr : candidates[0];
+
+  interface_method_cache.emplace(key, found);
+  return found;
+}
+
+RuntimeMethod *RuntimeClass::find_class_method(const MemberKey &key) {
+  auto cached = method_cache.find(key);
+  if (cached != method_cache.end())
+    return cached->second;
+
+  RuntimeMethod *found = find_declared_method(key);
+  if (!found && super_class)
+    found = super_class->find_class_method(key);
+
+  method_cache.emplace(key, found);
+  return found;
+}
+
+// Resolução de field (JVMS §5.4.3.2): a própria classe, superinterfaces e
+// depois a superclasse
+RuntimeField *RuntimeClass::find_field(const MemberKey &key) {
+  auto cached = field_cache.find(key);
+  if (cached != field_cache.end())
+    return cached->second;
+
+  RuntimeField *found = find_declared_field(key);
+  for (size_t i = 0; !found && i < interfaces.size(); i++)
+    found = interfaces[i]->find_field(key);
+  if (!found && super_class)
+    found = super_class->find_field(key);
+
+  field_cache.emplace(key, found);
+  return found;
+}
+
+// RuntimeMethod correspondente a um MethodInfo do ClassFile
+static RuntimeMethod &declared_method(RuntimeClass &klass,
+                                      const MethodInfo &m) {
+  const ClassFile &cf = *klass.class_file;
+  return klass.methods.at(MemberKey::of(cf.resolve_utf8(m.name_index),
+                                        cf.resolve_utf8(m.descriptor_index)));
+}
+
+static void collect_interfaces(RuntimeClass *iface,
+                               std::vector<RuntimeClass *> &out) {
+  for (auto seen : out)
+    if (seen == iface)
+      return;
+  out.push_back(iface);
+  for (auto super_iface : iface->interfaces)
+    collect_interfaces(super_iface, out);
+}
+
+// Superinterfaces diretas e indiretas da classe e das superclasses
+static std::vector<RuntimeClass *> superinterfaces(const RuntimeClass *klass) {
+  std::vector<RuntimeClass *> all;
+  for (; klass; klass = klass->super_class)
+    for (RuntimeClass *iface : klass->interfaces)
+      collect_interfaces(iface, all);
+  return all;
+}
+
+void RuntimeClass::build_vtable() {
+  // Interfaces não têm vtable: cada método abstrato/default recebe um índice
+  // de itable, na ordem de declaração
+  if (is_interface()) {
+    int32_t next = 0;
+    for (const auto &m : class_file->methods) {
+      RuntimeMethod &rm = declared_method(*this, m);
+      if (rm.is_virtual())
+        rm.itable_index = next++;
+    }
+    return;
+  }
+
+  if (super_class)
+    vtable = super_class->vtable;
+
+  // Um nome e descritor pode ter mais de um slot: quem não sobrescreve um
+  // método de pacote de outro pacote ganha um slot novo
+  std::unordered_map<MemberKey, std::vector<int32_t>, MemberKeyHash> slots;
+  for (size_t i = 0; i < vtable.size(); i++)
+    slots[vtable[i]->key].push_back(static_cast<int32_t>(i));
+
+  for (const auto &m : class_file->methods) {
+    RuntimeMethod &rm = declared_method(*this, m);
+    if (!rm.is_virtual())
+      continue;
+
+    auto it = slots.find(rm.key);
+    if (it != slots.end())
+      for (int32_t slot : it->second) {
+        if (!overrides_slot(slot))
+          continue;
+        RuntimeMethod *inherited = vtable[slot];
+        if (inherited->access_flags & ACC_Final_Method)
+          throw std::runtime_error("VerifyError: class " + name +
+                                   " overrides final method " +
+                                   inherited->owner->name + "." +
+                                   inherited->name + inherited->descriptor);
+        if (rm.vtable_index < 0)
+          rm.vtable_index = slot;
+        vtable[slot] = &rm;
+      }
+    if (rm.vtable_index < 0) {
+      rm.vtable_index = static_cast<int32_t>(vtable.size());
+      slots[rm.key].push_back(rm.vtable_index);
+      vtable.push_back(&rm);
+    }
+  }
+
+  // Métodos de interface sem implementação na cadeia de classes também têm
+  // slot, com o método escolhido nas superinterfaces: invokevirtual e
+  // invokeinterface chegam ao mesmo alvo. Um slot herdado assim é refeito,
+  // porque esta classe pode trazer uma subinterface mais específica.
+  for (RuntimeClass *iface : superinterfaces(this))
+    for (auto &pair : iface->methods) {
+      if (pair.second.itable_index < 0)
+        continue;
+      auto it = slots.find(pair.first);
+      if (it == slots.end()) {
+        slots[pair.first].push_back(static_cast<int32_t>(vtable.size()));
+        vtable.push_back(select_interface_method(pair.first));
+        continue;
+      }
+      for (int32_t slot : it->second)
+        if (vtable[slot]->owner->is_interface() ||
+            vtable[slot]->conflicting_defaults)
+          vtable[slot] = select_interface_method(pair.first);
+    }
+}
+
+// Sobrescrita (JVMS §5.4.5): o método herdado é público ou protegido, ou é
+// de pacote e do mesmo pacote de tempo de execução. Com um só carregador,
+// o pacote é o nome da classe até a última '/'.
+static std::string package_of(const std::string &class_name) {
+  size_t slash = class_name.rfind('/');
+  return slash == std::string::npos ? "" : class_name.substr(0, slash);
+}
+
+bool RuntimeClass::overrides_slot(int32_t slot) const {
+  // Basta sobrescrever um dos métodos que ocuparam o slot nas superclasses:
+  // cada um deles sobrescreve os anteriores
+  for (const RuntimeClass *k = super_class;
+       k && static_cast<size_t>(slot) < k->vtable.size(); k = k->super_class) {
+    const RuntimeMethod *inherited = k->vtable[slot];
+    if ((inherited->access_flags &
+         (ACC_Public_Method | ACC_Protected_Method)) ||
+        package_of(inherited->owner->name) == package_of(name))
+      return true;
+  }
+  return false;
+}
+
+static bool implements(const RuntimeClass *klass, const RuntimeClass *iface) {
+  for (; klass; klass = klass->super_class)
+    for (const RuntimeClass *direct : klass->interfaces)
+      if (direct == iface || implements(direct, iface))
+        return true;
+  return false;
+}
+
+bool RuntimeClass::is_assignable_to(const RuntimeClass *target) const {
+  if (this == target)
+    return true;
+
+  if (is_array()) {
+    if (target->is_array())
+      return is_reference_array() && target->is_reference_array() &&
+             component->is_assignable_to(target->component);
+    return target->name == "java/lang/Object" ||
+           target->name == "java/lang/Cloneable" ||
+           target->name == "java/io/Serializable";
   }
+  if (target->is_array())
+    return false;
+
+  if (target->is_interface())
+    return implements(this, target);
+  for (const RuntimeClass *k = super_class; k; k = k->super_class)
+    if (k == target)
+      return true;
+  return false;
+}
+
+std::vector<RuntimeMethod *>
+RuntimeClass::maximally_specific(const MemberKey &key) {
+  std::vector<RuntimeMethod *> candidates;
+  for (RuntimeClass *iface : superinterfaces(this)) {
+    RuntimeMethod *m = iface->find_declared_method(key);
+    if (m && !m->is_private() && !m->is_static())
+      candidates.push_back(m);
+  }
+
+  std::vector<RuntimeMethod *> result;
+  for (RuntimeMethod *m : candidates) {
+    bool shadowed = false;
+    for (RuntimeMethod *other : candidates)
+      shadowed = shadowed ||
+                 (other != m && other->owner->is_assignable_to(m->owner));
+    if (!shadowed)
+      result.push_back(m);
+  }
+  return result;
+}
+
+RuntimeMethod *RuntimeClass::select_interface_method(const MemberKey &key) {
+  std::vector<RuntimeMethod *> found = maximally_specific(key);
+  RuntimeMethod *selected = nullptr;
+  size_t defaults = 0;
+  for (RuntimeMethod *m : found)
+    if (!m->is_abstract()) {
+      selected = m;
+      defaults++;
+    }
+  if (defaults == 1)
+    return selected;
+  if (defaults == 0)
+    return found.empty() ? nullptr : found[0];
+
+  for (const auto &conflict : default_conflicts)
+    if (conflict->key == key)
+      return conflict.get();
+  std::unique_ptr<RuntimeMethod> conflict(new RuntimeMethod());
+  conflict->name = found[0]->name;
+  conflict->descriptor = found[0]->descriptor;
+  conflict->key = key;
+  conflict->access_flags = ACC_Public_Method | ACC_Abstract_Method;
+  conflict->owner = this;
+  conflict->conflicting_defaults = true;
+  default_conflicts.push_back(std::move(conflict));
+  return default_conflicts.back().get();
+}
+
+void RuntimeClass::build_itables() {
+  if (is_interface())
+    return;
+
+  std::vector<RuntimeClass *> all;
+  if (super_class)
+    for (const auto &entry : super_class->itables)
+      all.push_back(entry.interface);
+  for (auto iface : interfaces)
+    collect_interfaces(iface, all);
+
+  std::unordered_map<MemberKey, RuntimeMethod *, MemberKeyHash> impls;
+  for (auto m : vtable)
+    impls[m->key] = m;
+
+  itables.clear();
+  for (auto iface : all) {
+    ItableEntry entry;
+    entry.interface = iface;
+
+    for (auto &pair : iface->methods) {
+      RuntimeMethod &im = pair.second;
+      if (im.itable_index < 0)
+        continue;
+      if (entry.methods.size() <= static_cast<size_t>(im.itable_index))
+        entry.methods.resize(im.itable_index + 1, nullptr);
+
+      // O mesmo alvo da vtable. Classes montadas pelo runtime (lambdas) não
+      // têm slot para os defaults da interface: vale a mesma seleção.
+      auto it = impls.find(pair.first);
+      entry.methods[im.itable_index] = it != impls.end()
+                                           ? it->second
+                                           : select_interface_method(im.key);
+    }
+
+    itables.push_back(std::move(entry));
+  }
+}
+
+const ItableEntry *RuntimeClass::find_itable(const RuntimeClass *iface) const {
+  for (const auto &entry : itables)
+    if (entry.interface == iface)
+      return &entry;
   return nullptr;
 }
 
-std::unique_ptr<RuntimeClass>
-BootstrapClassLoader::load_class(const std::string &name) {
+RuntimeMethod *RuntimeClass::dispatch_virtual(RuntimeMethod *resolved) const {
+  // invokevirtual pode resolver para um método default de interface
+  if (resolved->owner && resolved->owner->is_interface())
+    return dispatch_interface(resolved);
+
+  if (resolved->vtable_index < 0)
+    return resolved;
+
+  if (static_cast<size_t>(resolved->vtable_index) >= vtable.size())
+    throw std::runtime_error("IncompatibleClassChangeError: " + name + "." +
+                             resolved->name);
+
+  return vtable[resolved->vtable_index];
+}
+
+RuntimeMethod *RuntimeClass::dispatch_interface(RuntimeMethod *resolved) const {
+  // Métodos de Object chamados através de uma interface
+  if (!resolved->owner || !resolved->owner->is_interface())
+    return dispatch_virtual(resolved);
+
+  if (resolved->itable_index < 0)
+    return resolved;
+
+  const ItableEntry *entry = find_itable(resolved->owner);
+  if (!entry)
+    throw std::runtime_error("IncompatibleClassChangeError: " + name +
+                             " does not implement " + resolved->owner->name);
+
+  return entry->methods[resolved->itable_index];
+}
+
+RuntimeClass *BootstrapClassLoader::load_class(const std::string &name) {
   ClassParser parser(name);
   std::unique_ptr<ClassFile> cf(new ClassFile(parser.parse()));
 
@@ -43,42 +418,91 @@ BootstrapClassLoader::load_class(const std::string &name) {
 
   runtime->method_area->storeClass(std::move(klass));
 
-  if (klass_ptr->find_method("<clinit>", "()V")) {
-    runtime->thread->call_stack.push_back(
-        new Frame(klass_ptr->find_method("<clinit>", "()V"), klass_ptr));
-  }
+  // vtable e itables dependem da hierarquia já ligada
+  if (!klass_ptr->super_name.empty())
+    klass_ptr->super_class =
+        runtime->find_or_load_class(klass_ptr->super_name);
 
-  if (!klass_ptr->super_name.empty() &&
-      runtime->method_area->getClassRef(klass_ptr->super_name) == nullptr) {
-    klass_ptr->super_class = load_class(klass_ptr->super_name).release();
+  for (const auto &iface_name : klass_ptr->interface_names)
+    klass_ptr->interfaces.push_back(
+        runtime->find_or_load_class(iface_name));
+
+  klass_ptr->layout_fields();
+  klass_ptr->layout_static_fields();
+  klass_ptr->build_vtable();
+  klass_ptr->build_itables();
+  NativeRegistry::bind(*klass_ptr);
+  runtime->method_area->add_to_hierarchy(klass_ptr);
+
+  // Estáticos String com ConstantValue recebem o literal internado
+  for (auto &pair : klass_ptr->fields) {
+    RuntimeField &rf = pair.second;
+    if (rf.is_static && rf.constantvalue_index != 0 && rf.is_reference()) {
+      RuntimeObject *value =
+          runtime->resolve_string(klass_ptr, rf.constantvalue_index);
+      write_static_ref(klass_ptr->static_address(rf), value);
+    }
   }
 
   std::cout << "Class loaded: " << klass_ptr->name << "\n";
-  return klass;
+  return klass_ptr;
+}
+
+void Runtime::initialize_class(RuntimeClass *klass) {
+  switch (klass->init_state) {
+  case InitState::Initialized:
+  case InitState::Initializing:
+    return;
+  case InitState::Failed:
+    throw std::runtime_error("NoClassDefFoundError: Could not initialize "
+                             "class " +
+                             klass->name);
+  case InitState::Linked:
+    break;
+  }
+
+  // <clinit> não é herdado: só o declarado pela própria classe. Roda com a
+  // classe já ligada e visível na MethodArea, então pode usar os próprios
+  // estáticos.
+  static const MemberKey clinit = MemberKey::of("<clinit>", "()V");
+  klass->init_state = InitState::Initializing;
+  try {
+    if (klass->super_class && !klass->is_interface())
+      initialize_class(klass->super_class);
+    if (RuntimeMethod *init = klass->find_declared_method(clinit)) {
+      OperandStack no_args;
+      thread->interpreter->invoke(init, no_args);
+    }
+  } catch (...) {
+    klass->init_state = InitState::Failed;
+    throw;
+  }
+  klass->init_state = InitState::Initialized;
 }
 
 std::unique_ptr<RuntimeClass>
 BootstrapClassLoader::build_runtime_class(std::unique_ptr<ClassFile> cf) {
   std::string name = cf->resolve_utf8(cf->this_class);
-  std::unordered_map<std::string, RuntimeField> fields;
-  std::unordered_map<std::string, RuntimeMethod> methods;
+  std::unordered_map<MemberKey, RuntimeField, MemberKeyHash> fields;
+  std::unordered_map<MemberKey, RuntimeMethod, MemberKeyHash> methods;
 
-  u4 offset_acc = 0;
   for (const auto &f : cf->fields) {
     std::string name = cf->resolve_utf8(f.name_index);
     std::string desc = cf->resolve_utf8(f.descriptor_index);
 
-    std::string key = desc + " " + name;
+    MemberKey key = MemberKey::of(name, desc);
 
     RuntimeField rf;
 
     rf.name = name;
     rf.descriptor = desc;
+    rf.key = key;
     rf.access_flags = f.access_flags;
     rf.is_static = (f.access_flags & ACC_Static_Field) != 0;
 
-    rf.offset = offset_acc;
-    offset_acc += rf.size_in_bytes();
+    for (const auto &attr : f.attributes)
+      if (attr.attribute_name == "ConstantValue")
+        rf.constantvalue_index = attr.constantvalue_info.constantvalue_index;
 
     fields.emplace(key, rf);
   }
@@ -87,12 +511,13 @@ BootstrapClassLoader::build_runtime_class(std::unique_ptr<ClassFile> cf) {
     std::string name = cf->resolve_utf8(m.name_index);
     std::string desc = cf->resolve_utf8(m.descriptor_index);
 
-    std::string key = desc + " " + name;
+    MemberKey key = MemberKey::of(name, desc);
 
     RuntimeMethod rm;
 
     rm.name = name;
     rm.descriptor = desc;
+    rm.key = key;
     rm.access_flags = m.access_flags;
     rm.code = m.find_code_attribute();
 
@@ -104,23 +529,55 @@ BootstrapClassLoader::build_runtime_class(std::unique_ptr<ClassFile> cf) {
   if (cf->super_class != 0) {
     klass->super_name = cf->resolve_utf8(cf->super_class);
   }
+  for (u2 iface : cf->interfaces)
+    klass->interface_names.push_back(cf->resolve_utf8(iface));
   klass->access_flags = cf->access_flags;
   klass->class_file = std::move(cf);
   klass->fields = std::move(fields);
   klass->methods = std::move(methods);
   klass->super_class = nullptr;
+  klass->cp_cache.resize(klass->class_file->constant_pool.size());
+
+  for (auto &pair : klass->fields)
+    pair.second.owner = klass.get();
+
+  for (auto &pair : klass->methods) {
+    pair.second.owner = klass.get();
+    pair.second.build_loop_counters();
+  }
 
   return klass;
 }
 
-Thread::Thread(Runtime *rt) : runtime(rt) { interpreter = new Interpreter(); }
+Thread::Thread(Runtime *rt) : runtime(rt), exception(0) {
+  interpreter = new Interpreter(this);
+}
 Thread::~Thread() {
   delete interpreter;
   for (auto frame : call_stack)
     delete frame;
 };
+Runtime::Runtime(unsigned gc_workers) {
+  heap = new Heap();
+  gc = new GarbageCollector(this, gc_workers);
+  heap->set_collector(gc);
+  thread = new Thread(this);
+  method_area = new MethodArea();
+  strings = new StringTable();
+  jit = new JitCompiler(this);
+  tiering = new TieringPolicy(this);
+  class_loader = new BootstrapClassLoader({}, this);
+}
+
 Runtime::~Runtime() {
+  // O coletor pode ter uma thread de fundo lendo classes e o heap
+  heap->set_collector(nullptr);
+  delete gc;
   delete thread;
   delete method_area;
+  delete strings;
   delete class_loader;
+  delete tiering;
+  delete jit;
+  delete heap;
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "./code_cache.h"
+
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+CodeCache::CodeCache(size_t capacity)
+    : base_(nullptr), capacity_(capacity), top_(0), page_size_(4096),
+      free_bytes_(0) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  page_size_ = info.dwPageSize;
+  void *p = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT,
+                         PAGE_EXECUTE_READ);
+  base_ = static_cast<u1 *>(p);
+#else
+  long page = sysconf(_SC_PAGESIZE);
+  if (page > 0)
+    page_size_ = static_cast<size_t>(page);
+  void *p = mmap(nullptr, capacity, PROT_READ | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  base_ = p == MAP_FAILED ? nullptr : static_cast<u1 *>(p);
+#endif
+  if (!base_)
+    throw std::runtime_error("OutOfMemoryError: cannot reserve code cache");
+}
+
+CodeCache::~CodeCache() {
+#ifdef _WIN32
+  VirtualFree(base_, 0, MEM_RELEASE);
+#else
+  munmap(base_, capacity_);
+#endif
+}
+
+void CodeCache::protect(u1 *start, size_t size, bool writable) {
+  uintptr_t first = reinterpret_cast<uintptr_t>(start) & ~(page_size_ - 1);
+  uintptr_t last = reinterpret_cast<uintptr_t>(start + size);
+  size_t length = last - first;
+#ifdef _WIN32
+  DWORD old;
+  BOOL ok = VirtualProtect(reinterpret_cast<void *>(first), length,
+                           writable ? PAGE_READWRITE : PAGE_EXECUTE_READ,
+                           &old);
+  if (!ok)
+    throw std::runtime_error("code cache: VirtualProtect failed");
+#else
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  if (mprotect(reinterpret_cast<void *>(first), length, prot) != 0)
+    throw std::runtime_error("code cache: mprotect failed");
+#endif
+}
+
+static size_t block_size(size_t size) { return (size + 15) & ~size_t(15); }
+
+const u1 *CodeCache::install(const std::vector<u1> &code) {
+  size_t size = block_size(code.size());
+  if (code.empty())
+    return nullptr;
+
+  size_t start = top_;
+  auto it = free_.begin();
+  while (it != free_.end() && it->second < size)
+    ++it;
+  if (it != free_.end()) {
+    start = it->first;
+    size_t rest = it->second - size;
+    free_.erase(it);
+    if (rest)
+      free_[start + size] = rest;
+    free_bytes_ -= size;
+  } else {
+    if (top_ + size > capacity_)
+      return nullptr;
+    top_ += size;
+  }
+
+  u1 *target = base_ + start;
+  protect(target, code.size(), true);
+  std::memcpy(target, code.data(), code.size());
+  protect(target, code.size(), false);
+#ifndef _WIN32
+  __builtin___clear_cache(reinterpret_cast<char *>(target),
+                          reinterpret_cast<char *>(target + code.size()));
+#endif
+  return target;
+}
+
+void CodeCache::release(const u1 *code, size_t size) {
+  size_t start = static_cast<size_t>(code - base_);
+  size = block_size(size);
+  u1 *target = base_ + start;
+  protect(target, size, true);
+  std::memset(target, 0xCC, size);
+  protect(target, size, false);
+
+  // Junta com o bloco livre seguinte e com o anterior; o que encosta em
+  // top_ volta para o bump
+  free_bytes_ += size;
+  auto next = free_.find(start + size);
+  if (next != free_.end()) {
+    size += next->second;
+    free_.erase(next);
+  }
+  auto it = free_.lower_bound(start);
+  if (it != free_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == start) {
+      start = prev->first;
+      size += prev->second;
+      free_.erase(prev);
+    }
+  }
+  if (start + size == top_) {
+    top_ = start;
+    free_bytes_ -= size;
+  } else {
+    free_[start] = size;
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../classfile/classfile_types.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// Faixa reservada para código compilado
+static const size_t DEFAULT_CODE_CACHE_SIZE = 32u * 1024 * 1024;
+
+// Memória executável do JIT: uma faixa reservada no início, preenchida por
+// bump e reaproveitada com os blocos que os métodos descartados devolvem
+// (código otimizado que voltou para o de templates). Nenhuma página é
+// gravável e executável ao mesmo tempo (W^X): as páginas ficam só leitura e
+// execução, e as que recebem um método novo viram leitura e escrita apenas
+// durante a cópia.
+class CodeCache {
+public:
+  explicit CodeCache(size_t capacity = DEFAULT_CODE_CACHE_SIZE);
+  ~CodeCache();
+
+  CodeCache(const CodeCache &) = delete;
+  CodeCache &operator=(const CodeCache &) = delete;
+
+  // Copia `code` para o cache, alinhado a 16 bytes, no primeiro bloco livre
+  // que o comporta ou no fim; nullptr se acabou o espaço
+  const u1 *install(const std::vector<u1> &code);
+  // Devolve o bloco de `install`, quando nenhum frame roda mais esse código.
+  // Os bytes viram int3 até serem reaproveitados.
+  void release(const u1 *code, size_t size);
+
+  bool contains(const void *p) const {
+    return p >= base_ && p < base_ + capacity_;
+  }
+  size_t used() const { return top_ - free_bytes_; }
+  size_t capacity() const { return capacity_; }
+
+private:
+  // Proteção das páginas que cobrem [start, start + size)
+  void protect(u1 *start, size_t size, bool writable);
+
+  u1 *base_;
+  size_t capacity_;
+  size_t top_;
+  size_t page_size_;
+  // Blocos livres abaixo de top_, unidos aos vizinhos: início -> tamanho
+  std::map<size_t, size_t> free_;
+  size_t free_bytes_;
+};
@@ -0,0 +1,148 @@
+#include "./runtime_class_types.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Intervalo [start, end) não usado entre fields
+struct Hole {
+  u4 start;
+  u4 end;
+};
+
+u4 align_up(u4 value, u4 alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Coloca um field de `size` bytes (alinhado a `size`) no primeiro buraco que
+// couber, ou no fim do layout. Devolve o offset escolhido.
+u4 place(std::vector<Hole> &holes, u4 &end, u4 size) {
+  for (size_t i = 0; i < holes.size(); i++) {
+    Hole hole = holes[i];
+    u4 offset = align_up(hole.start, size);
+    if (offset + size > hole.end)
+      continue;
+
+    holes.erase(holes.begin() + i);
+    if (offset + size < hole.end)
+      holes.insert(holes.begin() + i, Hole{offset + size, hole.end});
+    if (hole.start < offset)
+      holes.insert(holes.begin() + i, Hole{hole.start, offset});
+    return offset;
+  }
+
+  u4 offset = align_up(end, size);
+  if (offset > end)
+    holes.push_back(Hole{end, offset});
+  end = offset + size;
+  return offset;
+}
+
+// Campos declarados pela classe, estáticos ou de instância, na ordem do
+// ClassFile
+std::vector<RuntimeField *> declared_fields(RuntimeClass &klass,
+                                            bool statics) {
+  const ClassFile &cf = *klass.class_file;
+  std::vector<RuntimeField *> result;
+  for (const auto &f : cf.fields) {
+    RuntimeField *rf = klass.find_declared_field(MemberKey::of(
+        cf.resolve_utf8(f.name_index), cf.resolve_utf8(f.descriptor_index)));
+    if (rf && rf->is_static == statics)
+      result.push_back(rf);
+  }
+  return result;
+}
+
+// Atribui offsets a partir de `start` e devolve o fim do layout
+u4 layout(std::vector<RuntimeField *> fields, u4 start) {
+  // Maiores primeiro; dentro do mesmo tamanho mantém a ordem de declaração
+  std::stable_sort(fields.begin(), fields.end(),
+                   [](const RuntimeField *a, const RuntimeField *b) {
+                     return a->size_in_bytes() > b->size_in_bytes();
+                   });
+
+  u4 end = start;
+  std::vector<Hole> holes;
+  for (RuntimeField *rf : fields)
+    rf->offset = place(holes, end, rf->size_in_bytes());
+  return end;
+}
+
+} // namespace
+
+void RuntimeClass::layout_fields() {
+  // O fim da superclasse não é arredondado: o que sobra até o próximo
+  // alinhamento vira buraco para os fields menores desta classe
+  u4 start = super_class ? super_class->instance_size : 0;
+  std::vector<RuntimeField *> instance_fields = declared_fields(*this, false);
+  instance_size = layout(instance_fields, start);
+
+  ref_offsets = super_class ? super_class->ref_offsets : std::vector<u4>();
+  for (RuntimeField *rf : instance_fields)
+    if (rf->is_reference())
+      ref_offsets.push_back(rf->offset);
+}
+
+void RuntimeClass::layout_static_fields() {
+  std::vector<RuntimeField *> statics = declared_fields(*this, true);
+  static_size = layout(statics, 0);
+  static_storage.assign((static_size + sizeof(u8) - 1) / sizeof(u8), 0);
+
+  static_ref_offsets.clear();
+  for (RuntimeField *rf : statics)
+    if (rf->is_reference())
+      static_ref_offsets.push_back(rf->offset);
+
+  const auto &pool = class_file->constant_pool;
+  for (RuntimeField *rf : statics) {
+    u2 index = rf->constantvalue_index;
+    if (index == 0 || index >= pool.size())
+      continue;
+
+    u1 *address = static_address(*rf);
+    const ConstantInfo &info = pool[index].second;
+    switch (pool[index].first) {
+    case ConstantTag::CONSTANT_Integer: {
+      // boolean/byte/char/short também usam CONSTANT_Integer: guarda só os
+      // bytes menos significativos, no tamanho do field
+      u4 value = info.integer_info.bytes;
+      switch (rf->size_in_bytes()) {
+      case 1: {
+        u1 narrow = static_cast<u1>(value);
+        std::memcpy(address, &narrow, 1);
+        break;
+      }
+      case 2: {
+        u2 narrow = static_cast<u2>(value);
+        std::memcpy(address, &narrow, 2);
+        break;
+      }
+      default:
+        std::memcpy(address, &value, 4);
+      }
+      break;
+    }
+    case ConstantTag::CONSTANT_Float:
+      std::memcpy(address, &info.float_info.bytes, 4);
+      break;
+    case ConstantTag::CONSTANT_Long: {
+      u8 value = (static_cast<u8>(info.long_info.high_bytes) << 32) |
+                 info.long_info.low_bytes;
+      std::memcpy(address, &value, 8);
+      break;
+    }
+    case ConstantTag::CONSTANT_Double: {
+      u8 value = (static_cast<u8>(info.double_info.high_bytes) << 32) |
+                 info.double_info.low_bytes;
+      std::memcpy(address, &value, 8);
+      break;
+    }
+    default:
+      // CONSTANT_String precisa de java/lang/String: atribuído no fim da
+      // carga, com Runtime::resolve_string
+      break;
+    }
+  }
+}
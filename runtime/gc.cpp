@@ -0,0 +1,738 @@
+#include "./gc.h"
+#include "./java_string.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+// Pilha local maior que isso publica metade na fila compartilhada
+static const size_t PUBLISH_THRESHOLD = 64;
+// Máximo de objetos levados de uma vez de uma fila compartilhada
+static const size_t STEAL_BATCH = 32;
+// Trabalho das threads de fundo entre uma checagem de pausa e outra
+static const size_t CONCURRENT_MARK_BATCH = 256;
+static const size_t CONCURRENT_SWEEP_BATCH = 4096;
+// Ocupação da geração velha que inicia um ciclo concorrente
+static const size_t CONCURRENT_START_PERCENT = 45;
+
+static RuntimeObject *load_ref(const u1 *slot) {
+  NarrowRef bits;
+  std::memcpy(&bits, slot, sizeof(bits));
+  return decode_ref(bits);
+}
+
+static void store_ref(u1 *slot, RuntimeObject *ref) {
+  NarrowRef bits = encode_ref(ref);
+  std::memcpy(slot, &bits, sizeof(bits));
+}
+
+// Slots de referência de `obj` com endereço em [from, to): os fields de
+// referência, ou os elementos de um array de referências
+template <typename Visit>
+static void for_each_ref(RuntimeObject *obj, const u1 *from, const u1 *to,
+                         Visit visit) {
+  RuntimeClass *klass = obj->klass;
+  if (klass->is_array()) {
+    if (!klass->is_reference_array())
+      return;
+    u1 *first = obj->array_data();
+    u1 *last = first + obj->array_length() * sizeof(NarrowRef);
+    if (from > first)
+      first += (from - first + sizeof(NarrowRef) - 1) / sizeof(NarrowRef) *
+               sizeof(NarrowRef);
+    if (to < last)
+      last = const_cast<u1 *>(to);
+    for (u1 *slot = first; slot < last; slot += sizeof(NarrowRef))
+      visit(slot);
+    return;
+  }
+
+  for (u4 offset : klass->ref_offsets) {
+    u1 *slot = obj->data() + offset;
+    if (slot >= from && slot < to)
+      visit(slot);
+  }
+}
+
+template <typename Visit>
+static void for_each_ref(RuntimeObject *obj, Visit visit) {
+  const u1 *begin = reinterpret_cast<const u1 *>(obj);
+  for_each_ref(obj, begin, begin + obj->size(), visit);
+}
+
+// Os visitantes trabalham sobre referências comprimidas; um slot de frame
+// pode ser mais largo, então passa por uma cópia
+static void visit_slot(Slot &slot, const std::function<void(u1 *)> &visit) {
+  NarrowRef bits = static_cast<NarrowRef>(slot);
+  visit(reinterpret_cast<u1 *>(&bits));
+  slot = bits;
+}
+
+GarbageCollector::GarbageCollector(Runtime *runtime, unsigned workers)
+    : collections(0), young_collections(0), last_freed(0), last_promoted(0),
+      concurrent_cycles(0), runtime(runtime), idle_workers(0),
+      marking_failed(false), pool_round(0), pool_busy(0), pool_stop(false),
+      mark_from(nullptr), mark_to(nullptr),
+      concurrent(false), phase(CyclePhase::Idle), cycle_done(false),
+      tams(nullptr) {
+  size_t granules = runtime->heap->capacity() / HEAP_ALIGNMENT;
+  mark_words = (granules + 63) / 64;
+  mark_bits.reset(new std::atomic<u8>[mark_words]);
+  for (size_t i = 0; i < mark_words; i++)
+    mark_bits[i].store(0, std::memory_order_relaxed);
+
+  if (workers == 0)
+    workers = std::thread::hardware_concurrency();
+  if (workers == 0)
+    workers = 1;
+  for (unsigned i = 0; i < workers; i++)
+    this->workers.emplace_back(new MarkWorker());
+  for (size_t i = 1; i < this->workers.size(); i++)
+    pool.emplace_back(&GarbageCollector::pool_loop, this, i);
+}
+
+GarbageCollector::~GarbageCollector() {
+  SatbQueue::active.store(false);
+  if (cycle_thread.joinable())
+    cycle_thread.join();
+
+  {
+    std::lock_guard<std::mutex> guard(pool_lock);
+    pool_stop = true;
+  }
+  pool_wake.notify_all();
+  for (std::thread &thread : pool)
+    thread.join();
+}
+
+// Raízes
+
+void GarbageCollector::visit_frame(Frame &frame, const SlotVisitor &visit) {
+  RuntimeMethod *method = frame.method;
+  if (!method || !method->code)
+    return;
+
+  const ReferenceMap &map = method->reference_map();
+  const ReferenceMap::Entry *entry = map.at(frame.pc);
+  if (!entry)
+    throw std::runtime_error("GC: no reference map for " + method->name +
+                             " at pc " + std::to_string(frame.pc));
+
+  for (u2 i = 0; i < frame.local_vars.size(); i++)
+    if (map.local_is_ref(*entry, i))
+      visit_slot(frame.local_vars[i], visit);
+
+  // Operandos já consumidos pela instrução corrente (argumentos de um
+  // invoke) não estão mais na pilha; o prefixo que ficou tem os tipos do mapa
+  std::vector<Slot> &stack = frame.operand_stack.stack;
+  for (u2 i = 0; i < stack.size(); i++)
+    if (map.stack_is_ref(*entry, i))
+      visit_slot(stack[i], visit);
+}
+
+void GarbageCollector::visit_roots(const SlotVisitor &visit) {
+  for (Frame *frame : runtime->thread->call_stack)
+    visit_frame(*frame, visit);
+
+  for (NarrowRef &handle : runtime->thread->handles)
+    visit(reinterpret_cast<u1 *>(&handle));
+  visit(reinterpret_cast<u1 *>(&runtime->thread->exception));
+
+  runtime->strings->visit_roots(visit);
+
+  for (RuntimeClass *klass : runtime->method_area->getClasses()) {
+    u1 *statics = reinterpret_cast<u1 *>(klass->static_storage.data());
+    for (u4 offset : klass->static_ref_offsets)
+      visit(statics + offset);
+    visit(reinterpret_cast<u1 *>(&klass->mirror));
+  }
+}
+
+// Mark-sweep
+
+size_t GarbageCollector::bit_index(const void *p) const {
+  return static_cast<size_t>(static_cast<const u1 *>(p) -
+                             runtime->heap->base()) /
+         HEAP_ALIGNMENT;
+}
+
+bool GarbageCollector::is_marked(const RuntimeObject *obj) const {
+  size_t bit = bit_index(obj);
+  return (mark_bits[bit / 64].load(std::memory_order_relaxed) >> (bit % 64)) &
+         1;
+}
+
+// Só quem consegue ligar o bit empilha o objeto, então cada objeto é
+// varrido por exatamente um worker
+void GarbageCollector::mark(RuntimeObject *obj, MarkWorker &worker) {
+  if (!obj)
+    return;
+  if (!runtime->heap->contains(obj))
+    throw std::runtime_error("GC: reference outside the Java heap");
+  const u1 *address = reinterpret_cast<const u1 *>(obj);
+  if (address < mark_from || address >= mark_to)
+    return;
+
+  size_t bit = bit_index(obj);
+  u8 mask = u8(1) << (bit % 64);
+  if (mark_bits[bit / 64].load(std::memory_order_relaxed) & mask)
+    return;
+  if (mark_bits[bit / 64].fetch_or(mask, std::memory_order_relaxed) & mask)
+    return;
+  worker.local.push_back(obj);
+
+  // Publica a metade mais antiga (perto das raízes, com mais trabalho
+  // pendurado) quando a fila compartilhada já foi esvaziada
+  if (worker.local.size() >= PUBLISH_THRESHOLD &&
+      worker.shared_size.load() == 0) {
+    size_t half = worker.local.size() / 2;
+    std::lock_guard<std::mutex> guard(worker.lock);
+    worker.shared.insert(worker.shared.end(), worker.local.begin(),
+                         worker.local.begin() + half);
+    worker.shared_size.store(worker.shared.size());
+    worker.local.erase(worker.local.begin(), worker.local.begin() + half);
+  }
+}
+
+void GarbageCollector::scan_object(RuntimeObject *obj, MarkWorker &worker) {
+  for_each_ref(obj, [&](u1 *slot) { mark(load_ref(slot), worker); });
+}
+
+bool GarbageCollector::pop(MarkWorker &worker, RuntimeObject *&obj) {
+  if (worker.local.empty()) {
+    std::lock_guard<std::mutex> guard(worker.lock);
+    if (worker.shared.empty())
+      return false;
+    worker.local.push_back(worker.shared.back());
+    worker.shared.pop_back();
+    worker.shared_size.store(worker.shared.size());
+  }
+  obj = worker.local.back();
+  worker.local.pop_back();
+  return true;
+}
+
+// Leva até metade da fila compartilhada de outro worker, pelo lado oposto
+// ao que o dono consome
+bool GarbageCollector::steal(MarkWorker &thief) {
+  for (auto &victim : workers) {
+    if (victim.get() == &thief || victim->shared_size.load() == 0)
+      continue;
+
+    std::lock_guard<std::mutex> guard(victim->lock);
+    size_t count = std::min(STEAL_BATCH, (victim->shared.size() + 1) / 2);
+    if (count == 0)
+      continue;
+    thief.local.insert(thief.local.end(), victim->shared.begin(),
+                       victim->shared.begin() + count);
+    victim->shared.erase(victim->shared.begin(),
+                         victim->shared.begin() + count);
+    victim->shared_size.store(victim->shared.size());
+    return true;
+  }
+  return false;
+}
+
+// Um worker sem trabalho se declara ocioso e espera. Só um worker ativo
+// publica, e ele esvazia a própria fila antes de ficar ocioso, então com
+// todos ociosos não sobra nada em fila nenhuma e a marcação terminou.
+bool GarbageCollector::offer_termination() {
+  idle_workers.fetch_add(1);
+  for (;;) {
+    if (idle_workers.load() == workers.size() || marking_failed.load())
+      return true;
+    for (auto &worker : workers) {
+      if (worker->shared_size.load() > 0) {
+        idle_workers.fetch_sub(1);
+        return false;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+void GarbageCollector::mark_loop(MarkWorker &worker) {
+  for (;;) {
+    RuntimeObject *obj;
+    while (pop(worker, obj))
+      scan_object(obj, worker);
+    if (steal(worker))
+      continue;
+    if (offer_termination())
+      return;
+  }
+}
+
+void GarbageCollector::run_worker(MarkWorker &worker) {
+  try {
+    mark_loop(worker);
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(pool_lock);
+    if (!mark_error)
+      mark_error = std::current_exception();
+    marking_failed.store(true);
+  }
+}
+
+// Thread de um worker: espera a próxima rodada, marca e volta a esperar
+void GarbageCollector::pool_loop(size_t index) {
+  u8 seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(pool_lock);
+      pool_wake.wait(lock,
+                     [&] { return pool_stop || pool_round != seen; });
+      if (pool_stop)
+        return;
+      seen = pool_round;
+    }
+
+    run_worker(*workers[index]);
+
+    std::lock_guard<std::mutex> guard(pool_lock);
+    if (--pool_busy == 0)
+      pool_idle.notify_one();
+  }
+}
+
+void GarbageCollector::parallel_mark() {
+  idle_workers.store(0);
+  marking_failed.store(false);
+  if (workers.size() == 1) {
+    mark_loop(*workers[0]);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pool_lock);
+    mark_error = nullptr;
+    pool_busy = pool.size();
+    pool_round++;
+  }
+  pool_wake.notify_all();
+  run_worker(*workers[0]);
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(pool_lock);
+    pool_idle.wait(lock, [this] { return pool_busy == 0; });
+    error = mark_error;
+  }
+
+  if (error) {
+    for (auto &worker : workers) {
+      worker->local.clear();
+      worker->shared.clear();
+      worker->shared_size.store(0);
+    }
+    std::rethrow_exception(error);
+  }
+}
+
+void GarbageCollector::clear_mark_bits() {
+  Heap *heap = runtime->heap;
+  size_t used_words =
+      (static_cast<size_t>(heap->top() - heap->base()) / HEAP_ALIGNMENT +
+       63) /
+      64;
+  for (size_t i = 0; i < used_words; i++)
+    mark_bits[i].store(0, std::memory_order_relaxed);
+}
+
+// Varre a geração velha até `limit`. No sweep concorrente o mutador pode
+// estar alocando acima do limite, e a free list, esvaziada no início do
+// ciclo, recebe os blocos conforme o sweep avança.
+void GarbageCollector::sweep(u1 *limit, bool concurrent_sweep) {
+  Heap *heap = runtime->heap;
+  std::unique_lock<std::mutex> pause(cycle_lock, std::defer_lock);
+  if (concurrent_sweep)
+    pause.lock();
+  else
+    heap->clear_free_list();
+
+  u1 *p = heap->old_base();
+  u1 *run = nullptr; // início da sequência de blocos mortos corrente
+  size_t freed = 0;
+  size_t blocks = 0;
+
+  // Cards inteiros sobre espaço liberado ficam limpos: um objeto promovido
+  // para ali não pode ser visitado pelo card e de novo pela lista de
+  // promovidos na mesma coleta jovem
+  auto clean_cards = [heap](u1 *start, u1 *end) {
+    u1 *last = heap->card_for(end);
+    for (u1 *card = heap->card_for(start + CARD_SIZE - 1); card < last;
+         card++)
+      *card = CLEAN_CARD;
+  };
+  auto close_run = [&](u1 *end) {
+    size_t size = static_cast<size_t>(end - run);
+    clean_cards(run, end);
+    heap->fill(run, size);
+    if (size >= MIN_FREE_CHUNK)
+      heap->add_free_chunk(run, size);
+  };
+
+  while (p < limit) {
+    if (concurrent_sweep && ++blocks % CONCURRENT_SWEEP_BATCH == 0) {
+      pause.unlock();
+      std::this_thread::yield();
+      pause.lock();
+    }
+
+    size_t size = Heap::free_block_size(p);
+    bool live = false;
+    if (size == 0) {
+      RuntimeObject *obj = reinterpret_cast<RuntimeObject *>(p);
+      size = obj->size();
+      live = is_marked(obj);
+      if (!live)
+        freed += size;
+    }
+
+    if (live && run) {
+      close_run(p);
+      run = nullptr;
+    } else if (!live && !run) {
+      run = p;
+    }
+    p += size;
+  }
+
+  // Espaço morto no fim volta para a região de bump. Acima do topo a
+  // memória precisa estar zerada; se o mutador já alocou acima do limite,
+  // o bloco zerado entra na free list como os outros.
+  if (run) {
+    clean_cards(run, limit);
+    std::memset(run, 0, static_cast<size_t>(limit - run));
+    if (!heap->shrink_top(limit, run))
+      close_run(limit);
+  }
+
+  last_freed = freed;
+}
+
+// Objetos jovens também são marcados, porque podem ser o único caminho
+// até objetos velhos, mas só a geração velha passa pelo sweep
+void GarbageCollector::mark_sweep() {
+  Heap *heap = runtime->heap;
+  clear_mark_bits();
+  mark_from = heap->base();
+  mark_to = heap->base() + heap->capacity();
+
+  // As raízes são divididas entre os workers antes de eles começarem
+  size_t next = 0;
+  visit_roots([this, &next](u1 *slot) {
+    mark(load_ref(slot), *workers[next++ % workers.size()]);
+  });
+  parallel_mark();
+  sweep(heap->top(), false);
+  collections++;
+}
+
+// Ciclo concorrente
+
+// Pausa de marcação inicial. No modo geracional ela vem logo depois de uma
+// coleta jovem, e os survivors que sobraram são varridos como raízes; daí
+// em diante a marcação ignora a geração jovem.
+void GarbageCollector::start_cycle() {
+  Heap *heap = runtime->heap;
+  heap->retire(runtime->thread->tlab);
+  if (heap->generational()) {
+    // Sem espaço garantido para a coleta jovem, o ciclo fica para a
+    // próxima falha de alocação, que resolve pela coleta completa
+    if (heap->promotion_space(MAX_YOUNG_OBJECT) < heap->young_used())
+      return;
+    collect_young();
+  }
+
+  heap->clear_free_list();
+  tams = heap->top();
+  clear_mark_bits();
+  mark_from = heap->old_base();
+  mark_to = tams;
+
+  MarkWorker &worker = *workers[0];
+  visit_roots([this, &worker](u1 *slot) { mark(load_ref(slot), worker); });
+  Space &survivors = heap->from_space();
+  for (u1 *p = survivors.start; p < survivors.top;) {
+    RuntimeObject *obj = reinterpret_cast<RuntimeObject *>(p);
+    scan_object(obj, worker);
+    p += obj->size();
+  }
+
+  cycle_error = nullptr;
+  cycle_done.store(false);
+  SatbQueue::active.store(true);
+  phase = CyclePhase::Marking;
+  cycle_thread = std::thread(&GarbageCollector::concurrent_mark, this);
+}
+
+void GarbageCollector::concurrent_mark() {
+  MarkWorker &worker = *workers[0];
+  std::vector<const void *> satb;
+  try {
+    for (;;) {
+      std::unique_lock<std::mutex> pause(cycle_lock);
+      SatbQueue::take(satb);
+      for (const void *ref : satb)
+        mark(static_cast<RuntimeObject *>(const_cast<void *>(ref)), worker);
+      satb.clear();
+
+      RuntimeObject *obj;
+      for (size_t n = 0; n < CONCURRENT_MARK_BATCH && pop(worker, obj); n++)
+        scan_object(obj, worker);
+      bool idle = worker.local.empty() && worker.shared_size.load() == 0;
+      pause.unlock();
+
+      // O que ainda chegar pela fila SATB fica para a remarcação. Com a
+      // fila desligada fora de hora, o coletor está sendo destruído.
+      if (idle || !SatbQueue::active.load())
+        break;
+      std::this_thread::yield();
+    }
+  } catch (...) {
+    cycle_error = std::current_exception();
+  }
+  cycle_done.store(true);
+}
+
+// Pausa de remarcação: roda na thread do mutador, que é quem enche a fila
+// SATB, então com ela parada a fila só esvazia
+void GarbageCollector::remark() {
+  cycle_thread.join();
+  SatbQueue::flush();
+  SatbQueue::active.store(false);
+  if (cycle_error) {
+    phase = CyclePhase::Idle;
+    std::rethrow_exception(cycle_error);
+  }
+
+  std::vector<const void *> satb;
+  SatbQueue::take(satb);
+  for (const void *ref : satb)
+    mark(static_cast<RuntimeObject *>(const_cast<void *>(ref)), *workers[0]);
+  parallel_mark();
+
+  cycle_done.store(false);
+  phase = CyclePhase::Sweeping;
+  cycle_thread = std::thread(&GarbageCollector::concurrent_sweep, this);
+}
+
+void GarbageCollector::concurrent_sweep() {
+  sweep(tams, true);
+  cycle_done.store(true);
+}
+
+// Termina o ciclo corrente esperando as threads de fundo
+void GarbageCollector::finish_cycle() {
+  if (phase == CyclePhase::Marking)
+    remark();
+  if (phase == CyclePhase::Sweeping) {
+    cycle_thread.join();
+    phase = CyclePhase::Idle;
+    concurrent_cycles++;
+    collections++;
+  }
+}
+
+void GarbageCollector::poll() {
+  if (!concurrent)
+    return;
+
+  switch (phase) {
+  case CyclePhase::Idle: {
+    Heap *heap = runtime->heap;
+    size_t old_capacity =
+        heap->capacity() - static_cast<size_t>(heap->old_base() - heap->base());
+    size_t occupied = old_capacity - heap->old_free();
+    if (occupied * 100 >= old_capacity * CONCURRENT_START_PERCENT)
+      start_cycle();
+    break;
+  }
+  case CyclePhase::Marking:
+  case CyclePhase::Sweeping:
+    if (cycle_done.load())
+      finish_cycle();
+    break;
+  }
+}
+
+// Coleta jovem
+
+// Um slot pode ser visitado mais de uma vez (pelo card e pela lista de
+// promovidos); o que já está no survivor novo fica onde está
+RuntimeObject *GarbageCollector::evacuate(RuntimeObject *obj) {
+  Heap *heap = runtime->heap;
+  Space &to = heap->to_space();
+  if (!obj || !heap->in_young(obj) || to.contains(obj))
+    return obj;
+  if (obj->is_forwarded())
+    return obj->forwardee();
+
+  size_t size = obj->size();
+  unsigned age = obj->age() + 1;
+
+  u1 *copy;
+  if (age < TENURING_THRESHOLD &&
+      size <= static_cast<size_t>(to.end - to.top)) {
+    copy = to.top;
+    to.top += size;
+  } else {
+    // prepare_young garantiu espaço para promover tudo antes da cópia
+    copy = static_cast<u1 *>(heap->allocate_old(size));
+    if (!copy)
+      throw std::logic_error("GC: promotion failed despite reserved space");
+    promoted.push_back(reinterpret_cast<RuntimeObject *>(copy));
+    last_promoted += size;
+  }
+
+  std::memcpy(copy, obj, size);
+  RuntimeObject *moved = reinterpret_cast<RuntimeObject *>(copy);
+  moved->set_age(age);
+  obj->forward_to(moved);
+  return moved;
+}
+
+// Procura ponteiros velho -> jovem só nos cards sujos. O bitmap de inícios
+// de bloco dá o primeiro bloco que cobre o card; dali o card é percorrido
+// objeto a objeto, visitando só os slots que caem dentro dele.
+void GarbageCollector::scan_dirty_cards(const SlotVisitor &visit) {
+  Heap *heap = runtime->heap;
+  u1 *old_base = heap->old_base();
+  u1 *top = heap->top();
+  if (old_base == top)
+    return;
+
+  u1 *last = heap->card_for(top - 1);
+  for (u1 *card = heap->card_for(old_base); card <= last; card++) {
+    if (*card != DIRTY_CARD)
+      continue;
+    *card = CLEAN_CARD;
+
+    u1 *start = std::max(heap->card_address(card), old_base);
+    u1 *end = std::min(heap->card_address(card) + CARD_SIZE, top);
+    u1 *p = heap->block_start(start);
+    while (p < end) {
+      size_t size = Heap::free_block_size(p);
+      if (size == 0) {
+        RuntimeObject *obj = reinterpret_cast<RuntimeObject *>(p);
+        size = obj->size();
+        for_each_ref(obj, start, end, visit);
+      }
+      p += size;
+    }
+  }
+}
+
+void GarbageCollector::collect_young() {
+  Heap *heap = runtime->heap;
+  Space &to = heap->to_space();
+  promoted.clear();
+  last_promoted = 0;
+
+  auto update = [this](u1 *slot) { store_ref(slot, evacuate(load_ref(slot))); };
+  // Slot dentro da geração velha: se ainda aponta para um survivor, o card
+  // continua sujo para a próxima coleta jovem
+  auto update_old = [this, heap](u1 *slot) {
+    RuntimeObject *ref = evacuate(load_ref(slot));
+    store_ref(slot, ref);
+    if (heap->in_young(ref))
+      write_barrier(slot);
+  };
+
+  visit_roots(update);
+  scan_dirty_cards(update_old);
+
+  // Cheney: o que foi copiado para o survivor é varrido em ordem, e os
+  // promovidos pela lista, até nenhum dos dois crescer mais
+  u1 *scan = to.start;
+  size_t promoted_scanned = 0;
+  while (scan < to.top || promoted_scanned < promoted.size()) {
+    while (scan < to.top) {
+      RuntimeObject *obj = reinterpret_cast<RuntimeObject *>(scan);
+      for_each_ref(obj, update);
+      scan += obj->size();
+    }
+    while (promoted_scanned < promoted.size()) {
+      RuntimeObject *obj = promoted[promoted_scanned++];
+      for_each_ref(obj, update_old);
+    }
+  }
+
+  heap->reset_young();
+  young_collections++;
+}
+
+size_t GarbageCollector::marked_young() {
+  Heap *heap = runtime->heap;
+  size_t live = 0;
+  auto count = [&](u1 *p, u1 *end) {
+    while (p < end) {
+      size_t size = Heap::free_block_size(p);
+      if (size == 0) {
+        RuntimeObject *obj = reinterpret_cast<RuntimeObject *>(p);
+        size = obj->size();
+        if (is_marked(obj))
+          live += size;
+      }
+      p += size;
+    }
+  };
+  count(heap->eden_start(), heap->eden_top());
+  count(heap->from_space().start, heap->from_space().top);
+  return live;
+}
+
+// Uma coleta jovem não pode parar no meio: com objetos já copiados e
+// encaminhados o heap não volta ao estado anterior. Ela só começa com
+// espaço garantido na geração velha para o pior caso, tudo que está na
+// geração jovem sobreviver; senão uma coleta completa mede o que de fato
+// está vivo. Se nem isso cabe, a coleta jovem não acontece e a alocação
+// lança OutOfMemoryError com o heap intacto.
+bool GarbageCollector::prepare_young() {
+  Heap *heap = runtime->heap;
+  if (heap->promotion_space(MAX_YOUNG_OBJECT) >= heap->young_used())
+    return true;
+  finish_cycle();
+  if (heap->promotion_space(MAX_YOUNG_OBJECT) >= heap->young_used())
+    return true;
+  mark_sweep();
+  return heap->promotion_space(MAX_YOUNG_OBJECT) >= marked_young();
+}
+
+void GarbageCollector::collect() {
+  Heap *heap = runtime->heap;
+  // Com todos os TLABs devolvidos, a geração velha até o topo é percorrível
+  heap->retire(runtime->thread->tlab);
+
+  // No modo de espaço único um ciclo em andamento já é a coleta; termina
+  // ele, e se não bastar o heap pede uma completa
+  if (!heap->generational()) {
+    if (phase != CyclePhase::Idle)
+      finish_cycle();
+    else
+      mark_sweep();
+    return;
+  }
+
+  if (!prepare_young())
+    return;
+
+  // Coletas jovens continuam durante um ciclo; a thread de fundo fica
+  // suspensa enquanto a geração velha é percorrida e atualizada
+  std::lock_guard<std::mutex> pause(cycle_lock);
+  collect_young();
+}
+
+void GarbageCollector::collect_full() {
+  Heap *heap = runtime->heap;
+  heap->retire(runtime->thread->tlab);
+
+  finish_cycle();
+  mark_sweep();
+  if (heap->generational() &&
+      heap->promotion_space(MAX_YOUNG_OBJECT) >= marked_young())
+    collect_young();
+}
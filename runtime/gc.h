@@ -0,0 +1,151 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Coletor preciso e stop-the-world sobre o heap gerenciado.
+//
+// Raízes: os frames de Thread::call_stack, lidos com o ReferenceMap do pc
+// corrente de cada frame (só os slots que o mapa diz serem referências), os
+// fields estáticos de referência das classes carregadas, os Handles da
+// thread e a tabela de strings internadas.
+//
+// Coleta completa: mark-sweep. A marcação usa um bitmap lateral atômico, um
+// bit por palavra de 8 bytes do heap, e roda em `workers` threads com roubo
+// de trabalho. As threads dos workers são criadas com o coletor e ficam
+// paradas entre uma coleta e outra; o sweep percorre a geração velha bloco a bloco e devolve as
+// sequências de blocos mortos à free list.
+//
+// Coleta jovem (modo geracional): cópia estilo Cheney do eden e do survivor
+// de origem para o outro survivor, ou para a geração velha depois de
+// TENURING_THRESHOLD coletas. Além das raízes, os cards sujos da geração
+// velha dão os ponteiros velho -> jovem. O custo é proporcional ao que
+// sobrevive, não ao tamanho do heap.
+//
+// Modo concorrente (opcional): a geração velha é coletada em ciclos SATB.
+// Uma pausa curta de marcação inicial tira o snapshot das raízes e guarda o
+// topo da geração velha (TAMS); uma thread de fundo marca enquanto o
+// mutador roda, com a pré-barreira SATB cobrindo as referências
+// sobrescritas; uma pausa curta de remarcação esvazia a fila SATB; depois
+// uma thread de fundo faz o sweep. O que é alocado ou promovido durante o
+// ciclo fica acima do TAMS e é tratado como vivo (allocate-black), e a free
+// list fica vazia até o sweep devolver os blocos.
+class GarbageCollector {
+public:
+  // `workers` 0 usa um worker de marcação por núcleo
+  explicit GarbageCollector(Runtime *runtime, unsigned workers = 0);
+  ~GarbageCollector();
+
+  GarbageCollector(const GarbageCollector &) = delete;
+  GarbageCollector &operator=(const GarbageCollector &) = delete;
+
+  // Coleta jovem no modo geracional (precedida de uma completa se a geração
+  // velha não garantir a promoção de tudo; sem espaço nem depois dela, não
+  // coleta), completa no de espaço único
+  void collect();
+  void collect_full();
+
+  void set_concurrent(bool enabled) { concurrent = enabled; }
+  // Ponto seguro do mutador, no caminho lento da alocação: inicia um ciclo
+  // concorrente ou passa para a próxima fase quando a thread de fundo termina
+  void poll();
+
+  u8 collections;       // coletas completas
+  u8 young_collections;
+  size_t last_freed;    // bytes liberados na última coleta completa
+  size_t last_promoted; // bytes promovidos na última coleta jovem
+  u8 concurrent_cycles;
+
+  unsigned worker_count() const {
+    return static_cast<unsigned>(workers.size());
+  }
+
+private:
+  // Recebe o endereço de um slot de referência; pode reescrevê-lo
+  using SlotVisitor = std::function<void(u1 *)>;
+
+  // Trabalho de marcação de um worker. A pilha local só é tocada pelo dono,
+  // sem sincronização; quando cresce, metade vai para a fila compartilhada,
+  // de onde o próprio dono e os outros workers tiram trabalho.
+  struct MarkWorker {
+    std::vector<RuntimeObject *> local;
+    std::mutex lock;
+    std::deque<RuntimeObject *> shared;
+    std::atomic<size_t> shared_size{0};
+  };
+
+  enum class CyclePhase { Idle, Marking, Sweeping };
+
+  Runtime *runtime;
+  std::unique_ptr<std::atomic<u8>[]> mark_bits;
+  size_t mark_words;
+  std::vector<std::unique_ptr<MarkWorker>> workers;
+  std::atomic<unsigned> idle_workers;
+  std::atomic<bool> marking_failed;
+  std::vector<RuntimeObject *> promoted;
+
+  // Threads dos workers 1..N-1; o worker 0 é a thread que coleta. Cada
+  // coleta abre uma rodada (pool_round) e espera pool_busy chegar a zero.
+  std::vector<std::thread> pool;
+  std::mutex pool_lock;
+  std::condition_variable pool_wake;
+  std::condition_variable pool_idle;
+  u8 pool_round;
+  size_t pool_busy;
+  bool pool_stop;
+  std::exception_ptr mark_error; // protegido por pool_lock
+
+  // Só objetos em [mark_from, mark_to) são marcados e varridos
+  const u1 *mark_from;
+  const u1 *mark_to;
+
+  bool concurrent;
+  CyclePhase phase;
+  std::thread cycle_thread;
+  // A thread de fundo só trabalha segurando esse lock, em lotes; as pausas
+  // (coleta jovem) o pegam para suspendê-la
+  std::mutex cycle_lock;
+  std::atomic<bool> cycle_done;
+  std::exception_ptr cycle_error;
+  u1 *tams; // topo da geração velha no início da marcação
+
+  void visit_roots(const SlotVisitor &visit);
+  void visit_frame(Frame &frame, const SlotVisitor &visit);
+
+  size_t bit_index(const void *p) const;
+  bool is_marked(const RuntimeObject *obj) const;
+  void mark(RuntimeObject *obj, MarkWorker &worker);
+  void scan_object(RuntimeObject *obj, MarkWorker &worker);
+  bool pop(MarkWorker &worker, RuntimeObject *&obj);
+  bool steal(MarkWorker &thief);
+  bool offer_termination();
+  void mark_loop(MarkWorker &worker);
+  // mark_loop que guarda a primeira exceção em mark_error
+  void run_worker(MarkWorker &worker);
+  void pool_loop(size_t index);
+  void parallel_mark();
+  void clear_mark_bits();
+  void sweep(u1 *limit, bool concurrent_sweep);
+  void mark_sweep();
+
+  void start_cycle();
+  void concurrent_mark();
+  void remark();
+  void concurrent_sweep();
+  void finish_cycle();
+
+  RuntimeObject *evacuate(RuntimeObject *obj);
+  void scan_dirty_cards(const SlotVisitor &visit);
+  // Bytes marcados na geração jovem, depois de mark_sweep
+  size_t marked_young();
+  bool prepare_young();
+  void collect_young();
+};
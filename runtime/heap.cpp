@@ -0,0 +1,352 @@
+#include "./heap.h"
+#include "./gc.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// A faixa inteira é reservada de uma vez; o sistema só entrega páginas
+// físicas quando são tocadas, e elas já vêm zeradas
+static u1 *reserve_range(size_t size) {
+#ifdef _WIN32
+  void *p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT,
+                         PAGE_READWRITE);
+  return static_cast<u1 *>(p);
+#else
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return p == MAP_FAILED ? nullptr : static_cast<u1 *>(p);
+#endif
+}
+
+static void release_range(u1 *base, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  VirtualFree(base, 0, MEM_RELEASE);
+#else
+  munmap(base, size);
+#endif
+}
+
+u1 *Heap::card_base = nullptr;
+uintptr_t Heap::narrow_base = 0;
+unsigned Heap::narrow_shift = 0;
+
+// Maior distância da base que um u4 alcança com e sem shift
+static const u8 UNSCALED_NARROW_RANGE = u8(1) << 32;
+static const unsigned MAX_NARROW_SHIFT = 3;
+
+Heap::Heap(size_t capacity, size_t young_size) : collector_(nullptr) {
+  capacity = heap_align(capacity);
+  size_t survivor = heap_align(young_size / 8);
+  young_size = heap_align(young_size);
+  if (young_size >= capacity)
+    throw std::runtime_error("Young generation larger than the Java heap");
+
+  u8 narrow_range = u8(capacity) + HEAP_ALIGNMENT;
+  unsigned shift =
+      narrow_range <= UNSCALED_NARROW_RANGE ? 0 : MAX_NARROW_SHIFT;
+  if (narrow_range > (UNSCALED_NARROW_RANGE << MAX_NARROW_SHIFT))
+    throw std::runtime_error("Java heap too large for compressed references");
+
+  base_ = reserve_range(capacity);
+  if (!base_)
+    throw std::runtime_error("Could not reserve the Java heap");
+  end_ = base_ + capacity;
+  narrow_base = reinterpret_cast<uintptr_t>(base_) - HEAP_ALIGNMENT;
+  narrow_shift = shift;
+
+  young_end_ = base_ + young_size;
+  eden_end_ = young_end_ - 2 * survivor;
+  eden_top_.store(base_);
+  from_ = Space{eden_end_, eden_end_, eden_end_ + survivor};
+  to_ = Space{from_.end, from_.end, young_end_};
+  top_.store(young_end_);
+
+  cards_.assign((capacity >> CARD_SHIFT) + 1, CLEAN_CARD);
+  card_base = reinterpret_cast<u1 *>(
+      reinterpret_cast<uintptr_t>(cards_.data()) -
+      (reinterpret_cast<uintptr_t>(base_) >> CARD_SHIFT));
+
+  size_t old_words = static_cast<size_t>(end_ - young_end_) / HEAP_ALIGNMENT;
+  size_t start_words = (old_words + 63) / 64;
+  starts_.reset(new std::atomic<u8>[start_words]);
+  for (size_t i = 0; i < start_words; i++)
+    starts_[i].store(0, std::memory_order_relaxed);
+}
+
+Heap::~Heap() {
+  card_base = nullptr;
+  release_range(base_, capacity());
+}
+
+void Heap::fill(u1 *start, size_t size) {
+  if (size > 0)
+    record_block(start, size);
+  if (size >= sizeof(FreeBlockHeader)) {
+    FreeBlockHeader header{FREE_BLOCK, size};
+    std::memcpy(start, &header, sizeof(header));
+  } else {
+    std::memset(start, 0, size);
+  }
+}
+
+size_t Heap::free_block_size(const u1 *p) {
+  FreeBlockHeader header;
+  std::memcpy(&header.klass, p, sizeof(header.klass));
+  if (header.klass == nullptr)
+    return HEAP_ALIGNMENT;
+  if (header.klass != FREE_BLOCK)
+    return 0;
+  std::memcpy(&header, p, sizeof(header));
+  return header.size;
+}
+
+void Heap::retire(TLAB &tlab) {
+  if (tlab.top < tlab.end)
+    fill(tlab.top, static_cast<size_t>(tlab.end - tlab.top));
+  tlab = TLAB();
+}
+
+void Heap::reset_young() {
+  u1 *top = eden_top_.load();
+  std::memset(base_, 0, static_cast<size_t>(top - base_));
+  eden_top_.store(base_);
+
+  Space emptied = from_;
+  emptied.top = emptied.start;
+  from_ = to_;
+  to_ = emptied;
+}
+
+void Heap::record_block(const u1 *p, size_t size) {
+  if (p < young_end_)
+    return;
+  size_t first = static_cast<size_t>(p - young_end_) / HEAP_ALIGNMENT;
+  size_t last = first + size / HEAP_ALIGNMENT;
+  starts_[first / 64].fetch_or(u8(1) << (first % 64),
+                               std::memory_order_relaxed);
+
+  for (size_t bit = first + 1; bit < last;) {
+    size_t low = bit % 64;
+    size_t count = std::min<size_t>(64 - low, last - bit);
+    u8 mask = count == 64 ? ~u8(0) : ((u8(1) << count) - 1) << low;
+    starts_[bit / 64].fetch_and(~mask, std::memory_order_relaxed);
+    bit += count;
+  }
+}
+
+u1 *Heap::block_start(const u1 *p) const {
+  size_t bit = static_cast<size_t>(p - young_end_) / HEAP_ALIGNMENT;
+  size_t word = bit / 64;
+  u8 bits = starts_[word].load(std::memory_order_relaxed) &
+            (~u8(0) >> (63 - bit % 64));
+  while (bits == 0) {
+    if (word == 0)
+      return young_end_;
+    bits = starts_[--word].load(std::memory_order_relaxed);
+  }
+  size_t found = word * 64 + 63 - static_cast<size_t>(__builtin_clzll(bits));
+  return young_end_ + found * HEAP_ALIGNMENT;
+}
+
+size_t Heap::old_free() {
+  size_t free = static_cast<size_t>(end_ - top_.load());
+  std::lock_guard<std::mutex> guard(free_lock_);
+  for (const FreeChunk &chunk : free_list_)
+    free += chunk.size;
+  return free;
+}
+
+size_t Heap::promotion_space(size_t max_size) {
+  size_t waste = max_size > MIN_FREE_CHUNK ? max_size : MIN_FREE_CHUNK;
+  auto usable = [waste](size_t size) {
+    return size > waste ? size - waste : 0;
+  };
+  size_t space = usable(static_cast<size_t>(end_ - top_.load()));
+  std::lock_guard<std::mutex> guard(free_lock_);
+  for (const FreeChunk &chunk : free_list_)
+    space += usable(chunk.size);
+  return space;
+}
+
+void Heap::clear_free_list() {
+  std::lock_guard<std::mutex> guard(free_lock_);
+  free_list_.clear();
+}
+
+void Heap::add_free_chunk(u1 *start, size_t size) {
+  std::lock_guard<std::mutex> guard(free_lock_);
+  free_list_.push_back(FreeChunk{start, size});
+}
+
+void *Heap::allocate_shared(size_t size) {
+  u1 *old_top = top_.load(std::memory_order_relaxed);
+  do {
+    if (static_cast<size_t>(end_ - old_top) < size)
+      return nullptr;
+  } while (!top_.compare_exchange_weak(old_top, old_top + size,
+                                       std::memory_order_relaxed));
+  return old_top;
+}
+
+// First-fit na free list: tira até `max_size` bytes (pelo menos
+// `min_size`) do primeiro bloco que couber. O resto do bloco continua na
+// lista, ou vira só espaço morto se ficar pequeno demais.
+u1 *Heap::allocate_free(size_t min_size, size_t max_size, size_t &size) {
+  std::lock_guard<std::mutex> guard(free_lock_);
+  for (size_t i = 0; i < free_list_.size(); i++) {
+    FreeChunk &chunk = free_list_[i];
+    if (chunk.size < min_size)
+      continue;
+
+    size = chunk.size < max_size ? chunk.size : max_size;
+    u1 *result = chunk.start;
+    chunk.start += size;
+    chunk.size -= size;
+    fill(chunk.start, chunk.size);
+    if (chunk.size < MIN_FREE_CHUNK)
+      free_list_.erase(free_list_.begin() + i);
+
+    // Memória reaproveitada ainda tem os objetos mortos
+    std::memset(result, 0, size);
+    return result;
+  }
+  return nullptr;
+}
+
+void *Heap::allocate_old(size_t size) {
+  void *result = allocate_shared(size);
+  if (!result) {
+    size_t taken;
+    result = allocate_free(size, size, taken);
+  }
+  if (result)
+    record_block(static_cast<u1 *>(result), size);
+  return result;
+}
+
+// No modo geracional os TLABs saem só do eden
+bool Heap::refill_eden(TLAB &tlab, size_t min_size) {
+  u1 *old_top = eden_top_.load(std::memory_order_relaxed);
+  size_t size;
+  do {
+    size_t left = static_cast<size_t>(eden_end_ - old_top);
+    size = left < TLAB_SIZE ? left : TLAB_SIZE;
+    if (size < min_size)
+      return false;
+  } while (!eden_top_.compare_exchange_weak(old_top, old_top + size,
+                                            std::memory_order_relaxed));
+
+  tlab.start = old_top;
+  tlab.top = old_top;
+  tlab.end = old_top + size;
+  return true;
+}
+
+bool Heap::refill(TLAB &tlab, size_t min_size) {
+  retire(tlab);
+  if (generational())
+    return refill_eden(tlab, min_size);
+
+  size_t size = TLAB_SIZE;
+  u1 *chunk = static_cast<u1 *>(allocate_shared(TLAB_SIZE));
+  if (!chunk)
+    chunk = allocate_free(min_size, TLAB_SIZE, size);
+  if (!chunk)
+    return false;
+
+  tlab.start = chunk;
+  tlab.top = chunk;
+  tlab.end = chunk + size;
+  return true;
+}
+
+void *Heap::try_allocate(TLAB &tlab, size_t size) {
+  void *result = tlab.allocate(size);
+  if (result)
+    return result;
+
+  // Objetos grandes não justificam descartar o resto do TLAB atual, e no
+  // modo geracional nascem direto na geração velha
+  if (size > MAX_YOUNG_OBJECT)
+    return allocate_old(size);
+
+  if (!refill(tlab, size))
+    return nullptr;
+  return tlab.allocate(size);
+}
+
+void *Heap::allocate(TLAB &tlab, size_t size) {
+  void *result = tlab.allocate(size);
+  if (result)
+    return result;
+
+  // Caminho lento: ponto seguro para o coletor concorrente mudar de fase
+  if (collector_)
+    collector_->poll();
+  result = try_allocate(tlab, size);
+  if (!result && collector_) {
+    collector_->collect();
+    result = try_allocate(tlab, size);
+  }
+  if (!result && collector_) {
+    collector_->collect_full();
+    result = try_allocate(tlab, size);
+  }
+
+  if (!result)
+    throw std::runtime_error("OutOfMemoryError: Java heap space");
+  return result;
+}
+
+void *Heap::allocate_tenured(size_t size) {
+  if (collector_)
+    collector_->poll();
+  void *result = allocate_old(size);
+  if (!result && collector_) {
+    collector_->collect_full();
+    result = allocate_old(size);
+  }
+
+  if (!result)
+    throw std::runtime_error("OutOfMemoryError: Java heap space");
+  return result;
+}
+
+std::atomic<bool> SatbQueue::active(false);
+std::mutex SatbQueue::lock_;
+std::vector<const void *> SatbQueue::completed_;
+
+// Tamanho do buffer local antes de entregar
+static const size_t SATB_BUFFER_SIZE = 256;
+
+static thread_local std::vector<const void *> satb_buffer;
+
+void SatbQueue::enqueue(const void *ref) {
+  if (!ref)
+    return;
+  satb_buffer.push_back(ref);
+  if (satb_buffer.size() >= SATB_BUFFER_SIZE)
+    flush();
+}
+
+void SatbQueue::flush() {
+  if (satb_buffer.empty())
+    return;
+  std::lock_guard<std::mutex> guard(lock_);
+  completed_.insert(completed_.end(), satb_buffer.begin(), satb_buffer.end());
+  satb_buffer.clear();
+}
+
+void SatbQueue::take(std::vector<const void *> &out) {
+  std::lock_guard<std::mutex> guard(lock_);
+  out.insert(out.end(), completed_.begin(), completed_.end());
+  completed_.clear();
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "../classfile/classfile_types.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class GarbageCollector;
+
+// Tamanhos padrão do heap gerenciado
+static const size_t DEFAULT_HEAP_SIZE = 256u * 1024 * 1024;
+static const size_t TLAB_SIZE = 256u * 1024;
+// Objetos maiores nascem direto na geração velha
+static const size_t MAX_YOUNG_OBJECT = TLAB_SIZE / 4;
+
+// Geração jovem no modo geracional: eden mais dois survivors de 1/8 cada.
+// Tamanho 0 desliga o modo geracional e o heap vira um espaço só.
+static const size_t DEFAULT_YOUNG_SIZE = 32u * 1024 * 1024;
+
+// Coletas jovens que um objeto sobrevive antes de ser promovido
+static const unsigned TENURING_THRESHOLD = 7;
+
+// Card table: um byte por card de 512 bytes do heap
+static const unsigned CARD_SHIFT = 9;
+static const size_t CARD_SIZE = size_t(1) << CARD_SHIFT;
+static const u1 CLEAN_CARD = 0;
+static const u1 DIRTY_CARD = 1;
+
+// Todo bloco alocado no heap é múltiplo de 8 bytes e alinhado a 8
+static const size_t HEAP_ALIGNMENT = 8;
+
+// Blocos livres menores que isso não entram na free list; continuam
+// preenchidos como espaço morto até se juntarem a vizinhos num sweep
+static const size_t MIN_FREE_CHUNK = 256;
+
+inline size_t heap_align(size_t size) {
+  return (size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1);
+}
+
+// Cabeçalho de espaço morto. Tem o formato do cabeçalho de RuntimeObject
+// (ponteiro de classe, depois uma palavra) para que o heap possa ser
+// percorrido bloco a bloco: a "classe" é FREE_BLOCK e a palavra é o tamanho.
+// Buracos menores que o cabeçalho ficam com palavras zeradas, e cada palavra
+// zero conta como um bloco de 8 bytes.
+struct FreeBlockHeader {
+  const void *klass;
+  uintptr_t size;
+};
+
+static const void *const FREE_BLOCK = reinterpret_cast<const void *>(1);
+
+// Buffer de alocação local de uma thread (TLAB): um pedaço do heap que só a
+// thread dona usa, então alocar é só avançar `top`, sem sincronização
+struct TLAB {
+  u1 *start;
+  u1 *top;
+  u1 *end;
+
+  TLAB() : start(nullptr), top(nullptr), end(nullptr) {}
+
+  void *allocate(size_t size) {
+    if (static_cast<size_t>(end - top) < size)
+      return nullptr;
+    u1 *result = top;
+    top += size;
+    return result;
+  }
+};
+
+// Espaço contíguo com alocação por bump, usado pelos survivors
+struct Space {
+  u1 *start;
+  u1 *top;
+  u1 *end;
+
+  bool contains(const void *p) const { return p >= start && p < end; }
+  size_t used() const { return static_cast<size_t>(top - start); }
+};
+
+// Heap gerenciado: uma única faixa de memória virtual reservada no início.
+//
+// No modo geracional o começo da faixa é a geração jovem
+// [eden | survivor | survivor] e o resto é a geração velha. TLABs saem do
+// eden; objetos grandes e promovidos vão para a velha. No modo de espaço
+// único tudo é geração velha.
+//
+// Na geração velha as threads pegam TLABs da região compartilhada com uma
+// operação atômica e, depois de uma coleta completa, os blocos livres do
+// sweep são reaproveitados antes de avançar o topo. Ela também guarda um
+// bitmap com o início dos blocos, para que uma coleta jovem ache os objetos
+// de um card sujo sem percorrer a geração inteira.
+class Heap {
+public:
+  explicit Heap(size_t capacity = DEFAULT_HEAP_SIZE,
+                size_t young_size = DEFAULT_YOUNG_SIZE);
+  ~Heap();
+
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  // `size` já alinhado com heap_align. Memória devolvida zerada. Sem espaço,
+  // roda o coletor, depois uma coleta completa, antes de lançar
+  // OutOfMemoryError.
+  void *allocate(TLAB &tlab, size_t size);
+
+  void set_collector(GarbageCollector *collector) { collector_ = collector; }
+
+  bool generational() const { return young_end_ > base_; }
+
+  u1 *base() const { return base_; }
+  size_t capacity() const { return static_cast<size_t>(end_ - base_); }
+  bool contains(const void *p) const {
+    return p >= base_ && p < end_;
+  }
+
+  // Geração jovem
+  bool in_young(const void *p) const {
+    return p >= base_ && p < young_end_;
+  }
+  u1 *eden_start() const { return base_; }
+  u1 *eden_top() const { return eden_top_.load(); }
+  size_t young_used() const {
+    return static_cast<size_t>(eden_top_.load() - base_) + from_.used();
+  }
+  Space &from_space() { return from_; }
+  Space &to_space() { return to_; }
+  // Fim de uma coleta jovem: o eden volta a ficar vazio e zerado e os
+  // survivors trocam de papel
+  void reset_young();
+
+  // Geração velha
+  u1 *old_base() const { return young_end_; }
+  u1 *top() const { return top_.load(); }
+  size_t used() const { return static_cast<size_t>(top_.load() - young_end_); }
+  size_t old_free();
+  // Parte de old_free() que a promoção de objetos de até `max_size` bytes
+  // certamente aproveita: no fim de cada bloco livre e da região de bump o
+  // first-fit pode deixar sobrar até um objeto
+  size_t promotion_space(size_t max_size);
+  // Usado para promover objetos numa coleta jovem; nunca chama o coletor
+  void *allocate_old(size_t size);
+  // Objeto que nasce já na geração velha, que nunca move objetos. Sem
+  // espaço, roda uma coleta completa antes de lançar OutOfMemoryError.
+  void *allocate_tenured(size_t size);
+
+  // Formata [start, start + size) como espaço morto percorrível
+  void fill(u1 *start, size_t size);
+  // Tamanho do bloco de espaço morto em `p`, ou 0 se `p` é um objeto
+  static size_t free_block_size(const u1 *p);
+
+  // Devolve o resto do TLAB ao heap como espaço morto
+  void retire(TLAB &tlab);
+
+  // Chamados pelo sweep: a free list é refeita a cada coleta
+  void clear_free_list();
+  void add_free_chunk(u1 *start, size_t size);
+  // Falha se alguém alocou acima de `expected` nesse meio tempo
+  bool shrink_top(u1 *expected, u1 *new_top) {
+    return top_.compare_exchange_strong(expected, new_top);
+  }
+
+  // Bloco novo na geração velha: marca o início e apaga inícios antigos
+  // que caíram dentro dele. Atômico, porque um sweep concorrente e o
+  // mutador podem escrever na mesma palavra do bitmap.
+  void record_block(const u1 *p, size_t size);
+  // Último início de bloco em ou antes de `p`
+  u1 *block_start(const u1 *p) const;
+
+  // Referências comprimidas: uma referência é o deslocamento de 32 bits a
+  // partir de narrow_base, deslocado por narrow_shift. narrow_base fica um
+  // grão abaixo do heap para que 0 continue sendo null. Com heap de até
+  // 4 GiB o shift é 0; acima disso é 3 (objetos alinhados a 8), até 32 GiB.
+  static uintptr_t narrow_base;
+  static unsigned narrow_shift;
+
+  // Card table, indexada por endereço >> CARD_SHIFT já descontada a base,
+  // para a barreira de escrita ser um shift e um store
+  static u1 *card_base;
+  u1 *card_for(const void *p) const {
+    return card_base + (reinterpret_cast<uintptr_t>(p) >> CARD_SHIFT);
+  }
+  // Endereço coberto pelo card
+  u1 *card_address(const u1 *card) const {
+    return reinterpret_cast<u1 *>(static_cast<uintptr_t>(card - card_base)
+                                  << CARD_SHIFT);
+  }
+
+private:
+  struct FreeChunk {
+    u1 *start;
+    size_t size;
+  };
+
+  u1 *base_;
+  u1 *end_;
+  u1 *young_end_;              // fim da geração jovem, início da velha
+  u1 *eden_end_;
+  std::atomic<u1 *> eden_top_;
+  Space from_;
+  Space to_;
+  std::atomic<u1 *> top_; // início da região velha ainda não entregue
+
+  std::vector<u1> cards_;
+  // Um bit por palavra da geração velha
+  std::unique_ptr<std::atomic<u8>[]> starts_;
+
+  std::mutex free_lock_;
+  std::vector<FreeChunk> free_list_;
+
+  GarbageCollector *collector_;
+
+  void *try_allocate(TLAB &tlab, size_t size);
+  bool refill(TLAB &tlab, size_t min_size);
+  bool refill_eden(TLAB &tlab, size_t min_size);
+  void *allocate_shared(size_t size);
+  u1 *allocate_free(size_t min_size, size_t max_size, size_t &size);
+};
+
+// Fila SATB (snapshot-at-the-beginning) da marcação concorrente. Enquanto
+// `active`, toda referência prestes a ser sobrescrita vai para a fila, e
+// assim tudo que era alcançável no início da marcação acaba marcado. Cada
+// thread junta as referências num buffer local e entrega em blocos.
+class SatbQueue {
+public:
+  static std::atomic<bool> active;
+
+  static void enqueue(const void *ref);
+  // Entrega o buffer da thread corrente
+  static void flush();
+  // Tira tudo que já foi entregue
+  static void take(std::vector<const void *> &out);
+
+private:
+  static std::mutex lock_;
+  static std::vector<const void *> completed_;
+};
+
+// Barreira de escrita: toda escrita de referência dentro de um objeto do
+// heap (putfield, aastore) suja o card do endereço escrito. A coleta jovem
+// só procura ponteiros velho -> jovem nos cards sujos. putstatic não
+// precisa dela: os estáticos ficam fora do heap e são sempre raízes.
+inline void write_barrier(const void *field) {
+  Heap::card_base[reinterpret_cast<uintptr_t>(field) >> CARD_SHIFT] =
+      DIRTY_CARD;
+}
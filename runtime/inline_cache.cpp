@@ -0,0 +1,82 @@
+#include "../classfile/bytecode.h"
+#include "./runtime_class_types.h"
+
+#include <ostream>
+#include <vector>
+
+RuntimeMethod *InlineCache::miss(RuntimeClass *receiver,
+                                 RuntimeMethod *resolved) {
+  misses++;
+
+  RuntimeMethod *target = is_interface
+                              ? receiver->dispatch_interface(resolved)
+                              : receiver->dispatch_virtual(resolved);
+
+  if (state == InlineCacheState::Megamorphic)
+    return target;
+
+  if (count == INLINE_CACHE_SIZE) {
+    state = InlineCacheState::Megamorphic;
+    return target;
+  }
+
+  receivers[count] = receiver;
+  targets[count] = target;
+  count++;
+  state = count == 1 ? InlineCacheState::Monomorphic
+                     : InlineCacheState::Polymorphic;
+
+  return target;
+}
+
+void RuntimeMethod::build_inline_caches() {
+  inline_caches.clear();
+  inline_cache_table.clear();
+  if (!code)
+    return;
+
+  for (u4 pc = 0; pc < code->code_length;
+       pc += instruction_length(code->code, pc)) {
+    u1 op = code->code[pc];
+    if (op == OP_invokevirtual || op == OP_invokeinterface)
+      inline_caches.emplace_back(pc, op == OP_invokeinterface);
+  }
+
+  // Só depois de preencher o vetor: os ponteiros ficam estáveis
+  if (inline_caches.empty())
+    return;
+  inline_cache_table.assign(code->code_length, nullptr);
+  for (auto &ic : inline_caches)
+    inline_cache_table[ic.pc] = &ic;
+}
+
+static const char *state_name(InlineCacheState state) {
+  switch (state) {
+  case InlineCacheState::Uninitialized:
+    return "uninitialized";
+  case InlineCacheState::Monomorphic:
+    return "monomorphic";
+  case InlineCacheState::Polymorphic:
+    return "polymorphic";
+  case InlineCacheState::Megamorphic:
+    return "megamorphic";
+  }
+  return "?";
+}
+
+void MethodArea::printCallSiteProfile(std::ostream &out) const {
+  for (const auto &klass : classes) {
+    for (const auto &pair : klass.second->methods) {
+      const RuntimeMethod &m = pair.second;
+      for (const auto &ic : m.inline_caches) {
+        out << klass.first << "." << m.name << m.descriptor << " @" << ic.pc
+            << (ic.is_interface ? " invokeinterface " : " invokevirtual ")
+            << state_name(ic.state) << " hits=" << ic.hits
+            << " misses=" << ic.misses;
+        for (u1 i = 0; i < ic.count; i++)
+          out << (i == 0 ? " [" : ", ") << ic.receivers[i]->name;
+        out << (ic.count ? "]" : "") << "\n";
+      }
+    }
+  }
+}
@@ -0,0 +1,1211 @@
+#include "../classfile/bytecode.h"
+#include "./call_site.h"
+#include "./java_string.h"
+#include "./jit.h"
+#include "./tiering.h"
+#include "./native.h"
+#include "./runtime_class_types.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+int16_t read_s2(const std::vector<u1> &code, u4 pc) {
+  return static_cast<int16_t>(read_code_u2(code, pc));
+}
+
+int32_t read_s4(const std::vector<u1> &code, u4 pc) {
+  return static_cast<int32_t>(read_code_u4(code, pc));
+}
+
+Slot pop_slot(OperandStack &stack) {
+  if (stack.stack.empty())
+    throw std::runtime_error("Operand stack underflow");
+  Slot v = stack.stack.back();
+  stack.stack.pop_back();
+  return v;
+}
+
+// f2i, f2l, d2i, d2l: NaN vira 0 e valores fora do intervalo saturam
+template <typename I, typename F> I java_convert(F value) {
+  if (std::isnan(value))
+    return 0;
+  if (value >= static_cast<F>(std::numeric_limits<I>::max()))
+    return std::numeric_limits<I>::max();
+  if (value <= static_cast<F>(std::numeric_limits<I>::min()))
+    return std::numeric_limits<I>::min();
+  return static_cast<I>(value);
+}
+
+// fcmpl/fcmpg, dcmpl/dcmpg: `nan` é o resultado com algum NaN
+template <typename F> int32_t java_compare(F a, F b, int32_t nan) {
+  if (std::isnan(a) || std::isnan(b))
+    return nan;
+  return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+void check_null(const RuntimeObject *obj, const char *what) {
+  if (!obj)
+    throw std::runtime_error(std::string("NullPointerException: ") + what);
+}
+
+// Valor de um field em `address`, de instância ou estático, para a pilha
+void push_value(OperandStack &stack, const u1 *address, char type) {
+  switch (type) {
+  case 'B': {
+    int8_t v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.push_int(v);
+    break;
+  }
+  case 'Z': {
+    u1 v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.push_int(v);
+    break;
+  }
+  case 'C': {
+    u2 v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.push_int(v);
+    break;
+  }
+  case 'S': {
+    int16_t v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.push_int(v);
+    break;
+  }
+  case 'I':
+  case 'F': {
+    u4 v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.stack.push_back(v);
+    break;
+  }
+  case 'J':
+  case 'D': {
+    u8 v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.push_long(static_cast<int64_t>(v));
+    break;
+  }
+  default: { // L, [: a referência comprimida é o próprio slot
+    NarrowRef v;
+    std::memcpy(&v, address, sizeof(v));
+    stack.stack.push_back(v);
+  }
+  }
+}
+
+// Topo da pilha para um field primitivo em `address`, truncado ao tamanho
+// do field
+void pop_primitive(OperandStack &stack, u1 *address, char type) {
+  switch (type) {
+  case 'J':
+  case 'D': {
+    u8 v = static_cast<u8>(stack.pop_long());
+    std::memcpy(address, &v, sizeof(v));
+    break;
+  }
+  case 'B':
+  case 'Z': {
+    u1 v = static_cast<u1>(stack.pop_int());
+    if (type == 'Z')
+      v &= 1;
+    std::memcpy(address, &v, sizeof(v));
+    break;
+  }
+  case 'C':
+  case 'S': {
+    u2 v = static_cast<u2>(stack.pop_int());
+    std::memcpy(address, &v, sizeof(v));
+    break;
+  }
+  default: {
+    u4 v = static_cast<u4>(pop_slot(stack));
+    std::memcpy(address, &v, sizeof(v));
+  }
+  }
+}
+
+RuntimeObject *pop_array(OperandStack &stack, int32_t &index) {
+  index = stack.pop_int();
+  RuntimeObject *array = stack.pop_ref();
+  check_null(array, "array is null");
+  array->check_index(index);
+  return array;
+}
+
+// Classe de array cujo elemento é `component` (anewarray)
+std::string array_name_of(const RuntimeClass *component) {
+  if (component->is_array())
+    return "[" + component->name;
+  return "[L" + component->name + ";";
+}
+
+// Exceções que o runtime lança como std::runtime_error, com o nome simples
+// da classe no começo da mensagem, e que um handler Java pode capturar
+const char *const IMPLICIT_EXCEPTIONS[] = {
+    "ArithmeticException",        "ArrayIndexOutOfBoundsException",
+    "ArrayStoreException",        "ClassCastException",
+    "NegativeArraySizeException", "NullPointerException",
+};
+
+// Classe de uma exceção implícita pela mensagem, e o resto da mensagem em
+// `detail`; "" para os outros erros do runtime
+std::string implicit_exception_class(const std::string &message,
+                                     std::string &detail) {
+  size_t colon = message.find(": ");
+  std::string name = message.substr(0, colon);
+  for (const char *implicit : IMPLICIT_EXCEPTIONS)
+    if (name == implicit) {
+      detail = colon == std::string::npos ? "" : message.substr(colon + 2);
+      return "java/lang/" + name;
+    }
+  return "";
+}
+
+// Objeto de uma exceção implícita. Não roda construtor: a mensagem vai
+// direto para o detailMessage de Throwable, se a classe o tem.
+RuntimeObject *new_exception(Thread *thread, RuntimeClass *klass,
+                             const std::string &detail) {
+  static const MemberKey detail_message =
+      MemberKey::of("detailMessage", "Ljava/lang/String;");
+  RuntimeField *field = klass->find_field(detail_message);
+  if (!field)
+    return RuntimeObject::allocate(thread, klass);
+  Handle message(thread,
+                 new_string(thread, decode_modified_utf8(detail)));
+  RuntimeObject *obj = RuntimeObject::allocate(thread, klass);
+  obj->write_ref(*field, message.get());
+  return obj;
+}
+
+} // namespace
+
+void Interpreter::invoke(RuntimeMethod *method, OperandStack &caller) {
+  if (method->conflicting_defaults)
+    throw std::runtime_error("IncompatibleClassChangeError: conflicting "
+                             "default methods for " + method->owner->name +
+                             "." + method->name + method->descriptor);
+  if (method->is_abstract())
+    throw std::runtime_error("AbstractMethodError: " + method->owner->name +
+                             "." + method->name + method->descriptor);
+
+  const MethodSignature &sig = method->signature();
+  u2 receiver = method->is_static() ? 0 : 1;
+  size_t stack_slots = receiver + sig.arg_stack_slots;
+  if (caller.stack.size() < stack_slots)
+    throw std::runtime_error("Operand stack underflow");
+
+  Frame frame(method, method->owner);
+  frame.init(receiver + sig.arg_locals, 0);
+
+  // Argumentos viram as primeiras variáveis locais; long/double ocupam dois
+  // índices, mas só um slot físico da pilha com slots largos
+  size_t s = caller.stack.size() - stack_slots;
+  u2 l = 0;
+  if (receiver)
+    frame.local_vars[l++] = caller.stack[s++];
+  for (char type : sig.args) {
+    if (type == 'J' || type == 'D') {
+      for (u2 i = 0; i < CATEGORY2_STACK_SLOTS; i++)
+        frame.local_vars[l + i] = caller.stack[s++];
+      l += 2;
+    } else {
+      frame.local_vars[l++] = caller.stack[s++];
+    }
+  }
+  caller.stack.resize(caller.stack.size() - stack_slots);
+  call(frame, caller);
+}
+
+void Interpreter::call(Frame &frame, OperandStack &result) {
+  RuntimeMethod *method = frame.method;
+  if (!method->code) {
+    invoke_native(thread, method, frame, result);
+    return;
+  }
+  if (method->native) {
+    method->native(thread, frame, result);
+    return;
+  }
+
+  // Frames montados fora de invoke podem vir sem o espaço do bytecode
+  if (frame.local_vars.size() < method->code->max_locals)
+    frame.local_vars.resize(method->code->max_locals);
+  frame.operand_stack.stack.reserve(method->code->max_stack);
+
+  struct CallStackEntry {
+    Thread *thread;
+    ~CallStackEntry() { thread->call_stack.pop_back(); }
+  };
+  thread->call_stack.push_back(&frame);
+  CallStackEntry entry{thread};
+
+  thread->runtime->tiering->on_invocation(method);
+  // Cópia: uma desotimização pode trocar method->compiled no meio da
+  // execução
+  if (std::shared_ptr<CompiledMethod> compiled = method->compiled)
+    thread->runtime->jit->run(*compiled, frame);
+  else
+    execute(frame);
+
+  for (Slot slot : frame.operand_stack.stack)
+    result.stack.push_back(slot);
+}
+
+void Interpreter::execute(Frame &frame) {
+  for (;;) {
+    try {
+      while (step(frame)) {
+      }
+      return;
+    } catch (...) {
+      if (!dispatch_exception(frame, std::current_exception()))
+        throw;
+    }
+  }
+}
+
+bool Interpreter::dispatch_exception(Frame &frame,
+                                     std::exception_ptr exception) {
+  RuntimeMethod *method = frame.method;
+  Runtime *runtime = thread->runtime;
+  u4 pc = frame.pc;
+  if (!method->code || !method->in_try_block(pc))
+    return false;
+
+  // Classe da exceção: a do objeto lançado por athrow, ou a de uma
+  // implícita, que só ganha objeto se algum handler a captura. Sem a
+  // classe no classpath do runtime, a implícita continua fatal.
+  RuntimeClass *thrown = nullptr;
+  bool implicit = false;
+  std::string detail;
+  try {
+    std::rethrow_exception(exception);
+  } catch (const JavaException &) {
+    thrown = decode_ref(thread->exception)->klass;
+  } catch (const std::runtime_error &error) {
+    std::string name = implicit_exception_class(error.what(), detail);
+    if (name.empty())
+      return false;
+    try {
+      thrown = runtime->find_or_load_class(name);
+    } catch (const std::runtime_error &) {
+      return false;
+    }
+    implicit = true;
+  } catch (...) {
+    return false;
+  }
+
+  // Primeiro handler que cobre o pc e aceita a classe, na ordem da tabela;
+  // catch_type 0 (finally) aceita qualquer uma
+  for (const ExceptionTableEntry &handler : method->code->exception_table) {
+    if (pc < handler.start_pc || pc >= handler.end_pc)
+      continue;
+    if (handler.catch_type != 0 &&
+        !thrown->is_assignable_to(
+            runtime->resolve_class(method->owner, handler.catch_type)))
+      continue;
+
+    // A pilha que a instrução deixou não vale mais; vazia, ela não engana
+    // o GC de uma alocação da exceção implícita
+    frame.operand_stack.stack.clear();
+    RuntimeObject *obj = implicit ? new_exception(thread, thrown, detail)
+                                  : decode_ref(thread->exception);
+    thread->exception = 0;
+    frame.operand_stack.push_ref(obj);
+    frame.pc = handler.handler_pc;
+    return true;
+  }
+  return false;
+}
+
+bool Interpreter::step(Frame &frame) {
+  RuntimeMethod *method = frame.method;
+  RuntimeClass *klass = method->owner;
+  Runtime *runtime = thread->runtime;
+  const std::vector<u1> &code = method->code->code;
+  std::vector<Slot> &locals = frame.local_vars;
+  OperandStack &stack = frame.operand_stack;
+
+  // frame.pc fica na instrução até o fim dela: o GC lê o mapa de
+  // referências desse pc se a instrução alocar ou chamar outro método
+  u4 pc = frame.pc;
+  u1 op = code[pc];
+  // Desvio relativo à instrução corrente. Para trás, conta uma volta do
+  // laço; se o método já foi compilado (por este laço ou por outra
+  // chamada), o resto da execução do frame vai para o código compilado,
+  // entrando pelo cabeçalho do laço (OSR).
+  auto branch = [&](int32_t offset) {
+    frame.pc = static_cast<u4>(pc + offset);
+    if (offset > 0)
+      return true;
+    runtime->tiering->on_backedge(method, frame.pc);
+    std::shared_ptr<CompiledMethod> compiled = method->compiled;
+    if (!compiled || !compiled->entry_at(frame.pc))
+      return true;
+    runtime->jit->run(*compiled, frame);
+    return false;
+  };
+
+  switch (op) {
+  case OP_nop:
+    break;
+
+  // Constantes
+  case OP_aconst_null:
+    stack.push_ref(nullptr);
+    break;
+  case OP_iconst_m1:
+  case OP_iconst_0:
+  case OP_iconst_1:
+  case OP_iconst_2:
+  case OP_iconst_3:
+  case OP_iconst_4:
+  case OP_iconst_5:
+    stack.push_int(op - OP_iconst_0);
+    break;
+  case OP_lconst_0:
+  case OP_lconst_1:
+    stack.push_long(op - OP_lconst_0);
+    break;
+  case OP_fconst_0:
+  case OP_fconst_1:
+  case OP_fconst_2:
+    stack.push_float(static_cast<float>(op - OP_fconst_0));
+    break;
+  case OP_dconst_0:
+  case OP_dconst_1:
+    stack.push_double(op - OP_dconst_0);
+    break;
+  case OP_bipush:
+    stack.push_int(static_cast<int8_t>(code[pc + 1]));
+    break;
+  case OP_sipush:
+    stack.push_int(read_s2(code, pc + 1));
+    break;
+  case OP_ldc:
+  case OP_ldc_w:
+  case OP_ldc2_w: {
+    u2 index = op == OP_ldc ? code[pc + 1] : read_code_u2(code, pc + 1);
+    const ConstantPoolEntry &entry = klass->class_file->constant_pool[index];
+    const ConstantInfo &info = entry.second;
+    switch (entry.first) {
+    case ConstantTag::CONSTANT_Integer:
+    case ConstantTag::CONSTANT_Float:
+      stack.stack.push_back(info.integer_info.bytes);
+      break;
+    case ConstantTag::CONSTANT_Long:
+    case ConstantTag::CONSTANT_Double:
+      stack.push_long(static_cast<int64_t>(
+          (static_cast<u8>(info.long_info.high_bytes) << 32) |
+          info.long_info.low_bytes));
+      break;
+    case ConstantTag::CONSTANT_String:
+      stack.push_ref(runtime->resolve_string(klass, index));
+      break;
+    case ConstantTag::CONSTANT_Class:
+      stack.push_ref(
+          runtime->class_mirror(runtime->resolve_class(klass, index)));
+      break;
+    default:
+      throw std::runtime_error("ldc of constant #" + std::to_string(index) +
+                               " is not supported");
+    }
+    break;
+  }
+
+  // Variáveis locais
+  case OP_iload:
+  case OP_fload:
+  case OP_aload:
+    stack.stack.push_back(locals[code[pc + 1]]);
+    break;
+  case OP_lload:
+  case OP_dload:
+    stack.push_long(frame.load_long(code[pc + 1]));
+    break;
+  case OP_iload_0:
+  case OP_iload_1:
+  case OP_iload_2:
+  case OP_iload_3:
+    stack.stack.push_back(locals[op - OP_iload_0]);
+    break;
+  case OP_lload_0:
+  case OP_lload_1:
+  case OP_lload_2:
+  case OP_lload_3:
+    stack.push_long(frame.load_long(op - OP_lload_0));
+    break;
+  case OP_fload_0:
+  case OP_fload_1:
+  case OP_fload_2:
+  case OP_fload_3:
+    stack.stack.push_back(locals[op - OP_fload_0]);
+    break;
+  case OP_dload_0:
+  case OP_dload_1:
+  case OP_dload_2:
+  case OP_dload_3:
+    stack.push_long(frame.load_long(op - OP_dload_0));
+    break;
+  case OP_aload_0:
+  case OP_aload_1:
+  case OP_aload_2:
+  case OP_aload_3:
+    stack.stack.push_back(locals[op - OP_aload_0]);
+    break;
+  case OP_istore:
+  case OP_fstore:
+  case OP_astore:
+    locals[code[pc + 1]] = pop_slot(stack);
+    break;
+  case OP_lstore:
+  case OP_dstore:
+    frame.store_long(code[pc + 1], stack.pop_long());
+    break;
+  case OP_istore_0:
+  case OP_istore_1:
+  case OP_istore_2:
+  case OP_istore_3:
+    locals[op - OP_istore_0] = pop_slot(stack);
+    break;
+  case OP_lstore_0:
+  case OP_lstore_1:
+  case OP_lstore_2:
+  case OP_lstore_3:
+    frame.store_long(op - OP_lstore_0, stack.pop_long());
+    break;
+  case OP_fstore_0:
+  case OP_fstore_1:
+  case OP_fstore_2:
+  case OP_fstore_3:
+    locals[op - OP_fstore_0] = pop_slot(stack);
+    break;
+  case OP_dstore_0:
+  case OP_dstore_1:
+  case OP_dstore_2:
+  case OP_dstore_3:
+    frame.store_long(op - OP_dstore_0, stack.pop_long());
+    break;
+  case OP_astore_0:
+  case OP_astore_1:
+  case OP_astore_2:
+  case OP_astore_3:
+    locals[op - OP_astore_0] = pop_slot(stack);
+    break;
+  case OP_iinc:
+    locals[code[pc + 1]] = static_cast<u4>(
+        static_cast<u4>(locals[code[pc + 1]]) +
+        static_cast<u4>(static_cast<int8_t>(code[pc + 2])));
+    break;
+  case OP_wide: {
+    u1 wide_op = code[pc + 1];
+    u2 index = read_code_u2(code, pc + 2);
+    switch (wide_op) {
+    case OP_iload:
+    case OP_fload:
+    case OP_aload:
+      stack.stack.push_back(locals[index]);
+      break;
+    case OP_lload:
+    case OP_dload:
+      stack.push_long(frame.load_long(index));
+      break;
+    case OP_istore:
+    case OP_fstore:
+    case OP_astore:
+      locals[index] = pop_slot(stack);
+      break;
+    case OP_lstore:
+    case OP_dstore:
+      frame.store_long(index, stack.pop_long());
+      break;
+    case OP_iinc:
+      locals[index] = static_cast<u4>(
+          static_cast<u4>(locals[index]) +
+          static_cast<u4>(static_cast<int32_t>(read_s2(code, pc + 4))));
+      break;
+    case OP_ret:
+      frame.pc = static_cast<u4>(locals[index]);
+      return true;
+    default:
+      throw std::runtime_error("VerifyError: invalid wide opcode " +
+                               std::to_string(wide_op));
+    }
+    break;
+  }
+
+  // Arrays
+  case OP_iaload:
+  case OP_faload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.stack.push_back(array->array_get<u4>(index));
+    break;
+  }
+  case OP_laload:
+  case OP_daload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.push_long(static_cast<int64_t>(array->array_get<u8>(index)));
+    break;
+  }
+  case OP_aaload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.push_ref(array->array_load_ref(index));
+    break;
+  }
+  case OP_baload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.push_int(static_cast<int8_t>(array->array_get<u1>(index)));
+    break;
+  }
+  case OP_caload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.push_int(array->array_get<u2>(index));
+    break;
+  }
+  case OP_saload: {
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    stack.push_int(static_cast<int16_t>(array->array_get<u2>(index)));
+    break;
+  }
+  case OP_iastore:
+  case OP_fastore: {
+    u4 value = static_cast<u4>(pop_slot(stack));
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    array->array_set<u4>(index, value);
+    break;
+  }
+  case OP_lastore:
+  case OP_dastore: {
+    u8 value = static_cast<u8>(stack.pop_long());
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    array->array_set<u8>(index, value);
+    break;
+  }
+  case OP_aastore: {
+    RuntimeObject *value = stack.pop_ref();
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    array->check_store(value);
+    array->array_store_ref(index, value);
+    break;
+  }
+  case OP_bastore: {
+    u1 value = static_cast<u1>(stack.pop_int());
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    if (array->klass->element_type == 'Z')
+      value &= 1;
+    array->array_set<u1>(index, value);
+    break;
+  }
+  case OP_castore:
+  case OP_sastore: {
+    u2 value = static_cast<u2>(stack.pop_int());
+    int32_t index;
+    RuntimeObject *array = pop_array(stack, index);
+    array->array_set<u2>(index, value);
+    break;
+  }
+
+  // Pilha. Com slots largos um long/double é um slot físico só, e o mapa
+  // de referências diz quais slots são de categoria 2.
+  case OP_pop:
+    pop_slot(stack);
+    break;
+  case OP_pop2:
+    pop_slot(stack);
+    if (CATEGORY2_STACK_SLOTS == 2 ||
+        !method->reference_map().stack_is_category2(
+            *method->reference_map().at(pc),
+            static_cast<u2>(stack.size())))
+      pop_slot(stack);
+    break;
+  case OP_dup:
+    stack.stack.push_back(stack.stack.back());
+    break;
+  case OP_dup_x1: {
+    Slot a = pop_slot(stack), b = pop_slot(stack);
+    stack.stack.insert(stack.stack.end(), {a, b, a});
+    break;
+  }
+  case OP_swap: {
+    Slot a = pop_slot(stack), b = pop_slot(stack);
+    stack.stack.insert(stack.stack.end(), {a, b});
+    break;
+  }
+  case OP_dup_x2:
+  case OP_dup2:
+  case OP_dup2_x1:
+  case OP_dup2_x2: {
+    // Forma da JVMS em slots físicos: quantos slots o valor do topo (a)
+    // e os que ele atravessa (b, c) ocupam
+    const ReferenceMap &map = method->reference_map();
+    const ReferenceMap::Entry &entry = *map.at(pc);
+    u2 depth = static_cast<u2>(stack.size());
+    auto wide = [&](u2 from_top) {
+      return CATEGORY2_STACK_SLOTS == 1 &&
+             map.stack_is_category2(entry, depth - from_top);
+    };
+    u2 a = 1, crossed = 0;
+    if (op != OP_dup_x2)
+      a = wide(1) ? 1 : 2;
+    if (op == OP_dup2_x1)
+      crossed = 1;
+    else if (op != OP_dup2) // dup_x2, dup2_x2: um long ou dois de 32 bits
+      crossed = wide(a + 1) ? 1 : 2;
+    std::vector<Slot> top(stack.stack.end() - a, stack.stack.end());
+    stack.stack.insert(stack.stack.end() - a - crossed, top.begin(),
+                       top.end());
+    break;
+  }
+
+  // Aritmética de int
+  case OP_iadd: {
+    u4 b = static_cast<u4>(stack.pop_int()), a = stack.pop_int();
+    stack.push_int(static_cast<int32_t>(a + b));
+    break;
+  }
+  case OP_isub: {
+    u4 b = static_cast<u4>(stack.pop_int()), a = stack.pop_int();
+    stack.push_int(static_cast<int32_t>(a - b));
+    break;
+  }
+  case OP_imul: {
+    u4 b = static_cast<u4>(stack.pop_int()), a = stack.pop_int();
+    stack.push_int(static_cast<int32_t>(a * b));
+    break;
+  }
+  case OP_idiv:
+  case OP_irem: {
+    int32_t b = stack.pop_int(), a = stack.pop_int();
+    if (b == 0)
+      throw std::runtime_error("ArithmeticException: / by zero");
+    if (b == -1) // MIN_VALUE / -1 estoura em C++
+      stack.push_int(op == OP_idiv ? static_cast<int32_t>(0u - u4(a)) : 0);
+    else
+      stack.push_int(op == OP_idiv ? a / b : a % b);
+    break;
+  }
+  case OP_ineg:
+    stack.push_int(static_cast<int32_t>(0u - u4(stack.pop_int())));
+    break;
+  case OP_ishl: {
+    int32_t s = stack.pop_int() & 31;
+    stack.push_int(static_cast<int32_t>(u4(stack.pop_int()) << s));
+    break;
+  }
+  case OP_ishr: {
+    int32_t s = stack.pop_int() & 31;
+    stack.push_int(stack.pop_int() >> s);
+    break;
+  }
+  case OP_iushr: {
+    int32_t s = stack.pop_int() & 31;
+    stack.push_int(static_cast<int32_t>(u4(stack.pop_int()) >> s));
+    break;
+  }
+  case OP_iand: {
+    int32_t b = stack.pop_int();
+    stack.push_int(stack.pop_int() & b);
+    break;
+  }
+  case OP_ior: {
+    int32_t b = stack.pop_int();
+    stack.push_int(stack.pop_int() | b);
+    break;
+  }
+  case OP_ixor: {
+    int32_t b = stack.pop_int();
+    stack.push_int(stack.pop_int() ^ b);
+    break;
+  }
+
+  // Aritmética de long
+  case OP_ladd: {
+    u8 b = static_cast<u8>(stack.pop_long()), a = stack.pop_long();
+    stack.push_long(static_cast<int64_t>(a + b));
+    break;
+  }
+  case OP_lsub: {
+    u8 b = static_cast<u8>(stack.pop_long()), a = stack.pop_long();
+    stack.push_long(static_cast<int64_t>(a - b));
+    break;
+  }
+  case OP_lmul: {
+    u8 b = static_cast<u8>(stack.pop_long()), a = stack.pop_long();
+    stack.push_long(static_cast<int64_t>(a * b));
+    break;
+  }
+  case OP_ldiv:
+  case OP_lrem: {
+    int64_t b = stack.pop_long(), a = stack.pop_long();
+    if (b == 0)
+      throw std::runtime_error("ArithmeticException: / by zero");
+    if (b == -1)
+      stack.push_long(op == OP_ldiv ? static_cast<int64_t>(0u - u8(a)) : 0);
+    else
+      stack.push_long(op == OP_ldiv ? a / b : a % b);
+    break;
+  }
+  case OP_lneg:
+    stack.push_long(static_cast<int64_t>(0u - u8(stack.pop_long())));
+    break;
+  case OP_lshl: {
+    int32_t s = stack.pop_int() & 63;
+    stack.push_long(static_cast<int64_t>(u8(stack.pop_long()) << s));
+    break;
+  }
+  case OP_lshr: {
+    int32_t s = stack.pop_int() & 63;
+    stack.push_long(stack.pop_long() >> s);
+    break;
+  }
+  case OP_lushr: {
+    int32_t s = stack.pop_int() & 63;
+    stack.push_long(static_cast<int64_t>(u8(stack.pop_long()) >> s));
+    break;
+  }
+  case OP_land: {
+    int64_t b = stack.pop_long();
+    stack.push_long(stack.pop_long() & b);
+    break;
+  }
+  case OP_lor: {
+    int64_t b = stack.pop_long();
+    stack.push_long(stack.pop_long() | b);
+    break;
+  }
+  case OP_lxor: {
+    int64_t b = stack.pop_long();
+    stack.push_long(stack.pop_long() ^ b);
+    break;
+  }
+
+  // Ponto flutuante
+  case OP_fadd: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_float(a + b);
+    break;
+  }
+  case OP_fsub: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_float(a - b);
+    break;
+  }
+  case OP_fmul: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_float(a * b);
+    break;
+  }
+  case OP_fdiv: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_float(a / b);
+    break;
+  }
+  case OP_frem: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_float(std::fmod(a, b));
+    break;
+  }
+  case OP_fneg:
+    stack.push_float(-stack.pop_float());
+    break;
+  case OP_dadd: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_double(a + b);
+    break;
+  }
+  case OP_dsub: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_double(a - b);
+    break;
+  }
+  case OP_dmul: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_double(a * b);
+    break;
+  }
+  case OP_ddiv: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_double(a / b);
+    break;
+  }
+  case OP_drem: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_double(std::fmod(a, b));
+    break;
+  }
+  case OP_dneg:
+    stack.push_double(-stack.pop_double());
+    break;
+
+  // Conversões
+  case OP_i2l:
+    stack.push_long(stack.pop_int());
+    break;
+  case OP_i2f:
+    stack.push_float(static_cast<float>(stack.pop_int()));
+    break;
+  case OP_i2d:
+    stack.push_double(stack.pop_int());
+    break;
+  case OP_l2i:
+    stack.push_int(static_cast<int32_t>(stack.pop_long()));
+    break;
+  case OP_l2f:
+    stack.push_float(static_cast<float>(stack.pop_long()));
+    break;
+  case OP_l2d:
+    stack.push_double(static_cast<double>(stack.pop_long()));
+    break;
+  case OP_f2i:
+    stack.push_int(java_convert<int32_t>(stack.pop_float()));
+    break;
+  case OP_f2l:
+    stack.push_long(java_convert<int64_t>(stack.pop_float()));
+    break;
+  case OP_f2d:
+    stack.push_double(stack.pop_float());
+    break;
+  case OP_d2i:
+    stack.push_int(java_convert<int32_t>(stack.pop_double()));
+    break;
+  case OP_d2l:
+    stack.push_long(java_convert<int64_t>(stack.pop_double()));
+    break;
+  case OP_d2f:
+    stack.push_float(static_cast<float>(stack.pop_double()));
+    break;
+  case OP_i2b:
+    stack.push_int(static_cast<int8_t>(stack.pop_int()));
+    break;
+  case OP_i2c:
+    stack.push_int(static_cast<u2>(stack.pop_int()));
+    break;
+  case OP_i2s:
+    stack.push_int(static_cast<int16_t>(stack.pop_int()));
+    break;
+
+  // Comparações
+  case OP_lcmp: {
+    int64_t b = stack.pop_long(), a = stack.pop_long();
+    stack.push_int(a > b ? 1 : (a < b ? -1 : 0));
+    break;
+  }
+  case OP_fcmpl:
+  case OP_fcmpg: {
+    float b = stack.pop_float(), a = stack.pop_float();
+    stack.push_int(java_compare(a, b, op == OP_fcmpl ? -1 : 1));
+    break;
+  }
+  case OP_dcmpl:
+  case OP_dcmpg: {
+    double b = stack.pop_double(), a = stack.pop_double();
+    stack.push_int(java_compare(a, b, op == OP_dcmpl ? -1 : 1));
+    break;
+  }
+
+  // Desvios
+  case OP_ifeq:
+  case OP_ifne:
+  case OP_iflt:
+  case OP_ifge:
+  case OP_ifgt:
+  case OP_ifle: {
+    int32_t v = stack.pop_int();
+    bool taken = op == OP_ifeq   ? v == 0
+                 : op == OP_ifne ? v != 0
+                 : op == OP_iflt ? v < 0
+                 : op == OP_ifge ? v >= 0
+                 : op == OP_ifgt ? v > 0
+                                 : v <= 0;
+    if (taken) {
+      return branch(read_s2(code, pc + 1));
+    }
+    break;
+  }
+  case OP_if_icmpeq:
+  case OP_if_icmpne:
+  case OP_if_icmplt:
+  case OP_if_icmpge:
+  case OP_if_icmpgt:
+  case OP_if_icmple: {
+    int32_t b = stack.pop_int(), a = stack.pop_int();
+    bool taken = op == OP_if_icmpeq   ? a == b
+                 : op == OP_if_icmpne ? a != b
+                 : op == OP_if_icmplt ? a < b
+                 : op == OP_if_icmpge ? a >= b
+                 : op == OP_if_icmpgt ? a > b
+                                      : a <= b;
+    if (taken) {
+      return branch(read_s2(code, pc + 1));
+    }
+    break;
+  }
+  case OP_if_acmpeq:
+  case OP_if_acmpne: {
+    Slot b = pop_slot(stack), a = pop_slot(stack);
+    if ((a == b) == (op == OP_if_acmpeq)) {
+      return branch(read_s2(code, pc + 1));
+    }
+    break;
+  }
+  case OP_ifnull:
+  case OP_ifnonnull: {
+    bool null = pop_slot(stack) == 0;
+    if (null == (op == OP_ifnull)) {
+      return branch(read_s2(code, pc + 1));
+    }
+    break;
+  }
+  case OP_goto:
+    return branch(read_s2(code, pc + 1));
+  case OP_goto_w:
+    return branch(read_s4(code, pc + 1));
+  case OP_jsr:
+    stack.push_int(static_cast<int32_t>(pc + 3));
+    return branch(read_s2(code, pc + 1));
+  case OP_jsr_w:
+    stack.push_int(static_cast<int32_t>(pc + 5));
+    return branch(read_s4(code, pc + 1));
+  case OP_ret:
+    frame.pc = static_cast<u4>(locals[code[pc + 1]]);
+    return true;
+  case OP_tableswitch: {
+    u4 base = (pc + 4) & ~3u;
+    int32_t key = stack.pop_int();
+    int32_t low = read_s4(code, base + 4), high = read_s4(code, base + 8);
+    if (key < low || key > high)
+      return branch(read_s4(code, base));
+    return branch(read_s4(code, base + 12 + static_cast<u4>(key - low) * 4));
+  }
+  case OP_lookupswitch: {
+    u4 base = (pc + 4) & ~3u;
+    int32_t key = stack.pop_int();
+    u4 npairs = read_code_u4(code, base + 4);
+    int32_t offset = read_s4(code, base);
+    for (u4 i = 0; i < npairs; i++)
+      if (read_s4(code, base + 8 + i * 8) == key) {
+        offset = read_s4(code, base + 12 + i * 8);
+        break;
+      }
+    return branch(offset);
+  }
+
+  // Retorno: o valor fica sozinho na pilha do frame
+  case OP_ireturn:
+  case OP_freturn:
+  case OP_areturn: {
+    Slot v = pop_slot(stack);
+    stack.stack.assign(1, v);
+    return false;
+  }
+  case OP_lreturn:
+  case OP_dreturn: {
+    int64_t v = stack.pop_long();
+    stack.stack.clear();
+    stack.push_long(v);
+    return false;
+  }
+  case OP_return:
+    stack.stack.clear();
+    return false;
+
+  // Fields
+  case OP_getstatic:
+  case OP_putstatic: {
+    u2 index = read_code_u2(code, pc + 1);
+    RuntimeField *field = runtime->resolve_field(klass, index);
+    u1 *address = runtime->resolve_static_field(klass, index);
+    if (op == OP_getstatic)
+      push_value(stack, address, field->descriptor[0]);
+    else if (field->is_reference())
+      write_static_ref(address, stack.pop_ref());
+    else
+      pop_primitive(stack, address, field->descriptor[0]);
+    break;
+  }
+  case OP_getfield: {
+    RuntimeField *field =
+        runtime->resolve_field(klass, read_code_u2(code, pc + 1));
+    if (field->is_static)
+      throw std::runtime_error("IncompatibleClassChangeError: " +
+                               field->name + " is static");
+    RuntimeObject *obj = stack.pop_ref();
+    check_null(obj, "getfield on null");
+    push_value(stack, obj->data() + field->offset, field->descriptor[0]);
+    break;
+  }
+  case OP_putfield: {
+    RuntimeField *field =
+        runtime->resolve_field(klass, read_code_u2(code, pc + 1));
+    if (field->is_static)
+      throw std::runtime_error("IncompatibleClassChangeError: " +
+                               field->name + " is static");
+    if (field->is_reference()) {
+      RuntimeObject *value = stack.pop_ref();
+      RuntimeObject *obj = stack.pop_ref();
+      check_null(obj, "putfield on null");
+      obj->write_ref(*field, value);
+    } else {
+      // O objeto fica abaixo do valor, de um ou dois slots
+      size_t value_slots = field->size_in_bytes() == 8
+                               ? CATEGORY2_STACK_SLOTS
+                               : 1;
+      if (stack.size() < value_slots + 1)
+        throw std::runtime_error("Operand stack underflow");
+      RuntimeObject *obj =
+          slot_to_ref(stack.stack[stack.size() - value_slots - 1]);
+      check_null(obj, "putfield on null");
+      pop_primitive(stack, obj->data() + field->offset,
+                    field->descriptor[0]);
+      pop_slot(stack);
+    }
+    break;
+  }
+
+  // Chamadas
+  case OP_invokevirtual:
+  case OP_invokeinterface:
+  case OP_invokespecial:
+  case OP_invokestatic: {
+    RuntimeMethod *resolved =
+        runtime->resolve_method(klass, read_code_u2(code, pc + 1));
+    if ((op == OP_invokestatic) != resolved->is_static())
+      throw std::runtime_error("IncompatibleClassChangeError: " +
+                               resolved->owner->name + "." +
+                               resolved->name + " static mismatch");
+
+    RuntimeMethod *target = resolved;
+    if (op == OP_invokestatic) {
+      runtime->initialize_class(resolved->owner);
+    } else {
+      size_t args = resolved->signature().arg_stack_slots;
+      if (stack.size() < args + 1)
+        throw std::runtime_error("Operand stack underflow");
+      RuntimeObject *receiver =
+          slot_to_ref(stack.stack[stack.size() - args - 1]);
+      check_null(receiver, "invoke on null");
+
+      if (op == OP_invokespecial) {
+        // ACC_SUPER: super.m() começa a busca na superclasse da classe
+        // corrente, não na classe do Methodref
+        if (resolved->name[0] != '<' && !resolved->owner->is_interface() &&
+            resolved->owner != klass && klass->super_class &&
+            klass->is_assignable_to(resolved->owner))
+          target = klass->super_class->find_method(resolved->key);
+      } else if (resolved->is_virtual()) {
+        InlineCache *cache = method->inline_cache_at(pc);
+        target = cache ? cache->lookup(receiver->klass, resolved)
+                 : op == OP_invokeinterface
+                     ? receiver->klass->dispatch_interface(resolved)
+                     : receiver->klass->dispatch_virtual(resolved);
+      }
+    }
+    invoke(target, stack);
+    break;
+  }
+  case OP_invokedynamic:
+    runtime->resolve_call_site(method, pc).invoke(thread, stack);
+    break;
+
+  // Objetos
+  case OP_new: {
+    RuntimeClass *target =
+        runtime->resolve_class(klass, read_code_u2(code, pc + 1));
+    if (target->is_interface() ||
+        (target->access_flags & ACC_Abstract_Class))
+      throw std::runtime_error("InstantiationError: " + target->name);
+    runtime->initialize_class(target);
+    stack.push_ref(RuntimeObject::allocate(thread, target));
+    break;
+  }
+  case OP_newarray: {
+    int32_t length = stack.pop_int();
+    stack.push_ref(RuntimeObject::allocate_array(
+        thread, runtime->primitive_array_class(code[pc + 1]), length));
+    break;
+  }
+  case OP_anewarray: {
+    int32_t length = stack.pop_int();
+    RuntimeClass *component =
+        runtime->resolve_class(klass, read_code_u2(code, pc + 1));
+    stack.push_ref(RuntimeObject::allocate_array(
+        thread, runtime->array_class(array_name_of(component)), length));
+    break;
+  }
+  case OP_multianewarray: {
+    RuntimeClass *array_class =
+        runtime->resolve_class(klass, read_code_u2(code, pc + 1));
+    u1 dimensions = code[pc + 3];
+    std::vector<int32_t> counts(dimensions);
+    for (u1 i = dimensions; i-- > 0;)
+      counts[i] = stack.pop_int();
+    stack.push_ref(
+        RuntimeObject::allocate_multi_array(thread, array_class, counts));
+    break;
+  }
+  case OP_arraylength: {
+    RuntimeObject *array = stack.pop_ref();
+    check_null(array, "arraylength of null");
+    stack.push_int(static_cast<int32_t>(array->array_length()));
+    break;
+  }
+  case OP_checkcast: {
+    RuntimeObject *obj = slot_to_ref(stack.stack.back());
+    TieringPolicy::record_type(method, pc, obj ? obj->klass : nullptr);
+    RuntimeClass *target =
+        runtime->resolve_class(klass, read_code_u2(code, pc + 1));
+    if (obj && !obj->klass->is_assignable_to(target))
+      throw std::runtime_error("ClassCastException: " + obj->klass->name +
+                               " cannot be cast to " + target->name);
+    break;
+  }
+  case OP_instanceof: {
+    RuntimeObject *obj = stack.pop_ref();
+    TieringPolicy::record_type(method, pc, obj ? obj->klass : nullptr);
+    RuntimeClass *target =
+        runtime->resolve_class(klass, read_code_u2(code, pc + 1));
+    stack.push_int(obj && obj->klass->is_assignable_to(target) ? 1 : 0);
+    break;
+  }
+  case OP_athrow: {
+    RuntimeObject *obj = stack.pop_ref();
+    check_null(obj, "athrow of null");
+    thread->exception = encode_ref(obj);
+    throw JavaException(obj->klass->name + " thrown in " + klass->name +
+                        "." + method->name);
+  }
+  case OP_monitorenter:
+  case OP_monitorexit:
+    // Uma thread só: basta a checagem de null
+    check_null(stack.pop_ref(), "monitor of null");
+    break;
+
+  default:
+    throw std::runtime_error("VerifyError: invalid opcode " +
+                             std::to_string(op) + " in " + klass->name +
+                             "." + method->name);
+  }
+
+  frame.pc = pc + instruction_length(code, pc);
+  return true;
+}
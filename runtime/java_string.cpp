@@ -0,0 +1,131 @@
+#include "./java_string.h"
+
+#include <stdexcept>
+#include <string>
+
+static RuntimeField &string_field(RuntimeClass *klass, const MemberKey &key) {
+  RuntimeField *field = klass->find_field(key);
+  if (!field)
+    throw std::runtime_error("java/lang/String: missing field " + *key.name +
+                             " " + *key.descriptor +
+                             " (JDK 9+ layout expected)");
+  return *field;
+}
+
+static RuntimeField &value_field(RuntimeClass *klass) {
+  static const MemberKey key = MemberKey::of("value", "[B");
+  return string_field(klass, key);
+}
+
+static RuntimeField &coder_field(RuntimeClass *klass) {
+  static const MemberKey key = MemberKey::of("coder", "B");
+  return string_field(klass, key);
+}
+
+RuntimeField &string_hash_field(RuntimeClass *string_class) {
+  static const MemberKey key = MemberKey::of("hash", "I");
+  return string_field(string_class, key);
+}
+
+StringView string_view(const RuntimeObject *str) {
+  StringView view;
+  view.value = str->read_ref(value_field(str->klass));
+  view.coder = str->read_field<u1>(coder_field(str->klass));
+  view.length = static_cast<int32_t>(view.value->array_length() >>
+                                     (view.coder == CODER_LATIN1 ? 0 : 1));
+  return view;
+}
+
+std::u16string string_chars(const RuntimeObject *str) {
+  StringView view = string_view(str);
+  std::u16string chars(static_cast<size_t>(view.length), u'\0');
+  for (int32_t i = 0; i < view.length; i++)
+    chars[i] = static_cast<char16_t>(view.char_at(i));
+  return chars;
+}
+
+std::u16string decode_modified_utf8(const std::string &bytes) {
+  std::u16string chars;
+  chars.reserve(bytes.size());
+
+  for (size_t i = 0; i < bytes.size();) {
+    u1 b = static_cast<u1>(bytes[i]);
+    if (b < 0x80) {
+      chars.push_back(b);
+      i++;
+    } else if ((b & 0xE0) == 0xC0 && i + 1 < bytes.size()) {
+      chars.push_back(static_cast<char16_t>(
+          ((b & 0x1F) << 6) | (static_cast<u1>(bytes[i + 1]) & 0x3F)));
+      i += 2;
+    } else if ((b & 0xF0) == 0xE0 && i + 2 < bytes.size()) {
+      chars.push_back(static_cast<char16_t>(
+          ((b & 0x0F) << 12) | ((static_cast<u1>(bytes[i + 1]) & 0x3F) << 6) |
+          (static_cast<u1>(bytes[i + 2]) & 0x3F)));
+      i += 3;
+    } else {
+      throw std::runtime_error("ClassFormatError: malformed modified UTF-8");
+    }
+  }
+  return chars;
+}
+
+RuntimeObject *new_string(Thread *thread, const std::u16string &chars,
+                          bool tenured) {
+  RuntimeClass *bytes_class = thread->runtime->array_class("[B");
+
+  u1 coder = CODER_LATIN1;
+  for (char16_t c : chars)
+    if (c > 0xFF) {
+      coder = CODER_UTF16;
+      break;
+    }
+
+  int32_t length = static_cast<int32_t>(chars.size() << coder);
+  RuntimeObject *value =
+      tenured ? RuntimeObject::allocate_tenured_array(thread, bytes_class,
+                                                      length)
+              : RuntimeObject::allocate_array(thread, bytes_class, length);
+  if (coder == CODER_LATIN1)
+    for (size_t i = 0; i < chars.size(); i++)
+      value->array_set<u1>(static_cast<u4>(i), static_cast<u1>(chars[i]));
+  else
+    for (size_t i = 0; i < chars.size(); i++)
+      value->array_set<u2>(static_cast<u4>(i), static_cast<u2>(chars[i]));
+
+  return new_string_with_value(thread, value, coder, tenured);
+}
+
+RuntimeObject *new_string_with_value(Thread *thread, RuntimeObject *value,
+                                     u1 coder, bool tenured) {
+  // Carregar String e alocar o objeto podem mover o array
+  Handle array(thread, value);
+  RuntimeClass *string_class =
+      thread->runtime->find_or_load_class("java/lang/String");
+  RuntimeObject *str =
+      tenured ? RuntimeObject::allocate_tenured(thread, string_class)
+              : RuntimeObject::allocate(thread, string_class);
+  str->write_ref(value_field(string_class), array.get());
+  str->write_field<u1>(coder_field(string_class), coder);
+  return str;
+}
+
+RuntimeObject *StringTable::intern(Thread *thread,
+                                   const std::u16string &chars) {
+  auto it = strings_.find(chars);
+  if (it != strings_.end())
+    return decode_ref(it->second);
+
+  RuntimeObject *str = new_string(thread, chars, true);
+  strings_.emplace(chars, encode_ref(str));
+  return str;
+}
+
+RuntimeObject *StringTable::intern(RuntimeObject *str) {
+  auto result = strings_.emplace(string_chars(str), encode_ref(str));
+  return decode_ref(result.first->second);
+}
+
+void StringTable::visit_roots(const std::function<void(u1 *)> &visit) {
+  for (auto &pair : strings_)
+    visit(reinterpret_cast<u1 *>(&pair.second));
+}
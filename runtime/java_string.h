@@ -0,0 +1,62 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// java.lang.String no layout compacto da JDK 9+: byte[] value, byte coder e
+// int hash. Com coder LATIN1 cada caractere ocupa um byte; com UTF16, dois,
+// na ordem de bytes do host. Só vira UTF16 a string com algum caractere
+// acima de 0xFF, então o mesmo conteúdo sempre tem o mesmo coder.
+static const u1 CODER_LATIN1 = 0;
+static const u1 CODER_UTF16 = 1;
+
+// Leitura do conteúdo de uma String
+struct StringView {
+  const RuntimeObject *value;
+  u1 coder;
+  int32_t length;
+
+  u2 char_at(int32_t index) const {
+    if (coder == CODER_LATIN1)
+      return value->array_get<u1>(static_cast<u4>(index));
+    return value->array_get<u2>(static_cast<u4>(index));
+  }
+};
+
+StringView string_view(const RuntimeObject *str);
+std::u16string string_chars(const RuntimeObject *str);
+
+// Field `hash` da classe String (0 = ainda não calculado)
+RuntimeField &string_hash_field(RuntimeClass *string_class);
+
+// CONSTANT_Utf8 está em UTF-8 modificado (JVMS §4.4.7): NUL em dois bytes
+// e caracteres suplementares como dois surrogates de três bytes cada
+std::u16string decode_modified_utf8(const std::string &bytes);
+
+// Nova String com o conteúdo `chars`. `tenured` aloca a String e o array
+// direto na geração velha.
+RuntimeObject *new_string(Thread *thread, const std::u16string &chars,
+                          bool tenured = false);
+// String sobre um byte[] já preenchido no `coder` dado, sem copiar
+RuntimeObject *new_string_with_value(Thread *thread, RuntimeObject *value,
+                                     u1 coder, bool tenured = false);
+
+// Tabela de strings internadas: uma instância por conteúdo, para os
+// literais do constant pool e String.intern(). As entradas são raízes do
+// GC, e literais criados pela tabela nascem na geração velha.
+class StringTable {
+public:
+  // Instância canônica do conteúdo, criada se ainda não existe
+  RuntimeObject *intern(Thread *thread, const std::u16string &chars);
+  // String.intern(): a instância canônica, ou `str` se for a primeira
+  RuntimeObject *intern(RuntimeObject *str);
+
+  void visit_roots(const std::function<void(u1 *)> &visit);
+  size_t size() const { return strings_.size(); }
+
+private:
+  std::unordered_map<std::u16string, NarrowRef> strings_;
+};
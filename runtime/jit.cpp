@@ -0,0 +1,1179 @@
+#include "./jit.h"
+#include "../classfile/bytecode.h"
+#include "./ssa.h"
+#include "./tiering.h"
+#include "./x86_assembler.h"
+
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#ifdef JVM_JIT_SUPPORTED
+
+// Caminho lento do código compilado: roda a instrução em `pc` no
+// interpretador, com a pilha do frame no tamanho que ela tem antes da
+// instrução. Exceções não podem atravessar o código de máquina: ficam em
+// Thread::pending_exception e o código compilado sai com EXCEPTION_PENDING,
+// com o frame parado no pc da instrução.
+// Se a instrução carregou uma classe que invalidou o código, o frame já
+// está no pc seguinte e o resto dele roda no interpretador.
+u4 jit_step(Thread *thread, Frame *frame, u4 pc, u4 depth) {
+  std::vector<Slot> &stack = frame->operand_stack.stack;
+  size_t size = stack.size();
+  stack.resize(depth);
+  frame->pc = pc;
+  try {
+    thread->interpreter->step(*frame);
+  } catch (...) {
+    thread->pending_exception = std::current_exception();
+    return CompiledMethod::EXCEPTION_PENDING;
+  }
+  if (frame->compiled->invalidated)
+    return CompiledMethod::DEOPTIMIZED | static_cast<u4>(stack.size());
+  stack.resize(size);
+  return 0;
+}
+
+void jit_deoptimize(Frame *frame, u4 pc) { frame->pc = pc; }
+
+u4 jit_allocate(Thread *thread, RuntimeClass *klass) {
+  try {
+    return encode_ref(RuntimeObject::allocate(thread, klass));
+  } catch (...) {
+    thread->pending_exception = std::current_exception();
+    return 0;
+  }
+}
+
+#endif // JVM_JIT_SUPPORTED
+
+namespace {
+
+#ifdef JVM_JIT_SUPPORTED
+
+// Fixos durante o método todo. São preservados pela convenção de chamada,
+// então sobrevivem às chamadas ao runtime.
+const Reg THREAD = RBX;
+const Reg FRAME = R12;
+const Reg LOCALS = R13;
+const Reg STACK = R14;
+const Reg NARROW_BASE = R15;
+
+const u1 SLOT = sizeof(Slot);
+const int32_t OBJECT_DATA = sizeof(RuntimeObject);
+
+// Condições de ifeq..ifle e if_icmpeq..if_icmple, na ordem dos opcodes
+const Cond BRANCH_CONDS[] = {CC_E, CC_NE, CC_L, CC_GE, CC_G, CC_LE};
+
+class TemplateCompiler {
+public:
+  TemplateCompiler(RuntimeMethod *method)
+      : method(method), klass(method->owner), code(method->code->code),
+        map(method->reference_map()) {}
+
+  // false se o método tem alguma instrução sem template. `osr` recebe o
+  // pc de cada cabeçalho de laço e o offset da entrada para ele no código.
+  bool compile(std::vector<u1> &out,
+               std::vector<std::pair<u4, size_t>> &osr);
+
+private:
+  struct SlowPath {
+    Assembler::Label entry;
+    u4 pc;
+    u2 depth;
+    u4 next;
+  };
+
+  void prologue();
+  bool emit(u4 pc, u2 d);
+
+  Mem stack_slot(int index) const { return mem(STACK, index * SLOT); }
+  Mem local(u4 index) const { return mem(LOCALS, index * SLOT); }
+
+  // Valores de 32 bits (int, float e referências comprimidas). Com slots
+  // largos a escrita é de 64 bits, com os bits altos já zerados pela
+  // instrução de 32 bits que produziu o valor.
+  void load_int(Reg dst, const Mem &src) { as.load(dst, src, 4); }
+  void store_int(const Mem &dst, Reg src) { as.store(dst, src, SLOT); }
+  void copy_slot(const Mem &dst, const Mem &src) {
+    as.load(RAX, src, SLOT);
+    as.store(dst, RAX, SLOT);
+  }
+
+  // long/double a partir do índice `index` da pilha ou das locais: sem
+  // slots largos a parte alta fica no primeiro slot e a baixa no segundo
+  void load_long(Reg dst, Reg base, int index);
+  void store_long(Reg base, int index, Reg src);
+
+  // Referência comprimida em `reg` para ponteiro
+  void decode(Reg reg);
+  // Referência do slot em `reg`, decodificada; null vai para `slow`
+  void load_object(Reg reg, int index, Assembler::Label slow);
+
+  // Field ou elemento de tipo `type` (descritor) em `dst`, e o valor no
+  // topo da pilha em `index`
+  void load_value(Reg dst, const Mem &src, char type);
+  void push_value(int index, Reg src, char type);
+
+  // Endereço do elemento, com as checagens de null e de limites
+  Mem array_element(u4 pc, u2 d, u4 next, int array, int index, u1 size);
+
+  void call_step(u4 pc, u2 depth);
+  // Instrução rodada no interpretador quando uma checagem falha
+  Assembler::Label slow(u4 pc, u2 depth, u4 next);
+
+  // Label do alvo de um desvio; nullptr, e o método não compila, se ele
+  // cai fora do código
+  const Assembler::Label *branch_target(u4 pc, int32_t offset);
+  void jump_to(u4 pc, int32_t offset, Cond cond, bool always);
+
+  RuntimeMethod *method;
+  RuntimeClass *klass;
+  const std::vector<u1> &code;
+  const ReferenceMap &map;
+
+  Assembler as;
+  std::vector<Assembler::Label> labels; // início de cada instrução
+  std::vector<SlowPath> slow_paths;
+  Assembler::Label epilogue = 0;
+  bool valid = true; // algum desvio para fora do código
+};
+
+void TemplateCompiler::load_long(Reg dst, Reg base, int index) {
+  if (SLOT == 8) {
+    as.load(dst, mem(base, index * SLOT), 8);
+    return;
+  }
+  as.load(dst, mem(base, (index + 1) * SLOT), 4);
+  as.load(R11, mem(base, index * SLOT), 4);
+  as.shift_imm(SHIFT_SHL, R11, 32, true);
+  as.alu(ALU_OR, dst, R11, true);
+}
+
+void TemplateCompiler::store_long(Reg base, int index, Reg src) {
+  if (SLOT == 8) {
+    as.store(mem(base, index * SLOT), src, 8);
+    return;
+  }
+  as.store(mem(base, (index + 1) * SLOT), src, 4);
+  as.mov(R11, src, true);
+  as.shift_imm(SHIFT_SHR, R11, 32, true);
+  as.store(mem(base, index * SLOT), R11, 4);
+}
+
+void TemplateCompiler::decode(Reg reg) {
+  if (Heap::narrow_shift)
+    as.shift_imm(SHIFT_SHL, reg, static_cast<u1>(Heap::narrow_shift), true);
+  as.alu(ALU_ADD, reg, NARROW_BASE, true);
+}
+
+void TemplateCompiler::load_object(Reg reg, int index,
+                                   Assembler::Label slow) {
+  load_int(reg, stack_slot(index));
+  as.test(reg, reg, false);
+  as.jcc(CC_E, slow);
+  decode(reg);
+}
+
+void TemplateCompiler::load_value(Reg dst, const Mem &src, char type) {
+  switch (type) {
+  case 'B':
+    as.load(dst, src, 1, true);
+    break;
+  case 'Z':
+    as.load(dst, src, 1, false);
+    break;
+  case 'C':
+    as.load(dst, src, 2, false);
+    break;
+  case 'S':
+    as.load(dst, src, 2, true);
+    break;
+  case 'J':
+  case 'D':
+    as.load(dst, src, 8);
+    break;
+  default:
+    as.load(dst, src, 4);
+  }
+}
+
+void TemplateCompiler::push_value(int index, Reg src, char type) {
+  if (type == 'J' || type == 'D')
+    store_long(STACK, index, src);
+  else
+    store_int(stack_slot(index), src);
+}
+
+Mem TemplateCompiler::array_element(u4 pc, u2 d, u4 next, int array,
+                                    int index, u1 size) {
+  Assembler::Label s = slow(pc, d, next);
+  load_object(RAX, array, s);
+  load_int(RCX, stack_slot(index));
+  // Sem sinal: índice negativo também falha
+  as.cmp(RCX, mem(RAX, OBJECT_DATA), false);
+  as.jcc(CC_AE, s);
+  return mem(RAX, RCX, size, OBJECT_DATA + (size == 8 ? 8 : 4));
+}
+
+void TemplateCompiler::call_step(u4 pc, u2 depth) {
+  as.mov(RDI, THREAD, true);
+  as.mov(RSI, FRAME, true);
+  as.mov_imm32(RDX, pc);
+  as.mov_imm32(RCX, depth);
+  as.mov_imm64(RAX, reinterpret_cast<uintptr_t>(&jit_step));
+  as.call(RAX);
+  // Retorno diferente de 0: o de jit_step é o do código compilado
+  as.test(RAX, RAX, false);
+  as.jcc(CC_NE, epilogue);
+}
+
+Assembler::Label TemplateCompiler::slow(u4 pc, u2 depth, u4 next) {
+  if (slow_paths.empty() || slow_paths.back().pc != pc)
+    slow_paths.push_back({as.new_label(), pc, depth, next});
+  return slow_paths.back().entry;
+}
+
+const Assembler::Label *TemplateCompiler::branch_target(u4 pc,
+                                                        int32_t offset) {
+  u4 target = static_cast<u4>(pc + offset);
+  if (target >= code.size() || !map.at(target)) {
+    valid = false;
+    return nullptr;
+  }
+  return &labels[target];
+}
+
+void TemplateCompiler::jump_to(u4 pc, int32_t offset, Cond cond,
+                               bool always) {
+  const Assembler::Label *target = branch_target(pc, offset);
+  if (!target)
+    return;
+  if (always)
+    as.jmp(*target);
+  else
+    as.jcc(cond, *target);
+}
+
+// Comum à entrada normal e às de OSR: rsp fica alinhado a 16 para as
+// chamadas ao runtime
+void TemplateCompiler::prologue() {
+  as.push(RBP);
+  as.mov(RBP, RSP, true);
+  as.push(RBX);
+  as.push(R12);
+  as.push(R13);
+  as.push(R14);
+  as.push(R15);
+  as.alu_imm(ALU_SUB, RSP, 8, true);
+  as.mov(THREAD, RDI, true);
+  as.mov(FRAME, RSI, true);
+  as.mov(LOCALS, RDX, true);
+  as.mov(STACK, RCX, true);
+  as.mov_imm64(NARROW_BASE, Heap::narrow_base);
+}
+
+bool TemplateCompiler::compile(std::vector<u1> &out,
+                               std::vector<std::pair<u4, size_t>> &osr) {
+  epilogue = as.new_label();
+  labels.resize(code.size());
+  for (u4 pc = 0; pc < code.size(); pc += instruction_length(code, pc))
+    labels[pc] = as.new_label();
+
+  prologue();
+  for (u4 pc = 0; pc < code.size(); pc += instruction_length(code, pc)) {
+    as.bind(labels[pc]);
+    const ReferenceMap::Entry *entry = map.at(pc);
+    if (entry && !emit(pc, entry->stack_depth))
+      return false;
+  }
+  if (!valid)
+    return false;
+
+  for (const SlowPath &path : slow_paths) {
+    as.bind(path.entry);
+    call_step(path.pc, path.depth);
+    as.jmp(labels[path.next]);
+  }
+
+  // OSR: um frame interpretado no meio do laço entra direto no cabeçalho.
+  // Locais e pilha já estão no Frame, e a profundidade da pilha no
+  // cabeçalho é a mesma nas duas execuções.
+  for (const LoopCounter &loop : method->profile.loops) {
+    if (loop.header >= labels.size() || !map.at(loop.header))
+      continue;
+    osr.emplace_back(loop.header, as.size());
+    prologue();
+    as.jmp(labels[loop.header]);
+  }
+
+  as.bind(epilogue);
+  as.alu_imm(ALU_ADD, RSP, 8, true);
+  as.pop(R15);
+  as.pop(R14);
+  as.pop(R13);
+  as.pop(R12);
+  as.pop(RBX);
+  as.pop(RBP);
+  as.ret();
+
+  out = as.finish();
+  return true;
+}
+
+bool TemplateCompiler::emit(u4 pc, u2 d) {
+  const u1 op = code[pc];
+  const u4 next = pc + instruction_length(code, pc);
+  const int C2 = CATEGORY2_STACK_SLOTS;
+
+  switch (op) {
+  case OP_nop:
+  case OP_pop:
+  case OP_pop2:
+    // A profundidade de cada instrução é estática: nada a mover
+    break;
+
+  // Constantes
+  case OP_aconst_null:
+    as.alu(ALU_XOR, RAX, RAX, false);
+    store_int(stack_slot(d), RAX);
+    break;
+  case OP_iconst_m1:
+  case OP_iconst_0:
+  case OP_iconst_1:
+  case OP_iconst_2:
+  case OP_iconst_3:
+  case OP_iconst_4:
+  case OP_iconst_5:
+    as.mov_imm32(RAX, static_cast<u4>(op - OP_iconst_0));
+    store_int(stack_slot(d), RAX);
+    break;
+  case OP_bipush:
+    as.mov_imm32(RAX, static_cast<u4>(static_cast<int8_t>(code[pc + 1])));
+    store_int(stack_slot(d), RAX);
+    break;
+  case OP_sipush:
+    as.mov_imm32(RAX, static_cast<u4>(static_cast<int16_t>(
+                          read_code_u2(code, pc + 1))));
+    store_int(stack_slot(d), RAX);
+    break;
+  case OP_fconst_0:
+  case OP_fconst_1:
+  case OP_fconst_2: {
+    float value = static_cast<float>(op - OP_fconst_0);
+    u4 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    as.mov_imm32(RAX, bits);
+    store_int(stack_slot(d), RAX);
+    break;
+  }
+  case OP_lconst_0:
+  case OP_lconst_1:
+    as.mov_imm64(RAX, static_cast<u8>(op - OP_lconst_0));
+    store_long(STACK, d, RAX);
+    break;
+  case OP_dconst_0:
+  case OP_dconst_1: {
+    double value = op - OP_dconst_0;
+    u8 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    as.mov_imm64(RAX, bits);
+    store_long(STACK, d, RAX);
+    break;
+  }
+  case OP_ldc:
+  case OP_ldc_w:
+  case OP_ldc2_w: {
+    u2 index = op == OP_ldc ? code[pc + 1] : read_code_u2(code, pc + 1);
+    const ConstantPoolEntry &entry = klass->class_file->constant_pool[index];
+    switch (entry.first) {
+    case ConstantTag::CONSTANT_Integer:
+    case ConstantTag::CONSTANT_Float:
+      as.mov_imm32(RAX, entry.second.integer_info.bytes);
+      store_int(stack_slot(d), RAX);
+      break;
+    case ConstantTag::CONSTANT_Long:
+    case ConstantTag::CONSTANT_Double:
+      as.mov_imm64(RAX,
+                   (static_cast<u8>(entry.second.long_info.high_bytes) << 32) |
+                       entry.second.long_info.low_bytes);
+      store_long(STACK, d, RAX);
+      break;
+    default:
+      // Literal já internado na geração velha: o endereço não muda mais
+      if (entry.first == ConstantTag::CONSTANT_String &&
+          klass->cp_cache[index].string) {
+        as.mov_imm32(RAX, encode_ref(klass->cp_cache[index].string));
+        store_int(stack_slot(d), RAX);
+      } else {
+        call_step(pc, d);
+      }
+    }
+    break;
+  }
+
+  // Variáveis locais
+  case OP_iload:
+  case OP_fload:
+  case OP_aload:
+    copy_slot(stack_slot(d), local(code[pc + 1]));
+    break;
+  case OP_iload_0:
+  case OP_iload_1:
+  case OP_iload_2:
+  case OP_iload_3:
+    copy_slot(stack_slot(d), local(op - OP_iload_0));
+    break;
+  case OP_fload_0:
+  case OP_fload_1:
+  case OP_fload_2:
+  case OP_fload_3:
+    copy_slot(stack_slot(d), local(op - OP_fload_0));
+    break;
+  case OP_aload_0:
+  case OP_aload_1:
+  case OP_aload_2:
+  case OP_aload_3:
+    copy_slot(stack_slot(d), local(op - OP_aload_0));
+    break;
+  case OP_lload:
+  case OP_dload:
+    load_long(RAX, LOCALS, code[pc + 1]);
+    store_long(STACK, d, RAX);
+    break;
+  case OP_lload_0:
+  case OP_lload_1:
+  case OP_lload_2:
+  case OP_lload_3:
+    load_long(RAX, LOCALS, op - OP_lload_0);
+    store_long(STACK, d, RAX);
+    break;
+  case OP_dload_0:
+  case OP_dload_1:
+  case OP_dload_2:
+  case OP_dload_3:
+    load_long(RAX, LOCALS, op - OP_dload_0);
+    store_long(STACK, d, RAX);
+    break;
+  case OP_istore:
+  case OP_fstore:
+  case OP_astore:
+    copy_slot(local(code[pc + 1]), stack_slot(d - 1));
+    break;
+  case OP_istore_0:
+  case OP_istore_1:
+  case OP_istore_2:
+  case OP_istore_3:
+    copy_slot(local(op - OP_istore_0), stack_slot(d - 1));
+    break;
+  case OP_fstore_0:
+  case OP_fstore_1:
+  case OP_fstore_2:
+  case OP_fstore_3:
+    copy_slot(local(op - OP_fstore_0), stack_slot(d - 1));
+    break;
+  case OP_astore_0:
+  case OP_astore_1:
+  case OP_astore_2:
+  case OP_astore_3:
+    copy_slot(local(op - OP_astore_0), stack_slot(d - 1));
+    break;
+  case OP_lstore:
+  case OP_dstore:
+    load_long(RAX, STACK, d - C2);
+    store_long(LOCALS, code[pc + 1], RAX);
+    break;
+  case OP_lstore_0:
+  case OP_lstore_1:
+  case OP_lstore_2:
+  case OP_lstore_3:
+    load_long(RAX, STACK, d - C2);
+    store_long(LOCALS, op - OP_lstore_0, RAX);
+    break;
+  case OP_dstore_0:
+  case OP_dstore_1:
+  case OP_dstore_2:
+  case OP_dstore_3:
+    load_long(RAX, STACK, d - C2);
+    store_long(LOCALS, op - OP_dstore_0, RAX);
+    break;
+  case OP_iinc:
+    load_int(RAX, local(code[pc + 1]));
+    as.alu_imm(ALU_ADD, RAX, static_cast<int8_t>(code[pc + 2]), false);
+    store_int(local(code[pc + 1]), RAX);
+    break;
+  case OP_wide:
+    if (code[pc + 1] == OP_ret)
+      return false;
+    call_step(pc, d);
+    break;
+
+  // Arrays
+  case OP_iaload:
+  case OP_faload:
+  case OP_aaload:
+    as.load(RCX, array_element(pc, d, next, d - 2, d - 1, 4), 4);
+    store_int(stack_slot(d - 2), RCX);
+    break;
+  case OP_laload:
+  case OP_daload:
+    as.load(RCX, array_element(pc, d, next, d - 2, d - 1, 8), 8);
+    store_long(STACK, d - 2, RCX);
+    break;
+  case OP_baload:
+    as.load(RCX, array_element(pc, d, next, d - 2, d - 1, 1), 1, true);
+    store_int(stack_slot(d - 2), RCX);
+    break;
+  case OP_caload:
+    as.load(RCX, array_element(pc, d, next, d - 2, d - 1, 2), 2, false);
+    store_int(stack_slot(d - 2), RCX);
+    break;
+  case OP_saload:
+    as.load(RCX, array_element(pc, d, next, d - 2, d - 1, 2), 2, true);
+    store_int(stack_slot(d - 2), RCX);
+    break;
+  case OP_iastore:
+  case OP_fastore: {
+    Mem element = array_element(pc, d, next, d - 3, d - 2, 4);
+    load_int(RDX, stack_slot(d - 1));
+    as.store(element, RDX, 4);
+    break;
+  }
+  case OP_lastore:
+  case OP_dastore: {
+    Mem element = array_element(pc, d, next, d - C2 - 2, d - C2 - 1, 8);
+    load_long(RDX, STACK, d - C2);
+    as.store(element, RDX, 8);
+    break;
+  }
+  case OP_castore:
+  case OP_sastore: {
+    Mem element = array_element(pc, d, next, d - 3, d - 2, 2);
+    load_int(RDX, stack_slot(d - 1));
+    as.store(element, RDX, 2);
+    break;
+  }
+  case OP_arraylength: {
+    load_object(RAX, d - 1, slow(pc, d, next));
+    load_int(RAX, mem(RAX, OBJECT_DATA));
+    store_int(stack_slot(d - 1), RAX);
+    break;
+  }
+
+  // Pilha: as mesmas formas do interpretador, resolvidas na compilação
+  case OP_dup:
+  case OP_dup_x1:
+  case OP_dup_x2:
+  case OP_dup2:
+  case OP_dup2_x1:
+  case OP_dup2_x2: {
+    const ReferenceMap::Entry &entry = *map.at(pc);
+    auto wide = [&](int from_top) {
+      return C2 == 1 &&
+             map.stack_is_category2(entry, static_cast<u2>(d - from_top));
+    };
+    int a = 1, crossed = 0;
+    if (op == OP_dup_x1 || op == OP_dup2_x1)
+      crossed = 1;
+    if (op == OP_dup2 || op == OP_dup2_x1 || op == OP_dup2_x2)
+      a = wide(1) ? 1 : 2;
+    if (op == OP_dup_x2 || op == OP_dup2_x2)
+      crossed = wide(a + 1) ? 1 : 2;
+
+    static const Reg regs[] = {RAX, RCX, RDX, RSI};
+    int n = a + crossed, base = d - n;
+    for (int i = 0; i < n; i++)
+      as.load(regs[i], stack_slot(base + i), SLOT);
+    int out = base;
+    for (int i = crossed; i < n; i++)
+      as.store(stack_slot(out++), regs[i], SLOT);
+    for (int i = 0; i < n; i++)
+      as.store(stack_slot(out++), regs[i], SLOT);
+    break;
+  }
+  case OP_swap:
+    as.load(RAX, stack_slot(d - 2), SLOT);
+    as.load(RCX, stack_slot(d - 1), SLOT);
+    as.store(stack_slot(d - 2), RCX, SLOT);
+    as.store(stack_slot(d - 1), RAX, SLOT);
+    break;
+
+  // Aritmética de int
+  case OP_iadd:
+  case OP_isub:
+  case OP_iand:
+  case OP_ior:
+  case OP_ixor:
+  case OP_imul:
+  case OP_ishl:
+  case OP_ishr:
+  case OP_iushr:
+    load_int(RAX, stack_slot(d - 2));
+    load_int(RCX, stack_slot(d - 1));
+    switch (op) {
+    case OP_iadd:
+      as.alu(ALU_ADD, RAX, RCX, false);
+      break;
+    case OP_isub:
+      as.alu(ALU_SUB, RAX, RCX, false);
+      break;
+    case OP_iand:
+      as.alu(ALU_AND, RAX, RCX, false);
+      break;
+    case OP_ior:
+      as.alu(ALU_OR, RAX, RCX, false);
+      break;
+    case OP_ixor:
+      as.alu(ALU_XOR, RAX, RCX, false);
+      break;
+    case OP_imul:
+      as.imul(RAX, RCX, false);
+      break;
+    // O x86 usa só os 5 bits baixos da contagem, como o Java
+    case OP_ishl:
+      as.shift_cl(SHIFT_SHL, RAX, false);
+      break;
+    case OP_ishr:
+      as.shift_cl(SHIFT_SAR, RAX, false);
+      break;
+    default:
+      as.shift_cl(SHIFT_SHR, RAX, false);
+    }
+    store_int(stack_slot(d - 2), RAX);
+    break;
+  case OP_ineg:
+    load_int(RAX, stack_slot(d - 1));
+    as.neg(RAX, false);
+    store_int(stack_slot(d - 1), RAX);
+    break;
+  case OP_idiv:
+  case OP_irem:
+  case OP_ldiv:
+  case OP_lrem: {
+    // Divisor zero lança no interpretador; -1 não passa pelo idiv, que
+    // faria trap com MIN_VALUE / -1
+    bool is_long = op == OP_ldiv || op == OP_lrem;
+    bool is_div = op == OP_idiv || op == OP_ldiv;
+    int size = is_long ? C2 : 1;
+    if (is_long) {
+      load_long(RCX, STACK, d - size);
+      load_long(RAX, STACK, d - 2 * size);
+    } else {
+      load_int(RCX, stack_slot(d - 1));
+      load_int(RAX, stack_slot(d - 2));
+    }
+    as.test(RCX, RCX, is_long);
+    as.jcc(CC_E, slow(pc, d, next));
+    Assembler::Label divide = as.new_label(), done = as.new_label();
+    as.alu_imm(ALU_CMP, RCX, -1, is_long);
+    as.jcc(CC_NE, divide);
+    if (is_div)
+      as.neg(RAX, is_long);
+    else
+      as.alu(ALU_XOR, RAX, RAX, false);
+    as.jmp(done);
+    as.bind(divide);
+    as.sign_extend_rax(is_long);
+    as.idiv(RCX, is_long);
+    if (!is_div)
+      as.mov(RAX, RDX, is_long);
+    as.bind(done);
+    if (is_long)
+      store_long(STACK, d - 2 * size, RAX);
+    else
+      store_int(stack_slot(d - 2), RAX);
+    break;
+  }
+
+  // Aritmética de long
+  case OP_ladd:
+  case OP_lsub:
+  case OP_land:
+  case OP_lor:
+  case OP_lxor:
+  case OP_lmul:
+    load_long(RAX, STACK, d - 2 * C2);
+    load_long(RCX, STACK, d - C2);
+    switch (op) {
+    case OP_ladd:
+      as.alu(ALU_ADD, RAX, RCX, true);
+      break;
+    case OP_lsub:
+      as.alu(ALU_SUB, RAX, RCX, true);
+      break;
+    case OP_land:
+      as.alu(ALU_AND, RAX, RCX, true);
+      break;
+    case OP_lor:
+      as.alu(ALU_OR, RAX, RCX, true);
+      break;
+    case OP_lxor:
+      as.alu(ALU_XOR, RAX, RCX, true);
+      break;
+    default:
+      as.imul(RAX, RCX, true);
+    }
+    store_long(STACK, d - 2 * C2, RAX);
+    break;
+  case OP_lshl:
+  case OP_lshr:
+  case OP_lushr:
+    load_long(RAX, STACK, d - 1 - C2);
+    load_int(RCX, stack_slot(d - 1));
+    as.shift_cl(op == OP_lshl   ? SHIFT_SHL
+                : op == OP_lshr ? SHIFT_SAR
+                                : SHIFT_SHR,
+                RAX, true);
+    store_long(STACK, d - 1 - C2, RAX);
+    break;
+  case OP_lneg:
+    load_long(RAX, STACK, d - C2);
+    as.neg(RAX, true);
+    store_long(STACK, d - C2, RAX);
+    break;
+  case OP_lcmp:
+    load_long(RAX, STACK, d - 2 * C2);
+    load_long(RCX, STACK, d - C2);
+    as.alu(ALU_CMP, RAX, RCX, true);
+    as.setcc(CC_G, RDX);
+    as.setcc(CC_L, RCX);
+    as.movzx8(RDX, RDX);
+    as.movzx8(RCX, RCX);
+    as.alu(ALU_SUB, RDX, RCX, false);
+    store_int(stack_slot(d - 2 * C2), RDX);
+    break;
+
+  // Ponto flutuante em SSE; frem/drem ficam com o fmod do interpretador
+  case OP_fadd:
+  case OP_fsub:
+  case OP_fmul:
+  case OP_fdiv: {
+    static const SseOp ops[] = {SSE_ADD, SSE_SUB, SSE_MUL, SSE_DIV};
+    as.movs_load(SSE_SS, XMM0, stack_slot(d - 2));
+    as.movs_load(SSE_SS, XMM1, stack_slot(d - 1));
+    as.sse(SSE_SS, ops[(op - OP_fadd) / 4], XMM0, XMM1);
+    as.movd_from_xmm(RAX, XMM0, false);
+    store_int(stack_slot(d - 2), RAX);
+    break;
+  }
+  case OP_dadd:
+  case OP_dsub:
+  case OP_dmul:
+  case OP_ddiv: {
+    static const SseOp ops[] = {SSE_ADD, SSE_SUB, SSE_MUL, SSE_DIV};
+    load_long(RAX, STACK, d - 2 * C2);
+    load_long(RCX, STACK, d - C2);
+    as.movd_to_xmm(XMM0, RAX, true);
+    as.movd_to_xmm(XMM1, RCX, true);
+    as.sse(SSE_SD, ops[(op - OP_dadd) / 4], XMM0, XMM1);
+    as.movd_from_xmm(RAX, XMM0, true);
+    store_long(STACK, d - 2 * C2, RAX);
+    break;
+  }
+  case OP_fneg:
+    load_int(RAX, stack_slot(d - 1));
+    as.alu_imm(ALU_XOR, RAX, INT32_MIN, false);
+    store_int(stack_slot(d - 1), RAX);
+    break;
+  case OP_dneg:
+    load_long(RAX, STACK, d - C2);
+    as.btc(RAX, 63, true);
+    store_long(STACK, d - C2, RAX);
+    break;
+  case OP_fcmpl:
+  case OP_fcmpg:
+  case OP_dcmpl:
+  case OP_dcmpg: {
+    bool is_double = op == OP_dcmpl || op == OP_dcmpg;
+    int size = is_double ? C2 : 1;
+    if (is_double) {
+      load_long(RAX, STACK, d - 2 * size);
+      load_long(RCX, STACK, d - size);
+      as.movd_to_xmm(XMM0, RAX, true);
+      as.movd_to_xmm(XMM1, RCX, true);
+    } else {
+      as.movs_load(SSE_SS, XMM0, stack_slot(d - 2));
+      as.movs_load(SSE_SS, XMM1, stack_slot(d - 1));
+    }
+    Assembler::Label done = as.new_label();
+    as.ucomis(is_double, XMM0, XMM1);
+    as.mov_imm32(RAX, op == OP_fcmpl || op == OP_dcmpl ? 0xFFFFFFFFu : 1);
+    as.jcc(CC_P, done); // NaN
+    as.setcc(CC_A, RCX);
+    as.setcc(CC_B, RDX);
+    as.movzx8(RAX, RCX);
+    as.movzx8(RDX, RDX);
+    as.alu(ALU_SUB, RAX, RDX, false);
+    as.bind(done);
+    store_int(stack_slot(d - 2 * size), RAX);
+    break;
+  }
+
+  // Conversões. f2i, f2l, d2i e d2l saturam em Java e ficam com o
+  // interpretador.
+  case OP_i2l:
+    as.movsxd(RAX, stack_slot(d - 1));
+    store_long(STACK, d - 1, RAX);
+    break;
+  case OP_l2i:
+    load_long(RAX, STACK, d - C2);
+    as.mov(RAX, RAX, false); // zera os bits altos
+    store_int(stack_slot(d - C2), RAX);
+    break;
+  case OP_i2f:
+    load_int(RAX, stack_slot(d - 1));
+    as.cvtsi2s(SSE_SS, XMM0, RAX, false);
+    as.movd_from_xmm(RAX, XMM0, false);
+    store_int(stack_slot(d - 1), RAX);
+    break;
+  case OP_i2d:
+    load_int(RAX, stack_slot(d - 1));
+    as.cvtsi2s(SSE_SD, XMM0, RAX, false);
+    as.movd_from_xmm(RAX, XMM0, true);
+    store_long(STACK, d - 1, RAX);
+    break;
+  case OP_l2f:
+    load_long(RAX, STACK, d - C2);
+    as.cvtsi2s(SSE_SS, XMM0, RAX, true);
+    as.movd_from_xmm(RAX, XMM0, false);
+    store_int(stack_slot(d - C2), RAX);
+    break;
+  case OP_l2d:
+    load_long(RAX, STACK, d - C2);
+    as.cvtsi2s(SSE_SD, XMM0, RAX, true);
+    as.movd_from_xmm(RAX, XMM0, true);
+    store_long(STACK, d - C2, RAX);
+    break;
+  case OP_f2d:
+    as.movs_load(SSE_SS, XMM0, stack_slot(d - 1));
+    as.sse(SSE_SS, SSE_CVT, XMM0, XMM0);
+    as.movd_from_xmm(RAX, XMM0, true);
+    store_long(STACK, d - 1, RAX);
+    break;
+  case OP_d2f:
+    load_long(RAX, STACK, d - C2);
+    as.movd_to_xmm(XMM0, RAX, true);
+    as.sse(SSE_SD, SSE_CVT, XMM0, XMM0);
+    as.movd_from_xmm(RAX, XMM0, false);
+    store_int(stack_slot(d - C2), RAX);
+    break;
+  case OP_i2b:
+  case OP_i2c:
+  case OP_i2s:
+    load_int(RAX, stack_slot(d - 1));
+    if (op == OP_i2b)
+      as.movsx8(RAX, RAX);
+    else if (op == OP_i2c)
+      as.movzx16(RAX, RAX);
+    else
+      as.movsx16(RAX, RAX);
+    store_int(stack_slot(d - 1), RAX);
+    break;
+
+  // Desvios
+  case OP_ifeq:
+  case OP_ifne:
+  case OP_iflt:
+  case OP_ifge:
+  case OP_ifgt:
+  case OP_ifle:
+    load_int(RAX, stack_slot(d - 1));
+    as.test(RAX, RAX, false);
+    jump_to(pc, static_cast<int16_t>(read_code_u2(code, pc + 1)),
+            BRANCH_CONDS[op - OP_ifeq], false);
+    break;
+  case OP_if_icmpeq:
+  case OP_if_icmpne:
+  case OP_if_icmplt:
+  case OP_if_icmpge:
+  case OP_if_icmpgt:
+  case OP_if_icmple:
+  case OP_if_acmpeq:
+  case OP_if_acmpne:
+    load_int(RAX, stack_slot(d - 2));
+    load_int(RCX, stack_slot(d - 1));
+    as.alu(ALU_CMP, RAX, RCX, false);
+    jump_to(pc, static_cast<int16_t>(read_code_u2(code, pc + 1)),
+            op >= OP_if_acmpeq ? BRANCH_CONDS[op - OP_if_acmpeq]
+                               : BRANCH_CONDS[op - OP_if_icmpeq],
+            false);
+    break;
+  case OP_ifnull:
+  case OP_ifnonnull:
+    load_int(RAX, stack_slot(d - 1));
+    as.test(RAX, RAX, false);
+    jump_to(pc, static_cast<int16_t>(read_code_u2(code, pc + 1)),
+            op == OP_ifnull ? CC_E : CC_NE, false);
+    break;
+  case OP_goto:
+    jump_to(pc, static_cast<int16_t>(read_code_u2(code, pc + 1)), CC_E,
+            true);
+    break;
+  case OP_goto_w:
+    jump_to(pc, static_cast<int32_t>(read_code_u4(code, pc + 1)), CC_E,
+            true);
+    break;
+  case OP_tableswitch: {
+    // Checagem de limites com uma comparação sem sinal e desvio indireto
+    // por uma tabela logo depois do jmp, com a distância de cada alvo até
+    // o início dela
+    u4 base = (pc + 4) & ~3u;
+    int32_t low = static_cast<int32_t>(read_code_u4(code, base + 4));
+    int32_t high = static_cast<int32_t>(read_code_u4(code, base + 8));
+    if (high < low) {
+      valid = false;
+      break;
+    }
+    Assembler::Label table = as.new_label();
+    load_int(RAX, stack_slot(d - 1));
+    as.alu_imm(ALU_SUB, RAX, low, false); // zera a parte alta de rax
+    as.alu_imm(ALU_CMP, RAX,
+               static_cast<int32_t>(static_cast<u4>(high) -
+                                    static_cast<u4>(low)),
+               false);
+    jump_to(pc, static_cast<int32_t>(read_code_u4(code, base)), CC_A, false);
+    as.lea(R11, table);
+    as.movsxd(RAX, mem(R11, RAX, 4));
+    as.alu(ALU_ADD, RAX, R11, true);
+    as.jmp(RAX);
+    as.bind(table);
+    for (int64_t key = low; key <= high; key++) {
+      const Assembler::Label *target = branch_target(
+          pc, static_cast<int32_t>(read_code_u4(
+                  code, base + 12 + static_cast<u4>(key - low) * 4)));
+      if (!target)
+        break;
+      as.offset32(*target, table);
+    }
+    break;
+  }
+  case OP_lookupswitch: {
+    // Sequência de comparações com cada chave
+    u4 base = (pc + 4) & ~3u;
+    load_int(RAX, stack_slot(d - 1));
+    u4 npairs = read_code_u4(code, base + 4);
+    for (u4 i = 0; i < npairs; i++) {
+      as.alu_imm(ALU_CMP, RAX,
+                 static_cast<int32_t>(read_code_u4(code, base + 8 + i * 8)),
+                 false);
+      jump_to(pc, static_cast<int32_t>(read_code_u4(code, base + 12 + i * 8)),
+              CC_E, false);
+    }
+    jump_to(pc, static_cast<int32_t>(read_code_u4(code, base)), CC_E, true);
+    break;
+  }
+  case OP_jsr:
+  case OP_jsr_w:
+  case OP_ret:
+    // Sub-rotinas não existem mais no javac moderno
+    return false;
+
+  // Retorno: o valor vai para o início da pilha
+  case OP_ireturn:
+  case OP_freturn:
+  case OP_areturn:
+    if (d != 1)
+      copy_slot(stack_slot(0), stack_slot(d - 1));
+    as.mov_imm32(RAX, 1);
+    as.jmp(epilogue);
+    break;
+  case OP_lreturn:
+  case OP_dreturn:
+    if (d != C2) {
+      load_long(RAX, STACK, d - C2);
+      store_long(STACK, 0, RAX);
+    }
+    as.mov_imm32(RAX, C2);
+    as.jmp(epilogue);
+    break;
+  case OP_return:
+    as.alu(ALU_XOR, RAX, RAX, false);
+    as.jmp(epilogue);
+    break;
+
+  // Fields já resolvidos; referências gravadas passam pelas barreiras do
+  // interpretador
+  case OP_getfield:
+  case OP_putfield:
+  case OP_getstatic:
+  case OP_putstatic: {
+    const ConstantPoolCacheEntry &entry =
+        klass->cp_cache[read_code_u2(code, pc + 1)];
+    RuntimeField *field = entry.field;
+    bool is_static = op == OP_getstatic || op == OP_putstatic;
+    bool is_put = op == OP_putfield || op == OP_putstatic;
+    if (!field || field->is_static != is_static ||
+        (is_static && !entry.static_address) ||
+        (is_put && field->is_reference())) {
+      call_step(pc, d);
+      break;
+    }
+    char type = field->descriptor[0];
+    bool is_long = type == 'J' || type == 'D';
+    int value_slots = is_long ? C2 : 1;
+
+    Mem address = mem(RAX, 0);
+    if (is_static) {
+      as.mov_imm64(RAX, reinterpret_cast<uintptr_t>(entry.static_address));
+    } else {
+      int object = is_put ? d - value_slots - 1 : d - 1;
+      load_object(RAX, object, slow(pc, d, next));
+      address = mem(RAX, OBJECT_DATA + static_cast<int32_t>(field->offset));
+    }
+
+    if (!is_put) {
+      load_value(RCX, address, type);
+      push_value(is_static ? d : d - 1, RCX, type);
+    } else {
+      if (is_long)
+        load_long(RCX, STACK, d - value_slots);
+      else
+        load_int(RCX, stack_slot(d - 1));
+      if (type == 'Z')
+        as.alu_imm(ALU_AND, RCX, 1, false);
+      as.store(address, RCX, static_cast<u1>(field->size_in_bytes()));
+    }
+    break;
+  }
+
+  // Chamadas, alocação, checagens de tipo, exceções e o resto: uma
+  // instrução do interpretador
+  case OP_frem:
+  case OP_drem:
+  case OP_f2i:
+  case OP_f2l:
+  case OP_d2i:
+  case OP_d2l:
+  case OP_bastore:
+  case OP_aastore:
+  case OP_invokevirtual:
+  case OP_invokespecial:
+  case OP_invokestatic:
+  case OP_invokeinterface:
+  case OP_invokedynamic:
+  case OP_new:
+  case OP_newarray:
+  case OP_anewarray:
+  case OP_multianewarray:
+  case OP_checkcast:
+  case OP_instanceof:
+  case OP_athrow:
+  case OP_monitorenter:
+  case OP_monitorexit:
+    call_step(pc, d);
+    break;
+
+  default:
+    return false;
+  }
+  return true;
+}
+
+#endif // JVM_JIT_SUPPORTED
+
+} // namespace
+
+JitCompiler::JitCompiler(Runtime *runtime) : runtime(runtime) {}
+
+bool JitCompiler::compile(RuntimeMethod *method) {
+#ifdef JVM_JIT_SUPPORTED
+  if (!method->code || method->native || method->code->code.empty())
+    return false;
+
+  std::vector<u1> code;
+  std::vector<std::pair<u4, size_t>> osr;
+  TemplateCompiler compiler(method);
+  if (!compiler.compile(code, osr))
+    return false;
+  const u1 *start = cache_.install(code);
+  if (!start)
+    return false;
+
+  auto compiled =
+      std::make_shared<CompiledMethod>(&cache_, start, code.size());
+  compiled->method = method;
+  for (const auto &entry : osr)
+    compiled->osr_entries.push_back(
+        {entry.first, reinterpret_cast<CompiledMethod::Entry>(
+                          reinterpret_cast<uintptr_t>(start + entry.second))});
+  method->compiled = compiled;
+  return true;
+#else
+  (void)method;
+  return false;
+#endif
+}
+
+bool JitCompiler::optimize(RuntimeMethod *method) {
+#ifdef JVM_JIT_SUPPORTED
+  std::shared_ptr<CompiledMethod> baseline = method->compiled;
+  if (!baseline || baseline->baseline)
+    return false;
+
+  std::unique_ptr<IrGraph> graph = build_ir(runtime, method);
+  if (!graph)
+    return false;
+  inline_calls(*graph);
+  optimize_ir(*graph);
+  std::vector<u1> code;
+  if (!generate_code(*graph, code))
+    return false;
+  const u1 *start = cache_.install(code);
+  if (!start)
+    return false;
+
+  auto compiled =
+      std::make_shared<CompiledMethod>(&cache_, start, code.size());
+  compiled->method = method;
+  // Sem OSR no código otimizado: os laços de um frame interpretado entram
+  // no código de templates
+  compiled->osr_entries = baseline->osr_entries;
+  compiled->baseline = baseline;
+  method->compiled = compiled;
+  for (const HierarchyDependency &dependency : graph->dependencies)
+    runtime->method_area->add_dependency(dependency, compiled);
+  return true;
+#else
+  (void)method;
+  return false;
+#endif
+}
+
+void JitCompiler::run(const CompiledMethod &code, Frame &frame) {
+  Thread *thread = runtime->thread;
+  // O código compilado endereça a pilha inteira; a capacidade reservada em
+  // Frame::init garante que os dados não mudam de lugar
+  std::vector<Slot> &stack = frame.operand_stack.stack;
+  stack.resize(frame.method->code->max_stack);
+
+  CompiledMethod::Entry entry = code.entry_at(frame.pc);
+  if (!entry)
+    throw std::runtime_error("JIT: no entry at pc " +
+                             std::to_string(frame.pc) + " of " +
+                             frame.method->name);
+  frame.compiled = &code;
+  u4 depth = entry(thread, &frame, frame.local_vars.data(), stack.data());
+  frame.compiled = nullptr;
+  if (depth == CompiledMethod::EXCEPTION_PENDING) {
+    // Mesma busca de handler do interpretador, que continua o frame nele
+    stack.clear();
+    std::exception_ptr exception = thread->pending_exception;
+    thread->pending_exception = nullptr;
+    if (!thread->interpreter->dispatch_exception(frame, exception))
+      std::rethrow_exception(exception);
+    thread->interpreter->execute(frame);
+    return;
+  }
+  if (depth & CompiledMethod::DEOPTIMIZED) {
+    // Um guard falhou ou o código foi invalidado: o frame já tem o estado
+    // do pc onde o interpretador continua. Só o guard conta como
+    // especulação errada.
+    stack.resize(depth & ~CompiledMethod::DEOPTIMIZED);
+    if (!code.invalidated)
+      runtime->tiering->on_deoptimization(frame.method);
+    thread->interpreter->execute(frame);
+    return;
+  }
+  stack.resize(depth);
+}
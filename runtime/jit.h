@@ -0,0 +1,114 @@
+#pragma once
+
+#include "./code_cache.h"
+#include "./runtime_class_types.h"
+
+// O compilador só gera x86-64 com a convenção de chamada System V; nas
+// outras plataformas todo método continua interpretado
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JVM_JIT_SUPPORTED 1
+#endif
+
+#ifdef JVM_JIT_SUPPORTED
+// Chamados pelo código de máquina dos dois compiladores. jit_step roda no
+// interpretador a instrução em `pc`, com a pilha na profundidade `depth`, e
+// devolve 0 para o código compilado continuar; senão o valor é o retorno do
+// código compilado: EXCEPTION_PENDING se a instrução lançou (a exceção fica
+// em Thread::pending_exception) ou DEOPTIMIZED se ela invalidou o código.
+// jit_deoptimize deixa o frame pronto para o interpretador continuar em
+// `pc`, com locais e pilha já escritas pelo código otimizado. jit_allocate
+// cria os objetos que o código otimizado não alocou e devolve a referência
+// comprimida, ou 0 com a exceção em Thread::pending_exception.
+u4 jit_step(Thread *thread, Frame *frame, u4 pc, u4 depth);
+void jit_deoptimize(Frame *frame, u4 pc);
+u4 jit_allocate(Thread *thread, RuntimeClass *klass);
+#endif
+
+// Código de máquina de um método. Roda sobre o mesmo Frame do
+// interpretador: variáveis locais e pilha de operandos ficam na memória do
+// frame, onde o GC e o mapa de referências as encontram.
+struct CompiledMethod {
+  // Devolve a profundidade final da pilha, com o retorno a partir de
+  // stack[0], EXCEPTION_PENDING ou, no código otimizado, DEOPTIMIZED com a
+  // profundidade da pilha no pc onde o interpretador continua
+  using Entry = u4 (*)(Thread *thread, Frame *frame, Slot *locals,
+                       Slot *stack);
+  static const u4 EXCEPTION_PENDING = 0xFFFFFFFF;
+  static const u4 DEOPTIMIZED = 0x80000000;
+
+  // Entrada no cabeçalho de um laço, para um frame que começou no
+  // interpretador (on-stack replacement)
+  struct OsrEntry {
+    u4 pc;
+    Entry entry;
+  };
+
+  // O código em `code` volta para `cache` quando o último shared_ptr some:
+  // quem roda o método guarda um (JitCompiler::run)
+  CompiledMethod(CodeCache *cache, const u1 *code, size_t code_size)
+      : method(nullptr),
+        entry(reinterpret_cast<Entry>(reinterpret_cast<uintptr_t>(code))),
+        code_size(code_size), invalidated(false), cache(cache), code(code) {}
+  ~CompiledMethod() { cache->release(code, code_size); }
+
+  CompiledMethod(const CompiledMethod &) = delete;
+  CompiledMethod &operator=(const CompiledMethod &) = delete;
+
+  RuntimeMethod *method;
+  Entry entry;
+  size_t code_size;
+  std::vector<OsrEntry> osr_entries;
+  // Uma classe carregada depois da compilação quebrou uma suposição da
+  // análise de hierarquia (MethodArea::add_to_hierarchy)
+  bool invalidated;
+  // Código otimizado: o do compilador de templates, que continua valendo
+  // para as entradas de OSR e volta a ser o do método se as
+  // desotimizações se repetem
+  std::shared_ptr<CompiledMethod> baseline;
+
+  // Entrada para continuar um frame parado em `pc`; nullptr se não há
+  Entry entry_at(u4 pc) const {
+    if (pc == 0)
+      return entry;
+    for (const OsrEntry &osr : osr_entries)
+      if (osr.pc == pc)
+        return osr.entry;
+    return nullptr;
+  }
+
+private:
+  CodeCache *cache;
+  const u1 *code;
+};
+
+// Compilador de templates: cada instrução do bytecode vira um trecho fixo de
+// código de máquina, sem alocação de registradores entre instruções. As
+// instruções que já passaram pelo cache do constant pool (fields e
+// literais String resolvidos) usam o resultado direto; o resto, e os casos
+// raros das rápidas (null, índice fora do array, divisão por zero), chamam
+// Interpreter::step para aquela instrução.
+class JitCompiler {
+public:
+  explicit JitCompiler(Runtime *runtime);
+
+  // Chamado pelo TieringPolicy. Preenche method->compiled; false se o
+  // método usa alguma instrução que o compilador não traduz (jsr/ret) ou se
+  // o code cache encheu
+  bool compile(RuntimeMethod *method);
+
+  // Segundo tier (ssa.h): troca o código de templates de method->compiled
+  // pelo do compilador otimizador; false se a IR não pôde ser montada
+  bool optimize(RuntimeMethod *method);
+
+  // Roda o código compilado no frame já empilhado em Thread::call_stack, a
+  // partir de frame.pc: o início do método ou uma entrada de OSR. Depois de
+  // uma desotimização o resto do frame roda no interpretador. Quem chama
+  // guarda o shared_ptr: a desotimização pode trocar method->compiled.
+  void run(const CompiledMethod &code, Frame &frame);
+
+  const CodeCache &code_cache() const { return cache_; }
+
+private:
+  Runtime *runtime;
+  CodeCache cache_;
+};
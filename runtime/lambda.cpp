@@ -0,0 +1,415 @@
+#include "./lambda.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// Tipos dos parâmetros e do retorno de um descritor de método, um
+// descritor de campo por entrada
+void parse_descriptor(const std::string &descriptor,
+                      std::vector<std::string> &params, std::string &ret) {
+  size_t i = 1;
+  auto next_type = [&]() {
+    size_t start = i;
+    while (i < descriptor.size() && descriptor[i] == '[')
+      i++;
+    if (i < descriptor.size() && descriptor[i] == 'L')
+      i = descriptor.find(';', i);
+    if (i == std::string::npos || i >= descriptor.size())
+      throw std::runtime_error("LambdaConversionException: malformed "
+                               "descriptor " +
+                               descriptor);
+    i++;
+    return descriptor.substr(start, i - start);
+  };
+
+  if (descriptor.empty() || descriptor[0] != '(')
+    throw std::runtime_error("LambdaConversionException: malformed "
+                             "descriptor " +
+                             descriptor);
+  while (i < descriptor.size() && descriptor[i] != ')')
+    params.push_back(next_type());
+  i++;
+  ret = next_type();
+}
+
+// Representação nas variáveis locais: referência, int (inclui boolean,
+// byte, char e short), float, long ou double
+char slot_kind(const std::string &type) {
+  switch (type[0]) {
+  case 'L':
+  case '[':
+    return 'L';
+  case 'B':
+  case 'C':
+  case 'S':
+  case 'Z':
+  case 'I':
+    return 'I';
+  default:
+    return type[0];
+  }
+}
+
+u2 local_width(char kind) { return kind == 'J' || kind == 'D' ? 2 : 1; }
+
+u4 align_up(u4 value, u4 alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Classe escondida -> sítio que a criou, para o nativo do método da
+// interface achar o método de implementação
+std::unordered_map<const RuntimeClass *, const LambdaCallSite *> &sites() {
+  static std::unordered_map<const RuntimeClass *, const LambdaCallSite *>
+      table;
+  return table;
+}
+
+u4 lambda_counter = 0;
+
+} // namespace
+
+std::shared_ptr<LambdaCallSite> LambdaCallSite::link(Runtime *runtime,
+                                                     const LambdaSpec &spec) {
+  std::vector<std::string> captured, sam_params, impl_params;
+  std::string interface_type, sam_return, impl_return;
+  parse_descriptor(spec.site_descriptor, captured, interface_type);
+  parse_descriptor(spec.sam_descriptor, sam_params, sam_return);
+
+  const MethodHandleTarget &target = spec.implementation;
+  parse_descriptor(target.descriptor, impl_params, impl_return);
+  if (interface_type[0] != 'L')
+    throw std::runtime_error("LambdaConversionException: " +
+                             spec.site_descriptor +
+                             " does not return an interface");
+
+  std::shared_ptr<LambdaCallSite> site(new LambdaCallSite());
+  site->kind_ = target.kind;
+
+  RuntimeClass *owner = runtime->find_or_load_class(target.owner);
+  site->implementation_ = owner->find_method(target.name, target.descriptor);
+  if (!site->implementation_)
+    throw std::runtime_error("NoSuchMethodError: " + target.owner + "." +
+                             target.name + target.descriptor);
+
+  // Receptor de REF_invokeVirtual/Interface/Special: o primeiro capturado
+  // ou, sem capturas, o primeiro argumento do método da interface
+  switch (target.kind) {
+  case REF_invokeStatic:
+    break;
+  case REF_invokeVirtual:
+  case REF_invokeInterface:
+  case REF_invokeSpecial:
+    impl_params.insert(impl_params.begin(), "L" + target.owner + ";");
+    break;
+  case REF_newInvokeSpecial:
+    site->constructed_ = owner;
+    impl_return = "L" + target.owner + ";";
+    break;
+  default:
+    throw std::runtime_error("LambdaConversionException: unsupported "
+                             "MethodHandle kind " +
+                             std::to_string(target.kind));
+  }
+
+  // Capturados e argumentos passam adiante sem conversão: as representações
+  // precisam coincidir (sem boxing nem alargamento de primitivos)
+  if (captured.size() + sam_params.size() != impl_params.size())
+    throw std::runtime_error("LambdaConversionException: " + target.name +
+                             target.descriptor + " takes " +
+                             std::to_string(impl_params.size()) +
+                             " arguments, site provides " +
+                             std::to_string(captured.size() +
+                                            sam_params.size()));
+
+  u2 local = target.kind == REF_newInvokeSpecial ? 1 : 0;
+  for (size_t i = 0; i < impl_params.size(); i++) {
+    const std::string &given = i < captured.size()
+                                   ? captured[i]
+                                   : sam_params[i - captured.size()];
+    char kind = slot_kind(impl_params[i]);
+    if (slot_kind(given) != kind)
+      throw std::runtime_error("LambdaConversionException: type " + given +
+                               " does not match " + impl_params[i] +
+                               " of " + target.name);
+    if (kind == 'L')
+      site->ref_locals_.push_back(local);
+    local += local_width(kind);
+  }
+  site->implementation_locals_ = local;
+
+  site->sam_return_ = slot_kind(sam_return);
+  site->implementation_return_ = slot_kind(impl_return);
+  if (site->sam_return_ != 'V' &&
+      site->sam_return_ != site->implementation_return_)
+    throw std::runtime_error("LambdaConversionException: return type " +
+                             impl_return + " does not match " + sam_return);
+
+  // Pontes têm a mesma forma do método da interface, com outros tipos de
+  // referência
+  for (const std::string &bridge : spec.bridges) {
+    std::vector<std::string> params;
+    std::string ret;
+    parse_descriptor(bridge, params, ret);
+    bool same = params.size() == sam_params.size() &&
+                slot_kind(ret) == site->sam_return_;
+    for (size_t i = 0; same && i < params.size(); i++)
+      same = slot_kind(params[i]) == slot_kind(sam_params[i]);
+    if (!same)
+      throw std::runtime_error("LambdaConversionException: bridge " + bridge +
+                               " does not match " + spec.sam_descriptor);
+  }
+
+  std::unique_ptr<RuntimeClass> klass(new RuntimeClass());
+  klass->name = spec.caller->name + "$$Lambda$" +
+                std::to_string(++lambda_counter);
+  klass->super_name = "java/lang/Object";
+  klass->access_flags = ACC_Final_Class | ACC_Synthetic_Class;
+  klass->super_class = runtime->find_or_load_class(klass->super_name);
+  klass->interface_names.push_back(
+      interface_type.substr(1, interface_type.size() - 2));
+  for (const std::string &marker : spec.marker_interfaces)
+    klass->interface_names.push_back(marker);
+  for (const std::string &name : klass->interface_names)
+    klass->interfaces.push_back(runtime->find_or_load_class(name));
+
+  // Um field por capturado, em ordem, logo depois dos fields de Object
+  u4 end = klass->super_class->instance_size;
+  klass->ref_offsets = klass->super_class->ref_offsets;
+  for (size_t i = 0; i < captured.size(); i++) {
+    RuntimeField rf;
+    rf.name = "arg$" + std::to_string(i + 1);
+    rf.descriptor = captured[i];
+    rf.key = MemberKey::of(rf.name, rf.descriptor);
+    rf.access_flags = ACC_Private_Field | ACC_Final_Field;
+    rf.owner = klass.get();
+    rf.offset = align_up(end, rf.size_in_bytes());
+    end = rf.offset + rf.size_in_bytes();
+    if (rf.is_reference())
+      klass->ref_offsets.push_back(rf.offset);
+    site->captured_.push_back(&klass->fields.emplace(rf.key, rf).first->second);
+  }
+  klass->instance_size = end;
+
+  // Método da interface e pontes, todos no mesmo nativo
+  klass->vtable = klass->super_class->vtable;
+  std::vector<std::string> descriptors = spec.bridges;
+  descriptors.insert(descriptors.begin(), spec.sam_descriptor);
+  for (const std::string &descriptor : descriptors) {
+    RuntimeMethod rm;
+    rm.name = spec.method_name;
+    rm.descriptor = descriptor;
+    rm.key = MemberKey::of(rm.name, rm.descriptor);
+    rm.access_flags = ACC_Public_Method | ACC_Final_Method;
+    rm.owner = klass.get();
+    rm.native = &LambdaCallSite::forward;
+    auto inserted = klass->methods.emplace(rm.key, rm);
+    if (!inserted.second)
+      continue;
+    RuntimeMethod *method = &inserted.first->second;
+    method->vtable_index = static_cast<int32_t>(klass->vtable.size());
+    klass->vtable.push_back(method);
+  }
+  klass->build_itables();
+
+  // Sem capturas a instância única fica num estático, que é raiz do GC
+  if (captured.empty()) {
+    RuntimeField rf;
+    rf.name = "INSTANCE";
+    rf.descriptor = interface_type;
+    rf.key = MemberKey::of(rf.name, rf.descriptor);
+    rf.access_flags = ACC_Private_Field | ACC_Final_Field | ACC_Static_Field;
+    rf.is_static = true;
+    rf.owner = klass.get();
+    site->singleton_ = &klass->fields.emplace(rf.key, rf).first->second;
+    klass->static_size = sizeof(NarrowRef);
+    klass->static_storage.assign(1, 0);
+    klass->static_ref_offsets.push_back(0);
+  }
+
+  site->lambda_class_ = klass.get();
+  runtime->method_area->storeClass(std::move(klass));
+  runtime->method_area->add_to_hierarchy(site->lambda_class_);
+  sites()[site->lambda_class_] = site.get();
+
+  if (site->singleton_) {
+    RuntimeObject *instance =
+        RuntimeObject::allocate_tenured(runtime->thread, site->lambda_class_);
+    write_static_ref(site->lambda_class_->static_address(*site->singleton_),
+                     instance);
+  }
+  return site;
+}
+
+void LambdaCallSite::invoke(Thread *thread, OperandStack &stack) const {
+  if (singleton_) {
+    NarrowRef bits;
+    std::memcpy(&bits, lambda_class_->static_address(*singleton_),
+                sizeof(bits));
+    stack.push_ref(decode_ref(bits));
+    return;
+  }
+
+  // Capturados saem da pilha do último para o primeiro. As referências
+  // ficam em handles até a instância existir.
+  struct Release {
+    Thread *thread;
+    size_t base;
+    ~Release() { thread->handles.resize(base); }
+  } release{thread, thread->handles.size()};
+
+  std::vector<u8> values(captured_.size());
+  std::vector<size_t> handles(captured_.size());
+  for (size_t i = captured_.size(); i-- > 0;) {
+    const RuntimeField &field = *captured_[i];
+    switch (slot_kind(field.descriptor)) {
+    case 'L':
+      handles[i] = thread->handles.size();
+      thread->handles.push_back(encode_ref(stack.pop_ref()));
+      break;
+    case 'J':
+    case 'D':
+      values[i] = static_cast<u8>(stack.pop_long());
+      break;
+    default:
+      values[i] = static_cast<u4>(stack.pop_int());
+    }
+  }
+
+  RuntimeObject *instance = RuntimeObject::allocate(thread, lambda_class_);
+  for (size_t i = 0; i < captured_.size(); i++) {
+    const RuntimeField &field = *captured_[i];
+    switch (field.descriptor[0]) {
+    case 'L':
+    case '[':
+      instance->write_ref(field, decode_ref(thread->handles[handles[i]]));
+      break;
+    case 'J':
+    case 'D':
+      instance->write_field<u8>(field, values[i]);
+      break;
+    case 'B':
+    case 'Z':
+      instance->write_field<u1>(field, static_cast<u1>(values[i]));
+      break;
+    case 'C':
+    case 'S':
+      instance->write_field<u2>(field, static_cast<u2>(values[i]));
+      break;
+    default:
+      instance->write_field<u4>(field, static_cast<u4>(values[i]));
+    }
+  }
+  stack.push_ref(instance);
+}
+
+void LambdaCallSite::forward(Thread *thread, Frame &args,
+                             OperandStack &result) {
+  auto it = sites().find(args.method->owner);
+  if (it == sites().end())
+    throw std::runtime_error("Lambda class " + args.method->owner->name +
+                             " has no call site");
+  const LambdaCallSite &site = *it->second;
+
+  // Locais do método de implementação: capturados, depois os argumentos
+  // do método da interface (sem o this da instância)
+  Frame frame(site.implementation_, site.implementation_->owner);
+  frame.init(site.implementation_locals_, 0);
+  u2 local = site.kind_ == REF_newInvokeSpecial ? 1 : 0;
+
+  RuntimeObject *self = slot_to_ref(args.local_vars[0]);
+  for (const RuntimeField *field : site.captured_) {
+    switch (field->descriptor[0]) {
+    case 'L':
+    case '[':
+      frame.local_vars[local++] = ref_to_slot(self->read_ref(*field));
+      break;
+    case 'J':
+    case 'D':
+      frame.store_long(local,
+                       static_cast<int64_t>(self->read_field<u8>(*field)));
+      local += 2;
+      break;
+    case 'B':
+      frame.local_vars[local++] =
+          static_cast<u4>(self->read_field<int8_t>(*field));
+      break;
+    case 'Z':
+      frame.local_vars[local++] = self->read_field<u1>(*field);
+      break;
+    case 'S':
+      frame.local_vars[local++] =
+          static_cast<u4>(self->read_field<int16_t>(*field));
+      break;
+    case 'C':
+      frame.local_vars[local++] = self->read_field<u2>(*field);
+      break;
+    default:
+      frame.local_vars[local++] = self->read_field<u4>(*field);
+    }
+  }
+  for (u2 i = 1; local < site.implementation_locals_; i++)
+    frame.local_vars[local++] = args.local_vars[i];
+
+  RuntimeMethod *target = site.implementation_;
+  if (site.kind_ == REF_invokeVirtual || site.kind_ == REF_invokeInterface) {
+    RuntimeObject *receiver = slot_to_ref(frame.local_vars[0]);
+    if (!receiver)
+      throw std::runtime_error("NullPointerException: lambda receiver is "
+                               "null");
+    target = site.kind_ == REF_invokeVirtual
+                 ? receiver->klass->dispatch_virtual(target)
+                 : receiver->klass->dispatch_interface(target);
+  }
+
+  // REF_invokeStatic e REF_newInvokeSpecial inicializam a classe do alvo
+  // (JVMS §5.5). O <clinit> e o `new` podem mover os argumentos de
+  // referência, que esperam em handles; o objeto criado fica num handle
+  // durante o construtor.
+  struct Release {
+    Thread *thread;
+    size_t base;
+    ~Release() { thread->handles.resize(base); }
+  } release{thread, thread->handles.size()};
+  if (site.kind_ == REF_newInvokeSpecial ||
+      (site.kind_ == REF_invokeStatic && !target->owner->is_initialized())) {
+    for (u2 index : site.ref_locals_)
+      thread->handles.push_back(
+          static_cast<NarrowRef>(frame.local_vars[index]));
+    thread->runtime->initialize_class(target->owner);
+    RuntimeObject *created =
+        site.kind_ == REF_newInvokeSpecial
+            ? RuntimeObject::allocate(thread, site.constructed_)
+            : nullptr;
+    for (size_t i = 0; i < site.ref_locals_.size(); i++)
+      frame.local_vars[site.ref_locals_[i]] =
+          thread->handles[release.base + i];
+    if (created) {
+      frame.local_vars[0] = ref_to_slot(created);
+      thread->handles.push_back(encode_ref(created));
+    }
+  }
+
+  if (target->conflicting_defaults)
+    throw std::runtime_error("IncompatibleClassChangeError: conflicting "
+                             "default methods for " + target->owner->name +
+                             "." + target->name + target->descriptor);
+  if (target->is_abstract())
+    throw std::runtime_error("AbstractMethodError: " + target->owner->name +
+                             "." + target->name + target->descriptor);
+  frame.method = target;
+  frame.current_class = target->owner;
+  OperandStack returned;
+  thread->interpreter->call(frame, returned);
+
+  if (site.sam_return_ == 'V')
+    return;
+  if (site.kind_ == REF_newInvokeSpecial) {
+    result.push_ref(decode_ref(thread->handles.back()));
+    return;
+  }
+  for (Slot slot : returned.stack)
+    result.stack.push_back(slot);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "./call_site.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Método de um CONSTANT_MethodHandle (só os tipos REF_invoke* e
+// REF_newInvokeSpecial)
+struct MethodHandleTarget {
+  u1 kind; // MethodHandleKind
+  std::string owner;
+  std::string name;
+  std::string descriptor;
+};
+
+// Argumentos de LambdaMetafactory.metafactory/altMetafactory, já lidos do
+// constant pool da classe que contém o sítio
+struct LambdaSpec {
+  RuntimeClass *caller;
+  std::string method_name;     // nome do sítio: o método da interface
+  std::string site_descriptor; // (capturados)LInterface;
+  std::string sam_descriptor;  // samMethodType, já apagado
+  MethodHandleTarget implementation;
+  // altMetafactory: interfaces marcadoras e descritores extras (pontes) do
+  // mesmo método
+  std::vector<std::string> marker_interfaces;
+  std::vector<std::string> bridges;
+};
+
+// Sítio de uma expressão lambda ou referência a método. Na ligação é criada
+// uma classe escondida que implementa a interface funcional, com um field
+// por valor capturado e o método da interface ligado a um nativo que repassa
+// capturados e argumentos ao método de implementação. Cada execução do
+// sítio só aloca uma instância; sem capturas, é sempre a mesma instância.
+class LambdaCallSite : public CallSite {
+public:
+  static std::shared_ptr<LambdaCallSite> link(Runtime *runtime,
+                                              const LambdaSpec &spec);
+
+  void invoke(Thread *thread, OperandStack &stack) const override;
+
+  RuntimeClass *lambda_class() const { return lambda_class_; }
+
+private:
+  // Chamada do método da interface numa instância da classe escondida
+  static void forward(Thread *thread, Frame &args, OperandStack &result);
+
+  RuntimeClass *lambda_class_ = nullptr;
+  // Fields dos valores capturados, na ordem do descritor do sítio
+  std::vector<RuntimeField *> captured_;
+  // Estático com a instância única, quando não há capturas
+  RuntimeField *singleton_ = nullptr;
+
+  u1 kind_ = 0;
+  RuntimeMethod *implementation_ = nullptr;
+  RuntimeClass *constructed_ = nullptr; // REF_newInvokeSpecial
+  // Posições de referência entre as variáveis locais do método de
+  // implementação (seguradas em handles durante o `new` do construtor)
+  std::vector<u2> ref_locals_;
+  u2 implementation_locals_ = 0;
+  char sam_return_ = 'V';
+  char implementation_return_ = 'V';
+};
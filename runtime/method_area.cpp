@@ -1,4 +1,5 @@
 #include "./runtime_class_types.h"
+#include "./jit.h"
 
 #include <string>
 #include <utility>
@@ -13,4 +14,85 @@ RuntimeClass *MethodArea::getClassRef(const std::string &name) {
 
 void MethodArea::storeClass(std::unique_ptr<RuntimeClass> klass) {
   classes.emplace(klass->name, std::move(klass));
-}
\ No newline at end of file
+}
+
+std::vector<RuntimeClass *> MethodArea::getClasses() const {
+  std::vector<RuntimeClass *> result;
+  result.reserve(classes.size());
+  for (const auto &pair : classes)
+    result.push_back(pair.second.get());
+  return result;
+}
+
+static bool is_concrete(const RuntimeClass *klass) {
+  return !klass->is_interface() &&
+         (klass->access_flags & ACC_Abstract_Class) == 0;
+}
+
+// As chamadas seguintes vão para o código de templates. O tier volta a
+// Compiled e o countdown a 1: o método pode ser otimizado de novo, agora
+// sem a suposição.
+static void invalidate(CompiledMethod &code) {
+  code.invalidated = true;
+  RuntimeMethod *method = code.method;
+  if (method->compiled.get() != &code)
+    return;
+  method->compiled = code.baseline;
+  method->profile.tier = Tier::Compiled;
+  method->profile.countdown = 1;
+}
+
+void MethodArea::add_to_hierarchy(RuntimeClass *klass) {
+  if (klass->super_class)
+    subclasses[klass->super_class].push_back(klass);
+  if (!is_concrete(klass))
+    return;
+
+  size_t kept = 0;
+  for (Dependency &dependency : dependencies) {
+    std::shared_ptr<CompiledMethod> code = dependency.code.lock();
+    if (!code || code->invalidated)
+      continue;
+    const HierarchyDependency &assumption = dependency.assumption;
+    if (klass->is_assignable_to(assumption.resolved->owner) &&
+        klass->dispatch_virtual(assumption.resolved) != assumption.target) {
+      invalidate(*code);
+      continue;
+    }
+    dependencies[kept++] = std::move(dependency);
+  }
+  dependencies.resize(kept);
+}
+
+RuntimeMethod *
+MethodArea::unique_implementation(RuntimeMethod *resolved) const {
+  // Interfaces ficam de fora: o verificador não garante que o receptor de
+  // invokeinterface as implementa
+  RuntimeClass *root = resolved->owner;
+  if (!root || root->is_interface() || resolved->vtable_index < 0)
+    return nullptr;
+
+  RuntimeMethod *unique = nullptr;
+  std::vector<const RuntimeClass *> pending = {root};
+  while (!pending.empty()) {
+    const RuntimeClass *klass = pending.back();
+    pending.pop_back();
+    if (is_concrete(klass)) {
+      RuntimeMethod *target = klass->dispatch_virtual(resolved);
+      if (unique && target != unique)
+        return nullptr;
+      unique = target;
+    }
+    auto it = subclasses.find(klass);
+    if (it != subclasses.end())
+      pending.insert(pending.end(), it->second.begin(), it->second.end());
+  }
+  if (unique && unique->is_abstract())
+    return nullptr;
+  return unique;
+}
+
+void MethodArea::add_dependency(const HierarchyDependency &assumption,
+                                const std::shared_ptr<CompiledMethod> &code) {
+  dependencies.push_back({assumption, code});
+}
@@ -0,0 +1,375 @@
+#include "./native.h"
+#include "./array_ops.h"
+#include "./java_string.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+RuntimeObject *arg_ref(const Frame &args, u2 index) {
+  return slot_to_ref(args.local_vars[index]);
+}
+
+int32_t arg_int(const Frame &args, u2 index) {
+  return static_cast<int32_t>(args.local_vars[index]);
+}
+
+float arg_float(const Frame &args, u2 index) {
+  u4 bits = static_cast<u4>(args.local_vars[index]);
+  float v;
+  std::memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// java.lang.Math
+
+// min/max de ponto flutuante: NaN contamina e -0.0 é menor que 0.0
+template <typename T> T java_min(T a, T b) {
+  if (std::isnan(a) || std::isnan(b))
+    return a + b;
+  if (a == 0 && b == 0)
+    return std::signbit(a) ? a : b;
+  return a < b ? a : b;
+}
+
+template <typename T> T java_max(T a, T b) {
+  if (std::isnan(a) || std::isnan(b))
+    return a + b;
+  if (a == 0 && b == 0)
+    return std::signbit(a) ? b : a;
+  return a > b ? a : b;
+}
+
+void math_sqrt(Thread *, Frame &args, OperandStack &result) {
+  result.push_double(std::sqrt(args.load_double(0)));
+}
+
+// abs(MIN_VALUE) é o próprio MIN_VALUE
+void math_abs_int(Thread *, Frame &args, OperandStack &result) {
+  u4 v = static_cast<u4>(arg_int(args, 0));
+  result.push_int(static_cast<int32_t>(arg_int(args, 0) < 0 ? 0u - v : v));
+}
+
+void math_abs_long(Thread *, Frame &args, OperandStack &result) {
+  u8 v = static_cast<u8>(args.load_long(0));
+  result.push_long(static_cast<int64_t>(args.load_long(0) < 0 ? 0u - v : v));
+}
+
+void math_abs_float(Thread *, Frame &args, OperandStack &result) {
+  result.push_float(std::fabs(arg_float(args, 0)));
+}
+
+void math_abs_double(Thread *, Frame &args, OperandStack &result) {
+  result.push_double(std::fabs(args.load_double(0)));
+}
+
+void math_min_int(Thread *, Frame &args, OperandStack &result) {
+  int32_t a = arg_int(args, 0), b = arg_int(args, 1);
+  result.push_int(a < b ? a : b);
+}
+
+void math_max_int(Thread *, Frame &args, OperandStack &result) {
+  int32_t a = arg_int(args, 0), b = arg_int(args, 1);
+  result.push_int(a > b ? a : b);
+}
+
+void math_min_long(Thread *, Frame &args, OperandStack &result) {
+  int64_t a = args.load_long(0), b = args.load_long(2);
+  result.push_long(a < b ? a : b);
+}
+
+void math_max_long(Thread *, Frame &args, OperandStack &result) {
+  int64_t a = args.load_long(0), b = args.load_long(2);
+  result.push_long(a > b ? a : b);
+}
+
+void math_min_float(Thread *, Frame &args, OperandStack &result) {
+  result.push_float(java_min(arg_float(args, 0), arg_float(args, 1)));
+}
+
+void math_max_float(Thread *, Frame &args, OperandStack &result) {
+  result.push_float(java_max(arg_float(args, 0), arg_float(args, 1)));
+}
+
+void math_min_double(Thread *, Frame &args, OperandStack &result) {
+  result.push_double(java_min(args.load_double(0), args.load_double(2)));
+}
+
+void math_max_double(Thread *, Frame &args, OperandStack &result) {
+  result.push_double(java_max(args.load_double(0), args.load_double(2)));
+}
+
+// java.lang.System
+
+void system_arraycopy(Thread *, Frame &args, OperandStack &) {
+  array_copy(arg_ref(args, 0), arg_int(args, 1), arg_ref(args, 2),
+             arg_int(args, 3), arg_int(args, 4));
+}
+
+void system_nano_time(Thread *, Frame &, OperandStack &result) {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  result.push_long(static_cast<int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()));
+}
+
+void system_identity_hash_code(Thread *, Frame &args, OperandStack &result) {
+  RuntimeObject *obj = arg_ref(args, 0);
+  result.push_int(obj ? obj->identity_hash() : 0);
+}
+
+// java.lang.Object
+
+void object_hash_code(Thread *, Frame &args, OperandStack &result) {
+  result.push_int(arg_ref(args, 0)->identity_hash());
+}
+
+bool implements_named(const RuntimeClass *klass, const std::string &name) {
+  for (; klass; klass = klass->super_class)
+    for (const RuntimeClass *iface : klass->interfaces)
+      if (iface->name == name || implements_named(iface, name))
+        return true;
+  return false;
+}
+
+// Cópia rasa. O clone ganha um mark word novo: sem idade nem hash.
+void object_clone(Thread *thread, Frame &args, OperandStack &result) {
+  RuntimeObject *self = arg_ref(args, 0);
+  if (self->klass->is_array()) {
+    result.push_ref(array_clone(thread, self));
+    return;
+  }
+  if (!implements_named(self->klass, "java/lang/Cloneable"))
+    throw std::runtime_error("CloneNotSupportedException: " +
+                             self->klass->name);
+
+  Handle source(thread, self);
+  RuntimeObject *copy = RuntimeObject::allocate(thread, self->klass);
+  self = source.get();
+  std::memcpy(copy->data(), self->data(), self->klass->data_size());
+
+  // Objetos grandes nascem na geração velha
+  for (RuntimeClass *k = copy->klass; k; k = k->super_class)
+    for (const auto &pair : k->fields)
+      if (!pair.second.is_static && pair.second.is_reference())
+        write_barrier(copy->data() + pair.second.offset);
+  result.push_ref(copy);
+}
+
+// java.lang.String (ver java_string.h)
+
+// Strings com o mesmo conteúdo têm o mesmo coder (só vira UTF16 quem não
+// cabe em LATIN1), então basta comparar os bytes
+void string_equals(Thread *, Frame &args, OperandStack &result) {
+  RuntimeObject *self = arg_ref(args, 0);
+  RuntimeObject *other = arg_ref(args, 1);
+  if (self == other) {
+    result.push_int(1);
+    return;
+  }
+  if (!other || other->klass != self->klass) {
+    result.push_int(0);
+    return;
+  }
+
+  StringView a = string_view(self), b = string_view(other);
+  result.push_int(a.coder == b.coder && array_equals(a.value, b.value));
+}
+
+// s[0]*31^(n-1) + ... + s[n-1], guardado no field hash
+void string_hash_code(Thread *, Frame &args, OperandStack &result) {
+  RuntimeObject *self = arg_ref(args, 0);
+  RuntimeField &hash_field = string_hash_field(self->klass);
+  int32_t cached = self->read_field<int32_t>(hash_field);
+  if (cached != 0) {
+    result.push_int(cached);
+    return;
+  }
+
+  StringView s = string_view(self);
+  u4 h = 0;
+  if (s.coder == CODER_LATIN1) {
+    const u1 *bytes = s.value->array_data();
+    for (int32_t i = 0; i < s.length; i++)
+      h = 31 * h + bytes[i];
+  } else {
+    for (int32_t i = 0; i < s.length; i++)
+      h = 31 * h + s.char_at(i);
+  }
+
+  self->write_field<int32_t>(hash_field, static_cast<int32_t>(h));
+  result.push_int(static_cast<int32_t>(h));
+}
+
+int32_t index_of_char(const StringView &s, int32_t ch, int32_t from) {
+  if (from < 0)
+    from = 0;
+  if (from >= s.length)
+    return -1;
+
+  if (s.coder == CODER_LATIN1) {
+    if (ch < 0 || ch > 0xFF)
+      return -1;
+    const u1 *bytes = s.value->array_data();
+    const void *found = std::memchr(bytes + from, ch, s.length - from);
+    return found ? static_cast<int32_t>(static_cast<const u1 *>(found) - bytes)
+                 : -1;
+  }
+
+  if (ch >= 0 && ch < 0x10000) {
+    for (int32_t i = from; i < s.length; i++)
+      if (s.char_at(i) == ch)
+        return i;
+    return -1;
+  }
+  if (ch < 0 || ch > 0x10FFFF)
+    return -1;
+
+  // Código suplementar: procura o par de surrogates
+  u2 high = static_cast<u2>(0xD800 + ((ch - 0x10000) >> 10));
+  u2 low = static_cast<u2>(0xDC00 + ((ch - 0x10000) & 0x3FF));
+  for (int32_t i = from; i + 1 < s.length; i++)
+    if (s.char_at(i) == high && s.char_at(i + 1) == low)
+      return i;
+  return -1;
+}
+
+void string_index_of_char(Thread *, Frame &args, OperandStack &result) {
+  result.push_int(
+      index_of_char(string_view(arg_ref(args, 0)), arg_int(args, 1), 0));
+}
+
+void string_index_of_char_from(Thread *, Frame &args, OperandStack &result) {
+  result.push_int(index_of_char(string_view(arg_ref(args, 0)),
+                                arg_int(args, 1), arg_int(args, 2)));
+}
+
+void string_index_of_string(Thread *, Frame &args, OperandStack &result) {
+  RuntimeObject *needle_obj = arg_ref(args, 1);
+  if (!needle_obj)
+    throw std::runtime_error("NullPointerException: String.indexOf");
+
+  StringView hay = string_view(arg_ref(args, 0));
+  StringView needle = string_view(needle_obj);
+  if (needle.length == 0) {
+    result.push_int(0);
+    return;
+  }
+
+  // Cada candidato começa no próximo primeiro caractere do padrão
+  int32_t last = hay.length - needle.length;
+  for (int32_t i = 0; i <= last; i++) {
+    i = index_of_char(hay, needle.char_at(0), i);
+    if (i < 0 || i > last)
+      break;
+
+    bool match;
+    if (hay.coder == needle.coder)
+      match = std::memcmp(hay.value->array_data() + (i << hay.coder),
+                          needle.value->array_data(),
+                          needle.value->array_length()) == 0;
+    else {
+      match = true;
+      for (int32_t j = 1; match && j < needle.length; j++)
+        match = hay.char_at(i + j) == needle.char_at(j);
+    }
+    if (match) {
+      result.push_int(i);
+      return;
+    }
+  }
+  result.push_int(-1);
+}
+
+void string_intern(Thread *thread, Frame &args, OperandStack &result) {
+  result.push_ref(thread->runtime->strings->intern(arg_ref(args, 0)));
+}
+
+struct Intrinsic {
+  const char *klass;
+  const char *name;
+  const char *descriptor;
+  NativeMethod function;
+};
+
+const Intrinsic intrinsics[] = {
+    {"java/lang/Math", "sqrt", "(D)D", math_sqrt},
+    {"java/lang/Math", "abs", "(I)I", math_abs_int},
+    {"java/lang/Math", "abs", "(J)J", math_abs_long},
+    {"java/lang/Math", "abs", "(F)F", math_abs_float},
+    {"java/lang/Math", "abs", "(D)D", math_abs_double},
+    {"java/lang/Math", "min", "(II)I", math_min_int},
+    {"java/lang/Math", "max", "(II)I", math_max_int},
+    {"java/lang/Math", "min", "(JJ)J", math_min_long},
+    {"java/lang/Math", "max", "(JJ)J", math_max_long},
+    {"java/lang/Math", "min", "(FF)F", math_min_float},
+    {"java/lang/Math", "max", "(FF)F", math_max_float},
+    {"java/lang/Math", "min", "(DD)D", math_min_double},
+    {"java/lang/Math", "max", "(DD)D", math_max_double},
+    {"java/lang/StrictMath", "sqrt", "(D)D", math_sqrt},
+    {"java/lang/System", "arraycopy",
+     "(Ljava/lang/Object;ILjava/lang/Object;II)V", system_arraycopy},
+    {"java/lang/System", "nanoTime", "()J", system_nano_time},
+    {"java/lang/System", "identityHashCode", "(Ljava/lang/Object;)I",
+     system_identity_hash_code},
+    {"java/lang/Object", "hashCode", "()I", object_hash_code},
+    {"java/lang/Object", "clone", "()Ljava/lang/Object;", object_clone},
+    {"java/lang/String", "equals", "(Ljava/lang/Object;)Z", string_equals},
+    {"java/lang/String", "hashCode", "()I", string_hash_code},
+    {"java/lang/String", "indexOf", "(I)I", string_index_of_char},
+    {"java/lang/String", "indexOf", "(II)I", string_index_of_char_from},
+    {"java/lang/String", "indexOf", "(Ljava/lang/String;)I",
+     string_index_of_string},
+    {"java/lang/String", "intern", "()Ljava/lang/String;", string_intern},
+};
+
+} // namespace
+
+std::unordered_map<std::string, NativeRegistry::ClassTable> &
+NativeRegistry::table() {
+  static std::unordered_map<std::string, ClassTable> classes = [] {
+    std::unordered_map<std::string, ClassTable> initial;
+    for (const Intrinsic &i : intrinsics)
+      initial[i.klass][MemberKey::of(i.name, i.descriptor)] = i.function;
+    return initial;
+  }();
+  return classes;
+}
+
+void NativeRegistry::register_method(const std::string &klass,
+                                     const std::string &name,
+                                     const std::string &descriptor,
+                                     NativeMethod function) {
+  table()[klass][MemberKey::of(name, descriptor)] = function;
+}
+
+NativeMethod NativeRegistry::lookup(const std::string &klass,
+                                    const MemberKey &key) {
+  auto it = table().find(klass);
+  if (it == table().end())
+    return nullptr;
+  auto method = it->second.find(key);
+  return method == it->second.end() ? nullptr : method->second;
+}
+
+void NativeRegistry::bind(RuntimeClass &klass) {
+  auto it = table().find(klass.name);
+  if (it == table().end())
+    return;
+  for (auto &pair : klass.methods) {
+    auto method = it->second.find(pair.first);
+    if (method != it->second.end())
+      pair.second.native = method->second;
+  }
+}
+
+void invoke_native(Thread *thread, RuntimeMethod *method, Frame &args,
+                   OperandStack &result) {
+  if (!method->native)
+    throw std::runtime_error("UnsatisfiedLinkError: " + method->owner->name +
+                             "." + method->name + method->descriptor);
+  method->native(thread, args, result);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+#include <string>
+#include <unordered_map>
+
+// Registro por classe, nome e descritor. A ligação de uma classe consulta o
+// registro para cada método declarado: métodos ACC_NATIVE recebem a sua
+// implementação, e métodos com bytecode também podem ser trocados por um
+// intrínseco, que passa a rodar no lugar do bytecode.
+class NativeRegistry {
+public:
+  // Vale para as classes carregadas depois do registro
+  static void register_method(const std::string &klass,
+                              const std::string &name,
+                              const std::string &descriptor,
+                              NativeMethod function);
+
+  static NativeMethod lookup(const std::string &klass, const MemberKey &key);
+
+  // Preenche RuntimeMethod::native dos métodos da classe
+  static void bind(RuntimeClass &klass);
+
+private:
+  using ClassTable =
+      std::unordered_map<MemberKey, NativeMethod, MemberKeyHash>;
+  static std::unordered_map<std::string, ClassTable> &table();
+};
+
+// Chamada de um método com implementação nativa; UnsatisfiedLinkError se
+// o método é ACC_NATIVE e nada foi registrado para ele
+void invoke_native(Thread *thread, RuntimeMethod *method, Frame &args,
+                   OperandStack &result);
@@ -0,0 +1,115 @@
+#include "./runtime_class_types.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+RuntimeObject *RuntimeObject::allocate(Thread *thread, RuntimeClass *k) {
+  // O heap entrega memória zerada: os fields já têm o valor padrão
+  void *memory = thread->runtime->heap->allocate(thread->tlab, size_for(k));
+  return new (memory) RuntimeObject(k);
+}
+
+RuntimeObject *RuntimeObject::allocate_tenured(Thread *thread,
+                                               RuntimeClass *k) {
+  void *memory = thread->runtime->heap->allocate_tenured(size_for(k));
+  return new (memory) RuntimeObject(k);
+}
+
+static u4 checked_length(int32_t length) {
+  if (length < 0)
+    throw std::runtime_error("NegativeArraySizeException: " +
+                             std::to_string(length));
+  return static_cast<u4>(length);
+}
+
+RuntimeObject *RuntimeObject::construct_array(void *memory, RuntimeClass *k,
+                                              u4 length) {
+  RuntimeObject *array = new (memory) RuntimeObject(k);
+  std::memcpy(array->data(), &length, sizeof(length));
+  return array;
+}
+
+RuntimeObject *RuntimeObject::allocate_array(Thread *thread, RuntimeClass *k,
+                                             int32_t length) {
+  u4 count = checked_length(length);
+  void *memory =
+      thread->runtime->heap->allocate(thread->tlab, array_size_for(k, count));
+  return construct_array(memory, k, count);
+}
+
+RuntimeObject *RuntimeObject::allocate_tenured_array(Thread *thread,
+                                                     RuntimeClass *k,
+                                                     int32_t length) {
+  u4 count = checked_length(length);
+  void *memory =
+      thread->runtime->heap->allocate_tenured(array_size_for(k, count));
+  return construct_array(memory, k, count);
+}
+
+static RuntimeObject *allocate_dimension(Thread *thread, RuntimeClass *k,
+                                         const std::vector<int32_t> &dims,
+                                         size_t depth) {
+  RuntimeObject *array = RuntimeObject::allocate_array(thread, k, dims[depth]);
+  if (depth + 1 == dims.size())
+    return array;
+  if (!k->is_reference_array() || !k->component->is_array())
+    throw std::runtime_error("multianewarray: too many dimensions for " +
+                             k->name);
+
+  // Cada subarray alocado pode mover o array externo
+  Handle outer(thread, array);
+  for (int32_t i = 0; i < dims[depth]; i++) {
+    RuntimeObject *inner = allocate_dimension(thread, k->component, dims,
+                                              depth + 1);
+    outer.get()->array_store_ref(static_cast<u4>(i), inner);
+  }
+  return outer.get();
+}
+
+RuntimeObject *
+RuntimeObject::allocate_multi_array(Thread *thread, RuntimeClass *k,
+                                    const std::vector<int32_t> &dims) {
+  if (dims.empty())
+    throw std::runtime_error("multianewarray: no dimensions");
+  for (int32_t count : dims)
+    if (count < 0)
+      throw std::runtime_error("NegativeArraySizeException: " +
+                               std::to_string(count));
+  return allocate_dimension(thread, k, dims, 0);
+}
+
+void RuntimeObject::check_index(int32_t index) const {
+  u4 length = array_length();
+  if (index < 0 || static_cast<u4>(index) >= length)
+    throw std::runtime_error("ArrayIndexOutOfBoundsException: Index " +
+                             std::to_string(index) +
+                             " out of bounds for length " +
+                             std::to_string(length));
+}
+
+void RuntimeObject::check_store(RuntimeObject *value) const {
+  if (value && !value->klass->is_assignable_to(klass->component))
+    throw std::runtime_error("ArrayStoreException: " + value->klass->name);
+}
+
+int32_t RuntimeObject::identity_hash() {
+  uintptr_t hash = (mark & MARK_HASH_MASK) >> MARK_HASH_SHIFT;
+  if (hash)
+    return static_cast<int32_t>(hash);
+
+  // xorshift de Marsaglia por thread, como o hashCode=5 da HotSpot
+  static thread_local u4 x = 0x9e3779b9, y = 842502087, z = 0x8767,
+                         w = 273326509;
+  do {
+    u4 t = x ^ (x << 11);
+    x = y;
+    y = z;
+    z = w;
+    w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
+    hash = w & (MARK_HASH_MASK >> MARK_HASH_SHIFT);
+  } while (hash == 0);
+
+  mark = (mark & ~MARK_HASH_MASK) | (hash << MARK_HASH_SHIFT);
+  return static_cast<int32_t>(hash);
+}
@@ -0,0 +1,982 @@
+#include "./reference_map.h"
+#include "../classfile/bytecode.h"
+#include "./runtime_class_types.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Tipo de um slot da JVMS. long/double ocupam dois slots: o tipo no
+// primeiro e Top no segundo. A pilha física do OperandStack só tem os dois
+// sem JVM_WIDE_SLOTS; collect() converte.
+enum class VType : u1 { Top, Int, Float, Long, Double, Ref, ReturnAddress };
+
+struct State {
+  std::vector<VType> locals;
+  std::vector<VType> stack;
+};
+
+void push_type(std::vector<VType> &out, char c) {
+  switch (c) {
+  case 'V':
+    return;
+  case 'J':
+    out.push_back(VType::Long);
+    out.push_back(VType::Top);
+    return;
+  case 'D':
+    out.push_back(VType::Double);
+    out.push_back(VType::Top);
+    return;
+  case 'F':
+    out.push_back(VType::Float);
+    return;
+  case 'L':
+  case '[':
+    out.push_back(VType::Ref);
+    return;
+  default: // Z, B, C, S, I
+    out.push_back(VType::Int);
+  }
+}
+
+u4 type_slots(char c) {
+  if (c == 'V')
+    return 0;
+  return (c == 'J' || c == 'D') ? 2 : 1;
+}
+
+// Tipos dos argumentos (expandidos em slots) e tipo de retorno de um
+// descritor de método
+void parse_method_descriptor(const std::string &desc,
+                             std::vector<VType> &args, char &ret) {
+  size_t i = 1; // pula '('
+  while (i < desc.size() && desc[i] != ')') {
+    char c = desc[i];
+    if (c == '[') {
+      while (desc[i] == '[')
+        i++;
+      if (desc[i] == 'L')
+        i = desc.find(';', i);
+      c = '[';
+    } else if (c == 'L') {
+      i = desc.find(';', i);
+    }
+    push_type(args, c);
+    i++;
+  }
+  ret = i + 1 < desc.size() ? desc[i + 1] : 'V';
+}
+
+VType from_verification_type(const VerificationTypeInfo &vti) {
+  switch (vti.tag) {
+  case VTTag::Integer:
+    return VType::Int;
+  case VTTag::Float:
+    return VType::Float;
+  case VTTag::Long:
+    return VType::Long;
+  case VTTag::Double:
+    return VType::Double;
+  case VTTag::Null:
+  case VTTag::UninitializedThis:
+  case VTTag::Object:
+  case VTTag::Uninitialized:
+    return VType::Ref;
+  default:
+    return VType::Top;
+  }
+}
+
+void append_verification_types(std::vector<VType> &out,
+                               const std::vector<VerificationTypeInfo> &vtis) {
+  for (const auto &vti : vtis) {
+    VType t = from_verification_type(vti);
+    out.push_back(t);
+    if (t == VType::Long || t == VType::Double)
+      out.push_back(VType::Top);
+  }
+}
+
+class Analyzer {
+public:
+  Analyzer(const RuntimeMethod &method)
+      : method(method), code(*method.code), cf(*method.owner->class_file),
+        states(code.code_length), fixed(code.code_length, false),
+        queued(code.code_length, false) {}
+
+  void run();
+  void collect(u2 &max_locals, u2 &max_stack,
+               std::vector<ReferenceMap::Entry> &entries,
+               std::vector<bool> &bits) const;
+
+private:
+  const RuntimeMethod &method;
+  const CodeAttribute &code;
+  const ClassFile &cf;
+
+  std::vector<std::unique_ptr<State>> states; // estado antes de cada pc
+  std::vector<bool> fixed;                    // estado vindo da StackMapTable
+  std::vector<bool> queued;
+  std::vector<u4> worklist;
+
+  State entry_state() const;
+  void load_stack_map_frames(const State &initial);
+  void flow(u4 target, const State &s);
+  void step(u4 pc, State &s, std::vector<u4> &successors, bool &falls);
+
+  [[noreturn]] void fail(const std::string &what) const {
+    throw std::runtime_error("VerifyError: " + what + " in " +
+                             method.owner->name + "." + method.name +
+                             method.descriptor);
+  }
+
+  VType pop(State &s) {
+    if (s.stack.empty())
+      fail("operand stack underflow");
+    VType t = s.stack.back();
+    s.stack.pop_back();
+    return t;
+  }
+  void pop(State &s, u4 n) {
+    for (u4 i = 0; i < n; i++)
+      pop(s);
+  }
+  void push(State &s, char descriptor_char) {
+    push_type(s.stack, descriptor_char);
+  }
+
+  void load(State &s, u2 index, char type) {
+    if (index >= s.locals.size())
+      fail("local variable index out of range");
+    push(s, type);
+  }
+  void store(State &s, u2 index, VType t, u4 slots) {
+    if (index + slots > s.locals.size())
+      fail("local variable index out of range");
+    // Sobrescrever a segunda metade de um long/double invalida a primeira
+    if (index > 0 && (s.locals[index - 1] == VType::Long ||
+                      s.locals[index - 1] == VType::Double))
+      s.locals[index - 1] = VType::Top;
+    s.locals[index] = t;
+    if (slots == 2)
+      s.locals[index + 1] = VType::Top;
+  }
+
+  const ConstantNameAndTypeInfo &name_and_type(u2 index) const;
+  std::string member_descriptor(u2 index) const {
+    return cf.resolve_utf8(name_and_type(index).descriptor_index);
+  }
+  void invoke(State &s, u2 index, bool has_receiver);
+};
+
+State Analyzer::entry_state() const {
+  State s;
+  if (!method.is_static())
+    s.locals.push_back(VType::Ref);
+
+  char ret;
+  parse_method_descriptor(method.descriptor, s.locals, ret);
+  if (s.locals.size() > code.max_locals)
+    fail("arguments exceed max_locals");
+  s.locals.resize(code.max_locals, VType::Top);
+  return s;
+}
+
+void Analyzer::load_stack_map_frames(const State &initial) {
+  const StackMapTableInfo *table = nullptr;
+  for (const auto &attr : code.attributes)
+    if (attr.attribute_name == "StackMapTable")
+      table = &attr.stackmaptable_info;
+  if (!table)
+    return;
+
+  // Os frames são deltas: começam dos locals implícitos do descritor
+  std::vector<VerificationTypeInfo> locals;
+  if (!method.is_static()) {
+    VerificationTypeInfo self{};
+    self.tag = method.name == "<init>" ? VTTag::UninitializedThis
+                                       : VTTag::Object;
+    locals.push_back(self);
+  }
+  for (size_t i = method.is_static() ? 0 : 1; i < initial.locals.size();
+       i++) {
+    VerificationTypeInfo vti{};
+    switch (initial.locals[i]) {
+    case VType::Int:
+      vti.tag = VTTag::Integer;
+      break;
+    case VType::Float:
+      vti.tag = VTTag::Float;
+      break;
+    case VType::Long:
+      vti.tag = VTTag::Long;
+      i++;
+      break;
+    case VType::Double:
+      vti.tag = VTTag::Double;
+      i++;
+      break;
+    case VType::Ref:
+      vti.tag = VTTag::Object;
+      break;
+    default:
+      continue; // padding de max_locals
+    }
+    locals.push_back(vti);
+  }
+
+  std::vector<VerificationTypeInfo> stack;
+  int64_t pc = -1;
+  for (const auto &frame : table->entries) {
+    pc += frame.offset_delta + 1;
+    stack.clear();
+
+    switch (frame.kind) {
+    case SMFKind::Same:
+    case SMFKind::SameExt:
+      break;
+    case SMFKind::SameLocals1StackItem:
+    case SMFKind::SameLocals1StackItemExt:
+      stack.push_back(frame.stack_item);
+      break;
+    case SMFKind::Chop: {
+      size_t k = 251 - frame.frame_type;
+      locals.resize(locals.size() > k ? locals.size() - k : 0);
+      break;
+    }
+    case SMFKind::Append:
+      locals.insert(locals.end(), frame.locals_appended.begin(),
+                    frame.locals_appended.end());
+      break;
+    case SMFKind::Full:
+      locals = frame.locals_full;
+      stack = frame.stack_full;
+      break;
+    }
+
+    if (pc >= code.code_length)
+      fail("StackMapTable frame outside the code");
+
+    std::unique_ptr<State> s(new State());
+    append_verification_types(s->locals, locals);
+    s->locals.resize(code.max_locals, VType::Top);
+    append_verification_types(s->stack, stack);
+    states[pc] = std::move(s);
+    fixed[pc] = true;
+  }
+}
+
+void Analyzer::flow(u4 target, const State &s) {
+  if (target >= code.code_length)
+    fail("branch target outside the code");
+
+  bool changed = false;
+  if (fixed[target]) {
+    // A StackMapTable é a verdade nesse pc
+    changed = !queued[target];
+  } else if (!states[target]) {
+    states[target].reset(new State(s));
+    changed = true;
+  } else {
+    State &dst = *states[target];
+    if (dst.stack.size() != s.stack.size())
+      fail("inconsistent stack height");
+    for (size_t i = 0; i < dst.locals.size(); i++) {
+      if (dst.locals[i] != s.locals[i] && dst.locals[i] != VType::Top) {
+        dst.locals[i] = VType::Top;
+        changed = true;
+      }
+    }
+    for (size_t i = 0; i < dst.stack.size(); i++) {
+      if (dst.stack[i] != s.stack[i] && dst.stack[i] != VType::Top) {
+        dst.stack[i] = VType::Top;
+        changed = true;
+      }
+    }
+  }
+
+  if (changed) {
+    queued[target] = true;
+    worklist.push_back(target);
+  }
+}
+
+const ConstantNameAndTypeInfo &Analyzer::name_and_type(u2 index) const {
+  if (index >= cf.constant_pool.size())
+    fail("constant pool index out of range");
+
+  const ConstantPoolEntry &entry = cf.constant_pool[index];
+  u2 nat;
+  switch (entry.first) {
+  case ConstantTag::CONSTANT_Fieldref:
+    nat = entry.second.fieldref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_Methodref:
+    nat = entry.second.methodref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_InterfaceMethodref:
+    nat = entry.second.interface_methodref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_InvokeDynamic:
+  case ConstantTag::CONSTANT_Dynamic:
+    nat = entry.second.invoke_dynamic_info.name_and_type_index;
+    break;
+  default:
+    fail("unsupported member reference");
+  }
+  return cf.constant_pool[nat].second.name_and_type_info;
+}
+
+void Analyzer::invoke(State &s, u2 index, bool has_receiver) {
+  std::vector<VType> args;
+  char ret;
+  parse_method_descriptor(member_descriptor(index), args, ret);
+  pop(s, static_cast<u4>(args.size()) + (has_receiver ? 1 : 0));
+  push(s, ret);
+}
+
+void Analyzer::step(u4 pc, State &s, std::vector<u4> &successors,
+                    bool &falls) {
+  const std::vector<u1> &c = code.code;
+  u1 op = c[pc];
+  falls = true;
+
+  auto branch16 = [&]() {
+    successors.push_back(pc + static_cast<int16_t>(read_code_u2(c, pc + 1)));
+  };
+
+  switch (op) {
+  case OP_nop:
+    break;
+  case OP_aconst_null:
+    push(s, 'L');
+    break;
+  case OP_iconst_m1:
+  case OP_iconst_0:
+  case OP_iconst_1:
+  case OP_iconst_2:
+  case OP_iconst_3:
+  case OP_iconst_4:
+  case OP_iconst_5:
+  case OP_bipush:
+  case OP_sipush:
+    push(s, 'I');
+    break;
+  case OP_lconst_0:
+  case OP_lconst_1:
+    push(s, 'J');
+    break;
+  case OP_fconst_0:
+  case OP_fconst_1:
+  case OP_fconst_2:
+    push(s, 'F');
+    break;
+  case OP_dconst_0:
+  case OP_dconst_1:
+    push(s, 'D');
+    break;
+
+  case OP_ldc:
+  case OP_ldc_w:
+  case OP_ldc2_w: {
+    u2 index = op == OP_ldc ? c[pc + 1] : read_code_u2(c, pc + 1);
+    if (index >= cf.constant_pool.size())
+      fail("constant pool index out of range");
+    switch (cf.constant_pool[index].first) {
+    case ConstantTag::CONSTANT_Integer:
+      push(s, 'I');
+      break;
+    case ConstantTag::CONSTANT_Float:
+      push(s, 'F');
+      break;
+    case ConstantTag::CONSTANT_Long:
+      push(s, 'J');
+      break;
+    case ConstantTag::CONSTANT_Double:
+      push(s, 'D');
+      break;
+    case ConstantTag::CONSTANT_Dynamic:
+      push(s, member_descriptor(index)[0]);
+      break;
+    default: // String, Class, MethodType, MethodHandle
+      push(s, 'L');
+    }
+    break;
+  }
+
+  case OP_iload:
+    load(s, c[pc + 1], 'I');
+    break;
+  case OP_lload:
+    load(s, c[pc + 1], 'J');
+    break;
+  case OP_fload:
+    load(s, c[pc + 1], 'F');
+    break;
+  case OP_dload:
+    load(s, c[pc + 1], 'D');
+    break;
+  case OP_aload:
+    load(s, c[pc + 1], 'L');
+    break;
+  case OP_iload_0:
+  case OP_iload_1:
+  case OP_iload_2:
+  case OP_iload_3:
+    load(s, op - OP_iload_0, 'I');
+    break;
+  case OP_lload_0:
+  case OP_lload_1:
+  case OP_lload_2:
+  case OP_lload_3:
+    load(s, op - OP_lload_0, 'J');
+    break;
+  case OP_fload_0:
+  case OP_fload_1:
+  case OP_fload_2:
+  case OP_fload_3:
+    load(s, op - OP_fload_0, 'F');
+    break;
+  case OP_dload_0:
+  case OP_dload_1:
+  case OP_dload_2:
+  case OP_dload_3:
+    load(s, op - OP_dload_0, 'D');
+    break;
+  case OP_aload_0:
+  case OP_aload_1:
+  case OP_aload_2:
+  case OP_aload_3:
+    load(s, op - OP_aload_0, 'L');
+    break;
+
+  case OP_iaload:
+  case OP_baload:
+  case OP_caload:
+  case OP_saload:
+    pop(s, 2);
+    push(s, 'I');
+    break;
+  case OP_laload:
+    pop(s, 2);
+    push(s, 'J');
+    break;
+  case OP_faload:
+    pop(s, 2);
+    push(s, 'F');
+    break;
+  case OP_daload:
+    pop(s, 2);
+    push(s, 'D');
+    break;
+  case OP_aaload:
+    pop(s, 2);
+    push(s, 'L');
+    break;
+
+  case OP_istore:
+    pop(s);
+    store(s, c[pc + 1], VType::Int, 1);
+    break;
+  case OP_lstore:
+    pop(s, 2);
+    store(s, c[pc + 1], VType::Long, 2);
+    break;
+  case OP_fstore:
+    pop(s);
+    store(s, c[pc + 1], VType::Float, 1);
+    break;
+  case OP_dstore:
+    pop(s, 2);
+    store(s, c[pc + 1], VType::Double, 2);
+    break;
+  case OP_astore: {
+    VType t = pop(s); // referência ou returnAddress
+    store(s, c[pc + 1], t, 1);
+    break;
+  }
+  case OP_istore_0:
+  case OP_istore_1:
+  case OP_istore_2:
+  case OP_istore_3:
+    pop(s);
+    store(s, op - OP_istore_0, VType::Int, 1);
+    break;
+  case OP_lstore_0:
+  case OP_lstore_1:
+  case OP_lstore_2:
+  case OP_lstore_3:
+    pop(s, 2);
+    store(s, op - OP_lstore_0, VType::Long, 2);
+    break;
+  case OP_fstore_0:
+  case OP_fstore_1:
+  case OP_fstore_2:
+  case OP_fstore_3:
+    pop(s);
+    store(s, op - OP_fstore_0, VType::Float, 1);
+    break;
+  case OP_dstore_0:
+  case OP_dstore_1:
+  case OP_dstore_2:
+  case OP_dstore_3:
+    pop(s, 2);
+    store(s, op - OP_dstore_0, VType::Double, 2);
+    break;
+  case OP_astore_0:
+  case OP_astore_1:
+  case OP_astore_2:
+  case OP_astore_3: {
+    VType t = pop(s);
+    store(s, op - OP_astore_0, t, 1);
+    break;
+  }
+
+  case OP_iastore:
+  case OP_fastore:
+  case OP_aastore:
+  case OP_bastore:
+  case OP_castore:
+  case OP_sastore:
+    pop(s, 3);
+    break;
+  case OP_lastore:
+  case OP_dastore:
+    pop(s, 4);
+    break;
+
+  // Manipulação da pilha: opera sobre slots físicos, então a segunda metade
+  // de long/double acompanha a primeira
+  case OP_pop:
+    pop(s);
+    break;
+  case OP_pop2:
+    pop(s, 2);
+    break;
+  case OP_dup: {
+    VType a = pop(s);
+    s.stack.insert(s.stack.end(), {a, a});
+    break;
+  }
+  case OP_dup_x1: {
+    VType a = pop(s), b = pop(s);
+    s.stack.insert(s.stack.end(), {a, b, a});
+    break;
+  }
+  case OP_dup_x2: {
+    VType a = pop(s), b = pop(s), c3 = pop(s);
+    s.stack.insert(s.stack.end(), {a, c3, b, a});
+    break;
+  }
+  case OP_dup2: {
+    VType a = pop(s), b = pop(s);
+    s.stack.insert(s.stack.end(), {b, a, b, a});
+    break;
+  }
+  case OP_dup2_x1: {
+    VType a = pop(s), b = pop(s), c3 = pop(s);
+    s.stack.insert(s.stack.end(), {b, a, c3, b, a});
+    break;
+  }
+  case OP_dup2_x2: {
+    VType a = pop(s), b = pop(s), c3 = pop(s), d = pop(s);
+    s.stack.insert(s.stack.end(), {b, a, d, c3, b, a});
+    break;
+  }
+  case OP_swap: {
+    VType a = pop(s), b = pop(s);
+    s.stack.insert(s.stack.end(), {a, b});
+    break;
+  }
+
+  case OP_iadd:
+  case OP_isub:
+  case OP_imul:
+  case OP_idiv:
+  case OP_irem:
+  case OP_ishl:
+  case OP_ishr:
+  case OP_iushr:
+  case OP_iand:
+  case OP_ior:
+  case OP_ixor:
+  case OP_fcmpl:
+  case OP_fcmpg:
+    pop(s, 2);
+    push(s, 'I');
+    break;
+  case OP_ladd:
+  case OP_lsub:
+  case OP_lmul:
+  case OP_ldiv:
+  case OP_lrem:
+  case OP_land:
+  case OP_lor:
+  case OP_lxor:
+    pop(s, 4);
+    push(s, 'J');
+    break;
+  case OP_lshl:
+  case OP_lshr:
+  case OP_lushr:
+    pop(s, 3);
+    push(s, 'J');
+    break;
+  case OP_fadd:
+  case OP_fsub:
+  case OP_fmul:
+  case OP_fdiv:
+  case OP_frem:
+    pop(s, 2);
+    push(s, 'F');
+    break;
+  case OP_dadd:
+  case OP_dsub:
+  case OP_dmul:
+  case OP_ddiv:
+  case OP_drem:
+    pop(s, 4);
+    push(s, 'D');
+    break;
+  case OP_ineg:
+  case OP_fneg:
+  case OP_lneg:
+  case OP_dneg:
+  case OP_i2b:
+  case OP_i2c:
+  case OP_i2s:
+    // Mesmo tipo na entrada e na saída
+    break;
+  case OP_iinc:
+    store(s, c[pc + 1], VType::Int, 1);
+    break;
+
+  case OP_i2l:
+  case OP_f2l:
+    pop(s);
+    push(s, 'J');
+    break;
+  case OP_i2f:
+    pop(s);
+    push(s, 'F');
+    break;
+  case OP_i2d:
+  case OP_f2d:
+    pop(s);
+    push(s, 'D');
+    break;
+  case OP_l2i:
+  case OP_d2i:
+    pop(s, 2);
+    push(s, 'I');
+    break;
+  case OP_l2f:
+  case OP_d2f:
+    pop(s, 2);
+    push(s, 'F');
+    break;
+  case OP_l2d:
+    pop(s, 2);
+    push(s, 'D');
+    break;
+  case OP_d2l:
+    pop(s, 2);
+    push(s, 'J');
+    break;
+  case OP_f2i:
+    pop(s);
+    push(s, 'I');
+    break;
+  case OP_lcmp:
+  case OP_dcmpl:
+  case OP_dcmpg:
+    pop(s, 4);
+    push(s, 'I');
+    break;
+
+  case OP_ifeq:
+  case OP_ifne:
+  case OP_iflt:
+  case OP_ifge:
+  case OP_ifgt:
+  case OP_ifle:
+  case OP_ifnull:
+  case OP_ifnonnull:
+    pop(s);
+    branch16();
+    break;
+  case OP_if_icmpeq:
+  case OP_if_icmpne:
+  case OP_if_icmplt:
+  case OP_if_icmpge:
+  case OP_if_icmpgt:
+  case OP_if_icmple:
+  case OP_if_acmpeq:
+  case OP_if_acmpne:
+    pop(s, 2);
+    branch16();
+    break;
+  case OP_goto:
+    branch16();
+    falls = false;
+    break;
+  case OP_goto_w:
+    successors.push_back(pc + static_cast<int32_t>(read_code_u4(c, pc + 1)));
+    falls = false;
+    break;
+  case OP_jsr:
+  case OP_jsr_w:
+    // Sub-rotinas (class files antigos): o retorno volta para a instrução
+    // seguinte com o estado anterior ao jsr
+    s.stack.push_back(VType::ReturnAddress);
+    successors.push_back(
+        op == OP_jsr ? pc + static_cast<int16_t>(read_code_u2(c, pc + 1))
+                     : pc + static_cast<int32_t>(read_code_u4(c, pc + 1)));
+    falls = false;
+    {
+      State after(s);
+      after.stack.pop_back();
+      flow(pc + instruction_length(c, pc), after);
+    }
+    break;
+  case OP_ret:
+    falls = false;
+    break;
+
+  case OP_tableswitch: {
+    pop(s);
+    u4 base = (pc + 4) & ~3u;
+    successors.push_back(pc + static_cast<int32_t>(read_code_u4(c, base)));
+    int32_t low = static_cast<int32_t>(read_code_u4(c, base + 4));
+    int32_t high = static_cast<int32_t>(read_code_u4(c, base + 8));
+    for (int64_t i = 0; i <= static_cast<int64_t>(high) - low; i++)
+      successors.push_back(
+          pc + static_cast<int32_t>(read_code_u4(c, base + 12 + 4 * i)));
+    falls = false;
+    break;
+  }
+  case OP_lookupswitch: {
+    pop(s);
+    u4 base = (pc + 4) & ~3u;
+    successors.push_back(pc + static_cast<int32_t>(read_code_u4(c, base)));
+    u4 npairs = read_code_u4(c, base + 4);
+    for (u4 i = 0; i < npairs; i++)
+      successors.push_back(
+          pc + static_cast<int32_t>(read_code_u4(c, base + 12 + 8 * i)));
+    falls = false;
+    break;
+  }
+
+  case OP_ireturn:
+  case OP_lreturn:
+  case OP_freturn:
+  case OP_dreturn:
+  case OP_areturn:
+  case OP_return:
+  case OP_athrow:
+    falls = false;
+    break;
+
+  case OP_getstatic:
+    push(s, member_descriptor(read_code_u2(c, pc + 1))[0]);
+    break;
+  case OP_putstatic:
+    pop(s, type_slots(member_descriptor(read_code_u2(c, pc + 1))[0]));
+    break;
+  case OP_getfield:
+    pop(s);
+    push(s, member_descriptor(read_code_u2(c, pc + 1))[0]);
+    break;
+  case OP_putfield:
+    pop(s, type_slots(member_descriptor(read_code_u2(c, pc + 1))[0]) + 1);
+    break;
+
+  case OP_invokevirtual:
+  case OP_invokespecial:
+  case OP_invokeinterface:
+    invoke(s, read_code_u2(c, pc + 1), true);
+    break;
+  case OP_invokestatic:
+  case OP_invokedynamic:
+    invoke(s, read_code_u2(c, pc + 1), false);
+    break;
+
+  case OP_new:
+    push(s, 'L');
+    break;
+  case OP_newarray:
+  case OP_anewarray:
+  case OP_checkcast:
+    pop(s);
+    push(s, 'L');
+    break;
+  case OP_arraylength:
+  case OP_instanceof:
+    pop(s);
+    push(s, 'I');
+    break;
+  case OP_monitorenter:
+  case OP_monitorexit:
+    pop(s);
+    break;
+  case OP_multianewarray:
+    pop(s, c[pc + 3]);
+    push(s, 'L');
+    break;
+
+  case OP_wide: {
+    u1 wop = c[pc + 1];
+    u2 index = read_code_u2(c, pc + 2);
+    switch (wop) {
+    case OP_iload:
+      load(s, index, 'I');
+      break;
+    case OP_lload:
+      load(s, index, 'J');
+      break;
+    case OP_fload:
+      load(s, index, 'F');
+      break;
+    case OP_dload:
+      load(s, index, 'D');
+      break;
+    case OP_aload:
+      load(s, index, 'L');
+      break;
+    case OP_istore:
+      pop(s);
+      store(s, index, VType::Int, 1);
+      break;
+    case OP_lstore:
+      pop(s, 2);
+      store(s, index, VType::Long, 2);
+      break;
+    case OP_fstore:
+      pop(s);
+      store(s, index, VType::Float, 1);
+      break;
+    case OP_dstore:
+      pop(s, 2);
+      store(s, index, VType::Double, 2);
+      break;
+    case OP_astore: {
+      VType t = pop(s);
+      store(s, index, t, 1);
+      break;
+    }
+    case OP_iinc:
+      store(s, index, VType::Int, 1);
+      break;
+    case OP_ret:
+      falls = false;
+      break;
+    default:
+      fail("invalid wide instruction");
+    }
+    break;
+  }
+
+  default:
+    fail("unsupported opcode " + std::to_string(op));
+  }
+
+  if (s.stack.size() > code.max_stack)
+    fail("operand stack overflow");
+}
+
+void Analyzer::run() {
+  State initial = entry_state();
+  load_stack_map_frames(initial);
+  flow(0, initial);
+
+  while (!worklist.empty()) {
+    u4 pc = worklist.back();
+    worklist.pop_back();
+
+    State s = *states[pc];
+    State before = s;
+    std::vector<u4> successors;
+    bool falls;
+    step(pc, s, successors, falls);
+
+    if (falls)
+      successors.push_back(pc + instruction_length(code.code, pc));
+    for (u4 target : successors)
+      flow(target, s);
+
+    // Handlers recebem os locals de antes e de depois da instrução, com
+    // só a exceção na pilha
+    for (const auto &handler : code.exception_table) {
+      if (pc < handler.start_pc || pc >= handler.end_pc)
+        continue;
+      State h;
+      h.stack.push_back(VType::Ref);
+      h.locals = before.locals;
+      flow(handler.handler_pc, h);
+      h.locals = s.locals;
+      flow(handler.handler_pc, h);
+    }
+  }
+}
+
+void Analyzer::collect(u2 &max_locals, u2 &max_stack,
+                       std::vector<ReferenceMap::Entry> &entries,
+                       std::vector<bool> &bits) const {
+  max_locals = code.max_locals;
+  max_stack = code.max_stack;
+  u4 width = static_cast<u4>(max_locals) + 2u * max_stack;
+
+  for (u4 pc = 0; pc < code.code_length; pc++) {
+    if (!states[pc] || !queued[pc])
+      continue;
+
+    const State &s = *states[pc];
+    ReferenceMap::Entry entry;
+    entry.pc = pc;
+    entry.bit_offset = static_cast<u4>(bits.size());
+    bits.resize(bits.size() + width, false);
+    for (u2 i = 0; i < max_locals; i++)
+      bits[entry.bit_offset + i] = s.locals[i] == VType::Ref;
+
+    // Locais seguem os índices da JVMS; a pilha segue os slots físicos, e
+    // com slots largos a metade Top de um long/double não existe nela
+    u2 depth = 0;
+    for (size_t i = 0; i < s.stack.size(); i++) {
+      if (CATEGORY2_STACK_SLOTS == 1 && i > 0 && s.stack[i] == VType::Top &&
+          (s.stack[i - 1] == VType::Long || s.stack[i - 1] == VType::Double))
+        continue;
+      bits[entry.bit_offset + max_locals + depth] = s.stack[i] == VType::Ref;
+      bits[entry.bit_offset + max_locals + max_stack + depth] =
+          s.stack[i] == VType::Long || s.stack[i] == VType::Double;
+      depth++;
+    }
+    entry.stack_depth = depth;
+    entries.push_back(entry);
+  }
+}
+
+} // namespace
+
+std::shared_ptr<ReferenceMap>
+ReferenceMap::compute(const RuntimeMethod &method) {
+  std::shared_ptr<ReferenceMap> map(new ReferenceMap());
+  if (!method.code)
+    return map;
+
+  Analyzer analyzer(method);
+  analyzer.run();
+  analyzer.collect(map->max_locals, map->max_stack, map->entries, map->bits);
+  return map;
+}
+
+const ReferenceMap::Entry *ReferenceMap::at(u4 pc) const {
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), pc,
+      [](const Entry &e, u4 value) { return e.pc < value; });
+  if (it == entries.end() || it->pc != pc)
+    return nullptr;
+  return &*it;
+}
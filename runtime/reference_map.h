@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../classfile/classfile_types.h"
+#include <memory>
+#include <vector>
+
+struct RuntimeMethod;
+
+// Mapa de referências de um método, usado pelo GC para achar raízes de forma
+// precisa: para cada instrução alcançável, quais slots de local_vars e da
+// pilha de operandos contêm referências antes de ela executar.
+//
+// Calculado por interpretação abstrata do bytecode. Nos pcs com frame na
+// StackMapTable o estado vem da própria tabela; nos demais vem do fluxo a
+// partir das instruções anteriores (o que também cobre classes antigas, sem
+// StackMapTable). Slots com tipos conflitantes num ponto de junção não são
+// referências, então nenhum slot é tratado de forma conservadora.
+class ReferenceMap {
+public:
+  struct Entry {
+    u4 pc;
+    u2 stack_depth; // em slots físicos do OperandStack
+    u4 bit_offset;
+  };
+
+  static std::shared_ptr<ReferenceMap> compute(const RuntimeMethod &method);
+
+  // nullptr se `pc` não é início de uma instrução alcançável
+  const Entry *at(u4 pc) const;
+
+  bool local_is_ref(const Entry &entry, u2 index) const {
+    return index < max_locals && bits[entry.bit_offset + index];
+  }
+  bool stack_is_ref(const Entry &entry, u2 index) const {
+    return index < entry.stack_depth &&
+           bits[entry.bit_offset + max_locals + index];
+  }
+  // Slot físico com um long/double (o primeiro dos dois, sem slots largos).
+  // Com slots largos é o que decide pop2 e a família dup2.
+  bool stack_is_category2(const Entry &entry, u2 index) const {
+    return index < entry.stack_depth &&
+           bits[entry.bit_offset + max_locals + max_stack + index];
+  }
+
+private:
+  u2 max_locals;
+  u2 max_stack;
+  std::vector<Entry> entries; // ordenado por pc
+  std::vector<bool> bits;
+};
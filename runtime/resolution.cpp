@@ -0,0 +1,416 @@
+#include "../classfile/bytecode.h"
+#include "./java_string.h"
+#include "./lambda.h"
+#include "./runtime_class_types.h"
+#include "./string_concat.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+RuntimeClass *Runtime::find_or_load_class(const std::string &name) {
+  RuntimeClass *klass = method_area->getClassRef(name);
+  if (klass)
+    return klass;
+  if (!name.empty() && name[0] == '[')
+    return array_class(name);
+  return class_loader->load_class(name);
+}
+
+static u1 element_size_of(char type) {
+  switch (type) {
+  case 'B':
+  case 'Z':
+    return 1;
+  case 'C':
+  case 'S':
+    return 2;
+  case 'I':
+  case 'F':
+    return 4;
+  case 'J':
+  case 'D':
+    return 8;
+  case 'L':
+  case '[':
+    return sizeof(NarrowRef);
+  default:
+    return 0;
+  }
+}
+
+// Arrays herdam tudo de Object: não declaram membros, então a vtable e as
+// itables são as de Object
+RuntimeClass *Runtime::array_class(const std::string &name) {
+  if (RuntimeClass *klass = method_area->getClassRef(name))
+    return klass;
+
+  char type = name.size() >= 2 ? name[1] : 0;
+  u1 element_size = element_size_of(type);
+  if (name[0] != '[' || element_size == 0 ||
+      (type == 'L' && (name.size() < 4 || name.back() != ';')) ||
+      (type != 'L' && type != '[' && name.size() != 2))
+    throw std::runtime_error("Invalid array class name: " + name);
+
+  std::unique_ptr<RuntimeClass> klass(new RuntimeClass());
+  klass->name = name;
+  klass->super_name = "java/lang/Object";
+  klass->access_flags =
+      ACC_Public_Class | ACC_Final_Class | ACC_Abstract_Class;
+  klass->element_size = element_size;
+  klass->element_type = type;
+
+  if (type == 'L')
+    klass->component = find_or_load_class(name.substr(2, name.size() - 3));
+  else if (type == '[')
+    klass->component = find_or_load_class(name.substr(1));
+
+  klass->super_class = find_or_load_class(klass->super_name);
+  klass->vtable = klass->super_class->vtable;
+  klass->itables = klass->super_class->itables;
+
+  RuntimeClass *result = klass.get();
+  method_area->storeClass(std::move(klass));
+  return result;
+}
+
+RuntimeClass *Runtime::primitive_array_class(u1 atype) {
+  switch (atype) {
+  case T_BOOLEAN:
+    return array_class("[Z");
+  case T_CHAR:
+    return array_class("[C");
+  case T_FLOAT:
+    return array_class("[F");
+  case T_DOUBLE:
+    return array_class("[D");
+  case T_BYTE:
+    return array_class("[B");
+  case T_SHORT:
+    return array_class("[S");
+  case T_INT:
+    return array_class("[I");
+  case T_LONG:
+    return array_class("[J");
+  default:
+    throw std::runtime_error("Invalid newarray type " + std::to_string(atype));
+  }
+}
+
+static std::string utf8_at(const ClassFile &cf, u2 index) {
+  return cf.resolve_utf8(index);
+}
+
+RuntimeField *Runtime::resolve_field(RuntimeClass *current, u2 index) {
+  ConstantPoolCacheEntry &entry = current->cp_cache.at(index);
+  if (entry.field)
+    return entry.field;
+
+  const ClassFile &cf = *current->class_file;
+  if (cf.constant_pool[index].first != ConstantTag::CONSTANT_Fieldref)
+    throw std::runtime_error("Constant pool entry is not a Fieldref");
+
+  const ConstantFieldrefInfo &ref =
+      cf.constant_pool[index].second.fieldref_info;
+  const ConstantNameAndTypeInfo &nat =
+      cf.constant_pool[ref.name_and_type_index].second.name_and_type_info;
+
+  RuntimeClass *owner = find_or_load_class(utf8_at(cf, ref.class_index));
+  RuntimeField *field = owner->find_field(
+      MemberKey::of(utf8_at(cf, nat.name_index),
+                    utf8_at(cf, nat.descriptor_index)));
+  if (!field)
+    throw std::runtime_error("NoSuchFieldError: " + owner->name + "." +
+                             utf8_at(cf, nat.name_index));
+
+  entry.field = field;
+  return field;
+}
+
+u1 *Runtime::resolve_static_field(RuntimeClass *current, u2 index) {
+  ConstantPoolCacheEntry &entry = current->cp_cache.at(index);
+  if (entry.static_address)
+    return entry.static_address;
+
+  RuntimeField *field = resolve_field(current, index);
+  if (!field->is_static)
+    throw std::runtime_error("IncompatibleClassChangeError: " + field->name +
+                             " is not static");
+
+  // O field pode ter sido herdado: o bloco é o da classe que o declara, e
+  // é ela que o acesso inicializa. O endereço só entra no cache depois
+  // disso, então o código compilado que o usa não precisa checar.
+  initialize_class(field->owner);
+  entry.static_address = field->owner->static_address(*field);
+  return entry.static_address;
+}
+
+RuntimeMethod *Runtime::resolve_method(RuntimeClass *current, u2 index) {
+  ConstantPoolCacheEntry &entry = current->cp_cache.at(index);
+  if (entry.method)
+    return entry.method;
+
+  const ClassFile &cf = *current->class_file;
+  ConstantTag tag = cf.constant_pool[index].first;
+  if (tag != ConstantTag::CONSTANT_Methodref &&
+      tag != ConstantTag::CONSTANT_InterfaceMethodref)
+    throw std::runtime_error("Constant pool entry is not a Methodref");
+
+  // Methodref e InterfaceMethodref têm o mesmo formato
+  const ConstantMethodrefInfo &ref =
+      cf.constant_pool[index].second.methodref_info;
+  const ConstantNameAndTypeInfo &nat =
+      cf.constant_pool[ref.name_and_type_index].second.name_and_type_info;
+
+  // Métodos chamados num array (clone, hashCode...) são os de Object
+  RuntimeClass *owner = find_or_load_class(utf8_at(cf, ref.class_index));
+  if (owner->is_array())
+    owner = owner->super_class;
+  RuntimeMethod *method = owner->find_method(MemberKey::of(
+      utf8_at(cf, nat.name_index), utf8_at(cf, nat.descriptor_index)));
+  if (!method)
+    throw std::runtime_error("NoSuchMethodError: " + owner->name + "." +
+                             utf8_at(cf, nat.name_index) +
+                             utf8_at(cf, nat.descriptor_index));
+
+  entry.method = method;
+  return method;
+}
+
+RuntimeClass *Runtime::resolve_class(RuntimeClass *current, u2 index) {
+  ConstantPoolCacheEntry &entry = current->cp_cache.at(index);
+  if (entry.klass)
+    return entry.klass;
+
+  const ClassFile &cf = *current->class_file;
+  if (cf.constant_pool[index].first != ConstantTag::CONSTANT_Class)
+    throw std::runtime_error("Constant pool entry is not a Class");
+
+  entry.klass = find_or_load_class(
+      utf8_at(cf, cf.constant_pool[index].second.class_info.name_index));
+  return entry.klass;
+}
+
+RuntimeObject *Runtime::resolve_string(RuntimeClass *current, u2 index) {
+  ConstantPoolCacheEntry &entry = current->cp_cache.at(index);
+  if (entry.string)
+    return entry.string;
+
+  const ClassFile &cf = *current->class_file;
+  if (cf.constant_pool[index].first != ConstantTag::CONSTANT_String)
+    throw std::runtime_error("Constant pool entry is not a String");
+
+  // Literais criados pela tabela nascem na geração velha, mas um
+  // String.intern() anterior pode ter deixado como canônica uma String jovem
+  u2 utf8_index = cf.constant_pool[index].second.string_info.string_index;
+  RuntimeObject *str =
+      strings->intern(thread, decode_modified_utf8(utf8_at(cf, utf8_index)));
+  if (!heap->in_young(str))
+    entry.string = str;
+  return str;
+}
+
+RuntimeObject *Runtime::class_mirror(RuntimeClass *klass) {
+  // Na geração velha o endereço não muda, e RuntimeClass::mirror é raiz
+  if (!klass->mirror)
+    klass->mirror = encode_ref(RuntimeObject::allocate_tenured(
+        thread, find_or_load_class("java/lang/Class")));
+  return decode_ref(klass->mirror);
+}
+
+// Constante estática de makeConcatWithConstants, já como texto
+static std::u16string concat_constant(const ClassFile &cf, u2 index) {
+  const ConstantPoolEntry &entry = cf.constant_pool.at(index);
+  const ConstantInfo &info = entry.second;
+  switch (entry.first) {
+  case ConstantTag::CONSTANT_String:
+    return decode_modified_utf8(utf8_at(cf, info.string_info.string_index));
+  case ConstantTag::CONSTANT_Integer: {
+    std::string text =
+        std::to_string(static_cast<int32_t>(info.integer_info.bytes));
+    return std::u16string(text.begin(), text.end());
+  }
+  case ConstantTag::CONSTANT_Long: {
+    std::string text = std::to_string(static_cast<int64_t>(
+        (static_cast<u8>(info.long_info.high_bytes) << 32) |
+        info.long_info.low_bytes));
+    return std::u16string(text.begin(), text.end());
+  }
+  case ConstantTag::CONSTANT_Float: {
+    float value;
+    std::memcpy(&value, &info.float_info.bytes, sizeof(value));
+    std::string text = java_float_to_string(value);
+    return std::u16string(text.begin(), text.end());
+  }
+  case ConstantTag::CONSTANT_Double: {
+    u8 bits = (static_cast<u8>(info.double_info.high_bytes) << 32) |
+              info.double_info.low_bytes;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    std::string text = java_double_to_string(value);
+    return std::u16string(text.begin(), text.end());
+  }
+  default:
+    throw std::runtime_error("StringConcatException: unsupported constant #" +
+                             std::to_string(index));
+  }
+}
+
+// Alvo de um CONSTANT_MethodHandle: Methodref ou InterfaceMethodref, que
+// têm o mesmo formato
+static MethodHandleTarget method_handle_at(const ClassFile &cf, u2 index) {
+  const ConstantPoolEntry &handle = cf.constant_pool.at(index);
+  if (handle.first != ConstantTag::CONSTANT_MethodHandle)
+    throw std::runtime_error("ClassFormatError: #" + std::to_string(index) +
+                             " is not a MethodHandle");
+  const ConstantMethodHandleInfo &info = handle.second.method_handle_info;
+  const ConstantMethodrefInfo &ref =
+      cf.constant_pool.at(info.reference_index).second.methodref_info;
+  const ConstantNameAndTypeInfo &nat =
+      cf.constant_pool.at(ref.name_and_type_index).second.name_and_type_info;
+
+  MethodHandleTarget target;
+  target.kind = info.reference_kind;
+  target.owner = utf8_at(cf, ref.class_index);
+  target.name = utf8_at(cf, nat.name_index);
+  target.descriptor = utf8_at(cf, nat.descriptor_index);
+  return target;
+}
+
+static std::string method_type_at(const ClassFile &cf, u2 index) {
+  const ConstantPoolEntry &entry = cf.constant_pool.at(index);
+  if (entry.first != ConstantTag::CONSTANT_MethodType)
+    throw std::runtime_error("LambdaConversionException: #" +
+                             std::to_string(index) + " is not a MethodType");
+  return utf8_at(cf, entry.second.method_type_info.descriptor_index);
+}
+
+static int32_t integer_at(const ClassFile &cf, u2 index) {
+  const ConstantPoolEntry &entry = cf.constant_pool.at(index);
+  if (entry.first != ConstantTag::CONSTANT_Integer)
+    throw std::runtime_error("LambdaConversionException: #" +
+                             std::to_string(index) + " is not an Integer");
+  return static_cast<int32_t>(entry.second.integer_info.bytes);
+}
+
+// makeConcatWithConstants(lookup, name, type, recipe, constants...) e
+// makeConcat(lookup, name, type)
+static std::shared_ptr<CallSite>
+link_string_concat(const ClassFile &cf, const std::string &descriptor,
+                   const BootstrapMethod &bootstrap, bool with_constants) {
+  std::u16string recipe;
+  std::vector<std::u16string> constants;
+  if (with_constants) {
+    const std::vector<u2> &args = bootstrap.bootstrap_arguments;
+    if (args.empty() || cf.constant_pool.at(args[0]).first !=
+                            ConstantTag::CONSTANT_String)
+      throw std::runtime_error("StringConcatException: missing recipe");
+    recipe = concat_constant(cf, args[0]);
+    for (size_t i = 1; i < args.size(); i++)
+      constants.push_back(concat_constant(cf, args[i]));
+  }
+  return std::make_shared<StringConcat>(StringConcat::link(
+      descriptor, with_constants ? &recipe : nullptr, constants));
+}
+
+// metafactory(lookup, name, type, samMethodType, implMethod,
+// instantiatedMethodType) e altMetafactory(lookup, name, type, sam, impl,
+// instantiated, flags, [marcadores], [pontes])
+static std::shared_ptr<CallSite>
+link_lambda(Runtime *runtime, RuntimeClass *current, const std::string &name,
+            const std::string &descriptor, const BootstrapMethod &bootstrap,
+            bool alternate) {
+  static const int32_t FLAG_SERIALIZABLE = 1, FLAG_MARKERS = 2,
+                       FLAG_BRIDGES = 4;
+
+  const ClassFile &cf = *current->class_file;
+  const std::vector<u2> &args = bootstrap.bootstrap_arguments;
+  if (args.size() < (alternate ? 4u : 3u))
+    throw std::runtime_error("LambdaConversionException: missing "
+                             "metafactory arguments");
+
+  LambdaSpec spec;
+  spec.caller = current;
+  spec.method_name = name;
+  spec.site_descriptor = descriptor;
+  spec.sam_descriptor = method_type_at(cf, args[0]);
+  spec.implementation = method_handle_at(cf, args[1]);
+
+  if (alternate) {
+    int32_t flags = integer_at(cf, args[3]);
+    size_t next = 4;
+    auto count = [&]() {
+      if (next >= args.size())
+        throw std::runtime_error("LambdaConversionException: truncated "
+                                 "altMetafactory arguments");
+      int32_t n = integer_at(cf, args[next++]);
+      if (n < 0 || next + static_cast<size_t>(n) > args.size())
+        throw std::runtime_error("LambdaConversionException: truncated "
+                                 "altMetafactory arguments");
+      return static_cast<size_t>(n);
+    };
+    if (flags & FLAG_MARKERS)
+      for (size_t n = count(); n > 0; n--, next++)
+        spec.marker_interfaces.push_back(utf8_at(
+            cf, cf.constant_pool.at(args[next]).second.class_info.name_index));
+    if (flags & FLAG_SERIALIZABLE)
+      spec.marker_interfaces.push_back("java/io/Serializable");
+    if (flags & FLAG_BRIDGES)
+      for (size_t n = count(); n > 0; n--, next++)
+        spec.bridges.push_back(method_type_at(cf, args[next]));
+  }
+
+  return LambdaCallSite::link(runtime, spec);
+}
+
+const CallSite &Runtime::resolve_call_site(RuntimeMethod *method, u4 pc) {
+  if (pc < method->call_sites.size() && method->call_sites[pc])
+    return *method->call_sites[pc];
+
+  RuntimeClass *current = method->owner;
+  const ClassFile &cf = *current->class_file;
+  u2 index = read_code_u2(method->code->code, pc + 1);
+  if (cf.constant_pool[index].first != ConstantTag::CONSTANT_InvokeDynamic)
+    throw std::runtime_error("Constant pool entry is not an InvokeDynamic");
+  const ConstantInvokeDynamicInfo &indy =
+      cf.constant_pool[index].second.invoke_dynamic_info;
+
+  const BootstrapMethodsAttribute *bootstraps = cf.bootstrap_methods();
+  if (!bootstraps ||
+      indy.bootstrap_method_attr_index >= bootstraps->bootstrap_methods.size())
+    throw std::runtime_error("ClassFormatError: invokedynamic #" +
+                             std::to_string(index) +
+                             " has no BootstrapMethods entry");
+  const BootstrapMethod &bootstrap =
+      bootstraps->bootstrap_methods[indy.bootstrap_method_attr_index];
+  MethodHandleTarget target =
+      method_handle_at(cf, bootstrap.bootstrap_method_ref);
+
+  const ConstantNameAndTypeInfo &site =
+      cf.constant_pool.at(indy.name_and_type_index).second.name_and_type_info;
+  std::string name = utf8_at(cf, site.name_index);
+  std::string descriptor = utf8_at(cf, site.descriptor_index);
+
+  // Bootstraps com implementação nativa; os demais precisariam executar o
+  // bytecode do bootstrap e montar MethodHandles
+  std::shared_ptr<CallSite> call_site;
+  if (target.owner == "java/lang/invoke/StringConcatFactory" &&
+      (target.name == "makeConcatWithConstants" ||
+       target.name == "makeConcat"))
+    call_site =
+        link_string_concat(cf, descriptor, bootstrap,
+                           target.name == "makeConcatWithConstants");
+  else if (target.owner == "java/lang/invoke/LambdaMetafactory" &&
+           (target.name == "metafactory" || target.name == "altMetafactory"))
+    call_site = link_lambda(this, current, name, descriptor, bootstrap,
+                            target.name == "altMetafactory");
+  else
+    throw std::runtime_error("BootstrapMethodError: unsupported bootstrap "
+                             "method " +
+                             target.owner + "." + target.name);
+
+  if (method->call_sites.empty())
+    method->call_sites.resize(method->code->code_length);
+  method->call_sites[pc] = call_site;
+  return *call_site;
+}
@@ -2,5 +2,18 @@
 #include <string>
 
 void Runtime::start(std::string filepath) {
-  class_loader->load_class(filepath);
-}
\ No newline at end of file
+  RuntimeClass *klass = class_loader->load_class(filepath);
+
+  static const MemberKey main_key =
+      MemberKey::of("main", "([Ljava/lang/String;)V");
+  RuntimeMethod *main = klass->find_declared_method(main_key);
+  if (!main || !main->is_static())
+    return;
+
+  // main recebe um String[] vazio: a linha de comando é do próprio runtime
+  initialize_class(klass);
+  OperandStack args;
+  args.push_ref(RuntimeObject::allocate_array(
+      thread, array_class("[Ljava/lang/String;"), 0));
+  thread->interpreter->invoke(main, args);
+}
@@ -1,19 +1,75 @@
 #pragma once
 
 #include "../classfile/classfile_types.h"
+#include "./heap.h"
+#include "./reference_map.h"
 #include <cstring>
+#include <exception>
+#include <ostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 // Estruturas do runtime
 class RuntimeClass;
+struct RuntimeMethod;
 class ClassLoader;
-class RuntimeObject;
+struct RuntimeObject;
 class Runtime;
 class Interpreter;
 class Thread;
+class GarbageCollector;
+class StringTable;
+struct CallSite;
+struct CompiledMethod;
+class JitCompiler;
+class TieringPolicy;
+struct Frame;
+struct OperandStack;
+
+// Símbolos internados: cada string distinta (nome, descritor) existe uma
+// única vez, então comparar e fazer hash de símbolos é comparar ponteiros.
+using Symbol = const std::string *;
+
+class SymbolTable {
+public:
+  static Symbol intern(const std::string &value);
+  // Não insere: nullptr se a string nunca foi internada
+  static Symbol lookup(const std::string &value);
+
+private:
+  static std::unordered_set<std::string> &table();
+};
+
+// Chave (nome, descritor) de fields e métodos
+struct MemberKey {
+  Symbol name;
+  Symbol descriptor;
+
+  MemberKey() : name(nullptr), descriptor(nullptr) {}
+  MemberKey(Symbol name, Symbol descriptor)
+      : name(name), descriptor(descriptor) {}
+
+  static MemberKey of(const std::string &name, const std::string &descriptor) {
+    return MemberKey(SymbolTable::intern(name),
+                     SymbolTable::intern(descriptor));
+  }
+
+  bool operator==(const MemberKey &other) const {
+    return name == other.name && descriptor == other.descriptor;
+  }
+};
+
+struct MemberKeyHash {
+  size_t operator()(const MemberKey &key) const {
+    size_t h = std::hash<Symbol>()(key.name);
+    return h ^ (std::hash<Symbol>()(key.descriptor) + 0x9e3779b9 + (h << 6) +
+                (h >> 2));
+  }
+};
 
 // RuntimeField e RuntimeMethod
 
@@ -33,16 +89,25 @@ static const std::unordered_map<char, u4> descriptor_table = {
 struct RuntimeField {
   std::string name;
   std::string descriptor;
+  MemberKey key;
   u2 access_flags;
   bool is_static;
+  RuntimeClass *owner; // classe que declara o field
 
-  // Offset em bytes ou slots (dependendo do modelo)
+  // Offset em bytes dentro dos dados da instância ou, para fields
+  // estáticos, dentro de RuntimeClass::static_storage (calculado na ligação)
   u4 offset;
 
-  // Valor estático armazenado como bytes
-  std::vector<u1> static_data;
+  // Índice do atributo ConstantValue no constant pool (0 se não houver)
+  u2 constantvalue_index;
+
+  RuntimeField()
+      : access_flags(0), is_static(false), owner(nullptr), offset(0),
+        constantvalue_index(0) {}
 
-  RuntimeField() : access_flags(0), is_static(false), offset(0) {}
+  bool is_reference() const {
+    return !descriptor.empty() && (descriptor[0] == 'L' || descriptor[0] == '[');
+  }
 
   u4 size_in_bytes() const {
     if (descriptor.empty())
@@ -57,13 +122,248 @@ struct RuntimeField {
   }
 };
 
+// Cache de resolução de uma entrada do constant pool. Preenchido na primeira
+// execução da instrução que usa a entrada; as seguintes usam o resultado.
+struct ConstantPoolCacheEntry {
+  RuntimeField *field;
+  u1 *static_address; // getstatic/putstatic: endereço direto do valor
+  // ldc de CONSTANT_String: o literal internado. Só é guardado fora da
+  // geração jovem, onde o objeto não muda de endereço.
+  RuntimeObject *string;
+  RuntimeMethod *method; // Methodref/InterfaceMethodref
+  RuntimeClass *klass;   // CONSTANT_Class
+
+  ConstantPoolCacheEntry()
+      : field(nullptr), static_address(nullptr), string(nullptr),
+        method(nullptr), klass(nullptr) {}
+};
+
+// Inline cache de um sítio invokevirtual/invokeinterface. Guarda as últimas
+// classes de receptor vistas e o alvo já despachado para cada uma; depois de
+// INLINE_CACHE_SIZE classes distintas o sítio vira megamórfico e passa a ir
+// direto para a vtable/itable.
+static const u1 INLINE_CACHE_SIZE = 4;
+
+enum class InlineCacheState : u1 {
+  Uninitialized,
+  Monomorphic,
+  Polymorphic,
+  Megamorphic,
+};
+
+struct InlineCache {
+  u4 pc;             // posição do invoke no bytecode
+  bool is_interface; // invokeinterface usa a itable no miss
+  InlineCacheState state;
+
+  u1 count;
+  RuntimeClass *receivers[INLINE_CACHE_SIZE];
+  RuntimeMethod *targets[INLINE_CACHE_SIZE];
+
+  // Perfil para o relatório de polimorfismo
+  u8 hits;
+  u8 misses;
+
+  InlineCache(u4 pc, bool is_interface)
+      : pc(pc), is_interface(is_interface),
+        state(InlineCacheState::Uninitialized), count(0), receivers(),
+        targets(), hits(0), misses(0) {}
+
+  // `resolved` é o método resolvido no constant pool; só é usado no miss
+  RuntimeMethod *lookup(RuntimeClass *receiver, RuntimeMethod *resolved) {
+    for (u1 i = 0; i < count; i++) {
+      if (receivers[i] == receiver) {
+        hits++;
+        return targets[i];
+      }
+    }
+    return miss(receiver, resolved);
+  }
+
+private:
+  RuntimeMethod *miss(RuntimeClass *receiver, RuntimeMethod *resolved);
+};
+
+// Perfil de execução de um método, mantido pelo interpretador para o
+// TieringPolicy (ver tiering.h) e lido pelo compilador
+enum class Tier : u1 {
+  Interpreted, // só os contadores
+  Quickened,   // referências do constant pool já resolvidas
+  Profiling,   // coleta também os perfis de tipo
+  Compiled,
+  Optimized,
+};
+
+// Voltas de um laço, identificado pelo cabeçalho: o alvo dos desvios para
+// trás
+struct LoopCounter {
+  u4 header;
+  u4 count;
+};
+
+// Classes vistas no objeto de um checkcast/instanceof. Passadas
+// TYPE_PROFILE_WIDTH classes, as novas só contam em `other`. Os receptores
+// de invokevirtual/invokeinterface ficam no InlineCache do sítio.
+static const u1 TYPE_PROFILE_WIDTH = 2;
+
+struct TypeProfile {
+  u4 pc;
+  RuntimeClass *classes[TYPE_PROFILE_WIDTH];
+  u4 counts[TYPE_PROFILE_WIDTH];
+  u4 other;
+  bool null_seen;
+
+  explicit TypeProfile(u4 pc)
+      : pc(pc), classes(), counts(), other(0), null_seen(false) {}
+
+  void record(RuntimeClass *klass);
+};
+
+struct MethodProfile {
+  Tier tier;
+  u4 invocations;
+  u4 backedges; // soma de todos os laços
+  u4 deoptimizations;
+  // Eventos (chamadas e voltas de laço) até o TieringPolicy olhar o método
+  // de novo; começa em 1 para a primeira chamada calcular o valor real
+  u4 countdown;
+  std::vector<LoopCounter> loops; // ordenado por header
+  std::vector<TypeProfile> types; // ordenado por pc; só a partir de Profiling
+
+  MethodProfile()
+      : tier(Tier::Interpreted), invocations(0), backedges(0),
+        deoptimizations(0), countdown(1) {}
+
+  LoopCounter *loop_at(u4 header);
+  TypeProfile *type_profile_at(u4 pc);
+  u4 hottest_loop() const;
+};
+
+// Método implementado em C++ (ver NativeRegistry). Os argumentos chegam em
+// `args` como as variáveis locais de um frame normal (this no índice 0,
+// long/double ocupando dois índices) e o resultado, se houver, é empilhado
+// em `result`, a pilha de operandos de quem chamou.
+using NativeMethod = void (*)(Thread *thread, Frame &args,
+                              OperandStack &result);
+
+// Descritor de método já lido, para passar argumentos sem reler a string.
+// Um caractere por tipo: I (também boolean, byte, char e short), F, J, D, L
+// (qualquer referência) ou V (só no retorno).
+struct MethodSignature {
+  std::string args; // sem o this
+  char ret;
+  u2 arg_locals;      // variáveis locais ocupadas pelos argumentos
+  u2 arg_stack_slots; // slots físicos na pilha de operandos
+
+  MethodSignature() : ret(0), arg_locals(0), arg_stack_slots(0) {}
+  static MethodSignature parse(const std::string &descriptor);
+};
+
 struct RuntimeMethod {
   std::string name;
   std::string descriptor;
+  MemberKey key;
   u2 access_flags;
   const CodeAttribute *code; // aponta diretamente para o atributo do ClassFile
 
-  RuntimeMethod() : access_flags(0), code(nullptr) {}
+  RuntimeClass *owner; // classe que declara o método
+
+  // Posição na vtable da classe (ou na itable, para métodos de interface).
+  // -1 quando o método não participa de despacho dinâmico.
+  int32_t vtable_index;
+  int32_t itable_index;
+
+  // Um cache por invokevirtual/invokeinterface do método, ordenado por pc.
+  // Criados no quickening; antes disso os invokes despacham pela vtable
+  std::vector<InlineCache> inline_caches;
+  // Indexado por pc: o cache do invoke nesse pc, ou nullptr
+  std::vector<InlineCache *> inline_cache_table;
+  // Indexado por pc: o alvo ligado de cada invokedynamic. Cada instrução é
+  // um sítio próprio, mesmo quando duas usam a mesma entrada do constant
+  // pool. Vazio até o primeiro invokedynamic do método rodar.
+  std::vector<std::shared_ptr<CallSite>> call_sites;
+
+  // Calculado na primeira coleta que encontra o método na pilha
+  std::shared_ptr<ReferenceMap> ref_map;
+
+  // Ligado pelo NativeRegistry: quando presente, roda no lugar do bytecode
+  NativeMethod native;
+
+  // Contadores e perfis; quando o TieringPolicy decide compilar, as
+  // chamadas seguintes vão para `compiled`
+  MethodProfile profile;
+  std::shared_ptr<CompiledMethod> compiled;
+  bool not_compilable;  // o compilador já recusou o método
+  bool not_optimizable; // idem para o compilador otimizador
+  // Abstrato criado na ligação para um slot com mais de um default
+  // maximamente específico: chamá-lo é IncompatibleClassChangeError
+  bool conflicting_defaults;
+
+  RuntimeMethod()
+      : access_flags(0), code(nullptr), owner(nullptr), vtable_index(-1),
+        itable_index(-1), native(nullptr), not_compilable(false),
+        not_optimizable(false), conflicting_defaults(false) {}
+
+  bool is_static() const { return (access_flags & ACC_Static_Method) != 0; }
+  bool is_private() const { return (access_flags & ACC_Private_Method) != 0; }
+  bool is_abstract() const {
+    return (access_flags & ACC_Abstract_Method) != 0;
+  }
+  bool is_native() const { return (access_flags & ACC_Native_Method) != 0; }
+
+  // Algum handler da tabela de exceções cobre `pc`
+  bool in_try_block(u4 pc) const {
+    for (const ExceptionTableEntry &handler : code->exception_table)
+      if (pc >= handler.start_pc && pc < handler.end_pc)
+        return true;
+    return false;
+  }
+
+  // Construtores, <clinit>, estáticos e privados são sempre ligados
+  // estaticamente (invokespecial/invokestatic)
+  bool is_virtual() const {
+    return !is_static() && !is_private() && name[0] != '<';
+  }
+
+  void build_inline_caches();
+  InlineCache *inline_cache_at(u4 pc) const {
+    return pc < inline_cache_table.size() ? inline_cache_table[pc] : nullptr;
+  }
+  // Um LoopCounter por cabeçalho de laço do bytecode
+  void build_loop_counters();
+  // Um TypeProfile por checkcast e instanceof
+  void build_type_profiles();
+
+  const ReferenceMap &reference_map() {
+    if (!ref_map)
+      ref_map = ReferenceMap::compute(*this);
+    return *ref_map;
+  }
+
+  const MethodSignature &signature() {
+    if (!signature_.ret)
+      signature_ = MethodSignature::parse(descriptor);
+    return signature_;
+  }
+
+private:
+  MethodSignature signature_;
+};
+
+// Inicialização de classe (JVMS §5.5): o <clinit> roda no primeiro uso
+// ativo (new, getstatic, putstatic, invokestatic), não ao carregar
+enum class InitState : u1 {
+  Linked,
+  Initializing, // <clinit> em andamento: a própria thread usa a classe
+  Initialized,
+  Failed, // <clinit> lançou; usos seguintes dão NoClassDefFoundError
+};
+
+// Métodos que uma classe usa para implementar uma interface, na mesma ordem
+// de itable_index dos métodos declarados pela interface
+struct ItableEntry {
+  RuntimeClass *interface;
+  std::vector<RuntimeMethod *> methods;
 };
 
 // ------------------------------------------------------
@@ -77,21 +377,130 @@ public:
   u2 access_flags;
 
   RuntimeClass *super_class;
+  std::vector<std::string> interface_names;
+  std::vector<RuntimeClass *> interfaces; // apenas as diretas
   std::unique_ptr<ClassFile> class_file;
 
-  std::unordered_map<std::string, RuntimeField> fields;
-  std::unordered_map<std::string, RuntimeMethod> methods;
+  std::unordered_map<MemberKey, RuntimeField, MemberKeyHash> fields;
+  std::unordered_map<MemberKey, RuntimeMethod, MemberKeyHash> methods;
+
+  // Resultados (positivos e negativos) de buscas na hierarquia. Só são
+  // preenchidos depois da ligação, quando a hierarquia não muda mais.
+  // method_cache guarda só a cadeia de classes; interface_method_cache, o
+  // passo das superinterfaces para as chaves que a cadeia não resolve.
+  std::unordered_map<MemberKey, RuntimeMethod *, MemberKeyHash> method_cache;
+  std::unordered_map<MemberKey, RuntimeMethod *, MemberKeyHash>
+      interface_method_cache;
+  std::unordered_map<MemberKey, RuntimeField *, MemberKeyHash> field_cache;
+
+  // Montadas na ligação, depois que super_class e interfaces estão
+  // carregadas. A vtable começa como cópia da vtable da superclasse; métodos
+  // que sobrescrevem reaproveitam o índice herdado e os novos vão para o fim.
+  std::vector<RuntimeMethod *> vtable;
+  std::vector<ItableEntry> itables;
+  // Métodos com conflicting_defaults dos slots desta classe
+  std::vector<std::unique_ptr<RuntimeMethod>> default_conflicts;
+
+  // Todos os fields estáticos da classe num único bloco alinhado a 8 bytes,
+  // com o mesmo layout por tamanho dos fields de instância
+  std::vector<u8> static_storage;
+  u4 static_size;
+
+  // Mesmos índices do constant pool do ClassFile
+  std::vector<ConstantPoolCacheEntry> cp_cache;
+
+  InitState init_state;
+  // java.lang.Class da classe (ldc), comprimido como um NarrowRef e na
+  // geração velha; 0 até o primeiro uso
+  u4 mirror;
+
+  // Classes de array ("[I", "[Ljava/lang/String;", "[[I"...) são criadas
+  // pelo runtime, sem ClassFile. element_size 0 indica classe comum.
+  u1 element_size;
+  char element_type;       // descritor do elemento: B C D F I J S Z, L ou [
+  RuntimeClass *component; // classe do elemento, só em arrays de referência
 
   RuntimeClass()
-      : name(std::move(name)), super_name(std::move(super_name)),
-        access_flags(access_flags), super_class(nullptr),
-        class_file(std::move(class_file)), fields(), methods() {}
+      : access_flags(0), super_class(nullptr), static_size(0),
+        init_state(InitState::Linked), mirror(0), element_size(0),
+        element_type(0), component(nullptr), instance_size(0) {}
 
-  // Busca de método/field
+  bool is_interface() const {
+    return (access_flags & ACC_Interface_Class) != 0;
+  }
+
+  bool is_initialized() const {
+    return init_state == InitState::Initialized;
+  }
+
+  bool is_array() const { return element_size != 0; }
+  bool is_reference_array() const {
+    return element_type == 'L' || element_type == '[';
+  }
+  // Offset do primeiro elemento em RuntimeObject::data(): depois do
+  // comprimento (u4), alinhado ao tamanho do elemento
+  u4 array_base() const { return element_size == 8 ? 8 : 4; }
+
+  // Regras de atribuição de checkcast/instanceof/aastore entre classes
+  // já ligadas (JVMS §6.5.checkcast)
+  bool is_assignable_to(const RuntimeClass *target) const;
+
+  // Busca de método/field: declarados, depois superclasses e interfaces
+  // (métodos: maximamente específicos, JVMS §5.4.3.3)
   RuntimeMethod *find_method(const std::string &name,
                              const std::string &descriptor);
   RuntimeField *find_field(const std::string &name,
                            const std::string &descriptor);
+  RuntimeMethod *find_method(const MemberKey &key);
+  RuntimeField *find_field(const MemberKey &key);
+  // Só a própria classe e a cadeia de superclasses
+  RuntimeMethod *find_class_method(const MemberKey &key);
+
+  // Apenas os membros declarados pela própria classe
+  RuntimeMethod *find_declared_method(const MemberKey &key);
+  RuntimeField *find_declared_field(const MemberKey &key);
+
+  // Ligação: vtable e itables
+  void build_vtable();
+  void build_itables();
+  // Um método virtual desta classe com o nome e descritor do slot `slot` da
+  // vtable da superclasse o sobrescreve
+  bool overrides_slot(int32_t slot) const;
+  // Métodos maximamente específicos das superinterfaces (JVMS §5.4.3.3):
+  // não privados nem estáticos, sem outro declarado numa subinterface
+  std::vector<RuntimeMethod *> maximally_specific(const MemberKey &key);
+  // Seleção nas superinterfaces (JVMS §5.4.6) quando nenhuma classe da
+  // cadeia implementa `key`: o único default maximamente específico, um
+  // abstrato se não há default, ou um método de default_conflicts se há
+  // mais de um. nullptr se nenhuma superinterface declara `key`.
+  RuntimeMethod *select_interface_method(const MemberKey &key);
+
+  // Despacho dinâmico a partir do método resolvido no constant pool.
+  // `this` é a classe do receptor.
+  RuntimeMethod *dispatch_virtual(RuntimeMethod *resolved) const;
+  RuntimeMethod *dispatch_interface(RuntimeMethod *resolved) const;
+  const ItableEntry *find_itable(const RuntimeClass *iface) const;
+
+  // Tamanho em bytes dos fields de instância, incluindo os herdados.
+  // Definido por layout_fields().
+  u4 instance_size;
+
+  // Offsets dos fields de referência (de instância, incluindo os herdados, e
+  // estáticos), para o GC percorrer objetos e static_storage
+  std::vector<u4> ref_offsets;
+  std::vector<u4> static_ref_offsets;
+
+  // Layout dos fields de instância: começa depois dos fields da superclasse,
+  // agrupa por tamanho (8/4/2/1) com alinhamento natural e reaproveita os
+  // buracos deixados pelo alinhamento. Fields estáticos ficam de fora.
+  void layout_fields();
+
+  // Layout dos fields estáticos em static_storage, inicializados com os
+  // atributos ConstantValue
+  void layout_static_fields();
+  u1 *static_address(const RuntimeField &field) {
+    return reinterpret_cast<u1 *>(static_storage.data()) + field.offset;
+  }
 
   // Tamanho em bytes do data
   u4 data_size();
@@ -99,26 +508,211 @@ public:
 
 // Objetos
 
-struct RuntimeObject {
+// Objeto numa única alocação: cabeçalho (classe + mark word) seguido
+// imediatamente pelos bytes dos fields, nos offsets de RuntimeField::offset.
+// O alinhamento do cabeçalho garante que os fields de 8 bytes fiquem
+// alinhados.
+struct alignas(8) RuntimeObject {
   RuntimeClass *klass;
-  std::vector<u1> data; // bytes da instância
+  // Mark word: bits 0-1 estado (11 = copiado por uma coleta jovem, e o
+  // resto da palavra é o novo endereço), bits 2-5 idade em coletas jovens,
+  // bits 8 em diante o hash de identidade (0 = ainda não calculado)
+  uintptr_t mark;
+
+  static const uintptr_t MARK_STATE_MASK = 0x3;
+  static const uintptr_t MARK_FORWARDED = 0x3;
+  static const unsigned MARK_AGE_SHIFT = 2;
+  static const uintptr_t MARK_AGE_MASK = uintptr_t(0xF) << MARK_AGE_SHIFT;
+  static const unsigned MARK_HASH_SHIFT = 8;
+  static const unsigned MARK_HASH_BITS = sizeof(uintptr_t) == 8 ? 31 : 24;
+  static const uintptr_t MARK_HASH_MASK =
+      ((uintptr_t(1) << MARK_HASH_BITS) - 1) << MARK_HASH_SHIFT;
+
+  // Aloca no heap gerenciado, pelo TLAB da thread
+  static RuntimeObject *allocate(Thread *thread, RuntimeClass *k);
 
-  RuntimeObject(RuntimeClass *k) : klass(k) { data.resize(k->data_size()); }
+  // Array com elementos zerados; NegativeArraySizeException se length < 0
+  static RuntimeObject *allocate_array(Thread *thread, RuntimeClass *k,
+                                       int32_t length);
+  // Direto na geração velha (Heap::allocate_tenured): o endereço não muda
+  // mais, como o de literais String guardados no cache do constant pool
+  static RuntimeObject *allocate_tenured(Thread *thread, RuntimeClass *k);
+  static RuntimeObject *allocate_tenured_array(Thread *thread,
+                                               RuntimeClass *k,
+                                               int32_t length);
+  // multianewarray: `dims` com uma contagem por dimensão criada
+  static RuntimeObject *allocate_multi_array(Thread *thread, RuntimeClass *k,
+                                             const std::vector<int32_t> &dims);
+
+  static size_t size_for(RuntimeClass *k) {
+    return heap_align(sizeof(RuntimeObject) + k->data_size());
+  }
+
+  static size_t array_size_for(const RuntimeClass *k, u4 length) {
+    return heap_align(sizeof(RuntimeObject) + k->array_base() +
+                      static_cast<size_t>(length) * k->element_size);
+  }
+
+  size_t size() const {
+    return klass->is_array() ? array_size_for(klass, array_length())
+                             : size_for(klass);
+  }
+
+  u1 *data() { return reinterpret_cast<u1 *>(this + 1); }
+  const u1 *data() const { return reinterpret_cast<const u1 *>(this + 1); }
 
   template <typename T> T read_field(const RuntimeField &field) const {
     T value;
-    std::memcpy(&value, &data[field.offset], sizeof(T));
+    std::memcpy(&value, data() + field.offset, sizeof(T));
     return value;
   }
 
   template <typename T> void write_field(const RuntimeField &field, T value) {
-    std::memcpy(&data[field.offset], &value, sizeof(T));
+    std::memcpy(data() + field.offset, &value, sizeof(T));
   }
+
+  // Fields de referência; a escrita passa pela barreira do heap
+  inline RuntimeObject *read_ref(const RuntimeField &field) const;
+  inline void write_ref(const RuntimeField &field, RuntimeObject *value);
+
+  // Arrays: comprimento logo depois do cabeçalho, elementos contíguos a
+  // partir de RuntimeClass::array_base()
+  u4 array_length() const {
+    u4 length;
+    std::memcpy(&length, data(), sizeof(length));
+    return length;
+  }
+
+  u1 *array_data() { return data() + klass->array_base(); }
+  const u1 *array_data() const { return data() + klass->array_base(); }
+
+  // ArrayIndexOutOfBoundsException fora de [0, length)
+  void check_index(int32_t index) const;
+
+  template <typename T> T array_get(u4 index) const {
+    T value;
+    std::memcpy(&value, array_data() + index * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  template <typename T> void array_set(u4 index, T value) {
+    std::memcpy(array_data() + index * sizeof(T), &value, sizeof(T));
+  }
+
+  // aaload/aastore sem checagem de tipo; a escrita passa pelas barreiras
+  inline RuntimeObject *array_load_ref(u4 index) const;
+  inline void array_store_ref(u4 index, RuntimeObject *value);
+  // aastore completo: ArrayStoreException se `value` não cabe no array
+  void check_store(RuntimeObject *value) const;
+
+  bool is_forwarded() const {
+    return (mark & MARK_STATE_MASK) == MARK_FORWARDED;
+  }
+  RuntimeObject *forwardee() const {
+    return reinterpret_cast<RuntimeObject *>(mark & ~MARK_STATE_MASK);
+  }
+  void forward_to(RuntimeObject *copy) {
+    mark = reinterpret_cast<uintptr_t>(copy) | MARK_FORWARDED;
+  }
+
+  unsigned age() const {
+    return static_cast<unsigned>((mark & MARK_AGE_MASK) >> MARK_AGE_SHIFT);
+  }
+  void set_age(unsigned age) {
+    mark = (mark & ~MARK_AGE_MASK) | (uintptr_t(age) << MARK_AGE_SHIFT);
+  }
+
+  // Object.hashCode/System.identityHashCode: sorteado no primeiro pedido e
+  // guardado no mark word, que acompanha o objeto quando ele é copiado
+  int32_t identity_hash();
+
+private:
+  explicit RuntimeObject(RuntimeClass *k) : klass(k), mark(0) {}
+  // Cabeçalho e comprimento de um array em memória já zerada
+  static RuntimeObject *construct_array(void *memory, RuntimeClass *k,
+                                        u4 length);
+  RuntimeObject(const RuntimeObject &) = delete;
+  RuntimeObject &operator=(const RuntimeObject &) = delete;
 };
 
 // Frame e pilha de execução
 
+// Largura do slot de local_vars e da pilha de operandos. Compilando com
+// -DJVM_WIDE_SLOTS num host de 64 bits, o slot tem 64 bits e long/double
+// ocupam um slot físico só na pilha; nas variáveis locais o valor fica no
+// primeiro dos dois índices da JVMS e o segundo não é usado. Sem a flag,
+// long/double são divididos em dois slots de 32 bits (alto, depois baixo).
+#if defined(JVM_WIDE_SLOTS) && UINTPTR_MAX > 0xFFFFFFFFu
+#define JVM_SLOTS_ARE_WIDE 1
+using Slot = u8;
+#else
 using Slot = u4;
+#endif
+
+// Slots físicos de um long/double na pilha de operandos
+static const u2 CATEGORY2_STACK_SLOTS = sizeof(Slot) == 8 ? 1 : 2;
+
+// Referência comprimida (ver Heap::narrow_base), como fica guardada em
+// fields, estáticos e arrays. Num slot ela ocupa os bits baixos.
+using NarrowRef = u4;
+
+inline NarrowRef encode_ref(RuntimeObject *ref) {
+  if (!ref)
+    return 0;
+  return static_cast<NarrowRef>(
+      (reinterpret_cast<uintptr_t>(ref) - Heap::narrow_base) >>
+      Heap::narrow_shift);
+}
+
+inline RuntimeObject *decode_ref(NarrowRef bits) {
+  if (!bits)
+    return nullptr;
+  return reinterpret_cast<RuntimeObject *>(
+      Heap::narrow_base + (static_cast<uintptr_t>(bits) << Heap::narrow_shift));
+}
+
+inline Slot ref_to_slot(RuntimeObject *ref) { return encode_ref(ref); }
+
+inline RuntimeObject *slot_to_ref(Slot bits) {
+  return decode_ref(static_cast<NarrowRef>(bits));
+}
+
+RuntimeObject *RuntimeObject::read_ref(const RuntimeField &field) const {
+  return decode_ref(read_field<NarrowRef>(field));
+}
+
+void RuntimeObject::write_ref(const RuntimeField &field,
+                              RuntimeObject *value) {
+  // Pré-barreira SATB: o valor sobrescrito pode ser do snapshot da marcação
+  if (SatbQueue::active.load(std::memory_order_relaxed))
+    SatbQueue::enqueue(read_ref(field));
+  write_field<NarrowRef>(field, encode_ref(value));
+  write_barrier(data() + field.offset);
+}
+
+RuntimeObject *RuntimeObject::array_load_ref(u4 index) const {
+  return decode_ref(array_get<NarrowRef>(index));
+}
+
+void RuntimeObject::array_store_ref(u4 index, RuntimeObject *value) {
+  u1 *address = array_data() + index * sizeof(NarrowRef);
+  if (SatbQueue::active.load(std::memory_order_relaxed))
+    SatbQueue::enqueue(array_load_ref(index));
+  array_set<NarrowRef>(index, encode_ref(value));
+  write_barrier(address);
+}
+
+// putstatic de referência, em RuntimeClass::static_address. Estáticos não
+// sujam cards, mas precisam da pré-barreira SATB como qualquer referência.
+inline void write_static_ref(u1 *address, RuntimeObject *value) {
+  NarrowRef bits;
+  if (SatbQueue::active.load(std::memory_order_relaxed)) {
+    std::memcpy(&bits, address, sizeof(bits));
+    SatbQueue::enqueue(decode_ref(bits));
+  }
+  bits = encode_ref(value);
+  std::memcpy(address, &bits, sizeof(bits));
+}
 
 struct OperandStack {
   std::vector<Slot> stack;
@@ -126,12 +720,16 @@ struct OperandStack {
   // --- Push de 32 bits ---
   void push_int(int32_t v) { stack.push_back(static_cast<u4>(v)); }
 
-  // --- Push de 64 bits (2 slots) ---
+  // --- Push de 64 bits (2 slots, ou 1 com slots largos) ---
   void push_long(int64_t v) {
+#ifdef JVM_SLOTS_ARE_WIDE
+    stack.push_back(static_cast<Slot>(v));
+#else
     u4 high = static_cast<u4>((v >> 32) & 0xFFFFFFFF);
     u4 low = static_cast<u4>(v & 0xFFFFFFFF);
     stack.push_back(high);
     stack.push_back(low);
+#endif
   }
 
   // --- Pop de 32 bits ---
@@ -145,27 +743,30 @@ struct OperandStack {
 
   // --- Pop de 64 bits ---
   int64_t pop_long() {
-    if (stack.size() < 2)
+    if (stack.size() < CATEGORY2_STACK_SLOTS)
       throw std::runtime_error("Operand stack underflow");
+#ifdef JVM_SLOTS_ARE_WIDE
+    int64_t v = static_cast<int64_t>(stack.back());
+    stack.pop_back();
+    return v;
+#else
     u4 low = stack.back();
     stack.pop_back();
     u4 high = stack.back();
     stack.pop_back();
     return (static_cast<int64_t>(high) << 32) | low;
+#endif
   }
 
   // --- Referências ---
-  void push_ref(RuntimeObject *ref) {
-    // armazenar ponteiro como índice ou endereço truncado (32-bit)
-    stack.push_back(static_cast<u4>(reinterpret_cast<uintptr_t>(ref)));
-  }
+  void push_ref(RuntimeObject *ref) { stack.push_back(ref_to_slot(ref)); }
 
   RuntimeObject *pop_ref() {
     if (stack.empty())
       throw std::runtime_error("Operand stack underflow");
-    u4 bits = stack.back();
+    Slot bits = stack.back();
     stack.pop_back();
-    return reinterpret_cast<RuntimeObject *>(static_cast<uintptr_t>(bits));
+    return slot_to_ref(bits);
   }
 
   // --- Float / Double helpers ---
@@ -185,7 +786,7 @@ struct OperandStack {
       float f;
       u4 u;
     } conv;
-    conv.u = stack.back();
+    conv.u = static_cast<u4>(stack.back());
     stack.pop_back();
     return conv.f;
   }
@@ -218,17 +819,55 @@ struct OperandStack {
 struct Frame {
   RuntimeMethod *method;
   RuntimeClass *current_class;
+  // Código compilado que está rodando o frame; nullptr no interpretador
+  const CompiledMethod *compiled;
   std::vector<Slot> local_vars;
   OperandStack operand_stack;
+  // Enquanto um invoke ou uma alocação está em andamento, aponta para essa
+  // instrução: o GC usa o mapa de referências desse pc para achar as raízes
   u4 pc;
 
   Frame(RuntimeMethod *method, RuntimeClass *current_class)
-      : method(method), current_class(current_class), pc(0) {}
+      : method(method), current_class(current_class), compiled(nullptr),
+        pc(0) {}
 
   void init(u4 max_locals, u4 max_stack) {
     local_vars.resize(max_locals);
     operand_stack.stack.reserve(max_stack);
   }
+
+  // long/double nas variáveis locais, pelo índice da JVMS (o valor ocupa
+  // `index` e `index + 1`)
+  int64_t load_long(u2 index) const {
+#ifdef JVM_SLOTS_ARE_WIDE
+    return static_cast<int64_t>(local_vars[index]);
+#else
+    return (static_cast<int64_t>(local_vars[index]) << 32) |
+           local_vars[index + 1];
+#endif
+  }
+
+  void store_long(u2 index, int64_t v) {
+#ifdef JVM_SLOTS_ARE_WIDE
+    local_vars[index] = static_cast<Slot>(v);
+#else
+    local_vars[index] = static_cast<u4>((v >> 32) & 0xFFFFFFFF);
+    local_vars[index + 1] = static_cast<u4>(v & 0xFFFFFFFF);
+#endif
+  }
+
+  double load_double(u2 index) const {
+    u8 bits = static_cast<u8>(load_long(index));
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+
+  void store_double(u2 index, double v) {
+    u8 bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    store_long(index, static_cast<int64_t>(bits));
+  }
 };
 
 struct Thread {
@@ -236,15 +875,57 @@ struct Thread {
   Frame &current_frame() { return *call_stack.back(); }
   Runtime *runtime;
   Interpreter *interpreter;
+  TLAB tlab;
+  // Referências guardadas por código nativo entre alocações (ver Handle)
+  std::vector<NarrowRef> handles;
+  // Exceção de um helper chamado por código compilado, que não pode
+  // atravessar o código de máquina: é relançada na saída do método
+  std::exception_ptr pending_exception;
+  // Objeto da JavaException em andamento. Fica aqui, e não na exceção
+  // C++, para o GC atualizá-lo enquanto ela procura um handler.
+  NarrowRef exception;
 
   Thread(Runtime *rt);
   ~Thread();
 };
 
+// Exceção Java com objeto, lançada por athrow: o objeto está em
+// Thread::exception. As exceções implícitas (NullPointerException,
+// ArithmeticException...) continuam std::runtime_error com o nome da classe
+// na mensagem e só ganham objeto quando um handler as captura. A mensagem
+// é para quando nenhum captura.
+class JavaException : public std::runtime_error {
+public:
+  explicit JavaException(const std::string &message)
+      : std::runtime_error(message) {}
+};
+
+// Raiz para código do runtime que segura uma referência enquanto aloca: uma
+// alocação pode rodar o GC, que move objetos jovens e atualiza os handles.
+// Handles são liberados em ordem inversa à de criação.
+class Handle {
+public:
+  Handle(Thread *thread, RuntimeObject *obj)
+      : thread(thread), index(thread->handles.size()) {
+    thread->handles.push_back(encode_ref(obj));
+  }
+  ~Handle() { thread->handles.pop_back(); }
+
+  Handle(const Handle &) = delete;
+  Handle &operator=(const Handle &) = delete;
+
+  RuntimeObject *get() const { return decode_ref(thread->handles[index]); }
+
+private:
+  Thread *thread;
+  size_t index;
+};
+
 //  ClassLoader base
 class ClassLoader {
 public:
-  virtual std::unique_ptr<RuntimeClass> load_class(const std::string &name) = 0;
+  // A classe carregada pertence à MethodArea
+  virtual RuntimeClass *load_class(const std::string &name) = 0;
 
   virtual ~ClassLoader() {}
 };
@@ -257,7 +938,7 @@ public:
                                 Runtime *runtime)
       : classpath_(classpath), runtime(runtime) {}
 
-  std::unique_ptr<RuntimeClass> load_class(const std::string &name) override;
+  RuntimeClass *load_class(const std::string &name) override;
 
 private:
   std::vector<std::string> classpath_;
@@ -269,19 +950,80 @@ private:
   Runtime *runtime;
 };
 
-// Interpretador (esqueleto)
+// Interpretador. Código compilado usa o mesmo Frame, então um método pode
+// passar de um para o outro no meio da execução.
 struct Interpreter {
+  Thread *thread;
+
+  explicit Interpreter(Thread *thread) : thread(thread) {}
+
+  // Chamada de `method` com os argumentos no topo de `caller`: tira os
+  // argumentos, roda o método (nativo, compilado ou interpretado) e
+  // empilha o retorno em `caller`. Sem despacho: `method` é o alvo final.
+  void invoke(RuntimeMethod *method, OperandStack &caller);
+
+  // Roda `frame.method` com os argumentos já nas variáveis locais de
+  // `frame` e empilha o retorno em `result`
+  void call(Frame &frame, OperandStack &result);
+
+  // Roda o método de `frame` a partir de frame.pc até o retorno. O frame
+  // já está em Thread::call_stack; o valor de retorno, se houver, fica
+  // sozinho na pilha de operandos.
   void execute(Frame &frame);
+
+  // Só a instrução em frame.pc, que avança para a próxima (ou para o alvo
+  // do desvio); false depois de um return, inclusive quando o método
+  // terminou no código compilado depois de um OSR. Também é o caminho lento
+  // do código compilado, com a pilha no tamanho da instrução.
+  bool step(Frame &frame);
+
+  // Procura na tabela de exceções do método de `frame` um handler para a
+  // exceção lançada em frame.pc: a pilha fica só com o objeto da exceção e
+  // frame.pc vai para o handler. false se nenhum a captura; quem chamou a
+  // relança para o frame de baixo na pilha de chamadas.
+  bool dispatch_exception(Frame &frame, std::exception_ptr exception);
+};
+
+// Suposição do código otimizado sobre a hierarquia de classes: entre as
+// classes carregadas, `target` é a única implementação de `resolved`, e a
+// chamada foi ligada direto, sem teste da classe do receptor
+struct HierarchyDependency {
+  RuntimeMethod *resolved;
+  RuntimeMethod *target;
 };
 
 // Method Area
 class MethodArea {
 private:
+  struct Dependency {
+    HierarchyDependency assumption;
+    std::weak_ptr<CompiledMethod> code;
+  };
+
   std::unordered_map<std::string, std::unique_ptr<RuntimeClass>> classes;
+  // Subclasses diretas de cada classe já ligada
+  std::unordered_map<const RuntimeClass *, std::vector<RuntimeClass *>>
+      subclasses;
+  std::vector<Dependency> dependencies;
 
 public:
   RuntimeClass *getClassRef(const std::string &name);
   void storeClass(std::unique_ptr<RuntimeClass> klass);
+  std::vector<RuntimeClass *> getClasses() const;
+
+  // Análise de hierarquia de classes. add_to_hierarchy recebe a classe
+  // depois de ligada (vtable pronta) e invalida o código compilado cujas
+  // suposições ela quebra: o método volta ao código de templates e os
+  // frames que ainda rodam o código velho continuam no interpretador.
+  void add_to_hierarchy(RuntimeClass *klass);
+  // Implementação de um método virtual de classe comum a todas as classes
+  // concretas carregadas que o herdam; nullptr se há mais de uma ou nenhuma
+  RuntimeMethod *unique_implementation(RuntimeMethod *resolved) const;
+  void add_dependency(const HierarchyDependency &assumption,
+                      const std::shared_ptr<CompiledMethod> &code);
+
+  // Estado dos inline caches de todas as classes carregadas
+  void printCallSiteProfile(std::ostream &out) const;
 };
 
 // Runtime
@@ -291,15 +1033,45 @@ class Runtime {
 public:
   Thread *thread;
   MethodArea *method_area;
+  Heap *heap;
+  GarbageCollector *gc;
+  StringTable *strings;
+  JitCompiler *jit;
+  TieringPolicy *tiering;
 
   ClassLoader *class_loader;
 
-  Runtime() {
-    thread = new Thread(this);
-    method_area = new MethodArea();
-    class_loader = new BootstrapClassLoader({}, this);
-  }
-
+  // `gc_workers` 0 usa um worker de marcação por núcleo
+  explicit Runtime(unsigned gc_workers = 0);
   ~Runtime();
   void start(std::string filepath);
+
+  // Nomes começando com '[' são classes de array, criadas na hora
+  RuntimeClass *find_or_load_class(const std::string &name);
+  RuntimeClass *array_class(const std::string &name);
+  // Classe de array de newarray, pelo operando atype
+  RuntimeClass *primitive_array_class(u1 atype);
+  // Roda o <clinit> da superclasse e o da classe, se ainda não rodaram.
+  // Durante o <clinit> a classe já conta como inicializada para a própria
+  // thread.
+  void initialize_class(RuntimeClass *klass);
+
+  // Resolução de entradas do constant pool de `current`, com cache em
+  // RuntimeClass::cp_cache
+  RuntimeField *resolve_field(RuntimeClass *current, u2 index);
+  // Endereço de um estático; inicializa a classe que declara o field
+  u1 *resolve_static_field(RuntimeClass *current, u2 index);
+  // ldc de CONSTANT_String: a String internada do literal
+  RuntimeObject *resolve_string(RuntimeClass *current, u2 index);
+  // ldc de CONSTANT_Class: o java.lang.Class da classe, criado no primeiro
+  // uso. Não inicializa a classe.
+  RuntimeObject *class_mirror(RuntimeClass *klass);
+  // Methodref/InterfaceMethodref: o método declarado ou herdado, antes do
+  // despacho pelo receptor
+  RuntimeMethod *resolve_method(RuntimeClass *current, u2 index);
+  RuntimeClass *resolve_class(RuntimeClass *current, u2 index);
+  // invokedynamic em `pc` de `method`: roda o bootstrap na primeira
+  // execução da instrução. Só há bootstraps nativos (StringConcatFactory e
+  // LambdaMetafactory); os outros lançam BootstrapMethodError.
+  const CallSite &resolve_call_site(RuntimeMethod *method, u4 pc);
 };
\ No newline at end of file
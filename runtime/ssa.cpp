@@ -0,0 +1,330 @@
+#include "./ssa.h"
+
+#include <algorithm>
+
+IrCond negate(IrCond cond) {
+  switch (cond) {
+  case IrCond::EQ:
+    return IrCond::NE;
+  case IrCond::NE:
+    return IrCond::EQ;
+  case IrCond::LT:
+    return IrCond::GE;
+  case IrCond::GE:
+    return IrCond::LT;
+  case IrCond::GT:
+    return IrCond::LE;
+  case IrCond::LE:
+    return IrCond::GT;
+  case IrCond::ULT:
+    return IrCond::UGE;
+  default:
+    return IrCond::ULT;
+  }
+}
+
+IrCond swap_operands(IrCond cond) {
+  switch (cond) {
+  case IrCond::LT:
+    return IrCond::GT;
+  case IrCond::GE:
+    return IrCond::LE;
+  case IrCond::GT:
+    return IrCond::LT;
+  case IrCond::LE:
+    return IrCond::GE;
+  default:
+    return cond;
+  }
+}
+
+IrGraph::IrGraph(Runtime *runtime, RuntimeMethod *method)
+    : runtime(runtime), method(method), entry(nullptr) {
+  undef = make(IrOp::Undef, IrType::Top);
+}
+
+IrInstr *IrGraph::make(IrOp op, IrType type) {
+  instrs.emplace_back(new IrInstr());
+  IrInstr *instr = instrs.back().get();
+  instr->op = op;
+  instr->type = type;
+  instr->cond = IrCond::EQ;
+  instr->kind = 0;
+  instr->non_null = false;
+  instr->removed = false;
+  instr->index = 0;
+  instr->imm = 0;
+  instr->state = nullptr;
+  instr->block = nullptr;
+  instr->forward = nullptr;
+  instr->id = static_cast<u4>(instrs.size() - 1);
+  return instr;
+}
+
+IrInstr *IrGraph::constant(IrType type, int64_t bits) {
+  IrInstr *instr = make(IrOp::Const, type);
+  instr->imm = bits;
+  instr->non_null = type == IrType::Ref && bits != 0;
+  return instr;
+}
+
+IrBlock *IrGraph::new_block(u4 pc) {
+  blocks.emplace_back(new IrBlock());
+  IrBlock *block = blocks.back().get();
+  block->id = static_cast<u4>(blocks.size() - 1);
+  block->pc = pc;
+  block->entry_state = nullptr;
+  block->removed = false;
+  block->rpo = 0;
+  block->idom = nullptr;
+  return block;
+}
+
+FrameState *IrGraph::new_state(u4 pc) {
+  states.emplace_back(new FrameState());
+  states.back()->pc = pc;
+  return states.back().get();
+}
+
+void IrGraph::append(IrBlock *block, IrInstr *instr) {
+  instr->block = block;
+  if (instr->op == IrOp::Phi) {
+    block->phis.push_back(instr);
+    return;
+  }
+  if (!block->code.empty() && block->code.back()->is_terminator())
+    block->code.insert(block->code.end() - 1, instr);
+  else
+    block->code.push_back(instr);
+}
+
+IrInstr *IrGraph::resolve(IrInstr *value) {
+  while (value && value->forward)
+    value = value->forward;
+  return value;
+}
+
+void IrGraph::resolve_all() {
+  auto fix_state = [](FrameState *state) {
+    if (!state)
+      return;
+    for (IrInstr *&value : state->locals)
+      value = resolve(value);
+    for (IrInstr *&value : state->stack)
+      value = resolve(value);
+    for (ScalarObject &object : state->objects)
+      for (ScalarField &field : object.fields)
+        field.value = resolve(field.value);
+  };
+  for (const auto &block : blocks) {
+    if (block->removed)
+      continue;
+    fix_state(block->entry_state);
+    for (IrInstr *phi : block->phis)
+      for (IrInstr *&arg : phi->args)
+        arg = resolve(arg);
+    for (IrInstr *instr : block->code) {
+      for (IrInstr *&arg : instr->args)
+        arg = resolve(arg);
+      fix_state(instr->state);
+    }
+  }
+}
+
+void IrGraph::remove_trivial_phis() {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (IrBlock *block : order) {
+      auto &phis = block->phis;
+      for (size_t i = 0; i < phis.size();) {
+        IrInstr *phi = phis[i];
+        IrInstr *same = nullptr;
+        bool trivial = true;
+        for (IrInstr *arg : phi->args) {
+          arg = resolve(arg);
+          if (arg == phi || arg == same)
+            continue;
+          if (same) {
+            trivial = false;
+            break;
+          }
+          same = arg;
+        }
+        if (!trivial) {
+          i++;
+          continue;
+        }
+        phi->forward = same ? same : undef;
+        phi->removed = true;
+        phis.erase(phis.begin() + static_cast<long>(i));
+        changed = true;
+      }
+    }
+  }
+  resolve_all();
+}
+
+void IrGraph::compute_rpo() {
+  for (const auto &block : blocks)
+    block->rpo = UINT32_MAX;
+
+  // Busca em profundidade iterativa; a pós-ordem sai invertida
+  std::vector<IrBlock *> post;
+  std::vector<std::pair<IrBlock *, size_t>> work;
+  entry->rpo = 0;
+  work.emplace_back(entry, 0);
+  while (!work.empty()) {
+    IrBlock *block = work.back().first;
+    size_t &next = work.back().second;
+    if (next < block->succs.size()) {
+      IrBlock *succ = block->succs[next++];
+      if (succ->rpo == UINT32_MAX) {
+        succ->rpo = 0;
+        work.emplace_back(succ, 0);
+      }
+      continue;
+    }
+    post.push_back(block);
+    work.pop_back();
+  }
+
+  order.assign(post.rbegin(), post.rend());
+  for (u4 i = 0; i < order.size(); i++)
+    order[i]->rpo = i;
+
+  for (const auto &block : blocks) {
+    if (block->removed || block->rpo != UINT32_MAX)
+      continue;
+    block->removed = true;
+    for (IrBlock *succ : block->succs)
+      if (succ->rpo != UINT32_MAX)
+        remove_pred(succ, block.get());
+  }
+}
+
+void IrGraph::compute_dominators() {
+  // Cooper, Harvey e Kennedy: interseção pelos números da pós-ordem
+  // reversa até estabilizar
+  for (IrBlock *block : order)
+    block->idom = nullptr;
+  entry->idom = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (IrBlock *block : order) {
+      if (block == entry)
+        continue;
+      IrBlock *idom = nullptr;
+      for (IrBlock *pred : block->preds) {
+        if (!pred->idom)
+          continue;
+        if (!idom) {
+          idom = pred;
+          continue;
+        }
+        IrBlock *a = pred, *b = idom;
+        while (a != b) {
+          while (a->rpo > b->rpo)
+            a = a->idom;
+          while (b->rpo > a->rpo)
+            b = b->idom;
+        }
+        idom = a;
+      }
+      if (idom != block->idom) {
+        block->idom = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+bool IrGraph::dominates(const IrBlock *a, const IrBlock *b) {
+  while (b != a && b->rpo > a->rpo)
+    b = b->idom;
+  return b == a;
+}
+
+IrBlock *IrGraph::split_edge(IrBlock *pred, size_t index) {
+  IrBlock *succ = pred->succs[index];
+  IrBlock *middle = new_block(IrBlock::NO_PC);
+  middle->rpo = pred->rpo;
+  middle->idom = pred;
+
+  // Arestas repetidas (if com os dois destinos iguais) aparecem na mesma
+  // ordem nos sucessores de pred e nos predecessores de succ
+  size_t occurrence = static_cast<size_t>(
+      std::count(pred->succs.begin(), pred->succs.begin() + index, succ));
+  for (IrBlock *&p : succ->preds) {
+    if (p != pred)
+      continue;
+    if (occurrence-- == 0) {
+      p = middle;
+      break;
+    }
+  }
+  pred->succs[index] = middle;
+  middle->preds.push_back(pred);
+  middle->succs.push_back(succ);
+  append(middle, make(IrOp::Goto, IrType::Void));
+  return middle;
+}
+
+IrBlock *IrGraph::split_block(IrBlock *block, size_t index) {
+  IrBlock *tail = new_block(IrBlock::NO_PC);
+  tail->code.assign(block->code.begin() + static_cast<long>(index),
+                    block->code.end());
+  block->code.resize(index);
+  for (IrInstr *instr : tail->code)
+    instr->block = tail;
+  tail->succs = std::move(block->succs);
+  block->succs.clear();
+  for (IrBlock *succ : tail->succs)
+    std::replace(succ->preds.begin(), succ->preds.end(), block, tail);
+  return tail;
+}
+
+void IrGraph::split_critical_edges() {
+  std::vector<IrBlock *> current = order;
+  for (IrBlock *block : current) {
+    if (block->succs.size() < 2)
+      continue;
+    for (size_t i = 0; i < block->succs.size(); i++)
+      if (block->succs[i]->preds.size() > 1)
+        split_edge(block, i);
+  }
+  compute_rpo();
+}
+
+void IrGraph::absorb(IrGraph &other) {
+  for (auto &instr : other.instrs) {
+    instr->id = static_cast<u4>(instrs.size());
+    instrs.push_back(std::move(instr));
+  }
+  for (auto &block : other.blocks) {
+    block->id = static_cast<u4>(blocks.size());
+    blocks.push_back(std::move(block));
+  }
+  for (auto &state : other.states)
+    states.push_back(std::move(state));
+  dependencies.insert(dependencies.end(), other.dependencies.begin(),
+                      other.dependencies.end());
+  other.instrs.clear();
+  other.blocks.clear();
+  other.states.clear();
+  other.dependencies.clear();
+  other.order.clear();
+  other.entry = nullptr;
+  other.undef = nullptr;
+}
+
+void IrGraph::remove_pred(IrBlock *succ, IrBlock *pred) {
+  auto it = std::find(succ->preds.begin(), succ->preds.end(), pred);
+  if (it == succ->preds.end())
+    return;
+  size_t index = static_cast<size_t>(it - succ->preds.begin());
+  succ->preds.erase(it);
+  for (IrInstr *phi : succ->phis)
+    phi->args.erase(phi->args.begin() + static_cast<long>(index));
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+#include <memory>
+#include <vector>
+
+// IR em SSA do compilador otimizador (tier Optimized). É montada a partir
+// do bytecode já verificado (ssa_builder.cpp), recebe os métodos chamados
+// que valem inlining (ssa_inline.cpp), é otimizada (ssa_optimize.cpp) e
+// traduzida para x86-64 com alocação de registradores por linear scan
+// (ssa_codegen.cpp). Objetos que não escapam do método compilado deixam de
+// ser alocados (ssa_escape.cpp).
+//
+// O código otimizado recebe o mesmo Frame dos outros tiers, mas mantém os
+// valores em registradores e só escreve no frame quando precisa: antes de
+// um Step (instrução sem tradução, rodada no interpretador) e numa
+// desotimização, quando um Guard falha e a execução continua no
+// interpretador a partir do pc do guard.
+
+enum class IrType : u1 {
+  Void, // sem resultado; nos phis, tipo ainda não calculado
+  Int,  // também boolean, byte, char e short
+  Long,
+  Float,
+  Double,
+  Ref,  // referência comprimida
+  Word, // ponteiro de 64 bits fora do heap (RuntimeClass *)
+  Top,  // sem valor utilizável: local não escrita ou tipos conflitantes
+};
+
+enum class IrOp : u1 {
+  // Valores
+  Const, // `imm` com os bits do valor
+  Undef, // o valor de tipo Top
+  Param, // variável local `index` na entrada do método
+  Phi,   // um argumento por predecessor, na ordem de IrBlock::preds
+  Add,
+  Sub,
+  Mul,
+  Div, // depois de um Guard de divisor não nulo
+  Rem,
+  Neg,
+  And,
+  Or,
+  Xor,
+  Shl,
+  Shr,
+  Ushr,
+  Convert,     // `index` é o opcode (i2l ... i2s)
+  Compare,     // lcmp, fcmpl, fcmpg, dcmpl e dcmpg; `index` é o opcode
+  ArrayLength, // array não nulo
+  LoadKlass,   // objeto não nulo: RuntimeObject::klass
+  LoadElement, // array, índice
+  LoadField,   // objeto; `imm` é o offset em data()
+  LoadStatic,  // `imm` é o endereço
+  Reload,      // depois de um Step: slot `index` das locais ('L') ou da
+               // pilha ('S')
+  Virtual,     // objeto substituído por escalares, fora dos blocos: só
+               // aparece em estados, junto com um ScalarObject
+  // Efeitos
+  StoreElement, // array, índice, valor
+  StoreField,   // objeto, valor
+  StoreStatic,  // valor
+  Guard,        // a, b: desotimiza em `state` se `a cond b` for falso
+  Step,         // roda no interpretador a instrução em state->pc
+  // Terminadores
+  Goto,
+  If, // a, b: succs[0] se `a cond b`, senão succs[1]
+  Return,
+  Unwind, // depois de um Step que sempre lança (athrow)
+};
+
+enum class IrCond : u1 { EQ, NE, LT, GE, GT, LE, ULT, UGE };
+
+IrCond negate(IrCond cond);
+// `a cond b` é o mesmo que `b swap_operands(cond) a`; só para EQ, NE e as
+// condições com sinal
+IrCond swap_operands(IrCond cond);
+
+struct IrInstr;
+struct IrBlock;
+
+// Field primitivo de um objeto substituído por escalares; os outros ficam
+// com o valor padrão
+struct ScalarField {
+  u4 offset; // em RuntimeObject::data()
+  char kind; // como em IrInstr::kind
+  IrInstr *value;
+};
+
+// Objeto que não foi alocado, como estava num ponto do método: a
+// desotimização o aloca com estes fields e o põe nos slots com `object`
+struct ScalarObject {
+  IrInstr *object; // IrOp::Virtual
+  RuntimeClass *klass;
+  std::vector<ScalarField> fields;
+};
+
+// Estado do frame do interpretador antes da instrução em `pc`: o valor de
+// cada variável local e de cada slot físico da pilha de operandos, da base
+// para o topo. Locais mortas nesse pc, o segundo índice de um long/double
+// e o segundo slot dele na pilha (sem slots largos) ficam com o Undef.
+struct FrameState {
+  u4 pc;
+  std::vector<IrInstr *> locals;
+  std::vector<IrInstr *> stack;
+  std::vector<ScalarObject> objects; // um por IrOp::Virtual nos slots
+};
+
+struct IrInstr {
+  IrOp op;
+  IrType type;
+  IrCond cond; // Guard e If
+  // Loads e stores: o tipo em memória ('B', 'Z', 'C', 'S', 'I', 'J', 'F',
+  // 'D' ou 'L'). Reload: 'L' variável local, 'S' pilha.
+  char kind;
+  bool non_null; // referência que nunca é null (receptor, new, literais)
+  bool removed;
+  u4 index;
+  int64_t imm;
+  std::vector<IrInstr *> args;
+  FrameState *state; // Guard e Step
+  IrBlock *block;
+  IrInstr *forward; // valor equivalente, depois de uma simplificação
+  u4 id;
+
+  bool is_terminator() const { return op >= IrOp::Goto; }
+  bool is_const() const { return op == IrOp::Const; }
+  // Sem efeitos: pode sair do grafo se ninguém usa o resultado
+  bool is_pure() const { return op < IrOp::StoreElement; }
+};
+
+struct IrBlock {
+  static const u4 NO_PC = 0xFFFFFFFF;
+
+  u4 id;
+  u4 pc; // início no bytecode; NO_PC nos blocos criados pelo compilador
+  std::vector<IrInstr *> phis;
+  std::vector<IrInstr *> code; // termina com o terminador
+  std::vector<IrBlock *> preds;
+  std::vector<IrBlock *> succs;
+  // Estado na entrada dos cabeçalhos de laço, para os guards tirados de
+  // dentro do laço desotimizarem antes da primeira volta
+  FrameState *entry_state;
+  bool removed;
+
+  // Ordem e dominadores (IrGraph::compute_rpo e compute_dominators)
+  u4 rpo;
+  IrBlock *idom;
+
+  IrInstr *terminator() const { return code.back(); }
+};
+
+class IrGraph {
+public:
+  IrGraph(Runtime *runtime, RuntimeMethod *method);
+
+  Runtime *runtime;
+  RuntimeMethod *method;
+  IrBlock *entry;
+  IrInstr *undef;
+  std::vector<IrBlock *> order; // pós-ordem reversa, depois de compute_rpo
+  // Chamadas ligadas pela análise de hierarquia, inclusive nos métodos
+  // inlinados; registradas na MethodArea junto com o código
+  std::vector<HierarchyDependency> dependencies;
+
+  IrInstr *make(IrOp op, IrType type);
+  IrInstr *constant(IrType type, int64_t bits);
+  IrBlock *new_block(u4 pc);
+  FrameState *new_state(u4 pc);
+  // Instrução no fim do bloco, antes do terminador se ele já existe
+  void append(IrBlock *block, IrInstr *instr);
+
+  // Segue IrInstr::forward até o valor final
+  static IrInstr *resolve(IrInstr *value);
+  // Aplica os forwards em todos os argumentos e estados
+  void resolve_all();
+  // Phis cujos argumentos são todos o mesmo valor (ou o próprio phi) viram
+  // esse valor
+  void remove_trivial_phis();
+
+  // Ordem dos blocos alcançáveis a partir da entrada; os outros saem do
+  // grafo, com os argumentos de phi que vinham deles
+  void compute_rpo();
+  void compute_dominators();
+  static bool dominates(const IrBlock *a, const IrBlock *b);
+
+  // Novo bloco no meio da aresta pred->succs[index]
+  IrBlock *split_edge(IrBlock *pred, size_t index);
+  // Passa block->code a partir de `index` para um bloco novo, que herda os
+  // sucessores; `block` fica sem terminador
+  IrBlock *split_block(IrBlock *block, size_t index);
+  // Quebra as arestas de um bloco com vários sucessores para um com vários
+  // predecessores: o gerador de código põe os movimentos dos phis no bloco
+  // do meio
+  void split_critical_edges();
+  // Tira uma aresta pred->succ dos predecessores de `succ`, com o
+  // argumento correspondente dos phis
+  static void remove_pred(IrBlock *succ, IrBlock *pred);
+
+  // Traz para este grafo os nós e as dependências de `other` (um método
+  // inlinado), com ids novos; `other` fica vazio
+  void absorb(IrGraph &other);
+
+  size_t instr_count() const { return instrs.size(); }
+  size_t block_count() const { return blocks.size(); }
+
+private:
+  std::vector<std::unique_ptr<IrInstr>> instrs;
+  std::vector<std::unique_ptr<IrBlock>> blocks;
+  std::vector<std::unique_ptr<FrameState>> states;
+};
+
+// Grafo do método, ou nullptr se ele usa algo que o tier não traduz
+// (jsr/ret, switch grande, tipos inconsistentes)
+std::unique_ptr<IrGraph> build_ir(Runtime *runtime, RuntimeMethod *method);
+
+// Troca invokes por uma cópia do grafo do alvo quando ele é pequeno e
+// conhecido: ligação estática, método final, implementação única entre as
+// classes carregadas ou uma ou duas classes de receptor no inline cache do
+// sítio (ssa_inline.cpp)
+void inline_calls(IrGraph &graph);
+
+// Classe do objeto criado por um `new` do método, se `value` é o resultado
+// dele (o Reload que segue o Step); senão nullptr
+RuntimeClass *allocated_class(const IrGraph &graph, const IrInstr *value);
+
+// Escape analysis: os `new` cujo objeto não escapa saem do grafo e os
+// fields viram valores SSA (ssa_escape.cpp). true se mudou o grafo.
+bool replace_allocations(IrGraph &graph);
+
+// Dobra de constantes, propagação de cópias, escape analysis, GVN, código
+// invariante fora dos laços, eliminação de checagens de limite e de código
+// morto
+void optimize_ir(IrGraph &graph);
+
+// Código de máquina com a interface de CompiledMethod::Entry; false se a
+// tradução não deu certo
+bool generate_code(IrGraph &graph, std::vector<u1> &out);
@@ -0,0 +1,1308 @@
+#include "../classfile/bytecode.h"
+#include "./reference_map.h"
+#include "./ssa.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Construção do SSA direto do bytecode (Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form"): as variáveis são as
+// locais e os slots da pilha de operandos, lidas e escritas por bloco, e os
+// phis nascem na primeira leitura de um bloco com vários predecessores.
+
+namespace {
+
+// Métodos maiores ficam no código de templates
+const u4 MAX_CODE_LENGTH = 4000;
+// Cada caso de tableswitch/lookupswitch vira uma comparação
+const u4 MAX_SWITCH_CASES = 64;
+
+const int C2 = CATEGORY2_STACK_SLOTS;
+
+bool is_category2(IrType type) {
+  return type == IrType::Long || type == IrType::Double;
+}
+
+IrType type_of(char descriptor) {
+  switch (descriptor) {
+  case 'J':
+    return IrType::Long;
+  case 'F':
+    return IrType::Float;
+  case 'D':
+    return IrType::Double;
+  case 'L':
+  case '[':
+    return IrType::Ref;
+  case 'V':
+    return IrType::Void;
+  default:
+    return IrType::Int;
+  }
+}
+
+// Descritor do field, método ou call site de uma entrada do constant pool
+std::string member_descriptor(const ClassFile &cf, u2 index) {
+  const ConstantPoolEntry &entry = cf.constant_pool[index];
+  u2 nat;
+  switch (entry.first) {
+  case ConstantTag::CONSTANT_Fieldref:
+    nat = entry.second.fieldref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_Methodref:
+    nat = entry.second.methodref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_InterfaceMethodref:
+    nat = entry.second.interface_methodref_info.name_and_type_index;
+    break;
+  case ConstantTag::CONSTANT_InvokeDynamic:
+    nat = entry.second.invoke_dynamic_info.name_and_type_index;
+    break;
+  default:
+    return "";
+  }
+  return cf.resolve_utf8(
+      cf.constant_pool[nat].second.name_and_type_info.descriptor_index);
+}
+
+bool is_branch(u1 op) {
+  return (op >= OP_ifeq && op <= OP_if_acmpne) || op == OP_ifnull ||
+         op == OP_ifnonnull;
+}
+
+// Última instrução de um bloco: não cai na seguinte
+bool ends_flow(u1 op) {
+  return op == OP_goto || op == OP_goto_w || op == OP_tableswitch ||
+         op == OP_lookupswitch || (op >= OP_ireturn && op <= OP_return) ||
+         op == OP_athrow;
+}
+
+int32_t branch_offset(const std::vector<u1> &code, u4 pc) {
+  if (code[pc] == OP_goto_w)
+    return static_cast<int32_t>(read_code_u4(code, pc + 1));
+  return static_cast<int16_t>(read_code_u2(code, pc + 1));
+}
+
+// Casos de um switch: (chave, destino), e o destino padrão
+struct SwitchTable {
+  std::vector<std::pair<int32_t, u4>> cases;
+  u4 default_target;
+};
+
+SwitchTable read_switch(const std::vector<u1> &code, u4 pc) {
+  SwitchTable table;
+  u4 base = (pc + 4) & ~3u;
+  table.default_target =
+      static_cast<u4>(pc + static_cast<int32_t>(read_code_u4(code, base)));
+  if (code[pc] == OP_tableswitch) {
+    int32_t low = static_cast<int32_t>(read_code_u4(code, base + 4));
+    int32_t high = static_cast<int32_t>(read_code_u4(code, base + 8));
+    for (int64_t key = low; key <= high; key++) {
+      if (table.cases.size() > MAX_SWITCH_CASES)
+        break;
+      int32_t offset = static_cast<int32_t>(read_code_u4(
+          code, base + 12 + static_cast<u4>(key - low) * 4));
+      table.cases.emplace_back(static_cast<int32_t>(key),
+                               static_cast<u4>(pc + offset));
+    }
+  } else {
+    u4 npairs = read_code_u4(code, base + 4);
+    for (u4 i = 0; i < npairs && i <= MAX_SWITCH_CASES; i++) {
+      int32_t key = static_cast<int32_t>(read_code_u4(code, base + 8 + i * 8));
+      int32_t offset =
+          static_cast<int32_t>(read_code_u4(code, base + 12 + i * 8));
+      table.cases.emplace_back(key, static_cast<u4>(pc + offset));
+    }
+  }
+  return table;
+}
+
+class Builder {
+public:
+  Builder(IrGraph &graph)
+      : graph(graph), method(graph.method), klass(method->owner),
+        code(method->code->code), map(method->reference_map()),
+        max_locals(method->code->max_locals),
+        num_vars(static_cast<u4>(method->code->max_locals) +
+                 method->code->max_stack) {}
+
+  bool build();
+
+private:
+  bool compute_liveness();
+  bool find_blocks();
+  void fill_entry();
+  bool fill(IrBlock *block);
+  bool translate(u4 pc);
+  void seal_ready(IrBlock *block);
+  void infer_phi_types();
+  bool validate();
+
+  // Variáveis
+  IrInstr *read(u4 var, IrBlock *block);
+  void write(u4 var, IrInstr *value) { defs[current->id][var] = value; }
+  IrInstr *new_phi(IrBlock *block);
+  void add_phi_operands(u4 var, IrInstr *phi);
+  void seal(IrBlock *block);
+
+  // Pilha de operandos abstrata, um valor por slot físico
+  void push(IrInstr *value);
+  IrInstr *pop();
+  IrInstr *pop(IrType type);
+
+  IrInstr *emit(IrOp op, IrType type, std::initializer_list<IrInstr *> args);
+  IrInstr *constant(IrType type, int64_t bits) {
+    return graph.constant(type, bits);
+  }
+  FrameState *state(u4 pc);
+  void guard(IrCond cond, IrInstr *a, IrInstr *b, FrameState *state);
+  void null_check(IrInstr *object, FrameState *state);
+  void check_element(IrInstr *array, IrInstr *index, FrameState *state);
+  // Instrução rodada no interpretador; `pushes` são os tipos dos valores
+  // que ela deixa na pilha
+  bool step(u4 pc, FrameState *state, std::initializer_list<IrType> pushes,
+            bool non_null = false);
+  RuntimeClass *speculated_class(u4 pc);
+  void terminate(IrOp op, std::initializer_list<IrInstr *> args);
+
+  IrGraph &graph;
+  RuntimeMethod *method;
+  RuntimeClass *klass;
+  const std::vector<u1> &code;
+  const ReferenceMap &map;
+  u4 max_locals;
+  u4 num_vars;
+
+  // Locais vivas antes de cada instrução
+  std::vector<std::vector<bool>> live;
+
+  std::vector<IrBlock *> block_at; // por pc de início
+  std::vector<u4> last_pc;         // por id de bloco
+  struct SwitchChain {
+    std::vector<IrBlock *> blocks; // comparações depois da primeira
+    std::vector<int32_t> keys;
+  };
+  std::vector<SwitchChain> chains; // por id de bloco
+
+  std::vector<std::vector<IrInstr *>> defs; // por id de bloco e variável
+  std::vector<std::vector<std::pair<u4, IrInstr *>>> incomplete;
+  std::vector<bool> sealed;
+  std::vector<bool> filled;
+
+  IrBlock *current = nullptr;
+  std::vector<IrInstr *> stack;
+};
+
+bool Builder::build() {
+  if (code.empty() || code.size() > MAX_CODE_LENGTH || !map.at(0))
+    return false;
+  if (!compute_liveness() || !find_blocks())
+    return false;
+
+  size_t blocks = graph.block_count();
+  defs.assign(blocks, std::vector<IrInstr *>(num_vars, nullptr));
+  incomplete.resize(blocks);
+  sealed.assign(blocks, false);
+  filled.assign(blocks, false);
+
+  fill_entry();
+  for (IrBlock *block : graph.order) {
+    if (filled[block->id])
+      continue;
+    if (!fill(block))
+      return false;
+  }
+
+  graph.remove_trivial_phis();
+  infer_phi_types();
+  return validate();
+}
+
+// Locais vivas por pc, de trás para frente até estabilizar. Os estados de
+// desotimização só guardam as vivas: as outras o interpretador não lê.
+bool Builder::compute_liveness() {
+  live.assign(code.size(), std::vector<bool>());
+  std::vector<u4> pcs;
+  for (u4 pc = 0; pc < code.size(); pc += instruction_length(code, pc))
+    if (map.at(pc))
+      pcs.push_back(pc);
+  for (u4 pc : pcs)
+    live[pc].assign(max_locals, false);
+
+  std::vector<u4> succs;
+  std::vector<bool> in;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = pcs.rbegin(); it != pcs.rend(); ++it) {
+      u4 pc = *it;
+      u1 op = code[pc];
+      u4 next = pc + instruction_length(code, pc);
+
+      succs.clear();
+      if (is_branch(op) || op == OP_goto || op == OP_goto_w)
+        succs.push_back(static_cast<u4>(pc + branch_offset(code, pc)));
+      if (op == OP_tableswitch || op == OP_lookupswitch) {
+        SwitchTable table = read_switch(code, pc);
+        succs.push_back(table.default_target);
+        for (const auto &c : table.cases)
+          succs.push_back(c.second);
+      }
+      if (!ends_flow(op) && next < code.size())
+        succs.push_back(next);
+
+      in.assign(max_locals, false);
+      for (u4 succ : succs) {
+        if (succ >= code.size() || !map.at(succ))
+          return false;
+        for (u4 i = 0; i < max_locals; i++)
+          if (live[succ][i])
+            in[i] = true;
+      }
+
+      // Efeito da instrução nas locais
+      u1 base = op;
+      u4 index = 0;
+      bool wide = op == OP_wide;
+      if (wide) {
+        base = code[pc + 1];
+        index = read_code_u2(code, pc + 2);
+      } else if ((op >= OP_iload && op <= OP_aload) ||
+                 (op >= OP_istore && op <= OP_astore) || op == OP_iinc ||
+                 op == OP_ret) {
+        index = code[pc + 1];
+      }
+      if (base >= OP_iload_0 && base <= OP_aload_3) {
+        index = (base - OP_iload_0) % 4;
+        base = static_cast<u1>(OP_iload + (base - OP_iload_0) / 4);
+      } else if (base >= OP_istore_0 && base <= OP_astore_3) {
+        index = (base - OP_istore_0) % 4;
+        base = static_cast<u1>(OP_istore + (base - OP_istore_0) / 4);
+      }
+      if (base >= OP_istore && base <= OP_astore && index < max_locals) {
+        in[index] = false;
+        if ((base == OP_lstore || base == OP_dstore) && index + 1 < max_locals)
+          in[index + 1] = false;
+      }
+      if (((base >= OP_iload && base <= OP_aload) || base == OP_iinc ||
+           base == OP_ret) &&
+          index < max_locals)
+        in[index] = true;
+
+      // Uma exceção leva as locais de antes da instrução ao handler
+      for (const ExceptionTableEntry &handler : method->code->exception_table)
+        if (pc >= handler.start_pc && pc < handler.end_pc &&
+            map.at(handler.handler_pc))
+          for (u4 i = 0; i < max_locals; i++)
+            if (live[handler.handler_pc][i])
+              in[i] = true;
+
+      if (in != live[pc]) {
+        live[pc] = in;
+        changed = true;
+      }
+    }
+  }
+  return true;
+}
+
+bool Builder::find_blocks() {
+  // Líderes: o início, os destinos de desvios e o que vem depois deles
+  std::vector<bool> leader(code.size() + 1, false);
+  leader[0] = true;
+  for (u4 pc = 0; pc < code.size(); pc += instruction_length(code, pc)) {
+    if (!map.at(pc))
+      continue;
+    u1 op = code[pc];
+    u4 next = pc + instruction_length(code, pc);
+    if (op == OP_jsr || op == OP_jsr_w || op == OP_ret ||
+        (op == OP_wide && code[pc + 1] == OP_ret))
+      return false;
+    if (is_branch(op) || op == OP_goto || op == OP_goto_w) {
+      u4 target = static_cast<u4>(pc + branch_offset(code, pc));
+      if (target >= code.size())
+        return false;
+      leader[target] = true;
+    }
+    if (op == OP_tableswitch || op == OP_lookupswitch) {
+      SwitchTable table = read_switch(code, pc);
+      if (table.cases.size() > MAX_SWITCH_CASES)
+        return false;
+      if (table.default_target >= code.size())
+        return false;
+      leader[table.default_target] = true;
+      for (const auto &c : table.cases) {
+        if (c.second >= code.size())
+          return false;
+        leader[c.second] = true;
+      }
+    }
+    if (is_branch(op) || ends_flow(op))
+      leader[next] = true;
+  }
+
+  block_at.assign(code.size(), nullptr);
+  for (u4 pc = 0; pc < code.size(); pc += instruction_length(code, pc))
+    if (leader[pc] && map.at(pc))
+      block_at[pc] = graph.new_block(pc);
+
+  auto target = [&](u4 pc) {
+    return pc < code.size() ? block_at[pc] : nullptr;
+  };
+  graph.entry = graph.new_block(IrBlock::NO_PC);
+  graph.entry->succs.push_back(block_at[0]);
+
+  std::vector<IrBlock *> starts;
+  for (IrBlock *block : block_at)
+    if (block)
+      starts.push_back(block);
+  for (IrBlock *block : starts) {
+    u4 pc = block->pc;
+    for (;;) {
+      u4 next = pc + instruction_length(code, pc);
+      u1 op = code[pc];
+      if (is_branch(op) || ends_flow(op) || next >= code.size() ||
+          leader[next])
+        break;
+      pc = next;
+    }
+    if (last_pc.size() <= block->id)
+      last_pc.resize(block->id + 1);
+    last_pc[block->id] = pc;
+
+    u1 op = code[pc];
+    u4 next = pc + instruction_length(code, pc);
+    std::vector<IrBlock *> &succs = block->succs;
+    if (is_branch(op)) {
+      succs.push_back(target(static_cast<u4>(pc + branch_offset(code, pc))));
+      succs.push_back(target(next));
+    } else if (op == OP_goto || op == OP_goto_w) {
+      succs.push_back(target(static_cast<u4>(pc + branch_offset(code, pc))));
+    } else if (op == OP_tableswitch || op == OP_lookupswitch) {
+      // Cadeia de ifs: o bloco do switch compara a primeira chave e cada
+      // bloco novo compara a seguinte; o último cai no padrão
+      SwitchTable table = read_switch(code, pc);
+      if (chains.size() <= block->id)
+        chains.resize(block->id + 1);
+      SwitchChain chain;
+      IrBlock *from = block;
+      for (size_t i = 0; i < table.cases.size(); i++) {
+        chain.keys.push_back(table.cases[i].first);
+        from->succs.push_back(target(table.cases[i].second));
+        if (i + 1 == table.cases.size())
+          break;
+        IrBlock *link = graph.new_block(IrBlock::NO_PC);
+        chain.blocks.push_back(link);
+        from->succs.push_back(link);
+        from = link;
+      }
+      from->succs.push_back(target(table.default_target));
+      chains[block->id] = chain;
+    } else if (!ends_flow(op)) {
+      succs.push_back(target(next));
+    }
+    for (IrBlock *succ : succs)
+      if (!succ)
+        return false;
+    if (op == OP_tableswitch || op == OP_lookupswitch)
+      for (IrBlock *link : chains[block->id].blocks)
+        for (IrBlock *succ : link->succs)
+          if (!succ)
+            return false;
+  }
+
+  // Só os blocos alcançáveis pelo fluxo normal: uma exceção sai do código
+  // otimizado pelo Step que lançou, e o handler roda no interpretador
+  graph.compute_rpo();
+  for (IrBlock *block : graph.order)
+    for (IrBlock *succ : block->succs)
+      succ->preds.push_back(block);
+  return true;
+}
+
+IrInstr *Builder::new_phi(IrBlock *block) {
+  IrInstr *phi = graph.make(IrOp::Phi, IrType::Void);
+  graph.append(block, phi);
+  return phi;
+}
+
+IrInstr *Builder::read(u4 var, IrBlock *block) {
+  if (IrInstr *value = defs[block->id][var])
+    return value;
+  IrInstr *value;
+  if (!sealed[block->id]) {
+    value = new_phi(block);
+    incomplete[block->id].emplace_back(var, value);
+  } else if (block->preds.size() == 1) {
+    value = read(var, block->preds[0]);
+  } else if (block->preds.empty()) {
+    value = graph.undef;
+  } else {
+    // Escrito antes de ler os predecessores: um laço volta a este phi
+    value = new_phi(block);
+    defs[block->id][var] = value;
+    add_phi_operands(var, value);
+  }
+  defs[block->id][var] = value;
+  return value;
+}
+
+void Builder::add_phi_operands(u4 var, IrInstr *phi) {
+  for (IrBlock *pred : phi->block->preds)
+    phi->args.push_back(read(var, pred));
+}
+
+void Builder::seal(IrBlock *block) {
+  sealed[block->id] = true;
+  for (const auto &entry : incomplete[block->id])
+    add_phi_operands(entry.first, entry.second);
+  incomplete[block->id].clear();
+}
+
+void Builder::seal_ready(IrBlock *block) {
+  for (IrBlock *succ : block->succs) {
+    if (sealed[succ->id])
+      continue;
+    bool ready = true;
+    for (IrBlock *pred : succ->preds)
+      if (!filled[pred->id])
+        ready = false;
+    if (ready)
+      seal(succ);
+  }
+}
+
+void Builder::push(IrInstr *value) {
+  stack.push_back(value);
+  if (C2 == 2 && is_category2(value->type))
+    stack.push_back(graph.undef);
+}
+
+IrInstr *Builder::pop() {
+  IrInstr *value = stack.back();
+  stack.pop_back();
+  return value;
+}
+
+IrInstr *Builder::pop(IrType type) {
+  if (C2 == 2 && is_category2(type))
+    stack.pop_back();
+  return pop();
+}
+
+IrInstr *Builder::emit(IrOp op, IrType type,
+                       std::initializer_list<IrInstr *> args) {
+  IrInstr *instr = graph.make(op, type);
+  instr->args = args;
+  graph.append(current, instr);
+  return instr;
+}
+
+FrameState *Builder::state(u4 pc) {
+  FrameState *state = graph.new_state(pc);
+  state->locals.resize(max_locals, graph.undef);
+  for (u4 i = 0; i < max_locals; i++)
+    if (live[pc][i])
+      state->locals[i] = read(i, current);
+  state->stack = stack;
+  return state;
+}
+
+void Builder::guard(IrCond cond, IrInstr *a, IrInstr *b, FrameState *state) {
+  IrInstr *instr = emit(IrOp::Guard, IrType::Void, {a, b});
+  instr->cond = cond;
+  instr->state = state;
+}
+
+void Builder::null_check(IrInstr *object, FrameState *state) {
+  if (!object->non_null)
+    guard(IrCond::NE, object, constant(IrType::Ref, 0), state);
+}
+
+void Builder::check_element(IrInstr *array, IrInstr *index,
+                            FrameState *state) {
+  null_check(array, state);
+  // Sem sinal: índice negativo também falha
+  guard(IrCond::ULT, index, emit(IrOp::ArrayLength, IrType::Int, {array}),
+        state);
+}
+
+bool Builder::step(u4 pc, FrameState *state,
+                   std::initializer_list<IrType> pushes, bool non_null) {
+  IrInstr *instr = emit(IrOp::Step, IrType::Void, {});
+  instr->state = state;
+
+  // A profundidade depois da instrução é a do mapa de referências; os
+  // slots abaixo dos valores empilhados não mudam, mas referências podem
+  // ter sido movidas pelo GC e são relidas do frame. Mover não anula: o
+  // que não era null continua não sendo.
+  u4 next = pc + instruction_length(code, pc);
+  const ReferenceMap::Entry *after =
+      next < code.size() ? map.at(next) : nullptr;
+  if (!after)
+    return false;
+  u4 pushed = 0;
+  for (IrType type : pushes)
+    pushed += is_category2(type) ? C2 : 1;
+  if (after->stack_depth < pushed ||
+      after->stack_depth - pushed > stack.size())
+    return false;
+
+  auto reload = [&](char kind, u4 index, IrType type, bool known) {
+    IrInstr *value = emit(IrOp::Reload, type, {});
+    value->kind = kind;
+    value->index = index;
+    value->non_null = known;
+    return value;
+  };
+  stack.resize(after->stack_depth - pushed);
+  for (u4 s = 0; s < stack.size(); s++)
+    if (map.stack_is_ref(*after, static_cast<u2>(s)))
+      stack[s] = reload('S', s, IrType::Ref, state->stack[s]->non_null);
+  for (IrType type : pushes)
+    push(reload('S', static_cast<u4>(stack.size()), type, non_null));
+  for (u4 i = 0; i < max_locals; i++)
+    if (map.local_is_ref(*after, static_cast<u2>(i)))
+      write(i, live[next][i]
+                   ? reload('L', i, IrType::Ref, state->locals[i]->non_null)
+                   : graph.undef);
+  return true;
+}
+
+RuntimeClass *Builder::speculated_class(u4 pc) {
+  const TypeProfile *profile = method->profile.type_profile_at(pc);
+  if (!profile || !profile->classes[0] || profile->other ||
+      profile->null_seen)
+    return nullptr;
+  for (u1 i = 1; i < TYPE_PROFILE_WIDTH; i++)
+    if (profile->classes[i])
+      return nullptr;
+  return profile->classes[0];
+}
+
+void Builder::terminate(IrOp op, std::initializer_list<IrInstr *> args) {
+  emit(op, IrType::Void, args);
+}
+
+void Builder::fill_entry() {
+  current = graph.entry;
+  u4 local = 0;
+  auto param = [&](IrType type) {
+    IrInstr *value = emit(IrOp::Param, type, {});
+    value->index = local;
+    write(local, value);
+    local += is_category2(type) ? 2 : 1;
+    return value;
+  };
+  if (!method->is_static())
+    param(IrType::Ref)->non_null = true;
+  for (char c : method->signature().args)
+    param(type_of(c));
+  terminate(IrOp::Goto, {});
+  filled[current->id] = true;
+  sealed[current->id] = true;
+  seal_ready(current);
+}
+
+bool Builder::fill(IrBlock *block) {
+  current = block;
+  u2 depth = map.at(block->pc)->stack_depth;
+  stack.clear();
+  for (u4 s = 0; s < depth; s++)
+    stack.push_back(read(max_locals + s, block));
+  for (IrBlock *pred : block->preds)
+    if (pred->rpo >= block->rpo && !block->entry_state)
+      block->entry_state = state(block->pc);
+
+  u4 pc = block->pc;
+  for (;;) {
+    if (!translate(pc))
+      return false;
+    if (pc == last_pc[block->id])
+      break;
+    pc += instruction_length(code, pc);
+  }
+
+  // Sem terminador: cai no bloco seguinte
+  if (block->code.empty() || !block->code.back()->is_terminator())
+    terminate(IrOp::Goto, {});
+  for (u4 s = 0; s < stack.size(); s++)
+    defs[block->id][max_locals + s] = stack[s];
+
+  filled[block->id] = true;
+  seal_ready(block);
+  if (block->id < chains.size())
+    for (IrBlock *link : chains[block->id].blocks) {
+      filled[link->id] = true;
+      seal_ready(link);
+    }
+  return true;
+}
+
+bool Builder::translate(u4 pc) {
+  const u1 op = code[pc];
+  const ClassFile &cf = *klass->class_file;
+
+  // Aritmética: iadd..dneg em grupos de quatro tipos, shifts e lógicas em
+  // grupos de dois
+  static const IrType NUMERIC[] = {IrType::Int, IrType::Long, IrType::Float,
+                                   IrType::Double};
+  if (op >= OP_iadd && op <= OP_drem) {
+    static const IrOp OPS[] = {IrOp::Add, IrOp::Sub, IrOp::Mul, IrOp::Div,
+                               IrOp::Rem};
+    IrOp ir = OPS[(op - OP_iadd) / 4];
+    IrType type = NUMERIC[(op - OP_iadd) % 4];
+    bool integral = type == IrType::Int || type == IrType::Long;
+    if (ir == IrOp::Rem && !integral)
+      // frem/drem: o fmod do interpretador
+      return step(pc, state(pc), {type});
+    FrameState *st = (ir == IrOp::Div || ir == IrOp::Rem) && integral
+                         ? state(pc)
+                         : nullptr;
+    IrInstr *b = pop(type);
+    IrInstr *a = pop(type);
+    if (st && !(b->is_const() && b->imm != 0))
+      guard(IrCond::NE, b, constant(type, 0), st);
+    push(emit(ir, type, {a, b}));
+    return true;
+  }
+  if (op >= OP_ineg && op <= OP_dneg) {
+    IrType type = NUMERIC[op - OP_ineg];
+    push(emit(IrOp::Neg, type, {pop(type)}));
+    return true;
+  }
+  if (op >= OP_ishl && op <= OP_lxor) {
+    static const IrOp OPS[] = {IrOp::Shl, IrOp::Shr, IrOp::Ushr,
+                               IrOp::And, IrOp::Or,  IrOp::Xor};
+    IrOp ir = OPS[(op - OP_ishl) / 2];
+    IrType type = (op - OP_ishl) % 2 ? IrType::Long : IrType::Int;
+    bool shift = ir == IrOp::Shl || ir == IrOp::Shr || ir == IrOp::Ushr;
+    IrInstr *b = pop(shift ? IrType::Int : type);
+    IrInstr *a = pop(type);
+    push(emit(ir, type, {a, b}));
+    return true;
+  }
+  if (op >= OP_i2l && op <= OP_i2s) {
+    static const IrType FROM[] = {
+        IrType::Int,    IrType::Int,    IrType::Int,   IrType::Long,
+        IrType::Long,   IrType::Long,   IrType::Float, IrType::Float,
+        IrType::Float,  IrType::Double, IrType::Double, IrType::Double,
+        IrType::Int,    IrType::Int,    IrType::Int};
+    static const IrType TO[] = {
+        IrType::Long,  IrType::Float,  IrType::Double, IrType::Int,
+        IrType::Float, IrType::Double, IrType::Int,    IrType::Long,
+        IrType::Double, IrType::Int,   IrType::Long,   IrType::Float,
+        IrType::Int,   IrType::Int,    IrType::Int};
+    IrInstr *value = pop(FROM[op - OP_i2l]);
+    IrInstr *result = emit(IrOp::Convert, TO[op - OP_i2l], {value});
+    result->index = op;
+    push(result);
+    return true;
+  }
+  if (op >= OP_lcmp && op <= OP_dcmpg) {
+    IrType type = op == OP_lcmp                         ? IrType::Long
+                  : op == OP_fcmpl || op == OP_fcmpg ? IrType::Float
+                                                      : IrType::Double;
+    IrInstr *b = pop(type);
+    IrInstr *a = pop(type);
+    IrInstr *result = emit(IrOp::Compare, IrType::Int, {a, b});
+    result->index = op;
+    push(result);
+    return true;
+  }
+  if (is_branch(op)) {
+    static const IrCond CONDS[] = {IrCond::EQ, IrCond::NE, IrCond::LT,
+                                   IrCond::GE, IrCond::GT, IrCond::LE};
+    IrInstr *a, *b;
+    IrCond cond;
+    if (op <= OP_ifle) {
+      a = pop();
+      b = constant(IrType::Int, 0);
+      cond = CONDS[op - OP_ifeq];
+    } else if (op <= OP_if_acmpne) {
+      b = pop();
+      a = pop();
+      cond = op >= OP_if_acmpeq ? CONDS[op - OP_if_acmpeq]
+                                : CONDS[op - OP_if_icmpeq];
+    } else {
+      a = pop();
+      b = constant(IrType::Ref, 0);
+      cond = op == OP_ifnull ? IrCond::EQ : IrCond::NE;
+    }
+    emit(IrOp::If, IrType::Void, {a, b})->cond = cond;
+    return true;
+  }
+
+  switch (op) {
+  case OP_nop:
+    return true;
+
+  // Constantes
+  case OP_aconst_null:
+    push(constant(IrType::Ref, 0));
+    return true;
+  case OP_iconst_m1:
+  case OP_iconst_0:
+  case OP_iconst_1:
+  case OP_iconst_2:
+  case OP_iconst_3:
+  case OP_iconst_4:
+  case OP_iconst_5:
+    push(constant(IrType::Int, op - OP_iconst_0));
+    return true;
+  case OP_lconst_0:
+  case OP_lconst_1:
+    push(constant(IrType::Long, op - OP_lconst_0));
+    return true;
+  case OP_fconst_0:
+  case OP_fconst_1:
+  case OP_fconst_2: {
+    float value = static_cast<float>(op - OP_fconst_0);
+    u4 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    push(constant(IrType::Float, bits));
+    return true;
+  }
+  case OP_dconst_0:
+  case OP_dconst_1: {
+    double value = op - OP_dconst_0;
+    int64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    push(constant(IrType::Double, bits));
+    return true;
+  }
+  case OP_bipush:
+    push(constant(IrType::Int, static_cast<int8_t>(code[pc + 1])));
+    return true;
+  case OP_sipush:
+    push(constant(IrType::Int,
+                  static_cast<int16_t>(read_code_u2(code, pc + 1))));
+    return true;
+  case OP_ldc:
+  case OP_ldc_w:
+  case OP_ldc2_w: {
+    u2 index = op == OP_ldc ? code[pc + 1] : read_code_u2(code, pc + 1);
+    const ConstantPoolEntry &entry = cf.constant_pool[index];
+    switch (entry.first) {
+    case ConstantTag::CONSTANT_Integer:
+      push(constant(IrType::Int,
+                    static_cast<int32_t>(entry.second.integer_info.bytes)));
+      return true;
+    case ConstantTag::CONSTANT_Float:
+      push(constant(IrType::Float, entry.second.float_info.bytes));
+      return true;
+    case ConstantTag::CONSTANT_Long:
+      push(constant(IrType::Long,
+                    static_cast<int64_t>(
+                        (static_cast<u8>(entry.second.long_info.high_bytes)
+                         << 32) |
+                        entry.second.long_info.low_bytes)));
+      return true;
+    case ConstantTag::CONSTANT_Double:
+      push(constant(IrType::Double,
+                    static_cast<int64_t>(
+                        (static_cast<u8>(entry.second.double_info.high_bytes)
+                         << 32) |
+                        entry.second.double_info.low_bytes)));
+      return true;
+    default:
+      // Literal já internado na geração velha: o endereço não muda mais
+      if (entry.first == ConstantTag::CONSTANT_String &&
+          klass->cp_cache[index].string) {
+        push(constant(IrType::Ref, encode_ref(klass->cp_cache[index].string)));
+        return true;
+      }
+      return step(pc, state(pc), {IrType::Ref}, true);
+    }
+  }
+
+  // Variáveis locais
+  case OP_iload:
+  case OP_fload:
+  case OP_aload:
+  case OP_lload:
+  case OP_dload:
+  case OP_istore:
+  case OP_fstore:
+  case OP_astore:
+  case OP_lstore:
+  case OP_dstore:
+  case OP_iinc:
+  case OP_wide: {
+    u1 base = op;
+    u4 index = code[pc + 1];
+    int32_t increment = op == OP_iinc ? static_cast<int8_t>(code[pc + 2]) : 0;
+    if (op == OP_wide) {
+      base = code[pc + 1];
+      index = read_code_u2(code, pc + 2);
+      if (base == OP_iinc)
+        increment = static_cast<int16_t>(read_code_u2(code, pc + 4));
+    }
+    if (index >= max_locals)
+      return false;
+    switch (base) {
+    case OP_iload:
+    case OP_fload:
+    case OP_aload:
+    case OP_lload:
+    case OP_dload:
+      // Um phi ainda sem tipo não empilharia a segunda metade
+      stack.push_back(read(index, current));
+      if (C2 == 2 && (base == OP_lload || base == OP_dload))
+        stack.push_back(graph.undef);
+      return true;
+    case OP_istore:
+    case OP_fstore:
+    case OP_astore:
+      write(index, pop());
+      return true;
+    case OP_lstore:
+    case OP_dstore:
+      if (C2 == 2)
+        stack.pop_back();
+      write(index, pop());
+      if (index + 1 < max_locals)
+        write(index + 1, graph.undef);
+      return true;
+    case OP_iinc:
+      write(index, emit(IrOp::Add, IrType::Int,
+                        {read(index, current),
+                         constant(IrType::Int, increment)}));
+      return true;
+    default:
+      return false;
+    }
+  }
+  case OP_iload_0:
+  case OP_iload_1:
+  case OP_iload_2:
+  case OP_iload_3:
+  case OP_fload_0:
+  case OP_fload_1:
+  case OP_fload_2:
+  case OP_fload_3:
+  case OP_aload_0:
+  case OP_aload_1:
+  case OP_aload_2:
+  case OP_aload_3:
+    stack.push_back(read((op - OP_iload_0) % 4, current));
+    return true;
+  case OP_lload_0:
+  case OP_lload_1:
+  case OP_lload_2:
+  case OP_lload_3:
+  case OP_dload_0:
+  case OP_dload_1:
+  case OP_dload_2:
+  case OP_dload_3:
+    stack.push_back(read((op - OP_iload_0) % 4, current));
+    if (C2 == 2)
+      stack.push_back(graph.undef);
+    return true;
+  case OP_istore_0:
+  case OP_istore_1:
+  case OP_istore_2:
+  case OP_istore_3:
+  case OP_fstore_0:
+  case OP_fstore_1:
+  case OP_fstore_2:
+  case OP_fstore_3:
+  case OP_astore_0:
+  case OP_astore_1:
+  case OP_astore_2:
+  case OP_astore_3:
+    write((op - OP_istore_0) % 4, pop());
+    return true;
+  case OP_lstore_0:
+  case OP_lstore_1:
+  case OP_lstore_2:
+  case OP_lstore_3:
+  case OP_dstore_0:
+  case OP_dstore_1:
+  case OP_dstore_2:
+  case OP_dstore_3: {
+    u4 index = (op - OP_istore_0) % 4;
+    if (C2 == 2)
+      stack.pop_back();
+    write(index, pop());
+    if (index + 1 < max_locals)
+      write(index + 1, graph.undef);
+    return true;
+  }
+
+  // Arrays
+  case OP_iaload:
+  case OP_laload:
+  case OP_faload:
+  case OP_daload:
+  case OP_aaload:
+  case OP_baload:
+  case OP_caload:
+  case OP_saload: {
+    static const char KINDS[] = {'I', 'J', 'F', 'D', 'L', 'B', 'C', 'S'};
+    static const IrType TYPES[] = {IrType::Int,    IrType::Long,
+                                   IrType::Float,  IrType::Double,
+                                   IrType::Ref,    IrType::Int,
+                                   IrType::Int,    IrType::Int};
+    FrameState *st = state(pc);
+    IrInstr *index = pop();
+    IrInstr *array = pop();
+    check_element(array, index, st);
+    IrInstr *value = emit(IrOp::LoadElement, TYPES[op - OP_iaload],
+                          {array, index});
+    value->kind = KINDS[op - OP_iaload];
+    push(value);
+    return true;
+  }
+  case OP_iastore:
+  case OP_lastore:
+  case OP_fastore:
+  case OP_dastore:
+  case OP_castore:
+  case OP_sastore: {
+    static const char KINDS[] = {'I', 'J', 'F', 'D', 0, 0, 'C', 'S'};
+    static const IrType TYPES[] = {IrType::Int,   IrType::Long,
+                                   IrType::Float, IrType::Double,
+                                   IrType::Void,  IrType::Void,
+                                   IrType::Int,   IrType::Int};
+    FrameState *st = state(pc);
+    IrInstr *value = pop(TYPES[op - OP_iastore]);
+    IrInstr *index = pop();
+    IrInstr *array = pop();
+    check_element(array, index, st);
+    emit(IrOp::StoreElement, IrType::Void, {array, index, value})->kind =
+        KINDS[op - OP_iastore];
+    return true;
+  }
+  case OP_aastore:
+  case OP_bastore:
+    // Checagem de tipo do elemento e barreiras (aastore); byte ou boolean
+    // conforme a classe do array (bastore)
+    return step(pc, state(pc), {});
+  case OP_arraylength: {
+    FrameState *st = state(pc);
+    IrInstr *array = pop();
+    null_check(array, st);
+    push(emit(IrOp::ArrayLength, IrType::Int, {array}));
+    return true;
+  }
+
+  // Pilha: as mesmas formas do interpretador, pela categoria de cada slot
+  case OP_pop:
+    stack.pop_back();
+    return true;
+  case OP_pop2: {
+    const ReferenceMap::Entry &entry = *map.at(pc);
+    bool wide = C2 == 1 && map.stack_is_category2(
+                               entry, static_cast<u2>(stack.size() - 1));
+    stack.resize(stack.size() - (wide ? 1 : 2));
+    return true;
+  }
+  case OP_dup:
+  case OP_dup_x1:
+  case OP_dup_x2:
+  case OP_dup2:
+  case OP_dup2_x1:
+  case OP_dup2_x2: {
+    const ReferenceMap::Entry &entry = *map.at(pc);
+    int d = static_cast<int>(stack.size());
+    auto wide = [&](int from_top) {
+      return C2 == 1 &&
+             map.stack_is_category2(entry, static_cast<u2>(d - from_top));
+    };
+    int a = 1, crossed = 0;
+    if (op == OP_dup_x1 || op == OP_dup2_x1)
+      crossed = 1;
+    if (op == OP_dup2 || op == OP_dup2_x1 || op == OP_dup2_x2)
+      a = wide(1) ? 1 : 2;
+    if (op == OP_dup_x2 || op == OP_dup2_x2)
+      crossed = wide(a + 1) ? 1 : 2;
+    int n = a + crossed;
+    if (n > d)
+      return false;
+    std::vector<IrInstr *> moved(stack.end() - n, stack.end());
+    stack.resize(static_cast<size_t>(d - n));
+    for (int i = crossed; i < n; i++)
+      stack.push_back(moved[static_cast<size_t>(i)]);
+    for (IrInstr *value : moved)
+      stack.push_back(value);
+    return true;
+  }
+  case OP_swap:
+    std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+    return true;
+
+  // Desvios
+  case OP_goto:
+  case OP_goto_w:
+    terminate(IrOp::Goto, {});
+    return true;
+  case OP_tableswitch:
+  case OP_lookupswitch: {
+    IrInstr *key = pop();
+    const SwitchChain &chain = chains[current->id];
+    IrBlock *block = current;
+    for (size_t i = 0; i < chain.keys.size(); i++) {
+      if (i > 0)
+        current = chain.blocks[i - 1];
+      emit(IrOp::If, IrType::Void,
+           {key, constant(IrType::Int, chain.keys[i])})
+          ->cond = IrCond::EQ;
+    }
+    current = block;
+    if (chain.keys.empty())
+      terminate(IrOp::Goto, {});
+    return true;
+  }
+
+  // Retorno
+  case OP_ireturn:
+  case OP_lreturn:
+  case OP_freturn:
+  case OP_dreturn:
+  case OP_areturn:
+    terminate(IrOp::Return, {pop(op == OP_areturn ? IrType::Ref
+                                                  : NUMERIC[op - OP_ireturn])});
+    return true;
+  case OP_return:
+    terminate(IrOp::Return, {});
+    return true;
+
+  // Fields já resolvidos; referências gravadas passam pelas barreiras do
+  // interpretador
+  case OP_getfield:
+  case OP_putfield:
+  case OP_getstatic:
+  case OP_putstatic: {
+    u2 index = read_code_u2(code, pc + 1);
+    const ConstantPoolCacheEntry &entry = klass->cp_cache[index];
+    RuntimeField *field = entry.field;
+    bool is_static = op == OP_getstatic || op == OP_putstatic;
+    bool is_put = op == OP_putfield || op == OP_putstatic;
+    FrameState *st = state(pc);
+    if (!field || field->is_static != is_static ||
+        (is_static && !entry.static_address) ||
+        (is_put && field->is_reference())) {
+      std::string descriptor = member_descriptor(cf, index);
+      if (descriptor.empty())
+        return false;
+      if (is_put)
+        return step(pc, st, {});
+      return step(pc, st, {type_of(descriptor[0])});
+    }
+
+    char kind = field->descriptor[0] == '[' ? 'L' : field->descriptor[0];
+    IrType type = type_of(kind);
+    if (is_static) {
+      IrInstr *instr;
+      if (is_put) {
+        instr = emit(IrOp::StoreStatic, IrType::Void, {pop(type)});
+      } else {
+        instr = emit(IrOp::LoadStatic, type, {});
+        push(instr);
+      }
+      instr->kind = kind;
+      instr->imm = static_cast<int64_t>(
+          reinterpret_cast<uintptr_t>(entry.static_address));
+      return true;
+    }
+    IrInstr *value = is_put ? pop(type) : nullptr;
+    IrInstr *object = pop();
+    null_check(object, st);
+    IrInstr *instr;
+    if (is_put) {
+      instr = emit(IrOp::StoreField, IrType::Void, {object, value});
+    } else {
+      instr = emit(IrOp::LoadField, type, {object});
+      push(instr);
+    }
+    instr->kind = kind;
+    instr->imm = field->offset;
+    return true;
+  }
+
+  // Chamadas
+  case OP_invokevirtual:
+  case OP_invokespecial:
+  case OP_invokestatic:
+  case OP_invokeinterface:
+  case OP_invokedynamic: {
+    std::string descriptor =
+        member_descriptor(cf, read_code_u2(code, pc + 1));
+    size_t close = descriptor.find(')');
+    if (close == std::string::npos || close + 1 >= descriptor.size())
+      return false;
+    IrType type = type_of(descriptor[close + 1]);
+    FrameState *st = state(pc);
+    if (type == IrType::Void)
+      return step(pc, st, {});
+    return step(pc, st, {type});
+  }
+
+  // Objetos
+  case OP_new:
+  case OP_newarray:
+  case OP_anewarray:
+  case OP_multianewarray:
+    return step(pc, state(pc), {IrType::Ref}, true);
+  case OP_checkcast:
+  case OP_instanceof: {
+    // Com um único receptor no perfil, a checagem vira a comparação da
+    // classe; outra classe, ou null, desotimiza
+    FrameState *st = state(pc);
+    RuntimeClass *target =
+        klass->cp_cache[read_code_u2(code, pc + 1)].klass;
+    RuntimeClass *seen = target ? speculated_class(pc) : nullptr;
+    bool assignable = seen && seen->is_assignable_to(target);
+    if (!seen || (op == OP_checkcast && !assignable))
+      return step(pc, st, {op == OP_checkcast ? IrType::Ref : IrType::Int});
+    IrInstr *object = op == OP_checkcast ? stack.back() : pop();
+    null_check(object, st);
+    guard(IrCond::EQ, emit(IrOp::LoadKlass, IrType::Word, {object}),
+          constant(IrType::Word,
+                   static_cast<int64_t>(reinterpret_cast<uintptr_t>(seen))),
+          st);
+    if (op == OP_instanceof)
+      push(constant(IrType::Int, assignable ? 1 : 0));
+    return true;
+  }
+  case OP_athrow: {
+    // O interpretador lança; um handler do método continua no interpretador
+    IrInstr *instr = emit(IrOp::Step, IrType::Void, {});
+    instr->state = state(pc);
+    terminate(IrOp::Unwind, {});
+    return true;
+  }
+  case OP_monitorenter:
+  case OP_monitorexit: {
+    // Uma thread só: basta a checagem de null
+    FrameState *st = state(pc);
+    null_check(pop(), st);
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+void Builder::infer_phi_types() {
+  std::vector<IrInstr *> phis;
+  for (IrBlock *block : graph.order)
+    for (IrInstr *phi : block->phis)
+      phis.push_back(phi);
+
+  // Void < um tipo < Top, subindo até estabilizar
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (IrInstr *phi : phis) {
+      IrType type = IrType::Void;
+      for (IrInstr *arg : phi->args) {
+        IrType t = IrGraph::resolve(arg)->type;
+        if (arg == phi || t == IrType::Void)
+          continue;
+        if (type == IrType::Void)
+          type = t;
+        else if (type != t)
+          type = IrType::Top;
+      }
+      if (type != phi->type) {
+        phi->type = type;
+        changed = true;
+      }
+    }
+  }
+  for (IrInstr *phi : phis)
+    if (phi->type == IrType::Void)
+      phi->type = IrType::Top;
+}
+
+// O verificador garante tipos consistentes; o que a construção não conseguiu
+// tipar (locais vivas com Top, pilha com valores de tipos diferentes) fica
+// com o código de templates
+bool Builder::validate() {
+  auto valid_state = [&](const FrameState *state) {
+    if (!state)
+      return true;
+    for (const IrInstr *value : state->locals)
+      if (value->op == IrOp::Phi && value->type == IrType::Top)
+        return false;
+    for (size_t s = 0; s < state->stack.size(); s++) {
+      const IrInstr *value = state->stack[s];
+      if (value->type != IrType::Top)
+        continue;
+      if (value->op != IrOp::Undef || C2 != 2 || s == 0 ||
+          !is_category2(state->stack[s - 1]->type))
+        return false;
+    }
+    return true;
+  };
+
+  for (IrBlock *block : graph.order) {
+    if (!valid_state(block->entry_state))
+      return false;
+    for (IrInstr *instr : block->code) {
+      if (!valid_state(instr->state))
+        return false;
+      for (IrInstr *arg : instr->args)
+        if (arg->type == IrType::Top || arg->type == IrType::Void)
+          return false;
+      const std::vector<IrInstr *> &args = instr->args;
+      switch (instr->op) {
+      case IrOp::Add:
+      case IrOp::Sub:
+      case IrOp::Mul:
+      case IrOp::Div:
+      case IrOp::Rem:
+      case IrOp::And:
+      case IrOp::Or:
+      case IrOp::Xor:
+        if (args[0]->type != instr->type || args[1]->type != instr->type)
+          return false;
+        break;
+      case IrOp::Neg:
+        if (args[0]->type != instr->type)
+          return false;
+        break;
+      case IrOp::Shl:
+      case IrOp::Shr:
+      case IrOp::Ushr:
+        if (args[0]->type != instr->type || args[1]->type != IrType::Int)
+          return false;
+        break;
+      case IrOp::Compare:
+      case IrOp::If:
+      case IrOp::Guard:
+        if (args[0]->type != args[1]->type)
+          return false;
+        break;
+      case IrOp::ArrayLength:
+      case IrOp::LoadKlass:
+      case IrOp::LoadField:
+      case IrOp::StoreField:
+        if (args[0]->type != IrType::Ref)
+          return false;
+        break;
+      case IrOp::LoadElement:
+      case IrOp::StoreElement:
+        if (args[0]->type != IrType::Ref || args[1]->type != IrType::Int)
+          return false;
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+std::unique_ptr<IrGraph> build_ir(Runtime *runtime, RuntimeMethod *method) {
+  std::unique_ptr<IrGraph> graph(new IrGraph(runtime, method));
+  Builder builder(*graph);
+  if (!builder.build())
+    return nullptr;
+  return graph;
+}
@@ -0,0 +1,1237 @@
+#include "../classfile/bytecode.h"
+#include "./jit.h"
+#include "./ssa.h"
+#include "./x86_assembler.h"
+
+#include <algorithm>
+#include <cstddef>
+
+// Geração de código da IR: ordem linear pela pós-ordem reversa, vivacidade
+// por fluxo de dados e um intervalo contínuo por valor (do primeiro ao
+// último ponto em que ele está vivo), alocado por linear scan. Cada valor
+// fica num só lugar, registrador ou slot de spill, durante toda a vida; é
+// isso que deixa os stubs de desotimização lerem o estado direto de onde os
+// valores estão.
+
+namespace {
+
+#ifdef JVM_JIT_SUPPORTED
+
+const u1 SLOT = sizeof(Slot);
+const int C2 = CATEGORY2_STACK_SLOTS;
+const int32_t OBJECT_DATA = sizeof(RuntimeObject);
+const Reg NARROW_BASE = R15;
+
+// Frame nativo, a partir de rsp: os quatro argumentos da entrada, a área
+// onde os registradores voláteis vivos são guardados em volta das chamadas
+// ao interpretador e os slots de spill
+const int32_t THREAD_OFFSET = 0;
+const int32_t FRAME_OFFSET = 8;
+const int32_t LOCALS_OFFSET = 16;
+const int32_t STACK_OFFSET = 24;
+const int32_t GPR_SAVE = 32;
+const int32_t XMM_SAVE = GPR_SAVE + 16 * 8;
+const int32_t SPILL_AREA = XMM_SAVE + 16 * 8;
+
+// Os preservados pela convenção de chamada vêm primeiro: valores neles não
+// precisam ser guardados em volta dos Steps. RAX, RCX, RDX e R11 (e XMM0 e
+// XMM1) ficam livres para o código de cada instrução; R15 é a base das
+// referências comprimidas.
+const Reg GPRS[] = {RBX, R12, R13, R14, RBP, RSI, RDI, R8, R9, R10};
+const Xmm XMMS[] = {XMM2,  XMM3,  XMM4,  XMM5,  XMM6,  XMM7,  XMM8,
+                    XMM9,  XMM10, XMM11, XMM12, XMM13, XMM14, XMM15};
+
+bool is_callee_saved(Reg reg) {
+  return reg == RBX || reg == RBP || reg == R12 || reg == R13 || reg == R14;
+}
+
+bool is_fp(IrType type) {
+  return type == IrType::Float || type == IrType::Double;
+}
+
+bool is_category2(IrType type) {
+  return type == IrType::Long || type == IrType::Double;
+}
+
+// Operações de 64 bits nos registradores de uso geral
+bool is_wide(IrType type) {
+  return type == IrType::Long || type == IrType::Word;
+}
+
+SsePrefix prefix_of(IrType type) {
+  return type == IrType::Double ? SSE_SD : SSE_SS;
+}
+
+Cond cond_of(IrCond cond) {
+  switch (cond) {
+  case IrCond::EQ:
+    return CC_E;
+  case IrCond::NE:
+    return CC_NE;
+  case IrCond::LT:
+    return CC_L;
+  case IrCond::GE:
+    return CC_GE;
+  case IrCond::GT:
+    return CC_G;
+  case IrCond::LE:
+    return CC_LE;
+  case IrCond::ULT:
+    return CC_B;
+  default:
+    return CC_AE;
+  }
+}
+
+u1 size_of(char kind) {
+  switch (kind) {
+  case 'B':
+  case 'Z':
+    return 1;
+  case 'C':
+  case 'S':
+    return 2;
+  case 'J':
+  case 'D':
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+struct Location {
+  enum Kind : u1 { None, Gpr, Fpr, Spill };
+  Kind kind;
+  u1 reg;
+  u4 slot;
+
+  bool operator==(const Location &other) const {
+    return kind == other.kind &&
+           (kind == Spill ? slot == other.slot : reg == other.reg);
+  }
+};
+
+class CodeGenerator {
+public:
+  explicit CodeGenerator(IrGraph &graph)
+      : graph(graph), map(graph.method->reference_map()) {}
+
+  bool generate(std::vector<u1> &out);
+
+private:
+  struct Deopt {
+    Assembler::Label entry;
+    const FrameState *state;
+  };
+
+  // Alocação
+  bool is_allocated(const IrInstr *value) const {
+    return value->op != IrOp::Const && value->op != IrOp::Undef &&
+           value->op != IrOp::Virtual && value->type != IrType::Void &&
+           value->type != IrType::Top;
+  }
+  void number();
+  void compute_liveness();
+  bool allocate();
+  template <typename F> void for_each_use(const IrInstr *instr, F f) const;
+
+  // Acesso aos valores
+  Mem spill(u4 slot) const {
+    return mem(RSP, SPILL_AREA + static_cast<int32_t>(slot) * 8);
+  }
+  const Location &loc(const IrInstr *value) const { return locs[value->id]; }
+  void load_gpr(Reg dst, const IrInstr *value);
+  Reg gpr(const IrInstr *value, Reg scratch);
+  void load_xmm(Xmm dst, const IrInstr *value);
+  Xmm xmm(const IrInstr *value, Xmm scratch);
+  Reg result_gpr(const IrInstr *value) const;
+  Xmm result_xmm(const IrInstr *value) const;
+  void finish(const IrInstr *value, Reg src);
+  void finish(const IrInstr *value, Xmm src);
+  void decode(Reg reg);
+  bool fits_imm(const IrInstr *value) const;
+
+  // Frame do interpretador
+  void read_slot(const IrInstr *value, Reg base, u4 index);
+  void write_slot(Reg base, u4 index, const IrInstr *value);
+  void materialize(const FrameState *state, bool deoptimize);
+  void emit_deopt(const FrameState *state);
+
+  // Instruções
+  bool emit(IrBlock *block, IrInstr *instr);
+  void emit_arithmetic(IrInstr *instr);
+  void emit_division(IrInstr *instr);
+  void emit_convert(IrInstr *instr);
+  void emit_compare(IrInstr *instr);
+  void compare(const IrInstr *a, const IrInstr *b);
+  Mem element(const IrInstr *array, const IrInstr *index, char kind);
+  void emit_step(IrInstr *instr);
+  void emit_phi_moves(IrBlock *from, IrBlock *to);
+  void move(const Location &dst, const Location &src);
+  void prologue();
+  void epilogue_code();
+
+  IrGraph &graph;
+  const ReferenceMap &map;
+  Assembler as;
+
+  std::vector<IrBlock *> order;
+  std::vector<u4> block_start, block_end; // por id de bloco
+  std::vector<u4> position;               // por id de instrução
+  std::vector<std::vector<bool>> live_in, live_out;
+  std::vector<u4> start, end; // intervalo de cada valor
+  std::vector<Location> locs;
+  u4 spill_slots = 0;
+  u4 scalar_slots = 0; // fields dos objetos alocados na desotimização
+  int32_t frame_size = 0;
+
+  std::vector<Assembler::Label> labels; // por id de bloco
+  std::vector<Deopt> deopts;
+  Assembler::Label pending = 0;
+  Assembler::Label epilogue = 0;
+};
+
+template <typename F>
+void CodeGenerator::for_each_use(const IrInstr *instr, F f) const {
+  for (const IrInstr *arg : instr->args)
+    if (is_allocated(arg))
+      f(arg);
+  if (instr->state) {
+    for (const IrInstr *value : instr->state->locals)
+      if (is_allocated(value))
+        f(value);
+    for (const IrInstr *value : instr->state->stack)
+      if (is_allocated(value))
+        f(value);
+    for (const ScalarObject &object : instr->state->objects)
+      for (const ScalarField &field : object.fields)
+        if (is_allocated(field.value))
+          f(field.value);
+  }
+}
+
+// Posições pares: phis no início do bloco, depois uma por instrução
+void CodeGenerator::number() {
+  order = graph.order;
+  block_start.assign(graph.block_count(), 0);
+  block_end.assign(graph.block_count(), 0);
+  position.assign(graph.instr_count(), 0);
+  u4 pos = 0;
+  for (IrBlock *block : order) {
+    block_start[block->id] = pos;
+    for (IrInstr *phi : block->phis)
+      position[phi->id] = pos;
+    for (IrInstr *instr : block->code) {
+      pos += 2;
+      position[instr->id] = pos;
+    }
+    block_end[block->id] = pos;
+    pos += 2;
+  }
+}
+
+void CodeGenerator::compute_liveness() {
+  size_t values = graph.instr_count();
+  live_in.assign(graph.block_count(), std::vector<bool>(values, false));
+  live_out.assign(graph.block_count(), std::vector<bool>(values, false));
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      IrBlock *block = *it;
+      std::vector<bool> live(values, false);
+      for (IrBlock *succ : block->succs) {
+        const std::vector<bool> &in = live_in[succ->id];
+        for (size_t i = 0; i < values; i++)
+          if (in[i])
+            live[i] = true;
+        for (IrInstr *phi : succ->phis) {
+          live[phi->id] = false;
+          for (size_t p = 0; p < succ->preds.size(); p++)
+            if (succ->preds[p] == block && is_allocated(phi->args[p]))
+              live[phi->args[p]->id] = true;
+        }
+      }
+      live_out[block->id] = live;
+      for (auto instr = block->code.rbegin(); instr != block->code.rend();
+           ++instr) {
+        live[(*instr)->id] = false;
+        for_each_use(*instr, [&](const IrInstr *use) { live[use->id] = true; });
+      }
+      for (IrInstr *phi : block->phis)
+        live[phi->id] = false;
+      if (live != live_in[block->id]) {
+        live_in[block->id] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+}
+
+bool CodeGenerator::allocate() {
+  size_t values = graph.instr_count();
+  start.assign(values, UINT32_MAX);
+  end.assign(values, 0);
+  auto extend = [&](const IrInstr *value, u4 pos) {
+    start[value->id] = std::min(start[value->id], pos);
+    end[value->id] = std::max(end[value->id], pos);
+  };
+
+  std::vector<IrInstr *> defined;
+  for (IrBlock *block : order) {
+    for (size_t i = 0; i < values; i++) {
+      if (live_in[block->id][i])
+        start[i] = std::min(start[i], block_start[block->id]);
+      if (live_out[block->id][i])
+        end[i] = std::max(end[i], block_end[block->id]);
+    }
+    for (IrInstr *phi : block->phis) {
+      if (!is_allocated(phi))
+        continue;
+      extend(phi, block_start[block->id]);
+      defined.push_back(phi);
+      for (size_t p = 0; p < block->preds.size(); p++)
+        if (is_allocated(phi->args[p]))
+          extend(phi->args[p], block_end[block->preds[p]->id]);
+    }
+    for (IrInstr *instr : block->code) {
+      u4 pos = position[instr->id];
+      if (is_allocated(instr)) {
+        extend(instr, pos);
+        defined.push_back(instr);
+      }
+      for_each_use(instr, [&](const IrInstr *use) { extend(use, pos); });
+    }
+  }
+
+  // Linear scan: um intervalo só libera o registrador depois da última
+  // posição, então o resultado de uma instrução nunca divide registrador
+  // com os operandos dela
+  std::sort(defined.begin(), defined.end(),
+            [&](const IrInstr *a, const IrInstr *b) {
+              return start[a->id] < start[b->id];
+            });
+  locs.assign(values, Location{Location::None, 0, 0});
+  std::vector<IrInstr *> active;
+  bool gpr_free[16], xmm_free[16];
+  std::fill(std::begin(gpr_free), std::end(gpr_free), false);
+  std::fill(std::begin(xmm_free), std::end(xmm_free), false);
+  for (Reg reg : GPRS)
+    gpr_free[reg] = true;
+  for (Xmm reg : XMMS)
+    xmm_free[reg] = true;
+  auto release = [&](const IrInstr *value) {
+    const Location &l = locs[value->id];
+    if (l.kind == Location::Gpr)
+      gpr_free[l.reg] = true;
+    else if (l.kind == Location::Fpr)
+      xmm_free[l.reg] = true;
+  };
+
+  for (IrInstr *value : defined) {
+    u4 at = start[value->id];
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](const IrInstr *other) {
+                                  if (end[other->id] >= at)
+                                    return false;
+                                  release(other);
+                                  return true;
+                                }),
+                 active.end());
+
+    bool fp = is_fp(value->type);
+    Location &l = locs[value->id];
+    if (fp) {
+      for (Xmm reg : XMMS)
+        if (xmm_free[reg]) {
+          l = Location{Location::Fpr, reg, 0};
+          xmm_free[reg] = false;
+          break;
+        }
+    } else {
+      for (Reg reg : GPRS)
+        if (gpr_free[reg]) {
+          l = Location{Location::Gpr, reg, 0};
+          gpr_free[reg] = false;
+          break;
+        }
+    }
+    if (l.kind != Location::None) {
+      active.push_back(value);
+      continue;
+    }
+
+    // Sem registrador: vai para a memória o que vive mais
+    IrInstr *victim = nullptr;
+    for (IrInstr *other : active)
+      if (is_fp(other->type) == fp &&
+          (!victim || end[other->id] > end[victim->id]))
+        victim = other;
+    if (victim && end[victim->id] > end[value->id]) {
+      l = locs[victim->id];
+      locs[victim->id] = Location{Location::Spill, 0, spill_slots++};
+      std::replace(active.begin(), active.end(), victim, value);
+    } else {
+      l = Location{Location::Spill, 0, spill_slots++};
+    }
+  }
+
+  // Referências não podem atravessar um Step em registrador: o GC pode
+  // mover o objeto. O construtor relê do frame todas as que continuam
+  // vivas, então isso só acontece se algo deu errado antes. Os intervalos
+  // são envoltórios, então a checagem usa a vivacidade exata.
+  for (IrBlock *block : order) {
+    std::vector<bool> live = live_out[block->id];
+    for (auto instr = block->code.rbegin(); instr != block->code.rend();
+         ++instr) {
+      live[(*instr)->id] = false;
+      if ((*instr)->op == IrOp::Step)
+        for (IrInstr *value : defined)
+          if (value->type == IrType::Ref && live[value->id])
+            return false;
+      for_each_use(*instr, [&](const IrInstr *use) { live[use->id] = true; });
+    }
+  }
+
+  for (IrBlock *block : order)
+    for (IrInstr *instr : block->code) {
+      if (instr->op != IrOp::Guard)
+        continue;
+      u4 fields = 0;
+      for (const ScalarObject &object : instr->state->objects)
+        fields += static_cast<u4>(object.fields.size());
+      scalar_slots = std::max(scalar_slots, fields);
+    }
+
+  // Alinhado a 16 depois do endereço de retorno e dos seis push
+  frame_size = SPILL_AREA +
+               static_cast<int32_t>(spill_slots + scalar_slots) * 8;
+  if (frame_size % 16 != 8)
+    frame_size += 8;
+  return true;
+}
+
+void CodeGenerator::load_gpr(Reg dst, const IrInstr *value) {
+  if (value->is_const()) {
+    if (is_category2(value->type) || value->type == IrType::Word)
+      as.mov_imm64(dst, static_cast<u8>(value->imm));
+    else
+      as.mov_imm32(dst, static_cast<u4>(value->imm));
+    return;
+  }
+  const Location &l = loc(value);
+  switch (l.kind) {
+  case Location::Gpr:
+    if (l.reg != dst)
+      as.mov(dst, static_cast<Reg>(l.reg), true);
+    break;
+  case Location::Fpr:
+    as.movd_from_xmm(dst, static_cast<Xmm>(l.reg),
+                     value->type == IrType::Double);
+    break;
+  case Location::Spill:
+    // Valores de 32 bits saem zerados em cima
+    as.load(dst, spill(l.slot),
+            is_category2(value->type) || value->type == IrType::Word ? 8 : 4);
+    break;
+  default:
+    break;
+  }
+}
+
+Reg CodeGenerator::gpr(const IrInstr *value, Reg scratch) {
+  if (!value->is_const() && loc(value).kind == Location::Gpr)
+    return static_cast<Reg>(loc(value).reg);
+  load_gpr(scratch, value);
+  return scratch;
+}
+
+void CodeGenerator::load_xmm(Xmm dst, const IrInstr *value) {
+  bool is_double = value->type == IrType::Double;
+  if (value->is_const()) {
+    as.mov_imm64(RAX, static_cast<u8>(value->imm));
+    as.movd_to_xmm(dst, RAX, is_double);
+    return;
+  }
+  const Location &l = loc(value);
+  if (l.kind == Location::Fpr) {
+    if (l.reg != dst)
+      as.mov_xmm(dst, static_cast<Xmm>(l.reg));
+  } else if (l.kind == Location::Spill) {
+    as.movs_load(prefix_of(value->type), dst, spill(l.slot));
+  }
+}
+
+Xmm CodeGenerator::xmm(const IrInstr *value, Xmm scratch) {
+  if (!value->is_const() && loc(value).kind == Location::Fpr)
+    return static_cast<Xmm>(loc(value).reg);
+  load_xmm(scratch, value);
+  return scratch;
+}
+
+Reg CodeGenerator::result_gpr(const IrInstr *value) const {
+  return loc(value).kind == Location::Gpr ? static_cast<Reg>(loc(value).reg)
+                                          : R11;
+}
+
+Xmm CodeGenerator::result_xmm(const IrInstr *value) const {
+  return loc(value).kind == Location::Fpr ? static_cast<Xmm>(loc(value).reg)
+                                          : XMM0;
+}
+
+void CodeGenerator::finish(const IrInstr *value, Reg src) {
+  const Location &l = loc(value);
+  if (l.kind == Location::Gpr && l.reg != src)
+    as.mov(static_cast<Reg>(l.reg), src, true);
+  else if (l.kind == Location::Spill)
+    as.store(spill(l.slot), src, 8);
+}
+
+void CodeGenerator::finish(const IrInstr *value, Xmm src) {
+  const Location &l = loc(value);
+  if (l.kind == Location::Fpr && l.reg != src)
+    as.mov_xmm(static_cast<Xmm>(l.reg), src);
+  else if (l.kind == Location::Spill)
+    as.movs_store(prefix_of(value->type), spill(l.slot), src);
+}
+
+void CodeGenerator::decode(Reg reg) {
+  if (Heap::narrow_shift)
+    as.shift_imm(SHIFT_SHL, reg, static_cast<u1>(Heap::narrow_shift), true);
+  as.alu(ALU_ADD, reg, NARROW_BASE, true);
+}
+
+bool CodeGenerator::fits_imm(const IrInstr *value) const {
+  return value->is_const() &&
+         (!is_wide(value->type) ||
+          (value->imm >= INT32_MIN && value->imm <= INT32_MAX));
+}
+
+// Slot `index` a partir de `base` (locais ou pilha); sem slots largos,
+// long e double têm a parte alta no primeiro slot
+void CodeGenerator::read_slot(const IrInstr *value, Reg base, u4 index) {
+  Mem at = mem(base, static_cast<int32_t>(index * SLOT));
+  Mem low = mem(base, static_cast<int32_t>((index + 1) * SLOT));
+  switch (value->type) {
+  case IrType::Float: {
+    Xmm dst = result_xmm(value);
+    as.movs_load(SSE_SS, dst, at);
+    finish(value, dst);
+    return;
+  }
+  case IrType::Long:
+  case IrType::Double: {
+    Reg dst = value->type == IrType::Long ? result_gpr(value) : RAX;
+    if (SLOT == 8) {
+      as.load(dst, at, 8);
+    } else {
+      as.load(dst, low, 4);
+      as.load(RCX, at, 4);
+      as.shift_imm(SHIFT_SHL, RCX, 32, true);
+      as.alu(ALU_OR, dst, RCX, true);
+    }
+    if (value->type == IrType::Long) {
+      finish(value, dst);
+    } else {
+      Xmm x = result_xmm(value);
+      as.movd_to_xmm(x, RAX, true);
+      finish(value, x);
+    }
+    return;
+  }
+  default: {
+    Reg dst = result_gpr(value);
+    as.load(dst, at, 4);
+    finish(value, dst);
+  }
+  }
+}
+
+void CodeGenerator::write_slot(Reg base, u4 index, const IrInstr *value) {
+  Mem at = mem(base, static_cast<int32_t>(index * SLOT));
+  load_gpr(RAX, value);
+  if (!is_category2(value->type) || SLOT == 8) {
+    as.store(at, RAX, SLOT);
+    return;
+  }
+  as.store(mem(base, static_cast<int32_t>((index + 1) * SLOT)), RAX, 4);
+  as.mov(RCX, RAX, true);
+  as.shift_imm(SHIFT_SHR, RCX, 32, true);
+  as.store(at, RCX, 4);
+}
+
+// Escreve no frame o estado antes da instrução em state->pc. Antes de um
+// Step basta o que o GC e a própria instrução leem: as locais com
+// referências e a pilha. Numa desotimização o interpretador continua dali,
+// então vão também as outras locais vivas.
+void CodeGenerator::materialize(const FrameState *state, bool deoptimize) {
+  const ReferenceMap::Entry &entry = *map.at(state->pc);
+  as.load(R11, mem(RSP, LOCALS_OFFSET), 8);
+  for (u4 i = 0; i < state->locals.size(); i++) {
+    const IrInstr *value = state->locals[i];
+    bool ref = map.local_is_ref(entry, static_cast<u2>(i));
+    if (value->op == IrOp::Undef || value->op == IrOp::Virtual) {
+      // Local morta: null para o GC não seguir um valor velho. Objetos
+      // virtuais ficam null até emit_deopt alocá-los.
+      if (ref) {
+        as.alu(ALU_XOR, RAX, RAX, false);
+        as.store(mem(R11, static_cast<int32_t>(i * SLOT)), RAX, SLOT);
+      }
+      continue;
+    }
+    if (deoptimize || ref)
+      write_slot(R11, i, value);
+  }
+  as.load(R11, mem(RSP, STACK_OFFSET), 8);
+  for (u4 s = 0; s < state->stack.size(); s++) {
+    const IrInstr *value = state->stack[s];
+    if (value->op == IrOp::Virtual) {
+      as.alu(ALU_XOR, RAX, RAX, false);
+      as.store(mem(R11, static_cast<int32_t>(s * SLOT)), RAX, SLOT);
+    } else if (value->op != IrOp::Undef) {
+      write_slot(R11, s, value);
+    }
+  }
+}
+
+// Stub de desotimização: o frame recebe o estado do guard e o interpretador
+// continua do pc dele. Os objetos que o código otimizado manteve em valores
+// soltos são alocados depois de o frame apontar para o pc, para o GC usar o
+// mapa de referências certo; os já postos no frame ele atualiza. Os fields
+// esperam na área depois dos spills, porque as chamadas estragam os
+// voláteis.
+void CodeGenerator::emit_deopt(const FrameState *state) {
+  materialize(state, true);
+  int32_t buffer = SPILL_AREA + static_cast<int32_t>(spill_slots) * 8;
+  int32_t at = buffer;
+  for (const ScalarObject &object : state->objects)
+    for (const ScalarField &field : object.fields) {
+      load_gpr(RAX, field.value);
+      as.store(mem(RSP, at), RAX, 8);
+      at += 8;
+    }
+  as.load(RDI, mem(RSP, FRAME_OFFSET), 8);
+  as.mov_imm32(RSI, state->pc);
+  as.mov_imm64(RAX, reinterpret_cast<uintptr_t>(&jit_deoptimize));
+  as.call(RAX);
+
+  at = buffer;
+  for (const ScalarObject &object : state->objects) {
+    as.load(RDI, mem(RSP, THREAD_OFFSET), 8);
+    as.mov_imm64(RSI, reinterpret_cast<uintptr_t>(object.klass));
+    as.mov_imm64(RAX, reinterpret_cast<uintptr_t>(&jit_allocate));
+    as.call(RAX);
+    as.test(RAX, RAX, false);
+    as.jcc(CC_E, pending);
+    as.mov(RCX, RAX, false);
+    decode(RAX);
+    for (const ScalarField &field : object.fields) {
+      as.load(RDX, mem(RSP, at), 8);
+      as.store(mem(RAX, OBJECT_DATA + static_cast<int32_t>(field.offset)),
+               RDX, size_of(field.kind));
+      at += 8;
+    }
+    as.load(R11, mem(RSP, LOCALS_OFFSET), 8);
+    for (u4 i = 0; i < state->locals.size(); i++)
+      if (state->locals[i] == object.object)
+        as.store(mem(R11, static_cast<int32_t>(i * SLOT)), RCX, SLOT);
+    as.load(R11, mem(RSP, STACK_OFFSET), 8);
+    for (u4 s = 0; s < state->stack.size(); s++)
+      if (state->stack[s] == object.object)
+        as.store(mem(R11, static_cast<int32_t>(s * SLOT)), RCX, SLOT);
+  }
+  as.mov_imm32(RAX, CompiledMethod::DEOPTIMIZED |
+                        static_cast<u4>(state->stack.size()));
+  as.jmp(epilogue);
+}
+
+void CodeGenerator::compare(const IrInstr *a, const IrInstr *b) {
+  bool wide = is_wide(a->type);
+  Reg left = gpr(a, RAX);
+  if (fits_imm(b))
+    as.alu_imm(ALU_CMP, left, static_cast<int32_t>(b->imm), wide);
+  else
+    as.alu(ALU_CMP, left, gpr(b, RCX), wide);
+}
+
+Mem CodeGenerator::element(const IrInstr *array, const IrInstr *index,
+                           char kind) {
+  load_gpr(RAX, array);
+  decode(RAX);
+  load_gpr(RCX, index);
+  u1 size = size_of(kind);
+  return mem(RAX, RCX, size, OBJECT_DATA + (size == 8 ? 8 : 4));
+}
+
+void CodeGenerator::emit_arithmetic(IrInstr *instr) {
+  const IrInstr *a = instr->args[0];
+  const IrInstr *b = instr->args.size() > 1 ? instr->args[1] : nullptr;
+
+  if (is_fp(instr->type)) {
+    bool is_double = instr->type == IrType::Double;
+    if (instr->op == IrOp::Neg) {
+      // Troca o bit de sinal
+      load_gpr(RAX, a);
+      as.btc(RAX, is_double ? 63 : 31, is_double);
+      Xmm dst = result_xmm(instr);
+      as.movd_to_xmm(dst, RAX, is_double);
+      finish(instr, dst);
+      return;
+    }
+    static const SseOp OPS[] = {SSE_ADD, SSE_SUB, SSE_MUL, SSE_DIV};
+    Xmm dst = result_xmm(instr);
+    load_xmm(dst, a);
+    as.sse(prefix_of(instr->type),
+           OPS[static_cast<int>(instr->op) - static_cast<int>(IrOp::Add)], dst,
+           xmm(b, XMM1));
+    finish(instr, dst);
+    return;
+  }
+
+  bool wide = is_wide(instr->type);
+  Reg dst = result_gpr(instr);
+  switch (instr->op) {
+  case IrOp::Neg:
+    load_gpr(dst, a);
+    as.neg(dst, wide);
+    break;
+  case IrOp::Shl:
+  case IrOp::Shr:
+  case IrOp::Ushr: {
+    ShiftOp op = instr->op == IrOp::Shl   ? SHIFT_SHL
+                 : instr->op == IrOp::Shr ? SHIFT_SAR
+                                          : SHIFT_SHR;
+    // Como no Java, o x86 só usa os 5 (ou 6) bits baixos da contagem
+    if (b->is_const()) {
+      load_gpr(dst, a);
+      u1 count = static_cast<u1>(b->imm & (wide ? 63 : 31));
+      if (count)
+        as.shift_imm(op, dst, count, wide);
+      else if (!wide)
+        as.mov(dst, dst, false);
+    } else {
+      load_gpr(RCX, b);
+      load_gpr(dst, a);
+      as.shift_cl(op, dst, wide);
+    }
+    break;
+  }
+  case IrOp::Mul:
+    load_gpr(dst, a);
+    as.imul(dst, gpr(b, RCX), wide);
+    break;
+  default: {
+    AluOp op = instr->op == IrOp::Add   ? ALU_ADD
+               : instr->op == IrOp::Sub ? ALU_SUB
+               : instr->op == IrOp::And ? ALU_AND
+               : instr->op == IrOp::Or  ? ALU_OR
+                                        : ALU_XOR;
+    load_gpr(dst, a);
+    if (fits_imm(b))
+      as.alu_imm(op, dst, static_cast<int32_t>(b->imm), wide);
+    else
+      as.alu(op, dst, gpr(b, RCX), wide);
+  }
+  }
+  finish(instr, dst);
+}
+
+// O divisor já passou pelo guard de zero. MIN / -1 estoura no idiv, e no
+// Java dá MIN (resto 0).
+void CodeGenerator::emit_division(IrInstr *instr) {
+  bool wide = is_wide(instr->type);
+  const IrInstr *b = instr->args[1];
+  load_gpr(RAX, instr->args[0]);
+  load_gpr(RCX, b);
+  Assembler::Label done = as.new_label();
+  if (!b->is_const() || b->imm == -1) {
+    Assembler::Label normal = as.new_label();
+    as.alu_imm(ALU_CMP, RCX, -1, wide);
+    as.jcc(CC_NE, normal);
+    if (instr->op == IrOp::Div)
+      as.neg(RAX, wide);
+    else
+      as.alu(ALU_XOR, RDX, RDX, false);
+    as.jmp(done);
+    as.bind(normal);
+  }
+  as.sign_extend_rax(wide);
+  as.idiv(RCX, wide);
+  as.bind(done);
+  finish(instr, instr->op == IrOp::Div ? RAX : RDX);
+}
+
+void CodeGenerator::emit_convert(IrInstr *instr) {
+  const IrInstr *a = instr->args[0];
+  switch (instr->index) {
+  case OP_i2l: {
+    Reg dst = result_gpr(instr);
+    as.movsxd(dst, gpr(a, RAX));
+    finish(instr, dst);
+    return;
+  }
+  case OP_l2i: {
+    Reg dst = result_gpr(instr);
+    as.mov(dst, gpr(a, RAX), false);
+    finish(instr, dst);
+    return;
+  }
+  case OP_i2b:
+  case OP_i2c:
+  case OP_i2s: {
+    Reg dst = result_gpr(instr);
+    Reg src = gpr(a, RAX);
+    if (instr->index == OP_i2b)
+      as.movsx8(dst, src);
+    else if (instr->index == OP_i2c)
+      as.movzx16(dst, src);
+    else
+      as.movsx16(dst, src);
+    finish(instr, dst);
+    return;
+  }
+  case OP_i2f:
+  case OP_i2d:
+  case OP_l2f:
+  case OP_l2d: {
+    Xmm dst = result_xmm(instr);
+    // cvtsi2s só escreve a parte baixa; zerar antes corta a dependência
+    // com o valor anterior do registrador
+    as.alu(ALU_XOR, RCX, RCX, false);
+    as.movd_to_xmm(dst, RCX, false);
+    as.cvtsi2s(prefix_of(instr->type), dst, gpr(a, RAX),
+               a->type == IrType::Long);
+    finish(instr, dst);
+    return;
+  }
+  case OP_f2d:
+  case OP_d2f: {
+    Xmm dst = result_xmm(instr);
+    as.sse(prefix_of(a->type), SSE_CVT, dst, xmm(a, XMM1));
+    finish(instr, dst);
+    return;
+  }
+  default: {
+    // f2i, f2l, d2i e d2l: o cvtts2si dá o menor inteiro para NaN e para o
+    // que não cabe; o Java quer 0 para NaN e o maior inteiro para os
+    // positivos grandes
+    bool is_double = a->type == IrType::Double;
+    bool wide = instr->type == IrType::Long;
+    Xmm src = xmm(a, XMM1);
+    Reg dst = result_gpr(instr);
+    as.cvtts2si(prefix_of(a->type), dst, src, wide);
+    Assembler::Label done = as.new_label();
+    Assembler::Label nan = as.new_label();
+    as.alu_imm(ALU_CMP, dst, 1, wide);
+    as.jcc(CC_NO, done);
+    as.ucomis(is_double, src, src);
+    as.jcc(CC_P, nan);
+    as.alu(ALU_XOR, RAX, RAX, false);
+    as.movd_to_xmm(XMM0, RAX, is_double);
+    as.ucomis(is_double, src, XMM0);
+    as.jcc(CC_BE, done);
+    if (wide)
+      as.mov_imm64(dst, 0x7FFFFFFFFFFFFFFFull);
+    else
+      as.mov_imm32(dst, 0x7FFFFFFF);
+    as.jmp(done);
+    as.bind(nan);
+    as.alu(ALU_XOR, dst, dst, false);
+    as.bind(done);
+    finish(instr, dst);
+  }
+  }
+}
+
+// lcmp, fcmpl, fcmpg, dcmpl e dcmpg: -1, 0 ou 1
+void CodeGenerator::emit_compare(IrInstr *instr) {
+  const IrInstr *a = instr->args[0];
+  const IrInstr *b = instr->args[1];
+  Assembler::Label done = as.new_label();
+  Cond above = CC_G, below = CC_L;
+  if (instr->index == OP_lcmp) {
+    compare(a, b);
+  } else {
+    bool is_double = a->type == IrType::Double;
+    as.ucomis(is_double, xmm(a, XMM0), xmm(b, XMM1));
+    // Com NaN: -1 em fcmpl/dcmpl, 1 em fcmpg/dcmpg
+    bool less = instr->index == OP_fcmpl || instr->index == OP_dcmpl;
+    as.mov_imm32(RDX, less ? 0xFFFFFFFFu : 1u);
+    as.jcc(CC_P, done);
+    above = CC_A;
+    below = CC_B;
+  }
+  as.setcc(above, RDX);
+  as.setcc(below, RCX);
+  as.movzx8(RDX, RDX);
+  as.movzx8(RCX, RCX);
+  as.alu(ALU_SUB, RDX, RCX, false);
+  as.bind(done);
+  finish(instr, RDX);
+}
+
+void CodeGenerator::emit_step(IrInstr *instr) {
+  // Com suposições de hierarquia, a instrução pode invalidar o código e o
+  // interpretador continuar o frame no pc seguinte; dentro de um try, uma
+  // exceção o continua no handler. Nos dois casos as locais vão todas.
+  const FrameState *state = instr->state;
+  materialize(state, !graph.dependencies.empty() ||
+                         graph.method->in_try_block(state->pc));
+
+  // Voláteis vivos depois da chamada
+  u4 pos = position[instr->id];
+  std::vector<Location> saved;
+  for (size_t id = 0; id < locs.size(); id++) {
+    const Location &l = locs[id];
+    if (start[id] >= pos || end[id] <= pos)
+      continue;
+    if (l.kind == Location::Fpr ||
+        (l.kind == Location::Gpr && !is_callee_saved(static_cast<Reg>(l.reg))))
+      saved.push_back(l);
+  }
+  for (const Location &l : saved) {
+    if (l.kind == Location::Gpr)
+      as.store(mem(RSP, GPR_SAVE + l.reg * 8), static_cast<Reg>(l.reg), 8);
+    else
+      as.movs_store(SSE_SD, mem(RSP, XMM_SAVE + l.reg * 8),
+                    static_cast<Xmm>(l.reg));
+  }
+
+  as.load(RDI, mem(RSP, THREAD_OFFSET), 8);
+  as.load(RSI, mem(RSP, FRAME_OFFSET), 8);
+  as.mov_imm32(RDX, state->pc);
+  as.mov_imm32(RCX, static_cast<u4>(state->stack.size()));
+  as.mov_imm64(RAX, reinterpret_cast<uintptr_t>(&jit_step));
+  as.call(RAX);
+  as.test(RAX, RAX, false);
+  as.jcc(CC_NE, epilogue);
+
+  for (const Location &l : saved) {
+    if (l.kind == Location::Gpr)
+      as.load(static_cast<Reg>(l.reg), mem(RSP, GPR_SAVE + l.reg * 8), 8);
+    else
+      as.movs_load(SSE_SD, static_cast<Xmm>(l.reg),
+                   mem(RSP, XMM_SAVE + l.reg * 8));
+  }
+}
+
+void CodeGenerator::move(const Location &dst, const Location &src) {
+  if (dst == src)
+    return;
+  if (dst.kind == Location::Gpr) {
+    Reg d = static_cast<Reg>(dst.reg);
+    if (src.kind == Location::Gpr)
+      as.mov(d, static_cast<Reg>(src.reg), true);
+    else if (src.kind == Location::Fpr)
+      as.movd_from_xmm(d, static_cast<Xmm>(src.reg), true);
+    else
+      as.load(d, spill(src.slot), 8);
+  } else if (dst.kind == Location::Fpr) {
+    Xmm d = static_cast<Xmm>(dst.reg);
+    if (src.kind == Location::Fpr)
+      as.mov_xmm(d, static_cast<Xmm>(src.reg));
+    else if (src.kind == Location::Gpr)
+      as.movd_to_xmm(d, static_cast<Reg>(src.reg), true);
+    else
+      as.movs_load(SSE_SD, d, spill(src.slot));
+  } else {
+    if (src.kind == Location::Gpr) {
+      as.store(spill(dst.slot), static_cast<Reg>(src.reg), 8);
+    } else if (src.kind == Location::Fpr) {
+      as.movs_store(SSE_SD, spill(dst.slot), static_cast<Xmm>(src.reg));
+    } else {
+      as.load(RAX, spill(src.slot), 8);
+      as.store(spill(dst.slot), RAX, 8);
+    }
+  }
+}
+
+// Movimentos paralelos dos phis de `to` na aresta from->to. Um ciclo é
+// quebrado guardando um dos destinos em R11.
+void CodeGenerator::emit_phi_moves(IrBlock *from, IrBlock *to) {
+  size_t edge = static_cast<size_t>(
+      std::find(to->preds.begin(), to->preds.end(), from) - to->preds.begin());
+  std::vector<std::pair<Location, Location>> moves;
+  std::vector<std::pair<const IrInstr *, const IrInstr *>> constants;
+  for (IrInstr *phi : to->phis) {
+    if (!is_allocated(phi))
+      continue;
+    const IrInstr *arg = phi->args[edge];
+    if (arg->is_const())
+      constants.emplace_back(phi, arg);
+    else if (is_allocated(arg) && !(loc(phi) == loc(arg)))
+      moves.emplace_back(loc(phi), loc(arg));
+  }
+
+  const Location scratch{Location::Gpr, R11, 0};
+  while (!moves.empty()) {
+    bool progress = false;
+    for (size_t i = 0; i < moves.size(); i++) {
+      bool blocked = false;
+      for (size_t j = 0; j < moves.size(); j++)
+        if (j != i && moves[j].second == moves[i].first)
+          blocked = true;
+      if (blocked)
+        continue;
+      move(moves[i].first, moves[i].second);
+      moves.erase(moves.begin() + static_cast<long>(i));
+      progress = true;
+      break;
+    }
+    if (progress)
+      continue;
+    Location saved = moves[0].first;
+    move(scratch, saved);
+    for (auto &m : moves)
+      if (m.second == saved)
+        m.second = scratch;
+  }
+
+  for (const auto &c : constants) {
+    const Location &dst = loc(c.first);
+    if (dst.kind == Location::Fpr) {
+      load_xmm(static_cast<Xmm>(dst.reg), c.second);
+    } else if (dst.kind == Location::Gpr) {
+      load_gpr(static_cast<Reg>(dst.reg), c.second);
+    } else {
+      load_gpr(RAX, c.second);
+      as.store(spill(dst.slot), RAX, 8);
+    }
+  }
+}
+
+bool CodeGenerator::emit(IrBlock *block, IrInstr *instr) {
+  const std::vector<IrInstr *> &args = instr->args;
+  switch (instr->op) {
+  case IrOp::Param:
+    as.load(RDX, mem(RSP, LOCALS_OFFSET), 8);
+    read_slot(instr, RDX, instr->index);
+    return true;
+  case IrOp::Reload:
+    as.load(RDX, mem(RSP, instr->kind == 'L' ? LOCALS_OFFSET : STACK_OFFSET),
+            8);
+    read_slot(instr, RDX, instr->index);
+    return true;
+  case IrOp::Add:
+  case IrOp::Sub:
+  case IrOp::Mul:
+  case IrOp::Neg:
+  case IrOp::And:
+  case IrOp::Or:
+  case IrOp::Xor:
+  case IrOp::Shl:
+  case IrOp::Shr:
+  case IrOp::Ushr:
+    emit_arithmetic(instr);
+    return true;
+  case IrOp::Div:
+  case IrOp::Rem:
+    if (is_fp(instr->type)) {
+      if (instr->op == IrOp::Rem)
+        return false;
+      emit_arithmetic(instr);
+    } else {
+      emit_division(instr);
+    }
+    return true;
+  case IrOp::Convert:
+    emit_convert(instr);
+    return true;
+  case IrOp::Compare:
+    emit_compare(instr);
+    return true;
+  case IrOp::ArrayLength: {
+    load_gpr(RAX, args[0]);
+    decode(RAX);
+    Reg dst = result_gpr(instr);
+    as.load(dst, mem(RAX, OBJECT_DATA), 4);
+    finish(instr, dst);
+    return true;
+  }
+  case IrOp::LoadKlass: {
+    load_gpr(RAX, args[0]);
+    decode(RAX);
+    Reg dst = result_gpr(instr);
+    as.load(dst, mem(RAX, 0), 8);
+    finish(instr, dst);
+    return true;
+  }
+  case IrOp::LoadElement:
+  case IrOp::LoadField:
+  case IrOp::LoadStatic: {
+    Mem at = mem(RAX, 0);
+    if (instr->op == IrOp::LoadElement) {
+      at = element(args[0], args[1], instr->kind);
+    } else if (instr->op == IrOp::LoadField) {
+      load_gpr(RAX, args[0]);
+      decode(RAX);
+      at = mem(RAX, OBJECT_DATA + static_cast<int32_t>(instr->imm));
+    } else {
+      as.mov_imm64(RAX, static_cast<u8>(instr->imm));
+    }
+    if (is_fp(instr->type)) {
+      Xmm dst = result_xmm(instr);
+      as.movs_load(prefix_of(instr->type), dst, at);
+      finish(instr, dst);
+    } else {
+      Reg dst = result_gpr(instr);
+      as.load(dst, at, size_of(instr->kind),
+              instr->kind == 'B' || instr->kind == 'S');
+      finish(instr, dst);
+    }
+    return true;
+  }
+  case IrOp::StoreElement:
+  case IrOp::StoreField:
+  case IrOp::StoreStatic: {
+    const IrInstr *value = args.back();
+    // O valor primeiro: o endereço usa RAX e RCX
+    if (is_fp(value->type))
+      load_xmm(XMM0, value);
+    else
+      load_gpr(RDX, value);
+    Mem at = mem(RAX, 0);
+    if (instr->op == IrOp::StoreElement) {
+      at = element(args[0], args[1], instr->kind);
+    } else if (instr->op == IrOp::StoreField) {
+      load_gpr(RAX, args[0]);
+      decode(RAX);
+      at = mem(RAX, OBJECT_DATA + static_cast<int32_t>(instr->imm));
+    } else {
+      as.mov_imm64(RAX, static_cast<u8>(instr->imm));
+    }
+    if (is_fp(value->type)) {
+      as.movs_store(prefix_of(value->type), at, XMM0);
+    } else {
+      if (instr->kind == 'Z')
+        as.alu_imm(ALU_AND, RDX, 1, false);
+      as.store(at, RDX, size_of(instr->kind));
+    }
+    return true;
+  }
+  case IrOp::Guard: {
+    Assembler::Label stub = as.new_label();
+    compare(args[0], args[1]);
+    as.jcc(cond_of(negate(instr->cond)), stub);
+    deopts.push_back({stub, instr->state});
+    return true;
+  }
+  case IrOp::Step:
+    emit_step(instr);
+    return true;
+  case IrOp::Goto: {
+    IrBlock *succ = block->succs[0];
+    emit_phi_moves(block, succ);
+    if (succ->rpo != block->rpo + 1)
+      as.jmp(labels[succ->id]);
+    return true;
+  }
+  case IrOp::If: {
+    for (IrBlock *succ : block->succs)
+      if (!succ->phis.empty())
+        return false;
+    compare(args[0], args[1]);
+    IrBlock *taken = block->succs[0];
+    IrBlock *other = block->succs[1];
+    if (taken->rpo == block->rpo + 1) {
+      as.jcc(cond_of(negate(instr->cond)), labels[other->id]);
+    } else {
+      as.jcc(cond_of(instr->cond), labels[taken->id]);
+      if (other->rpo != block->rpo + 1)
+        as.jmp(labels[other->id]);
+    }
+    return true;
+  }
+  case IrOp::Return: {
+    u4 depth = 0;
+    if (!args.empty()) {
+      as.load(R11, mem(RSP, STACK_OFFSET), 8);
+      write_slot(R11, 0, args[0]);
+      depth = is_category2(args[0]->type) ? C2 : 1;
+    }
+    as.mov_imm32(RAX, depth);
+    as.jmp(epilogue);
+    return true;
+  }
+  case IrOp::Unwind:
+    as.jmp(pending);
+    return true;
+  default:
+    return false;
+  }
+}
+
+void CodeGenerator::prologue() {
+  as.push(RBP);
+  as.push(RBX);
+  as.push(R12);
+  as.push(R13);
+  as.push(R14);
+  as.push(R15);
+  as.alu_imm(ALU_SUB, RSP, frame_size, true);
+  as.store(mem(RSP, THREAD_OFFSET), RDI, 8);
+  as.store(mem(RSP, FRAME_OFFSET), RSI, 8);
+  as.store(mem(RSP, LOCALS_OFFSET), RDX, 8);
+  as.store(mem(RSP, STACK_OFFSET), RCX, 8);
+  as.mov_imm64(NARROW_BASE, Heap::narrow_base);
+}
+
+void CodeGenerator::epilogue_code() {
+  as.bind(pending);
+  as.mov_imm32(RAX, CompiledMethod::EXCEPTION_PENDING);
+  as.bind(epilogue);
+  as.alu_imm(ALU_ADD, RSP, frame_size, true);
+  as.pop(R15);
+  as.pop(R14);
+  as.pop(R13);
+  as.pop(R12);
+  as.pop(RBX);
+  as.pop(RBP);
+  as.ret();
+}
+
+bool CodeGenerator::generate(std::vector<u1> &out) {
+  graph.split_critical_edges();
+  number();
+  compute_liveness();
+  if (!allocate())
+    return false;
+
+  pending = as.new_label();
+  epilogue = as.new_label();
+  labels.assign(graph.block_count(), 0);
+  for (IrBlock *block : order)
+    labels[block->id] = as.new_label();
+
+  prologue();
+  for (IrBlock *block : order) {
+    as.bind(labels[block->id]);
+    for (IrInstr *instr : block->code)
+      if (!emit(block, instr))
+        return false;
+  }
+
+  for (const Deopt &deopt : deopts) {
+    as.bind(deopt.entry);
+    emit_deopt(deopt.state);
+  }
+  epilogue_code();
+
+  out = as.finish();
+  return true;
+}
+
+#endif // JVM_JIT_SUPPORTED
+
+} // namespace
+
+bool generate_code(IrGraph &graph, std::vector<u1> &out) {
+#ifdef JVM_JIT_SUPPORTED
+  return CodeGenerator(graph).generate(out);
+#else
+  (void)graph;
+  (void)out;
+  return false;
+#endif
+}
@@ -0,0 +1,328 @@
+#include "../classfile/bytecode.h"
+#include "./ssa.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+// Escape analysis no tier otimizado. Um `new` é um Step seguido do Reload
+// do objeto; se, depois do inlining do construtor, o objeto só é lido e
+// escrito por LoadField e StoreField, tem a classe lida por LoadKlass ou
+// aparece no estado de um Guard, o Step sai do grafo e cada field vira um
+// valor SSA, com phis onde caminhos com escritas diferentes se juntam. Os
+// estados que citam o objeto ganham um ScalarObject com os fields daquele
+// ponto, e a desotimização aloca o objeto só quando precisa.
+//
+// Qualquer outro uso faz o objeto escapar: Steps (chamadas que ficaram,
+// putfield de referência e tudo o que roda no interpretador), phis,
+// comparações e o retorno. Por isso os fields de referência de um objeto
+// substituído nunca são escritos e continuam null.
+//
+// Com uma thread só, monitorenter e monitorexit são checagens de null, que
+// o resultado do new dispensa: um synchronized sobre o objeto não deixa
+// código nem o faz escapar.
+
+namespace {
+
+IrType type_of(char kind) {
+  switch (kind) {
+  case 'J':
+    return IrType::Long;
+  case 'F':
+    return IrType::Float;
+  case 'D':
+    return IrType::Double;
+  case 'L':
+    return IrType::Ref;
+  default:
+    return IrType::Int;
+  }
+}
+
+bool in_state(const FrameState *state, const IrInstr *value) {
+  return state &&
+         (std::find(state->locals.begin(), state->locals.end(), value) !=
+              state->locals.end() ||
+          std::find(state->stack.begin(), state->stack.end(), value) !=
+              state->stack.end());
+}
+
+// Um `new` do método e o Reload com o objeto
+struct Allocation {
+  IrInstr *step;
+  IrInstr *object;
+  RuntimeClass *klass;
+};
+
+class AllocationReplacer {
+public:
+  AllocationReplacer(IrGraph &graph, const Allocation &allocation)
+      : graph(graph), step(allocation.step), object(allocation.object),
+        klass(allocation.klass) {}
+
+  bool escapes() const;
+  void replace();
+
+private:
+  IrInstr *zero(u4 offset) {
+    return graph.constant(type_of(kinds[offset]), 0);
+  }
+  IrInstr *narrow(IrInstr *store);
+  IrInstr *read_begin(IrBlock *block, u4 offset);
+  IrInstr *read_end(IrBlock *block, u4 offset);
+  FrameState *snapshot(FrameState *state,
+                       const std::map<u4, IrInstr *> &current,
+                       IrBlock *block);
+
+  IrGraph &graph;
+  IrInstr *step;
+  IrInstr *object;
+  RuntimeClass *klass;
+
+  std::map<u4, char> kinds; // fields acessados, por offset
+  // Último valor escrito em cada bloco e valor na entrada, por offset
+  std::map<std::pair<u4, u4>, IrInstr *> end_values, begin_values;
+  std::map<IrInstr *, IrInstr *> stored; // StoreField -> valor guardado
+};
+
+bool AllocationReplacer::escapes() const {
+  for (IrBlock *block : graph.order) {
+    for (IrInstr *phi : block->phis)
+      if (std::find(phi->args.begin(), phi->args.end(), object) !=
+          phi->args.end())
+        return true;
+    for (IrInstr *instr : block->code) {
+      if (in_state(instr->state, object) && instr->op != IrOp::Guard)
+        return true;
+      for (size_t i = 0; i < instr->args.size(); i++) {
+        if (instr->args[i] != object)
+          continue;
+        bool field = i == 0 && (instr->op == IrOp::LoadField ||
+                                instr->op == IrOp::StoreField);
+        if (!field && instr->op != IrOp::LoadKlass)
+          return true;
+      }
+    }
+  }
+  return false;
+}
+
+// O valor como o field o guarda: putfield trunca byte, char e short e
+// boolean fica só com o bit 0
+IrInstr *AllocationReplacer::narrow(IrInstr *store) {
+  IrInstr *value = store->args[1];
+  IrInstr *instr = nullptr;
+  switch (store->kind) {
+  case 'B':
+  case 'C':
+  case 'S':
+    instr = graph.make(IrOp::Convert, IrType::Int);
+    instr->index = store->kind == 'B'   ? OP_i2b
+                   : store->kind == 'C' ? OP_i2c
+                                        : OP_i2s;
+    instr->args = {value};
+    return instr;
+  case 'Z':
+    instr = graph.make(IrOp::And, IrType::Int);
+    instr->args = {value, graph.constant(IrType::Int, 1)};
+    return instr;
+  default:
+    return value;
+  }
+}
+
+// Leitura de um field na entrada de um bloco dominado pelo new: todo
+// caminho para trás chega a uma escrita ou ao próprio new antes de sair
+// dessa região. O phi entra no mapa antes dos argumentos, para os laços.
+IrInstr *AllocationReplacer::read_begin(IrBlock *block, u4 offset) {
+  auto key = std::make_pair(block->id, offset);
+  auto it = begin_values.find(key);
+  if (it != begin_values.end())
+    return it->second;
+  if (block->preds.size() == 1) {
+    IrInstr *value = read_end(block->preds[0], offset);
+    begin_values[key] = value;
+    return value;
+  }
+  IrInstr *phi = graph.make(IrOp::Phi, type_of(kinds[offset]));
+  graph.append(block, phi);
+  begin_values[key] = phi;
+  for (IrBlock *pred : block->preds)
+    phi->args.push_back(read_end(pred, offset));
+  return phi;
+}
+
+IrInstr *AllocationReplacer::read_end(IrBlock *block, u4 offset) {
+  auto it = end_values.find(std::make_pair(block->id, offset));
+  if (it != end_values.end())
+    return it->second;
+  return read_begin(block, offset);
+}
+
+// Cópia do estado com os fields do objeto nesse ponto: estados são
+// compartilhados (um por pc, ou o do invoke nos guards inlinados)
+FrameState *AllocationReplacer::snapshot(
+    FrameState *state, const std::map<u4, IrInstr *> &current,
+    IrBlock *block) {
+  FrameState *copy = graph.new_state(state->pc);
+  *copy = *state;
+  ScalarObject scalar;
+  scalar.object = object;
+  scalar.klass = klass;
+  for (const auto &pair : kinds) {
+    if (pair.second == 'L')
+      continue;
+    auto it = current.find(pair.first);
+    IrInstr *value =
+        it != current.end() ? it->second : read_begin(block, pair.first);
+    scalar.fields.push_back({pair.first, pair.second, value});
+  }
+  copy->objects.push_back(std::move(scalar));
+  return copy;
+}
+
+void AllocationReplacer::replace() {
+  IrBlock *home = step->block;
+  for (IrBlock *block : graph.order)
+    for (IrInstr *instr : block->code)
+      if ((instr->op == IrOp::LoadField || instr->op == IrOp::StoreField) &&
+          instr->args[0] == object)
+        kinds[static_cast<u4>(instr->imm)] = instr->kind;
+
+  // Valores no fim de cada bloco: no do new, zero até a primeira escrita
+  for (IrBlock *block : graph.order) {
+    auto &code = block->code;
+    auto first = code.begin();
+    if (block == home) {
+      first = std::find(code.begin(), code.end(), step);
+      for (const auto &pair : kinds)
+        end_values[std::make_pair(block->id, pair.first)] = zero(pair.first);
+    }
+    for (auto it = first; it != code.end(); ++it) {
+      IrInstr *instr = *it;
+      if (instr->op != IrOp::StoreField || instr->args[0] != object)
+        continue;
+      stored[instr] = narrow(instr);
+      end_values[std::make_pair(block->id, static_cast<u4>(instr->imm))] =
+          stored[instr];
+    }
+  }
+
+  for (IrBlock *block : graph.order) {
+    if (in_state(block->entry_state, object))
+      block->entry_state = snapshot(block->entry_state, {}, block);
+
+    std::map<u4, IrInstr *> current;
+    std::vector<IrInstr *> code;
+    bool after_step = false;
+    for (IrInstr *instr : block->code) {
+      if (instr == step) {
+        step->removed = true;
+        for (const auto &pair : kinds)
+          current[pair.first] = zero(pair.first);
+        after_step = true;
+        continue;
+      }
+      // Os Reloads do new: nenhum GC rodou, valem os valores de antes
+      if (after_step && instr->op == IrOp::Reload) {
+        instr->removed = instr != object;
+        if (instr != object)
+          instr->forward = instr->kind == 'L'
+                               ? step->state->locals[instr->index]
+                               : step->state->stack[instr->index];
+        continue;
+      }
+      after_step = false;
+
+      if (instr->op == IrOp::StoreField && instr->args[0] == object) {
+        instr->removed = true;
+        IrInstr *value = stored[instr];
+        current[static_cast<u4>(instr->imm)] = value;
+        if (value != instr->args[1]) {
+          value->block = block;
+          code.push_back(value);
+        }
+        continue;
+      }
+      if (instr->op == IrOp::LoadField && instr->args[0] == object) {
+        u4 offset = static_cast<u4>(instr->imm);
+        instr->removed = true;
+        auto it = current.find(offset);
+        instr->forward =
+            it != current.end() ? it->second : read_begin(block, offset);
+        continue;
+      }
+      if (instr->op == IrOp::LoadKlass && instr->args[0] == object) {
+        instr->removed = true;
+        instr->forward = graph.constant(
+            IrType::Word,
+            static_cast<int64_t>(reinterpret_cast<uintptr_t>(klass)));
+        continue;
+      }
+      if (in_state(instr->state, object))
+        instr->state = snapshot(instr->state, current, block);
+      code.push_back(instr);
+    }
+    block->code = std::move(code);
+  }
+
+  object->op = IrOp::Virtual;
+  object->block = nullptr;
+}
+
+} // namespace
+
+RuntimeClass *allocated_class(const IrGraph &graph, const IrInstr *value) {
+  if (value->op != IrOp::Reload || value->kind != 'S' || !value->block)
+    return nullptr;
+  // Os Reloads seguem o Step, e o do objeto é o slot empilhado por ele
+  const auto &code = value->block->code;
+  auto it = std::find(code.begin(), code.end(), value);
+  while (it != code.begin() && (*it)->op == IrOp::Reload)
+    --it;
+  const IrInstr *step = *it;
+  if (step->op != IrOp::Step || step->state->stack.size() != value->index)
+    return nullptr;
+
+  const RuntimeMethod *method = graph.method;
+  const std::vector<u1> &bytecode = method->code->code;
+  u4 pc = step->state->pc;
+  if (bytecode[pc] != OP_new)
+    return nullptr;
+  RuntimeClass *klass =
+      method->owner->cp_cache[read_code_u2(bytecode, pc + 1)].klass;
+  // Sem a classe resolvida e inicializada, ou com InstantiationError, o
+  // Step fica: é ele que roda o <clinit>
+  if (!klass || !klass->is_initialized() || klass->is_interface() ||
+      klass->is_array() || (klass->access_flags & ACC_Abstract_Class))
+    return nullptr;
+  return klass;
+}
+
+bool replace_allocations(IrGraph &graph) {
+  std::vector<Allocation> allocations;
+  for (IrBlock *block : graph.order)
+    for (IrInstr *instr : block->code)
+      if (instr->op == IrOp::Reload)
+        if (RuntimeClass *klass = allocated_class(graph, instr)) {
+          auto &code = block->code;
+          auto it = std::find(code.begin(), code.end(), instr);
+          while ((*it)->op == IrOp::Reload)
+            --it;
+          allocations.push_back({*it, instr, klass});
+        }
+
+  bool changed = false;
+  for (const Allocation &allocation : allocations) {
+    AllocationReplacer replacer(graph, allocation);
+    if (replacer.escapes())
+      continue;
+    replacer.replace();
+    changed = true;
+  }
+  if (changed) {
+    graph.resolve_all();
+    graph.remove_trivial_phis();
+  }
+  return changed;
+}
@@ -0,0 +1,431 @@
+#include "../classfile/bytecode.h"
+#include "./ssa.h"
+
+#include <algorithm>
+
+// Inlining no tier otimizado. No grafo do chamador um invoke é um Step; se o
+// alvo é conhecido e pequeno, o grafo dele entra no lugar do Step, com os
+// parâmetros trocados pelos argumentos e os returns ligados ao resto do
+// bloco. Uma chamada virtual com uma única implementação entre as classes
+// carregadas é ligada direto, e a suposição fica registrada com o código
+// (análise de hierarquia); as outras, com uma ou duas classes no inline
+// cache do sítio, ganham um teste da classe do receptor antes de cada cópia.
+//
+// O código inlinado não tem frame próprio no interpretador, então só entram
+// alvos sem Steps e cujos guards rodam antes de qualquer escrita na
+// memória: um guard que falha desotimiza no estado do invoke e o
+// interpretador refaz a chamada inteira.
+//
+// Com uma thread só, o lock de um método synchronized nunca é disputado, mas
+// só um receptor criado pelo próprio método garante isso sem depender do
+// resto do programa: esses alvos entram e o lock some (lock elision). Se o
+// objeto não escapa, a escape analysis tira também a alocação.
+
+namespace {
+
+// Bytecode inlinado sempre que o alvo é conhecido
+const u4 MAX_INLINE_SIZE = 35;
+// Alvos chamados, em média, pelo menos uma vez por chamada do método
+// compilado podem ser maiores
+const u4 MAX_HOT_INLINE_SIZE = 100;
+const u4 MAX_INLINE_DEPTH = 4;
+// Soma do bytecode inlinado numa compilação
+const u4 MAX_INLINE_BUDGET = 500;
+// Classes de receptor testadas num sítio polimórfico; inline caches com mais
+// classes não são inlinados
+const u1 MAX_INLINE_RECEIVERS = 2;
+
+IrType return_type(char descriptor) {
+  switch (descriptor) {
+  case 'V':
+    return IrType::Void;
+  case 'J':
+    return IrType::Long;
+  case 'F':
+    return IrType::Float;
+  case 'D':
+    return IrType::Double;
+  case 'L':
+  case '[':
+    return IrType::Ref;
+  default:
+    return IrType::Int;
+  }
+}
+
+// Receptor de um invoke criado por um `new` do método compilado
+bool is_local_receiver(const IrGraph &graph, const IrInstr *step,
+                       RuntimeMethod *resolved) {
+  if (resolved->is_static())
+    return false;
+  const FrameState *state = step->state;
+  size_t receiver =
+      state->stack.size() - 1 - resolved->signature().arg_stack_slots;
+  return allocated_class(graph, IrGraph::resolve(state->stack[receiver]));
+}
+
+bool is_store(const IrInstr *instr) {
+  return instr->op == IrOp::StoreElement || instr->op == IrOp::StoreField ||
+         instr->op == IrOp::StoreStatic;
+}
+
+// Alvos de um invoke. Sem classe: ligação direta, sem teste do receptor.
+struct CallTargets {
+  RuntimeMethod *resolved = nullptr;
+  bool by_hierarchy = false; // alvo único só entre as classes carregadas
+  u1 count = 0;
+  RuntimeClass *classes[MAX_INLINE_RECEIVERS] = {};
+  RuntimeMethod *methods[MAX_INLINE_RECEIVERS] = {};
+
+  void add(RuntimeClass *klass, RuntimeMethod *method) {
+    classes[count] = klass;
+    methods[count] = method;
+    count++;
+  }
+};
+
+class Inliner {
+public:
+  Inliner(Runtime *runtime, RuntimeMethod *root)
+      : runtime(runtime), root(root), budget(MAX_INLINE_BUDGET) {}
+
+  void run(IrGraph &graph, u4 depth);
+
+private:
+  bool find_targets(IrGraph &graph, u4 pc, CallTargets &targets);
+  bool accepts(RuntimeMethod *target, bool local_receiver) const;
+  std::unique_ptr<IrGraph> build(RuntimeMethod *target, u4 depth);
+  bool prepare(IrGraph &callee, FrameState *state);
+  void splice(IrGraph &graph, IrInstr *step, const CallTargets &targets,
+              std::vector<std::unique_ptr<IrGraph>> &callees);
+
+  Runtime *runtime;
+  RuntimeMethod *root;
+  u4 budget;
+  std::vector<RuntimeMethod *> active; // cadeia de inlining em andamento
+};
+
+void Inliner::run(IrGraph &graph, u4 depth) {
+  if (depth >= MAX_INLINE_DEPTH)
+    return;
+  std::vector<IrInstr *> steps;
+  for (IrBlock *block : graph.order)
+    for (IrInstr *instr : block->code)
+      if (instr->op == IrOp::Step)
+        steps.push_back(instr);
+
+  active.push_back(graph.method);
+  bool changed = false;
+  for (IrInstr *step : steps) {
+    CallTargets targets;
+    if (!find_targets(graph, step->state->pc, targets))
+      continue;
+    bool local = is_local_receiver(graph, step, targets.resolved);
+    bool ok = true;
+    for (u1 i = 0; i < targets.count && ok; i++)
+      ok = accepts(targets.methods[i], local);
+    if (!ok)
+      continue;
+
+    u4 size = 0;
+    for (u1 i = 0; i < targets.count; i++)
+      size += targets.methods[i]->code->code_length;
+    if (size > budget)
+      continue;
+
+    // Os inlinings dentro dos alvos gastam do mesmo orçamento: se este
+    // invoke fica, o gasto deles volta
+    u4 saved = budget;
+    std::vector<std::unique_ptr<IrGraph>> callees;
+    for (u1 i = 0; i < targets.count && ok; i++) {
+      callees.push_back(build(targets.methods[i], depth));
+      ok = callees.back() && prepare(*callees.back(), step->state);
+    }
+    if (!ok || size > budget) {
+      budget = saved;
+      continue;
+    }
+    budget -= size;
+    splice(graph, step, targets, callees);
+    if (targets.by_hierarchy)
+      graph.dependencies.push_back({targets.resolved, targets.methods[0]});
+    changed = true;
+  }
+  active.pop_back();
+
+  if (changed) {
+    graph.resolve_all();
+    graph.compute_rpo();
+  }
+}
+
+// Mesma escolha de alvo do interpretador, sem resolver nada: só entradas do
+// constant pool já resolvidas e classes carregadas ou vistas no inline cache
+bool Inliner::find_targets(IrGraph &graph, u4 pc, CallTargets &targets) {
+  RuntimeMethod *method = graph.method;
+  RuntimeClass *klass = method->owner;
+  const std::vector<u1> &code = method->code->code;
+  u1 op = code[pc];
+  if (op != OP_invokevirtual && op != OP_invokespecial &&
+      op != OP_invokestatic && op != OP_invokeinterface)
+    return false;
+  RuntimeMethod *resolved =
+      klass->cp_cache[read_code_u2(code, pc + 1)].method;
+  if (!resolved || (op == OP_invokestatic) != resolved->is_static())
+    return false;
+  targets.resolved = resolved;
+
+  if (op == OP_invokestatic) {
+    // O invoke é que inicializa a classe do alvo
+    if (!resolved->owner->is_initialized())
+      return false;
+    targets.add(nullptr, resolved);
+  } else if (op == OP_invokespecial) {
+    RuntimeMethod *target = resolved;
+    if (resolved->name[0] != '<' && !resolved->owner->is_interface() &&
+        resolved->owner != klass && klass->super_class &&
+        klass->is_assignable_to(resolved->owner))
+      target = klass->super_class->find_method(resolved->key);
+    if (!target)
+      return false;
+    targets.add(nullptr, target);
+  } else if (!resolved->is_virtual() ||
+             (resolved->access_flags & ACC_Final_Method) ||
+             (!resolved->owner->is_interface() &&
+              (resolved->owner->access_flags & ACC_Final_Class))) {
+    targets.add(nullptr, resolved);
+  } else if (RuntimeMethod *unique =
+                 op == OP_invokevirtual
+                     ? runtime->method_area->unique_implementation(resolved)
+                     : nullptr) {
+    targets.add(nullptr, unique);
+    targets.by_hierarchy = true;
+  } else {
+    // O inline cache já guarda o alvo despachado para cada receptor
+    const InlineCache *cache = method->inline_cache_at(pc);
+    if (!cache || cache->state == InlineCacheState::Uninitialized ||
+        cache->state == InlineCacheState::Megamorphic ||
+        cache->count > MAX_INLINE_RECEIVERS)
+      return false;
+    for (u1 i = 0; i < cache->count; i++)
+      targets.add(cache->receivers[i], cache->targets[i]);
+  }
+  return true;
+}
+
+bool Inliner::accepts(RuntimeMethod *target, bool local_receiver) const {
+  if (!target || !target->code || target->native || target->is_abstract() ||
+      target->is_native() ||
+      ((target->access_flags & ACC_Synchronized_Method) && !local_receiver))
+    return false;
+  if (std::find(active.begin(), active.end(), target) != active.end())
+    return false;
+  u4 size = target->code->code_length;
+  if (size <= MAX_INLINE_SIZE)
+    return true;
+  return size <= MAX_HOT_INLINE_SIZE &&
+         target->profile.invocations >= root->profile.invocations;
+}
+
+std::unique_ptr<IrGraph> Inliner::build(RuntimeMethod *target, u4 depth) {
+  std::unique_ptr<IrGraph> callee = build_ir(runtime, target);
+  if (callee)
+    run(*callee, depth + 1);
+  return callee;
+}
+
+// Confere as condições do começo do arquivo e troca os estados de
+// desotimização do alvo pelo estado do invoke. Os laços alcançados depois
+// de uma escrita ficam sem estado de entrada: nada sai deles para o
+// pré-cabeçalho.
+bool Inliner::prepare(IrGraph &callee, FrameState *state) {
+  // Escrita em algum caminho até o início (in) e até o fim (out) do bloco
+  size_t blocks = callee.block_count();
+  std::vector<bool> in(blocks, false), out(blocks, false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (IrBlock *block : callee.order) {
+      bool dirty = false;
+      for (IrBlock *pred : block->preds)
+        dirty = dirty || out[pred->id];
+      in[block->id] = dirty;
+      for (IrInstr *instr : block->code)
+        dirty = dirty || is_store(instr);
+      if (dirty != out[block->id]) {
+        out[block->id] = dirty;
+        changed = true;
+      }
+    }
+  }
+
+  bool returns = false;
+  for (IrBlock *block : callee.order) {
+    bool dirty = in[block->id];
+    for (IrInstr *instr : block->code) {
+      switch (instr->op) {
+      case IrOp::Step:
+      case IrOp::Unwind:
+        return false;
+      case IrOp::Guard:
+        if (dirty)
+          return false;
+        instr->state = state;
+        break;
+      case IrOp::Return:
+        returns = true;
+        break;
+      default:
+        dirty = dirty || is_store(instr);
+        break;
+      }
+    }
+    if (block->entry_state)
+      block->entry_state = in[block->id] ? nullptr : state;
+  }
+  return returns;
+}
+
+void Inliner::splice(IrGraph &graph, IrInstr *step,
+                     const CallTargets &targets,
+                     std::vector<std::unique_ptr<IrGraph>> &callees) {
+  FrameState *state = step->state;
+  IrBlock *block = step->block;
+
+  // O Step sai com os Reloads que o seguem; o resto do bloco vai para a
+  // continuação, onde os returns chegam
+  auto &code = block->code;
+  size_t at = static_cast<size_t>(
+      std::find(code.begin(), code.end(), step) - code.begin());
+  size_t end = at + 1;
+  while (end < code.size() && code[end]->op == IrOp::Reload)
+    end++;
+  std::vector<IrInstr *> reloads(code.begin() + static_cast<long>(at) + 1,
+                                 code.begin() + static_cast<long>(end));
+  IrBlock *next = graph.split_block(block, end);
+  code.resize(at);
+  step->removed = true;
+
+  // Argumentos por índice de variável local, como em Interpreter::invoke
+  const MethodSignature &sig = targets.resolved->signature();
+  u4 receiver = targets.resolved->is_static() ? 0 : 1;
+  size_t base = state->stack.size() - receiver - sig.arg_stack_slots;
+  std::vector<IrInstr *> args(receiver + sig.arg_locals, graph.undef);
+  size_t s = base;
+  u4 l = 0;
+  if (receiver)
+    args[l++] = state->stack[s++];
+  for (char type : sig.args) {
+    args[l] = state->stack[s];
+    bool wide = type == 'J' || type == 'D';
+    s += wide ? CATEGORY2_STACK_SLOTS : 1;
+    l += wide ? 2 : 1;
+  }
+
+  IrInstr *result = graph.undef;
+  IrType type = return_type(sig.ret);
+  if (type != IrType::Void) {
+    result = graph.make(IrOp::Phi, type);
+    graph.append(next, result);
+  }
+
+  auto link = [&](IrBlock *from, IrBlock *to, IrInstr *terminator) {
+    from->succs.push_back(to);
+    to->preds.push_back(from);
+    if (terminator) {
+      terminator->block = nullptr;
+      graph.append(from, terminator);
+    }
+  };
+  auto jump = [&](IrBlock *from, IrBlock *to) {
+    link(from, to, graph.make(IrOp::Goto, IrType::Void));
+  };
+
+  // Receptor: null check e, pelo inline cache, a classe de cada cópia
+  IrInstr *object = receiver ? args[0] : nullptr;
+  auto guard = [&](IrBlock *where, IrCond cond, IrInstr *a, IrInstr *b) {
+    IrInstr *instr = graph.make(IrOp::Guard, IrType::Void);
+    instr->cond = cond;
+    instr->args = {a, b};
+    instr->state = state;
+    graph.append(where, instr);
+  };
+  if (object && !object->non_null)
+    guard(block, IrCond::NE, object, graph.constant(IrType::Ref, 0));
+  IrInstr *klass = nullptr;
+  if (targets.classes[0]) {
+    klass = graph.make(IrOp::LoadKlass, IrType::Word);
+    klass->args.push_back(object);
+    graph.append(block, klass);
+  }
+
+  IrBlock *from = block;
+  for (u1 i = 0; i < targets.count; i++) {
+    IrGraph &callee = *callees[i];
+    IrBlock *entry = callee.entry;
+    callee.undef->forward = graph.undef;
+    for (IrInstr *instr : entry->code) {
+      if (instr->op != IrOp::Param)
+        continue;
+      instr->forward =
+          instr->index < args.size() ? args[instr->index] : graph.undef;
+      instr->removed = true;
+    }
+    entry->code.erase(std::remove_if(entry->code.begin(), entry->code.end(),
+                                     [](const IrInstr *instr) {
+                                       return instr->removed;
+                                     }),
+                      entry->code.end());
+    for (IrBlock *callee_block : callee.order) {
+      IrInstr *terminator = callee_block->terminator();
+      if (terminator->op != IrOp::Return)
+        continue;
+      if (type != IrType::Void)
+        result->args.push_back(terminator->args[0]);
+      terminator->op = IrOp::Goto;
+      terminator->args.clear();
+      link(callee_block, next, nullptr);
+    }
+    graph.absorb(callee);
+
+    RuntimeClass *expected = targets.classes[i];
+    if (!expected) {
+      jump(from, entry);
+      continue;
+    }
+    IrInstr *word = graph.constant(
+        IrType::Word,
+        static_cast<int64_t>(reinterpret_cast<uintptr_t>(expected)));
+    if (i + 1 == targets.count) {
+      // Classe fora do inline cache: o interpretador faz o despacho
+      guard(from, IrCond::EQ, klass, word);
+      jump(from, entry);
+      continue;
+    }
+    IrInstr *test = graph.make(IrOp::If, IrType::Void);
+    test->cond = IrCond::EQ;
+    test->args = {klass, word};
+    IrBlock *miss = graph.new_block(IrBlock::NO_PC);
+    link(from, entry, test);
+    from->succs.push_back(miss);
+    miss->preds.push_back(from);
+    from = miss;
+  }
+
+  // Os Reloads viram os valores de antes da chamada, que nenhum GC moveu
+  for (IrInstr *reload : reloads) {
+    reload->removed = true;
+    if (reload->kind == 'L')
+      reload->forward = state->locals[reload->index];
+    else if (reload->index < base)
+      reload->forward = state->stack[reload->index];
+    else
+      reload->forward = result;
+  }
+}
+
+} // namespace
+
+void inline_calls(IrGraph &graph) {
+  Inliner(graph.runtime, graph.method).run(graph, 0);
+}
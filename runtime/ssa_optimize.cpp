@@ -0,0 +1,1011 @@
+#include "../classfile/bytecode.h"
+#include "./ssa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+
+// Otimizações sobre a IR. Todas preservam os estados dos Guards e Steps: um
+// valor que aparece num estado continua vivo, e um guard tirado de um laço
+// passa a desotimizar com o estado do cabeçalho, antes da primeira volta.
+
+namespace {
+
+// ------------------------------------------------------
+// Constantes
+// ------------------------------------------------------
+
+int32_t as_int(const IrInstr *c) { return static_cast<int32_t>(c->imm); }
+int64_t as_long(const IrInstr *c) { return c->imm; }
+
+float as_float(const IrInstr *c) {
+  u4 bits = static_cast<u4>(c->imm);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+double as_double(const IrInstr *c) {
+  double value;
+  std::memcpy(&value, &c->imm, sizeof(value));
+  return value;
+}
+
+IrInstr *int_constant(IrGraph &graph, int32_t value) {
+  return graph.constant(IrType::Int, value);
+}
+
+IrInstr *long_constant(IrGraph &graph, int64_t value) {
+  return graph.constant(IrType::Long, value);
+}
+
+IrInstr *float_constant(IrGraph &graph, float value) {
+  u4 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return graph.constant(IrType::Float, bits);
+}
+
+IrInstr *double_constant(IrGraph &graph, double value) {
+  int64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return graph.constant(IrType::Double, bits);
+}
+
+// f2i, d2l...: NaN vira 0 e o que não cabe satura (JVMS §6.5.d2i)
+template <typename To, typename From> To saturate(From value) {
+  if (std::isnan(value))
+    return 0;
+  if (value >= static_cast<From>(std::numeric_limits<To>::max()))
+    return std::numeric_limits<To>::max();
+  if (value <= static_cast<From>(std::numeric_limits<To>::min()))
+    return std::numeric_limits<To>::min();
+  return static_cast<To>(value);
+}
+
+template <typename T> int32_t compare(T a, T b, int32_t nan_result) {
+  if (a > b)
+    return 1;
+  if (a == b)
+    return 0;
+  if (a < b)
+    return -1;
+  return nan_result;
+}
+
+template <typename T> bool test(IrCond cond, T a, T b) {
+  switch (cond) {
+  case IrCond::EQ:
+    return a == b;
+  case IrCond::NE:
+    return a != b;
+  case IrCond::LT:
+    return a < b;
+  case IrCond::GE:
+    return a >= b;
+  case IrCond::GT:
+    return a > b;
+  case IrCond::LE:
+    return a <= b;
+  default:
+    return false;
+  }
+}
+
+// Resultado de `a cond b` entre constantes; false se não dá para saber
+bool fold_condition(IrCond cond, const IrInstr *a, const IrInstr *b,
+                    bool &result) {
+  if (!a->is_const() || !b->is_const())
+    return false;
+  if (cond == IrCond::ULT || cond == IrCond::UGE) {
+    if (a->type != IrType::Int)
+      return false;
+    bool below = static_cast<u4>(a->imm) < static_cast<u4>(b->imm);
+    result = cond == IrCond::ULT ? below : !below;
+    return true;
+  }
+  switch (a->type) {
+  case IrType::Int:
+    result = test(cond, as_int(a), as_int(b));
+    return true;
+  case IrType::Long:
+  case IrType::Ref:
+  case IrType::Word:
+    result = test(cond, a->imm, b->imm);
+    return true;
+  default:
+    return false;
+  }
+}
+
+IrInstr *fold_int(IrGraph &graph, IrOp op, int32_t a, int32_t b) {
+  u4 ua = static_cast<u4>(a), ub = static_cast<u4>(b);
+  switch (op) {
+  case IrOp::Add:
+    return int_constant(graph, static_cast<int32_t>(ua + ub));
+  case IrOp::Sub:
+    return int_constant(graph, static_cast<int32_t>(ua - ub));
+  case IrOp::Mul:
+    return int_constant(graph, static_cast<int32_t>(ua * ub));
+  case IrOp::Div:
+    if (b == 0)
+      return nullptr;
+    if (b == -1)
+      return int_constant(graph, static_cast<int32_t>(0u - ua));
+    return int_constant(graph, a / b);
+  case IrOp::Rem:
+    if (b == 0)
+      return nullptr;
+    return int_constant(graph, b == -1 ? 0 : a % b);
+  case IrOp::And:
+    return int_constant(graph, a & b);
+  case IrOp::Or:
+    return int_constant(graph, a | b);
+  case IrOp::Xor:
+    return int_constant(graph, a ^ b);
+  case IrOp::Shl:
+    return int_constant(graph, static_cast<int32_t>(ua << (b & 31)));
+  case IrOp::Shr:
+    return int_constant(graph, a >> (b & 31));
+  case IrOp::Ushr:
+    return int_constant(graph, static_cast<int32_t>(ua >> (b & 31)));
+  default:
+    return nullptr;
+  }
+}
+
+IrInstr *fold_long(IrGraph &graph, IrOp op, int64_t a, int64_t b) {
+  u8 ua = static_cast<u8>(a), ub = static_cast<u8>(b);
+  switch (op) {
+  case IrOp::Add:
+    return long_constant(graph, static_cast<int64_t>(ua + ub));
+  case IrOp::Sub:
+    return long_constant(graph, static_cast<int64_t>(ua - ub));
+  case IrOp::Mul:
+    return long_constant(graph, static_cast<int64_t>(ua * ub));
+  case IrOp::Div:
+    if (b == 0)
+      return nullptr;
+    if (b == -1)
+      return long_constant(graph, static_cast<int64_t>(0 - ua));
+    return long_constant(graph, a / b);
+  case IrOp::Rem:
+    if (b == 0)
+      return nullptr;
+    return long_constant(graph, b == -1 ? 0 : a % b);
+  case IrOp::And:
+    return long_constant(graph, a & b);
+  case IrOp::Or:
+    return long_constant(graph, a | b);
+  case IrOp::Xor:
+    return long_constant(graph, a ^ b);
+  case IrOp::Shl:
+    return long_constant(graph, static_cast<int64_t>(ua << (b & 63)));
+  case IrOp::Shr:
+    return long_constant(graph, a >> (b & 63));
+  case IrOp::Ushr:
+    return long_constant(graph, static_cast<int64_t>(ua >> (b & 63)));
+  default:
+    return nullptr;
+  }
+}
+
+template <typename T> bool fold_real(IrOp op, T a, T b, T &result) {
+  switch (op) {
+  case IrOp::Add:
+    result = a + b;
+    return true;
+  case IrOp::Sub:
+    result = a - b;
+    return true;
+  case IrOp::Mul:
+    result = a * b;
+    return true;
+  case IrOp::Div:
+    result = a / b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+IrInstr *fold_convert(IrGraph &graph, u4 opcode, const IrInstr *c) {
+  switch (opcode) {
+  case OP_i2l:
+    return long_constant(graph, as_int(c));
+  case OP_i2f:
+    return float_constant(graph, static_cast<float>(as_int(c)));
+  case OP_i2d:
+    return double_constant(graph, as_int(c));
+  case OP_l2i:
+    return int_constant(graph, static_cast<int32_t>(as_long(c)));
+  case OP_l2f:
+    return float_constant(graph, static_cast<float>(as_long(c)));
+  case OP_l2d:
+    return double_constant(graph, static_cast<double>(as_long(c)));
+  case OP_f2i:
+    return int_constant(graph, saturate<int32_t>(as_float(c)));
+  case OP_f2l:
+    return long_constant(graph, saturate<int64_t>(as_float(c)));
+  case OP_f2d:
+    return double_constant(graph, as_float(c));
+  case OP_d2i:
+    return int_constant(graph, saturate<int32_t>(as_double(c)));
+  case OP_d2l:
+    return long_constant(graph, saturate<int64_t>(as_double(c)));
+  case OP_d2f:
+    return float_constant(graph, static_cast<float>(as_double(c)));
+  case OP_i2b:
+    return int_constant(graph, static_cast<int8_t>(as_int(c)));
+  case OP_i2c:
+    return int_constant(graph, static_cast<u2>(as_int(c)));
+  case OP_i2s:
+    return int_constant(graph, static_cast<int16_t>(as_int(c)));
+  default:
+    return nullptr;
+  }
+}
+
+IrInstr *fold_compare(IrGraph &graph, u4 opcode, const IrInstr *a,
+                      const IrInstr *b) {
+  switch (opcode) {
+  case OP_lcmp:
+    return int_constant(graph, compare(as_long(a), as_long(b), 0));
+  case OP_fcmpl:
+  case OP_fcmpg:
+    return int_constant(
+        graph, compare(as_float(a), as_float(b), opcode == OP_fcmpl ? -1 : 1));
+  case OP_dcmpl:
+  case OP_dcmpg:
+    return int_constant(graph, compare(as_double(a), as_double(b),
+                                       opcode == OP_dcmpl ? -1 : 1));
+  default:
+    return nullptr;
+  }
+}
+
+bool is_zero(const IrInstr *value) {
+  return value->is_const() && value->imm == 0 &&
+         (value->type == IrType::Int || value->type == IrType::Long);
+}
+
+bool is_one(const IrInstr *value) {
+  return value->is_const() && value->imm == 1 &&
+         (value->type == IrType::Int || value->type == IrType::Long);
+}
+
+// ------------------------------------------------------
+// Simplificação
+// ------------------------------------------------------
+
+void replace(IrInstr *instr, IrInstr *value) {
+  instr->forward = value;
+  instr->removed = true;
+}
+
+// Valor equivalente mais simples, ou nullptr
+IrInstr *simplify_value(IrGraph &graph, IrInstr *instr) {
+  const std::vector<IrInstr *> &args = instr->args;
+  bool integral = instr->type == IrType::Int || instr->type == IrType::Long;
+
+  switch (instr->op) {
+  case IrOp::Add:
+  case IrOp::Sub:
+  case IrOp::Mul:
+  case IrOp::Div:
+  case IrOp::Rem:
+  case IrOp::And:
+  case IrOp::Or:
+  case IrOp::Xor:
+  case IrOp::Shl:
+  case IrOp::Shr:
+  case IrOp::Ushr: {
+    IrInstr *a = args[0], *b = args[1];
+    if (a->is_const() && b->is_const()) {
+      switch (instr->type) {
+      case IrType::Int:
+        return fold_int(graph, instr->op, as_int(a), as_int(b));
+      case IrType::Long:
+        return fold_long(graph, instr->op, as_long(a), as_long(b));
+      case IrType::Float: {
+        float result;
+        if (fold_real(instr->op, as_float(a), as_float(b), result))
+          return float_constant(graph, result);
+        return nullptr;
+      }
+      case IrType::Double: {
+        double result;
+        if (fold_real(instr->op, as_double(a), as_double(b), result))
+          return double_constant(graph, result);
+        return nullptr;
+      }
+      default:
+        return nullptr;
+      }
+    }
+    if (!integral)
+      return nullptr;
+    IrOp op = instr->op;
+    // Identidades; ponto flutuante fica de fora (-0.0, NaN)
+    if (is_zero(b) && (op == IrOp::Add || op == IrOp::Sub || op == IrOp::Or ||
+                       op == IrOp::Xor || op == IrOp::Shl ||
+                       op == IrOp::Shr || op == IrOp::Ushr))
+      return a;
+    if (is_zero(a) && (op == IrOp::Add || op == IrOp::Or || op == IrOp::Xor))
+      return b;
+    if (is_one(b) && (op == IrOp::Mul || op == IrOp::Div))
+      return a;
+    if (is_one(a) && op == IrOp::Mul)
+      return b;
+    if ((is_zero(a) || is_zero(b)) && (op == IrOp::Mul || op == IrOp::And))
+      return graph.constant(instr->type, 0);
+    if (a == b && (op == IrOp::Sub || op == IrOp::Xor))
+      return graph.constant(instr->type, 0);
+    if (a == b && (op == IrOp::And || op == IrOp::Or))
+      return a;
+    return nullptr;
+  }
+  case IrOp::Neg: {
+    IrInstr *a = args[0];
+    if (!a->is_const())
+      return nullptr;
+    switch (instr->type) {
+    case IrType::Int:
+      return int_constant(graph,
+                          static_cast<int32_t>(0u - static_cast<u4>(a->imm)));
+    case IrType::Long:
+      return long_constant(graph,
+                           static_cast<int64_t>(0 - static_cast<u8>(a->imm)));
+    case IrType::Float:
+      return float_constant(graph, -as_float(a));
+    case IrType::Double:
+      return double_constant(graph, -as_double(a));
+    default:
+      return nullptr;
+    }
+  }
+  case IrOp::Convert:
+    if (args[0]->is_const())
+      return fold_convert(graph, instr->index, args[0]);
+    return nullptr;
+  case IrOp::Compare:
+    if (args[0]->is_const() && args[1]->is_const())
+      return fold_compare(graph, instr->index, args[0], args[1]);
+    if (instr->index == OP_lcmp && args[0] == args[1])
+      return int_constant(graph, 0);
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+// Troca o If do fim do bloco por um Goto para succs[keep]
+void fold_branch(IrGraph &graph, IrBlock *block, size_t keep) {
+  IrBlock *kept = block->succs[keep];
+  IrBlock *dropped = block->succs[1 - keep];
+  IrGraph::remove_pred(dropped, block);
+  block->succs.assign(1, kept);
+  block->code.back()->removed = true;
+  block->code.back() = graph.make(IrOp::Goto, IrType::Void);
+  block->code.back()->block = block;
+}
+
+// true se mudou o grafo de fluxo
+bool simplify_terminator(IrGraph &graph, IrBlock *block) {
+  IrInstr *term = block->terminator();
+  if (term->op != IrOp::If)
+    return false;
+  IrInstr *&a = term->args[0];
+  IrInstr *&b = term->args[1];
+
+  // if (lcmp(x, y) cond 0) é if (x cond y)
+  if (a->op == IrOp::Compare && a->index == OP_lcmp && is_zero(b) &&
+      term->cond != IrCond::ULT && term->cond != IrCond::UGE) {
+    IrInstr *compare = a;
+    a = compare->args[0];
+    b = compare->args[1];
+  }
+
+  if (block->succs[0] == block->succs[1]) {
+    fold_branch(graph, block, 0);
+    return true;
+  }
+  bool result;
+  if (fold_condition(term->cond, a, b, result)) {
+    fold_branch(graph, block, result ? 0 : 1);
+    return true;
+  }
+  if (a == b && a->type != IrType::Float && a->type != IrType::Double) {
+    IrCond cond = term->cond;
+    bool taken = cond == IrCond::EQ || cond == IrCond::GE ||
+                 cond == IrCond::LE || cond == IrCond::UGE;
+    fold_branch(graph, block, taken ? 0 : 1);
+    return true;
+  }
+  return false;
+}
+
+// Guard que sempre passa
+bool redundant_guard(const IrInstr *guard) {
+  const IrInstr *a = guard->args[0], *b = guard->args[1];
+  if (guard->cond == IrCond::NE && a->non_null && b->is_const() &&
+      b->type == IrType::Ref && b->imm == 0)
+    return true;
+  if (a == b && a->type != IrType::Float && a->type != IrType::Double)
+    return guard->cond == IrCond::EQ || guard->cond == IrCond::GE ||
+           guard->cond == IrCond::LE || guard->cond == IrCond::UGE;
+  bool result;
+  return fold_condition(guard->cond, a, b, result) && result;
+}
+
+// Tira dos blocos as instruções marcadas como removidas
+void sweep(IrGraph &graph) {
+  for (IrBlock *block : graph.order) {
+    auto removed = [](const IrInstr *instr) { return instr->removed; };
+    block->phis.erase(
+        std::remove_if(block->phis.begin(), block->phis.end(), removed),
+        block->phis.end());
+    block->code.erase(
+        std::remove_if(block->code.begin(), block->code.end(), removed),
+        block->code.end());
+  }
+}
+
+void simplify(IrGraph &graph) {
+  bool cfg_changed = false;
+  bool changed = true;
+  for (int round = 0; changed && round < 4; round++) {
+    changed = false;
+    for (IrBlock *block : graph.order) {
+      for (IrInstr *instr : block->code) {
+        if (instr->removed)
+          continue;
+        for (IrInstr *&arg : instr->args)
+          arg = IrGraph::resolve(arg);
+        if (instr->op == IrOp::Guard) {
+          if (redundant_guard(instr)) {
+            instr->removed = true;
+            changed = true;
+          }
+          continue;
+        }
+        if (instr->is_terminator()) {
+          if (simplify_terminator(graph, block))
+            changed = cfg_changed = true;
+          continue;
+        }
+        if (IrInstr *value = simplify_value(graph, instr)) {
+          replace(instr, IrGraph::resolve(value));
+          changed = true;
+        }
+      }
+    }
+    sweep(graph);
+    graph.resolve_all();
+    if (cfg_changed) {
+      // Blocos que ficaram inalcançáveis saem, e com eles argumentos de phi
+      graph.compute_rpo();
+      cfg_changed = false;
+    }
+    graph.remove_trivial_phis();
+  }
+  graph.compute_dominators();
+}
+
+// ------------------------------------------------------
+// Numeração global de valores
+// ------------------------------------------------------
+
+struct ValueKey {
+  IrOp op;
+  IrType type;
+  IrCond cond;
+  char kind;
+  u4 index;
+  int64_t imm;
+  std::vector<u4> args;
+
+  bool operator<(const ValueKey &other) const {
+    return std::tie(op, type, cond, kind, index, imm, args) <
+           std::tie(other.op, other.type, other.cond, other.kind, other.index,
+                    other.imm, other.args);
+  }
+};
+
+bool is_numbered(const IrInstr *instr) {
+  switch (instr->op) {
+  case IrOp::Add:
+  case IrOp::Sub:
+  case IrOp::Mul:
+  case IrOp::Div:
+  case IrOp::Rem:
+  case IrOp::Neg:
+  case IrOp::And:
+  case IrOp::Or:
+  case IrOp::Xor:
+  case IrOp::Shl:
+  case IrOp::Shr:
+  case IrOp::Ushr:
+  case IrOp::Convert:
+  case IrOp::Compare:
+  case IrOp::ArrayLength:
+  case IrOp::LoadKlass:
+  case IrOp::Guard:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool is_commutative(const IrInstr *instr) {
+  return (instr->op == IrOp::Add || instr->op == IrOp::Mul ||
+          instr->op == IrOp::And || instr->op == IrOp::Or ||
+          instr->op == IrOp::Xor) &&
+         (instr->type == IrType::Int || instr->type == IrType::Long);
+}
+
+ValueKey key_of(const IrInstr *instr) {
+  ValueKey key{instr->op,    instr->type, instr->cond, instr->kind,
+               instr->index, instr->imm,  {}};
+  for (const IrInstr *arg : instr->args)
+    key.args.push_back(arg->id);
+  if (is_commutative(instr))
+    std::sort(key.args.begin(), key.args.end());
+  return key;
+}
+
+// Uma instrução é substituída por outra igual cujo bloco a domina. Guards
+// iguais a um guard dominante já passaram e saem do grafo.
+void number_values(IrGraph &graph) {
+  std::map<ValueKey, IrInstr *> constants;
+  std::map<ValueKey, std::vector<IrInstr *>> values;
+
+  auto canonical = [&](IrInstr *&value) {
+    value = IrGraph::resolve(value);
+    if (!value->is_const())
+      return;
+    auto it = constants.emplace(key_of(value), value).first;
+    value = it->second;
+  };
+  auto canonical_state = [&](FrameState *state) {
+    if (!state)
+      return;
+    for (IrInstr *&value : state->locals)
+      canonical(value);
+    for (IrInstr *&value : state->stack)
+      canonical(value);
+    for (ScalarObject &object : state->objects)
+      for (ScalarField &field : object.fields)
+        canonical(field.value);
+  };
+
+  for (IrBlock *block : graph.order) {
+    canonical_state(block->entry_state);
+    for (IrInstr *phi : block->phis)
+      for (IrInstr *&arg : phi->args)
+        canonical(arg);
+    for (IrInstr *instr : block->code) {
+      for (IrInstr *&arg : instr->args)
+        canonical(arg);
+      canonical_state(instr->state);
+      if (!is_numbered(instr))
+        continue;
+      std::vector<IrInstr *> &same = values[key_of(instr)];
+      IrInstr *found = nullptr;
+      for (IrInstr *candidate : same)
+        if (IrGraph::dominates(candidate->block, block)) {
+          found = candidate;
+          break;
+        }
+      if (!found) {
+        same.push_back(instr);
+        continue;
+      }
+      if (instr->op == IrOp::Guard)
+        instr->removed = true;
+      else
+        replace(instr, found);
+    }
+  }
+  sweep(graph);
+  graph.resolve_all();
+  graph.remove_trivial_phis();
+}
+
+// ------------------------------------------------------
+// Laços
+// ------------------------------------------------------
+
+struct Loop {
+  IrBlock *header;
+  std::vector<IrBlock *> latches;
+  std::vector<bool> body; // por id de bloco
+  size_t size;
+  IrBlock *preheader;
+  FrameState *entry; // estado dos guards tirados do laço
+};
+
+bool in_loop(const Loop &loop, const IrInstr *value) {
+  return value->block && loop.body[value->block->id];
+}
+
+std::vector<Loop> find_loops(IrGraph &graph) {
+  std::vector<Loop> loops;
+  for (IrBlock *header : graph.order) {
+    Loop loop;
+    loop.header = header;
+    for (IrBlock *pred : header->preds)
+      if (IrGraph::dominates(header, pred))
+        loop.latches.push_back(pred);
+    if (loop.latches.empty())
+      continue;
+
+    loop.body.assign(graph.block_count(), false);
+    loop.body[header->id] = true;
+    loop.size = 1;
+    std::vector<IrBlock *> work(loop.latches);
+    while (!work.empty()) {
+      IrBlock *block = work.back();
+      work.pop_back();
+      if (loop.body[block->id])
+        continue;
+      loop.body[block->id] = true;
+      loop.size++;
+      for (IrBlock *pred : block->preds)
+        work.push_back(pred);
+    }
+
+    loop.preheader = nullptr;
+    loop.entry = nullptr;
+    IrBlock *outside = nullptr;
+    size_t count = 0;
+    for (IrBlock *pred : header->preds)
+      if (!loop.body[pred->id]) {
+        outside = pred;
+        count++;
+      }
+    if (count == 1 && outside->succs.size() == 1)
+      loop.preheader = outside;
+    loops.push_back(std::move(loop));
+  }
+  // Internos primeiro
+  std::sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) {
+    return a.size < b.size;
+  });
+  return loops;
+}
+
+// Um bloco só com a aresta de entrada para cada cabeçalho de laço
+void insert_preheaders(IrGraph &graph) {
+  bool changed = false;
+  for (Loop &loop : find_loops(graph)) {
+    if (loop.preheader)
+      continue;
+    IrBlock *outside = nullptr;
+    size_t count = 0;
+    for (IrBlock *pred : loop.header->preds)
+      if (!loop.body[pred->id]) {
+        outside = pred;
+        count++;
+      }
+    if (count != 1)
+      continue;
+    auto &succs = outside->succs;
+    if (std::count(succs.begin(), succs.end(), loop.header) != 1)
+      continue;
+    graph.split_edge(outside, static_cast<size_t>(
+                                  std::find(succs.begin(), succs.end(),
+                                            loop.header) -
+                                  succs.begin()));
+    changed = true;
+  }
+  if (changed) {
+    graph.compute_rpo();
+    graph.compute_dominators();
+  }
+}
+
+// Estado de desotimização no fim do pré-cabeçalho: o do cabeçalho, com os
+// phis trocados pelo valor que vem da entrada
+FrameState *preheader_state(IrGraph &graph, Loop &loop) {
+  if (loop.entry)
+    return loop.entry;
+  const FrameState *state = loop.header->entry_state;
+  if (!state)
+    return nullptr;
+  auto &preds = loop.header->preds;
+  size_t edge = static_cast<size_t>(
+      std::find(preds.begin(), preds.end(), loop.preheader) - preds.begin());
+  auto map = [&](IrInstr *value) {
+    value = IrGraph::resolve(value);
+    if (value->op == IrOp::Phi && value->block == loop.header)
+      return value->args[edge];
+    return value;
+  };
+  loop.entry = graph.new_state(state->pc);
+  for (IrInstr *value : state->locals)
+    loop.entry->locals.push_back(map(value));
+  for (IrInstr *value : state->stack)
+    loop.entry->stack.push_back(map(value));
+  loop.entry->objects = state->objects;
+  for (ScalarObject &object : loop.entry->objects)
+    for (ScalarField &field : object.fields)
+      field.value = map(field.value);
+  return loop.entry;
+}
+
+bool is_null(const IrInstr *value) {
+  return value->is_const() && value->type == IrType::Ref && value->imm == 0;
+}
+
+void move_to(IrGraph &graph, IrInstr *instr, IrBlock *to) {
+  auto &code = instr->block->code;
+  code.erase(std::find(code.begin(), code.end(), instr));
+  graph.append(to, instr);
+}
+
+class LoopOptimizer {
+public:
+  explicit LoopOptimizer(IrGraph &graph) : graph(graph) {}
+
+  void run() {
+    insert_preheaders(graph);
+    std::vector<Loop> loops = find_loops(graph);
+    collect_null_checks();
+    for (Loop &loop : loops) {
+      if (!loop.preheader)
+        continue;
+      hoist_invariants(loop);
+      eliminate_range_checks(loop);
+    }
+  }
+
+private:
+  void collect_null_checks();
+  bool non_null_at(IrInstr *object, const IrBlock *block) const;
+  bool has_side_effects(const Loop &loop) const;
+  void hoist_invariants(Loop &loop);
+  void eliminate_range_checks(Loop &loop);
+  void guard(Loop &loop, IrCond cond, IrInstr *a, IrInstr *b);
+
+  IrGraph &graph;
+  // Guard(NE, x, null) de cada referência x
+  std::map<const IrInstr *, std::vector<IrInstr *>> null_checks;
+};
+
+void LoopOptimizer::collect_null_checks() {
+  for (IrBlock *block : graph.order)
+    for (IrInstr *instr : block->code)
+      if (instr->op == IrOp::Guard && instr->cond == IrCond::NE &&
+          is_null(instr->args[1]))
+        null_checks[instr->args[0]].push_back(instr);
+}
+
+bool LoopOptimizer::non_null_at(IrInstr *object, const IrBlock *block) const {
+  if (object->non_null)
+    return true;
+  auto it = null_checks.find(object);
+  if (it == null_checks.end())
+    return false;
+  for (const IrInstr *check : it->second)
+    if (!check->removed && IrGraph::dominates(check->block, block))
+      return true;
+  return false;
+}
+
+bool LoopOptimizer::has_side_effects(const Loop &loop) const {
+  for (IrBlock *block : graph.order) {
+    if (!loop.body[block->id])
+      continue;
+    for (const IrInstr *instr : block->code)
+      if (instr->op == IrOp::StoreElement || instr->op == IrOp::StoreField ||
+          instr->op == IrOp::StoreStatic || instr->op == IrOp::Step)
+        return true;
+  }
+  return false;
+}
+
+void LoopOptimizer::hoist_invariants(Loop &loop) {
+  bool writes = has_side_effects(loop);
+  IrBlock *preheader = loop.preheader;
+
+  for (IrBlock *block : graph.order) {
+    if (!loop.body[block->id])
+      continue;
+    bool every_iteration = true;
+    for (IrBlock *latch : loop.latches)
+      if (!IrGraph::dominates(block, latch))
+        every_iteration = false;
+
+    std::vector<IrInstr *> code(block->code);
+    for (IrInstr *instr : code) {
+      if (instr->is_terminator())
+        continue;
+      bool invariant = true;
+      for (IrInstr *arg : instr->args)
+        if (in_loop(loop, arg))
+          invariant = false;
+      if (!invariant)
+        continue;
+
+      switch (instr->op) {
+      case IrOp::Add:
+      case IrOp::Sub:
+      case IrOp::Mul:
+      case IrOp::Neg:
+      case IrOp::And:
+      case IrOp::Or:
+      case IrOp::Xor:
+      case IrOp::Shl:
+      case IrOp::Shr:
+      case IrOp::Ushr:
+      case IrOp::Convert:
+      case IrOp::Compare:
+        break;
+      case IrOp::ArrayLength:
+      case IrOp::LoadKlass:
+        if (!non_null_at(instr->args[0], preheader))
+          continue;
+        break;
+      case IrOp::LoadField:
+        if (writes || !non_null_at(instr->args[0], preheader))
+          continue;
+        break;
+      case IrOp::LoadStatic:
+        if (writes)
+          continue;
+        break;
+      case IrOp::Guard:
+        // Só os que rodam em toda volta; desotimizam no cabeçalho
+        if (!every_iteration || !preheader_state(graph, loop))
+          continue;
+        instr->state = loop.entry;
+        break;
+      default:
+        continue;
+      }
+      move_to(graph, instr, preheader);
+    }
+  }
+}
+
+// Um índice i = phi(início, i + 1) que fica no laço enquanto i < limite
+// (ou <=) só pode sair do array se início < 0 ou limite > comprimento;
+// essas duas condições viram guards no pré-cabeçalho e a checagem de cada
+// acesso a[i] sai do laço.
+void LoopOptimizer::eliminate_range_checks(Loop &loop) {
+  IrBlock *header = loop.header;
+  if (loop.latches.size() != 1 || header->preds.size() != 2)
+    return;
+  IrInstr *term = header->terminator();
+  if (term->op != IrOp::If)
+    return;
+  size_t inside;
+  if (loop.body[header->succs[0]->id] && !loop.body[header->succs[1]->id])
+    inside = 0;
+  else if (loop.body[header->succs[1]->id] &&
+           !loop.body[header->succs[0]->id])
+    inside = 1;
+  else
+    return;
+  IrBlock *body = header->succs[inside];
+  if (!IrGraph::dominates(body, loop.latches[0]))
+    return;
+
+  size_t entry_edge = header->preds[0] == loop.preheader ? 0 : 1;
+  IrInstr *iv = nullptr;
+  IrInstr *limit = nullptr;
+  IrCond cond = inside == 0 ? term->cond : negate(term->cond);
+  for (int side = 0; side < 2; side++) {
+    IrInstr *phi = term->args[side];
+    IrInstr *other = term->args[1 - side];
+    if (phi->op != IrOp::Phi || phi->block != header ||
+        phi->type != IrType::Int || in_loop(loop, other))
+      continue;
+    IrInstr *next = phi->args[1 - entry_edge];
+    if (next->op != IrOp::Add || next->args[0] != phi ||
+        !is_one(next->args[1]))
+      continue;
+    iv = phi;
+    limit = other;
+    if (side == 1)
+      cond = swap_operands(cond);
+  }
+  if (!iv || (cond != IrCond::LT && cond != IrCond::LE))
+    return;
+  IrInstr *init = iv->args[entry_edge];
+
+  for (IrBlock *block : graph.order) {
+    if (!loop.body[block->id] || !IrGraph::dominates(body, block))
+      continue;
+    for (IrInstr *check : block->code) {
+      if (check->removed || check->op != IrOp::Guard ||
+          check->cond != IrCond::ULT || check->args[0] != iv)
+        continue;
+      IrInstr *length = check->args[1];
+      if (length->op != IrOp::ArrayLength || in_loop(loop, length->args[0]))
+        continue;
+      if (!preheader_state(graph, loop))
+        return;
+      IrInstr *array = length->args[0];
+      if (!non_null_at(array, loop.preheader))
+        guard(loop, IrCond::NE, array, graph.constant(IrType::Ref, 0));
+      IrInstr *hoisted = graph.make(IrOp::ArrayLength, IrType::Int);
+      hoisted->args.push_back(array);
+      graph.append(loop.preheader, hoisted);
+      guard(loop, IrCond::GE, init, graph.constant(IrType::Int, 0));
+      guard(loop, cond == IrCond::LT ? IrCond::LE : IrCond::LT, limit,
+            hoisted);
+      check->removed = true;
+    }
+  }
+  sweep(graph);
+}
+
+void LoopOptimizer::guard(Loop &loop, IrCond cond, IrInstr *a, IrInstr *b) {
+  IrInstr *instr = graph.make(IrOp::Guard, IrType::Void);
+  instr->cond = cond;
+  instr->args = {a, b};
+  instr->state = loop.entry;
+  graph.append(loop.preheader, instr);
+  if (cond == IrCond::NE && is_null(b))
+    null_checks[a].push_back(instr);
+}
+
+// ------------------------------------------------------
+// Código morto
+// ------------------------------------------------------
+
+void remove_dead_code(IrGraph &graph) {
+  std::vector<bool> live(graph.instr_count(), false);
+  std::vector<IrInstr *> work;
+  auto mark = [&](IrInstr *value) {
+    if (!live[value->id]) {
+      live[value->id] = true;
+      work.push_back(value);
+    }
+  };
+  for (IrBlock *block : graph.order)
+    for (IrInstr *instr : block->code)
+      if (!instr->is_pure())
+        mark(instr);
+  while (!work.empty()) {
+    IrInstr *instr = work.back();
+    work.pop_back();
+    for (IrInstr *arg : instr->args)
+      mark(arg);
+    if (instr->state) {
+      for (IrInstr *value : instr->state->locals)
+        mark(value);
+      for (IrInstr *value : instr->state->stack)
+        mark(value);
+      for (const ScalarObject &object : instr->state->objects)
+        for (const ScalarField &field : object.fields)
+          mark(field.value);
+    }
+  }
+  for (IrBlock *block : graph.order) {
+    for (IrInstr *instr : block->phis)
+      instr->removed = !live[instr->id];
+    for (IrInstr *instr : block->code)
+      instr->removed = !live[instr->id];
+  }
+  sweep(graph);
+}
+
+} // namespace
+
+void optimize_ir(IrGraph &graph) {
+  graph.compute_dominators();
+  simplify(graph);
+  if (replace_allocations(graph))
+    simplify(graph);
+  number_values(graph);
+  LoopOptimizer(graph).run();
+  number_values(graph);
+  simplify(graph);
+  number_values(graph);
+  remove_dead_code(graph);
+}
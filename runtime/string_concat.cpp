@@ -0,0 +1,288 @@
+#include "./string_concat.h"
+#include "./java_string.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// O to_chars científico já dá os dígitos mais curtos; falta só o formato
+// da JDK (sempre com ponto, "E" e expoente sem sinal de +)
+template <typename T> std::string java_floating_to_string(T value) {
+  if (std::isnan(value))
+    return "NaN";
+  if (std::isinf(value))
+    return value < 0 ? "-Infinity" : "Infinity";
+
+  char buffer[64];
+  auto converted = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                 std::chars_format::scientific);
+  std::string scientific(buffer, converted.ptr);
+
+  std::string out;
+  size_t start = 0;
+  if (scientific[0] == '-') {
+    out.push_back('-');
+    start = 1;
+  }
+  size_t e = scientific.find('e');
+  std::string digits;
+  for (size_t i = start; i < e; i++)
+    if (scientific[i] != '.')
+      digits.push_back(scientific[i]);
+  int exponent = std::stoi(scientific.substr(e + 1));
+
+  if (exponent < -3 || exponent >= 7) {
+    out += digits.substr(0, 1) + "." +
+           (digits.size() > 1 ? digits.substr(1) : "0") + "E" +
+           std::to_string(exponent);
+  } else if (exponent < 0) {
+    out += "0." + std::string(static_cast<size_t>(-exponent - 1), '0') +
+           digits;
+  } else {
+    size_t integer_digits = static_cast<size_t>(exponent) + 1;
+    std::string integer = digits.substr(0, integer_digits);
+    integer.append(integer_digits - integer.size(), '0');
+    out += integer + "." +
+           (digits.size() > integer_digits ? digits.substr(integer_digits)
+                                           : "0");
+  }
+  return out;
+}
+
+std::u16string widen(const std::string &ascii) {
+  return std::u16string(ascii.begin(), ascii.end());
+}
+
+bool needs_utf16(const std::u16string &text) {
+  for (char16_t c : text)
+    if (c > 0xFF)
+      return true;
+  return false;
+}
+
+// Argumento já convertido: uma String segura em Thread::handles, ou o texto
+struct Value {
+  int64_t handle = -1;
+  std::u16string text;
+};
+
+// String.valueOf(Object) de uma referência que não é String: o toString()
+// do objeto, nativo ou em bytecode; o de Object é feito aqui mesmo.
+void object_to_string(Thread *thread, RuntimeObject *obj, Value &value) {
+  static const MemberKey to_string =
+      MemberKey::of("toString", "()Ljava/lang/String;");
+  RuntimeMethod *method = obj->klass->find_method(to_string);
+
+  if (method &&
+      (method->native || method->owner->name != "java/lang/Object")) {
+    Frame args(method, method->owner);
+    args.init(1, 0);
+    args.local_vars[0] = ref_to_slot(obj);
+    OperandStack result;
+    thread->interpreter->call(args, result);
+    RuntimeObject *str = result.pop_ref();
+    if (str)
+      thread->handles[value.handle] = encode_ref(str);
+    else {
+      value.handle = -1;
+      value.text = u"null";
+    }
+    return;
+  }
+
+  // Object.toString: getClass().getName() + "@" + hashCode() em hexa
+  std::string name = obj->klass->name;
+  for (char &c : name)
+    if (c == '/')
+      c = '.';
+  char hash[16];
+  auto end = std::to_chars(hash, hash + sizeof(hash),
+                           static_cast<u4>(obj->identity_hash()), 16);
+  value.handle = -1;
+  value.text = widen(name + "@" + std::string(hash, end.ptr));
+}
+
+} // namespace
+
+std::string java_float_to_string(float value) {
+  return java_floating_to_string(value);
+}
+
+std::string java_double_to_string(double value) {
+  return java_floating_to_string(value);
+}
+
+StringConcat StringConcat::link(const std::string &descriptor,
+                                const std::u16string *recipe,
+                                const std::vector<std::u16string> &constants) {
+  StringConcat concat;
+  for (size_t i = 1; i < descriptor.size() && descriptor[i] != ')'; i++) {
+    char type = descriptor[i];
+    if (type == '[' || type == 'L') {
+      while (i < descriptor.size() && descriptor[i] == '[')
+        i++;
+      if (i < descriptor.size() && descriptor[i] == 'L')
+        i = descriptor.find(';', i);
+      if (i == std::string::npos)
+        throw std::runtime_error("StringConcatException: malformed "
+                                 "descriptor " +
+                                 descriptor);
+      type = 'L';
+    }
+    concat.arg_types.push_back(type);
+  }
+
+  if (!recipe) {
+    for (size_t i = 0; i < concat.arg_types.size(); i++)
+      concat.pieces.push_back({static_cast<int32_t>(i), u""});
+    return concat;
+  }
+
+  // Constantes vizinhas e texto da receita viram um único literal
+  size_t next_arg = 0, next_constant = 0;
+  std::u16string literal;
+  auto flush_literal = [&]() {
+    if (!literal.empty())
+      concat.pieces.push_back({-1, literal});
+    literal.clear();
+  };
+  for (char16_t c : *recipe) {
+    if (c == 1) {
+      flush_literal();
+      concat.pieces.push_back({static_cast<int32_t>(next_arg++), u""});
+    } else if (c == 2) {
+      if (next_constant >= constants.size())
+        throw std::runtime_error("StringConcatException: recipe uses more "
+                                 "constants than provided");
+      literal += constants[next_constant++];
+    } else {
+      literal.push_back(c);
+    }
+  }
+  flush_literal();
+
+  if (next_arg != concat.arg_types.size())
+    throw std::runtime_error(
+        "StringConcatException: Mismatched number of concat arguments: "
+        "recipe wants " +
+        std::to_string(next_arg) + " arguments, but signature provides " +
+        std::to_string(concat.arg_types.size()));
+  return concat;
+}
+
+void StringConcat::invoke(Thread *thread, OperandStack &stack) const {
+  // As Strings dos argumentos ficam em handles até o fim: alocar o
+  // resultado pode mover todas elas
+  struct Release {
+    Thread *thread;
+    size_t base;
+    ~Release() { thread->handles.resize(base); }
+  } release{thread, thread->handles.size()};
+
+  // Os argumentos saem da pilha do último para o primeiro
+  std::vector<Value> values(arg_types.size());
+  for (size_t i = arg_types.size(); i-- > 0;) {
+    Value &v = values[i];
+    switch (arg_types[i]) {
+    case 'J':
+      v.text = widen(std::to_string(stack.pop_long()));
+      break;
+    case 'D':
+      v.text = widen(java_double_to_string(stack.pop_double()));
+      break;
+    case 'F':
+      v.text = widen(java_float_to_string(stack.pop_float()));
+      break;
+    case 'Z':
+      v.text = stack.pop_int() ? u"true" : u"false";
+      break;
+    case 'C':
+      v.text = std::u16string(1, static_cast<char16_t>(stack.pop_int()));
+      break;
+    case 'L':
+      v.handle = static_cast<int64_t>(thread->handles.size());
+      thread->handles.push_back(encode_ref(stack.pop_ref()));
+      break;
+    default: // B S I
+      v.text = widen(std::to_string(stack.pop_int()));
+    }
+  }
+
+  RuntimeClass *string_class =
+      thread->runtime->find_or_load_class("java/lang/String");
+  for (Value &v : values) {
+    if (v.handle < 0)
+      continue;
+    RuntimeObject *obj = decode_ref(thread->handles[v.handle]);
+    if (!obj) {
+      v.handle = -1;
+      v.text = u"null";
+    } else if (obj->klass != string_class) {
+      object_to_string(thread, obj, v);
+    }
+  }
+
+  // Tamanho e coder do resultado, antes de alocar
+  size_t length = 0;
+  u1 coder = CODER_LATIN1;
+  for (const Piece &piece : pieces) {
+    const std::u16string *text = &piece.literal;
+    if (piece.arg >= 0) {
+      const Value &v = values[piece.arg];
+      if (v.handle >= 0) {
+        StringView view = string_view(decode_ref(thread->handles[v.handle]));
+        length += static_cast<size_t>(view.length);
+        coder |= view.coder;
+        continue;
+      }
+      text = &v.text;
+    }
+    length += text->size();
+    if (coder == CODER_LATIN1 && needs_utf16(*text))
+      coder = CODER_UTF16;
+  }
+  if (length > static_cast<size_t>(INT32_MAX >> coder))
+    throw std::runtime_error(
+        "OutOfMemoryError: Overflow: String length out of range");
+
+  RuntimeObject *value = RuntimeObject::allocate_array(
+      thread, thread->runtime->array_class("[B"),
+      static_cast<int32_t>(length << coder));
+
+  u1 *out = value->array_data();
+  size_t at = 0;
+  auto put = [&](char16_t c) {
+    if (coder == CODER_LATIN1) {
+      out[at++] = static_cast<u1>(c);
+    } else {
+      u2 unit = c;
+      std::memcpy(out + 2 * at++, &unit, 2);
+    }
+  };
+  for (const Piece &piece : pieces) {
+    const std::u16string *text = &piece.literal;
+    if (piece.arg >= 0) {
+      const Value &v = values[piece.arg];
+      if (v.handle >= 0) {
+        StringView view = string_view(decode_ref(thread->handles[v.handle]));
+        if (view.coder == coder) {
+          std::memcpy(out + (at << coder), view.value->array_data(),
+                      view.value->array_length());
+          at += static_cast<size_t>(view.length);
+        } else {
+          for (int32_t i = 0; i < view.length; i++)
+            put(view.char_at(i));
+        }
+        continue;
+      }
+      text = &v.text;
+    }
+    for (char16_t c : *text)
+      put(c);
+  }
+
+  stack.push_ref(new_string_with_value(thread, value, coder));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "./call_site.h"
+
+#include <string>
+#include <vector>
+
+// Concatenação de strings do javac 9+: `a + b` vira um invokedynamic cujo
+// bootstrap é StringConcatFactory.makeConcatWithConstants (ou makeConcat).
+// Em vez de montar a cadeia de MethodHandles da JDK, o sítio é ligado a uma
+// receita interpretada aqui: pedaços constantes e argumentos em ordem. Cada
+// execução converte os argumentos, soma os tamanhos, aloca o byte[] do
+// resultado uma única vez e copia tudo para ele.
+struct StringConcat : CallSite {
+  // Um pedaço da receita: um argumento (arg >= 0) ou um texto constante
+  struct Piece {
+    int32_t arg;
+    std::u16string literal;
+  };
+
+  // Tipo de cada argumento pelo descritor: B C D F I J S Z, ou L para
+  // qualquer referência
+  std::vector<char> arg_types;
+  std::vector<Piece> pieces;
+
+  // `recipe` usa \1 para o próximo argumento e \2 para a próxima constante
+  // de `constants`; sem receita (makeConcat) cada argumento é um pedaço
+  static StringConcat link(const std::string &descriptor,
+                           const std::u16string *recipe,
+                           const std::vector<std::u16string> &constants);
+
+  // Tira os argumentos de `stack` e empilha a String resultante
+  void invoke(Thread *thread, OperandStack &stack) const override;
+};
+
+// Float.toString e Double.toString: o menor decimal que volta ao mesmo
+// valor, em notação científica fora de [10^-3, 10^7)
+std::string java_float_to_string(float value);
+std::string java_double_to_string(double value);
@@ -0,0 +1,20 @@
+#include "./runtime_class_types.h"
+
+#include <string>
+#include <unordered_set>
+
+std::unordered_set<std::string> &SymbolTable::table() {
+  static std::unordered_set<std::string> symbols;
+  return symbols;
+}
+
+// Elementos de unordered_set não mudam de endereço em rehash, então o
+// ponteiro devolvido vale enquanto o processo existir
+Symbol SymbolTable::intern(const std::string &value) {
+  return &*table().insert(value).first;
+}
+
+Symbol SymbolTable::lookup(const std::string &value) {
+  auto it = table().find(value);
+  return it == table().end() ? nullptr : &*it;
+}
@@ -0,0 +1,244 @@
+#include "./tiering.h"
+#include "../classfile/bytecode.h"
+#include "./jit.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Perfis
+
+void TypeProfile::record(RuntimeClass *klass) {
+  if (!klass) {
+    null_seen = true;
+    return;
+  }
+  for (u1 i = 0; i < TYPE_PROFILE_WIDTH; i++) {
+    if (classes[i] == klass) {
+      counts[i]++;
+      return;
+    }
+    if (!classes[i]) {
+      classes[i] = klass;
+      counts[i] = 1;
+      return;
+    }
+  }
+  other++;
+}
+
+LoopCounter *MethodProfile::loop_at(u4 header) {
+  auto it = std::lower_bound(
+      loops.begin(), loops.end(), header,
+      [](const LoopCounter &loop, u4 value) { return loop.header < value; });
+  if (it == loops.end() || it->header != header)
+    return nullptr;
+  return &*it;
+}
+
+TypeProfile *MethodProfile::type_profile_at(u4 pc) {
+  auto it = std::lower_bound(
+      types.begin(), types.end(), pc,
+      [](const TypeProfile &profile, u4 value) { return profile.pc < value; });
+  if (it == types.end() || it->pc != pc)
+    return nullptr;
+  return &*it;
+}
+
+u4 MethodProfile::hottest_loop() const {
+  u4 hottest = 0;
+  for (const LoopCounter &loop : loops)
+    hottest = std::max(hottest, loop.count);
+  return hottest;
+}
+
+static int32_t branch_offset(const std::vector<u1> &code, u4 pc) {
+  if (code[pc] == OP_goto_w)
+    return static_cast<int32_t>(read_code_u4(code, pc + 1));
+  return static_cast<int16_t>(read_code_u2(code, pc + 1));
+}
+
+void RuntimeMethod::build_loop_counters() {
+  profile.loops.clear();
+  if (!code)
+    return;
+
+  const std::vector<u1> &bytecode = code->code;
+  for (u4 pc = 0; pc < code->code_length;
+       pc += instruction_length(bytecode, pc)) {
+    u1 op = bytecode[pc];
+    bool branch = (op >= OP_ifeq && op <= OP_goto) || op == OP_ifnull ||
+                  op == OP_ifnonnull || op == OP_goto_w;
+    int32_t offset = branch ? branch_offset(bytecode, pc) : 1;
+    if (offset <= 0)
+      profile.loops.push_back({static_cast<u4>(pc + offset), 0});
+  }
+
+  // Vários desvios para trás (continue) podem voltar ao mesmo cabeçalho
+  auto &loops = profile.loops;
+  std::sort(loops.begin(), loops.end(),
+            [](const LoopCounter &a, const LoopCounter &b) {
+              return a.header < b.header;
+            });
+  loops.erase(std::unique(loops.begin(), loops.end(),
+                          [](const LoopCounter &a, const LoopCounter &b) {
+                            return a.header == b.header;
+                          }),
+              loops.end());
+}
+
+void RuntimeMethod::build_type_profiles() {
+  profile.types.clear();
+  if (!code)
+    return;
+
+  for (u4 pc = 0; pc < code->code_length;
+       pc += instruction_length(code->code, pc)) {
+    u1 op = code->code[pc];
+    if (op == OP_checkcast || op == OP_instanceof)
+      profile.types.emplace_back(pc);
+  }
+}
+
+// Política
+
+TieringPolicy::TieringPolicy(Runtime *runtime) : runtime(runtime) {}
+
+void TieringPolicy::update(RuntimeMethod *method) {
+  MethodProfile &profile = method->profile;
+  const TieringThresholds &t = thresholds_;
+  u8 hotness = static_cast<u8>(profile.invocations) + profile.backedges;
+  auto reached = [](u4 threshold, u8 value) {
+    return threshold != 0 && value >= threshold;
+  };
+
+  bool compile = profile.tier < Tier::Compiled && !method->not_compilable &&
+                 (reached(t.compile, profile.invocations) ||
+                  reached(t.backedge, profile.hottest_loop()));
+  bool start_profiling =
+      profile.tier < Tier::Profiling && reached(t.profile, hotness);
+
+  // Cada tier inclui o anterior: o compilador aproveita o cp_cache resolvido
+  if (profile.tier == Tier::Interpreted &&
+      (compile || start_profiling || reached(t.quicken, hotness))) {
+    quicken(method);
+    profile.tier = Tier::Quickened;
+  }
+  if (start_profiling) {
+    method->build_type_profiles();
+    profile.tier = Tier::Profiling;
+  }
+  if (compile) {
+    if (runtime->jit->compile(method))
+      profile.tier = Tier::Compiled;
+    else
+      method->not_compilable = true;
+  }
+  if (profile.tier == Tier::Compiled && !method->not_optimizable &&
+      reached(t.optimize, profile.invocations)) {
+    if (runtime->jit->optimize(method))
+      profile.tier = Tier::Optimized;
+    else
+      method->not_optimizable = true;
+  }
+
+  // Cada evento soma no máximo 1 a cada contador, então nenhum limiar é
+  // cruzado antes de o countdown zerar de novo
+  u8 next = UINT32_MAX;
+  auto until = [&](u4 threshold, u8 value) {
+    if (threshold != 0 && value < threshold)
+      next = std::min(next, threshold - value);
+  };
+  if (profile.tier == Tier::Interpreted)
+    until(t.quicken, hotness);
+  if (profile.tier < Tier::Profiling)
+    until(t.profile, hotness);
+  if (profile.tier < Tier::Compiled && !method->not_compilable) {
+    until(t.compile, profile.invocations);
+    until(t.backedge, profile.hottest_loop());
+  }
+  if (profile.tier <= Tier::Compiled && !method->not_optimizable &&
+      !method->not_compilable)
+    until(t.optimize, profile.invocations);
+  profile.countdown = static_cast<u4>(next);
+}
+
+void TieringPolicy::on_deoptimization(RuntimeMethod *method) {
+  MethodProfile &profile = method->profile;
+  if (++profile.deoptimizations < MAX_DEOPTIMIZATIONS ||
+      profile.tier != Tier::Optimized)
+    return;
+  method->compiled = method->compiled->baseline;
+  method->not_optimizable = true;
+  profile.tier = Tier::Compiled;
+}
+
+// Resolve as referências do constant pool usadas pelo método cujas classes
+// já estão carregadas; as outras continuam para a primeira execução da
+// instrução, e erros de resolução também, para só aparecerem se a
+// instrução rodar. Estáticos só de classes já inicializadas: o endereço no
+// cache vale como inicialização feita. Também cria os inline caches dos
+// invokes virtuais.
+void TieringPolicy::quicken(RuntimeMethod *method) {
+  if (!method->code)
+    return;
+
+  method->build_inline_caches();
+
+  RuntimeClass *klass = method->owner;
+  const ClassFile &cf = *klass->class_file;
+  const std::vector<u1> &code = method->code->code;
+  auto loaded = [&](u2 class_index) {
+    return runtime->method_area->getClassRef(cf.resolve_utf8(class_index)) !=
+           nullptr;
+  };
+
+  for (u4 pc = 0; pc < method->code->code_length;
+       pc += instruction_length(code, pc)) {
+    u1 op = code[pc];
+    u2 index = op == OP_ldc ? code[pc + 1] : 0;
+    if (op == OP_ldc_w || (op >= OP_getstatic && op <= OP_new) ||
+        op == OP_anewarray || op == OP_checkcast || op == OP_instanceof ||
+        op == OP_multianewarray)
+      index = read_code_u2(code, pc + 1);
+    if (index == 0 || index >= cf.constant_pool.size())
+      continue;
+
+    const ConstantInfo &info = cf.constant_pool[index].second;
+    try {
+      switch (op) {
+      case OP_getfield:
+      case OP_putfield:
+        if (loaded(info.fieldref_info.class_index))
+          runtime->resolve_field(klass, index);
+        break;
+      case OP_getstatic:
+      case OP_putstatic:
+        if (loaded(info.fieldref_info.class_index) &&
+            runtime->resolve_field(klass, index)->owner->is_initialized())
+          runtime->resolve_static_field(klass, index);
+        break;
+      case OP_invokevirtual:
+      case OP_invokespecial:
+      case OP_invokestatic:
+      case OP_invokeinterface:
+        if (loaded(info.methodref_info.class_index))
+          runtime->resolve_method(klass, index);
+        break;
+      case OP_ldc:
+      case OP_ldc_w:
+        if (cf.constant_pool[index].first == ConstantTag::CONSTANT_String)
+          runtime->resolve_string(klass, index);
+        break;
+      case OP_new:
+      case OP_anewarray:
+      case OP_checkcast:
+      case OP_instanceof:
+      case OP_multianewarray:
+        if (loaded(index))
+          runtime->resolve_class(klass, index);
+        break;
+      }
+    } catch (const std::runtime_error &) {
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "./runtime_class_types.h"
+
+// Limiares padrão. Os de quicken e profile contam chamadas mais voltas de
+// laço; os de compile e optimize só chamadas; o de backedge as voltas de um
+// único laço.
+static const u4 DEFAULT_QUICKEN_THRESHOLD = 100;
+static const u4 DEFAULT_PROFILE_THRESHOLD = 500;
+static const u4 DEFAULT_COMPILE_THRESHOLD = 1000;
+static const u4 DEFAULT_BACKEDGE_THRESHOLD = 10000;
+static const u4 DEFAULT_OPTIMIZE_THRESHOLD = 10000;
+
+// Desotimizações até o método voltar de vez ao código de templates
+static const u4 MAX_DEOPTIMIZATIONS = 16;
+
+// Zero desliga a transição correspondente
+struct TieringThresholds {
+  u4 quicken;
+  u4 profile;
+  u4 compile;
+  u4 backedge;
+  u4 optimize;
+
+  TieringThresholds()
+      : quicken(DEFAULT_QUICKEN_THRESHOLD),
+        profile(DEFAULT_PROFILE_THRESHOLD),
+        compile(DEFAULT_COMPILE_THRESHOLD),
+        backedge(DEFAULT_BACKEDGE_THRESHOLD),
+        optimize(DEFAULT_OPTIMIZE_THRESHOLD) {}
+};
+
+// Decide quando um método sobe de tier: Interpreted -> Quickened (resolve
+// de uma vez as referências do constant pool cujas classes já estão
+// carregadas e cria os inline caches) -> Profiling (o interpretador passa a
+// registrar perfis de tipo) -> Compiled (compilador de templates) ->
+// Optimized (compilador SSA, que especula com os perfis e os inline caches
+// e desotimiza quando erra). O interpretador só
+// incrementa contadores e decrementa MethodProfile::countdown; a decisão
+// roda quando o countdown zera, no primeiro evento em que algum limiar pode
+// ter sido cruzado.
+class TieringPolicy {
+public:
+  explicit TieringPolicy(Runtime *runtime);
+
+  // Início de uma chamada do método, antes de escolher entre o código
+  // compilado e o interpretador
+  void on_invocation(RuntimeMethod *method) {
+    MethodProfile &profile = method->profile;
+    profile.invocations++;
+    if (--profile.countdown == 0)
+      update(method);
+  }
+
+  // Desvio para trás em direção a `header`, no interpretador
+  void on_backedge(RuntimeMethod *method, u4 header) {
+    MethodProfile &profile = method->profile;
+    if (LoopCounter *loop = profile.loop_at(header))
+      loop->count++;
+    profile.backedges++;
+    if (--profile.countdown == 0)
+      update(method);
+  }
+
+  // O código otimizado do método desotimizou: o frame continua no
+  // interpretador. Depois de MAX_DEOPTIMIZATIONS o método fica com o código
+  // de templates.
+  void on_deoptimization(RuntimeMethod *method);
+
+  // Objeto de checkcast/instanceof em `pc`
+  static void record_type(RuntimeMethod *method, u4 pc, RuntimeClass *klass) {
+    if (method->profile.tier != Tier::Profiling)
+      return;
+    if (TypeProfile *types = method->profile.type_profile_at(pc))
+      types->record(klass);
+  }
+
+  const TieringThresholds &thresholds() const { return thresholds_; }
+  void set_thresholds(const TieringThresholds &thresholds) {
+    thresholds_ = thresholds;
+  }
+
+private:
+  void update(RuntimeMethod *method);
+  void quicken(RuntimeMethod *method);
+
+  Runtime *runtime;
+  TieringThresholds thresholds_;
+};
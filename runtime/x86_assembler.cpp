@@ -0,0 +1,396 @@
+#include "./x86_assembler.h"
+
+#include <stdexcept>
+
+Assembler::Label Assembler::new_label() {
+  labels_.push_back(-1);
+  return labels_.size() - 1;
+}
+
+void Assembler::bind(Label label) {
+  labels_[label] = static_cast<int64_t>(code_.size());
+}
+
+std::vector<u1> Assembler::finish() {
+  for (const Fixup &fixup : fixups_) {
+    int64_t target = labels_[fixup.label];
+    if (target < 0)
+      throw std::runtime_error("assembler: unbound label");
+    int64_t origin = fixup.base < 0 ? static_cast<int64_t>(fixup.at + 4)
+                                    : labels_[fixup.base];
+    if (origin < 0)
+      throw std::runtime_error("assembler: unbound label");
+    u4 offset = static_cast<u4>(target - origin);
+    for (int i = 0; i < 4; i++)
+      code_[fixup.at + i] = static_cast<u1>(offset >> (8 * i));
+  }
+  fixups_.clear();
+  return code_;
+}
+
+void Assembler::emit32(u4 value) {
+  for (int i = 0; i < 4; i++)
+    emit(static_cast<u1>(value >> (8 * i)));
+}
+
+void Assembler::emit64(u8 value) {
+  for (int i = 0; i < 8; i++)
+    emit(static_cast<u1>(value >> (8 * i)));
+}
+
+void Assembler::rex(bool wide, u1 reg, u1 index, u1 base, bool force) {
+  u1 prefix = static_cast<u1>(0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) |
+                              ((index >> 3) << 1) | (base >> 3));
+  if (prefix != 0x40 || force)
+    emit(prefix);
+}
+
+void Assembler::rex_mem(bool wide, u1 reg, const Mem &m, bool force) {
+  rex(wide, reg, m.scale ? m.index : 0, m.base, force);
+}
+
+void Assembler::modrm_reg(u1 reg, u1 rm) {
+  emit(static_cast<u1>(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Sempre mod=10 (disp32). Base rsp/r12 e endereços com índice precisam do
+// byte SIB.
+void Assembler::modrm_mem(u1 reg, const Mem &m) {
+  u1 r = static_cast<u1>((reg & 7) << 3);
+  if (m.scale) {
+    u1 scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+    emit(static_cast<u1>(0x80 | r | 4));
+    emit(static_cast<u1>((scale << 6) | ((m.index & 7) << 3) | (m.base & 7)));
+  } else if ((m.base & 7) == RSP) {
+    emit(static_cast<u1>(0x80 | r | 4));
+    emit(0x24);
+  } else {
+    emit(static_cast<u1>(0x80 | r | (m.base & 7)));
+  }
+  emit32(static_cast<u4>(m.disp));
+}
+
+void Assembler::rel32(Label target) {
+  fixups_.push_back({code_.size(), target, -1});
+  emit32(0);
+}
+
+// Movimentos
+
+void Assembler::mov(Reg dst, Reg src, bool wide) {
+  rex(wide, src, 0, dst);
+  emit(0x89);
+  modrm_reg(src, dst);
+}
+
+void Assembler::mov_imm32(Reg dst, u4 value) {
+  rex(false, 0, 0, dst);
+  emit(static_cast<u1>(0xB8 + (dst & 7)));
+  emit32(value);
+}
+
+void Assembler::mov_imm64(Reg dst, u8 value) {
+  if (value <= 0xFFFFFFFFu) {
+    mov_imm32(dst, static_cast<u4>(value));
+    return;
+  }
+  rex(true, 0, 0, dst);
+  emit(static_cast<u1>(0xB8 + (dst & 7)));
+  emit64(value);
+}
+
+void Assembler::load(Reg dst, const Mem &src, u1 size, bool sign) {
+  switch (size) {
+  case 1:
+    rex_mem(false, dst, src);
+    emit(0x0F);
+    emit(sign ? 0xBE : 0xB6);
+    break;
+  case 2:
+    rex_mem(false, dst, src);
+    emit(0x0F);
+    emit(sign ? 0xBF : 0xB7);
+    break;
+  case 4:
+    rex_mem(false, dst, src);
+    emit(0x8B);
+    break;
+  default:
+    rex_mem(true, dst, src);
+    emit(0x8B);
+  }
+  modrm_mem(dst, src);
+}
+
+void Assembler::store(const Mem &dst, Reg src, u1 size) {
+  switch (size) {
+  case 1:
+    rex_mem(false, src, dst, src >= RSP);
+    emit(0x88);
+    break;
+  case 2:
+    emit(0x66);
+    rex_mem(false, src, dst);
+    emit(0x89);
+    break;
+  case 4:
+    rex_mem(false, src, dst);
+    emit(0x89);
+    break;
+  default:
+    rex_mem(true, src, dst);
+    emit(0x89);
+  }
+  modrm_mem(src, dst);
+}
+
+void Assembler::movsxd(Reg dst, const Mem &src) {
+  rex_mem(true, dst, src);
+  emit(0x63);
+  modrm_mem(dst, src);
+}
+
+void Assembler::movsxd(Reg dst, Reg src) {
+  rex(true, dst, 0, src);
+  emit(0x63);
+  modrm_reg(dst, src);
+}
+
+void Assembler::lea(Reg dst, Label target) {
+  rex(true, dst, 0, 0);
+  emit(0x8D);
+  emit(static_cast<u1>(((dst & 7) << 3) | 5)); // mod=00 rm=101: rip + disp32
+  rel32(target);
+}
+
+void Assembler::movzx8(Reg dst, Reg src) {
+  rex(false, dst, 0, src, src >= RSP);
+  emit(0x0F);
+  emit(0xB6);
+  modrm_reg(dst, src);
+}
+
+void Assembler::movsx8(Reg dst, Reg src) {
+  rex(false, dst, 0, src, src >= RSP);
+  emit(0x0F);
+  emit(0xBE);
+  modrm_reg(dst, src);
+}
+
+void Assembler::movzx16(Reg dst, Reg src) {
+  rex(false, dst, 0, src);
+  emit(0x0F);
+  emit(0xB7);
+  modrm_reg(dst, src);
+}
+
+void Assembler::movsx16(Reg dst, Reg src) {
+  rex(false, dst, 0, src);
+  emit(0x0F);
+  emit(0xBF);
+  modrm_reg(dst, src);
+}
+
+// Aritmética
+
+void Assembler::alu(AluOp op, Reg dst, Reg src, bool wide) {
+  static const u1 opcodes[] = {0x01, 0x09, 0x21, 0x29, 0x31, 0x39};
+  rex(wide, src, 0, dst);
+  emit(opcodes[op]);
+  modrm_reg(src, dst);
+}
+
+void Assembler::alu_imm(AluOp op, Reg dst, int32_t value, bool wide) {
+  static const u1 digits[] = {0, 1, 4, 5, 6, 7};
+  rex(wide, 0, 0, dst);
+  if (value >= -128 && value <= 127) {
+    emit(0x83);
+    modrm_reg(digits[op], dst);
+    emit(static_cast<u1>(value));
+  } else {
+    emit(0x81);
+    modrm_reg(digits[op], dst);
+    emit32(static_cast<u4>(value));
+  }
+}
+
+void Assembler::cmp(Reg left, const Mem &right, bool wide) {
+  rex_mem(wide, left, right);
+  emit(0x3B);
+  modrm_mem(left, right);
+}
+
+void Assembler::test(Reg left, Reg right, bool wide) {
+  rex(wide, right, 0, left);
+  emit(0x85);
+  modrm_reg(right, left);
+}
+
+void Assembler::imul(Reg dst, Reg src, bool wide) {
+  rex(wide, dst, 0, src);
+  emit(0x0F);
+  emit(0xAF);
+  modrm_reg(dst, src);
+}
+
+void Assembler::neg(Reg dst, bool wide) {
+  rex(wide, 0, 0, dst);
+  emit(0xF7);
+  modrm_reg(3, dst);
+}
+
+void Assembler::idiv(Reg divisor, bool wide) {
+  rex(wide, 0, 0, divisor);
+  emit(0xF7);
+  modrm_reg(7, divisor);
+}
+
+void Assembler::sign_extend_rax(bool wide) {
+  if (wide)
+    emit(0x48);
+  emit(0x99);
+}
+
+void Assembler::shift_cl(ShiftOp op, Reg dst, bool wide) {
+  rex(wide, 0, 0, dst);
+  emit(0xD3);
+  modrm_reg(op, dst);
+}
+
+void Assembler::shift_imm(ShiftOp op, Reg dst, u1 count, bool wide) {
+  rex(wide, 0, 0, dst);
+  emit(0xC1);
+  modrm_reg(op, dst);
+  emit(count);
+}
+
+void Assembler::btc(Reg dst, u1 bit, bool wide) {
+  rex(wide, 0, 0, dst);
+  emit(0x0F);
+  emit(0xBA);
+  modrm_reg(7, dst);
+  emit(bit);
+}
+
+void Assembler::setcc(Cond cond, Reg dst) {
+  rex(false, 0, 0, dst, dst >= RSP);
+  emit(0x0F);
+  emit(static_cast<u1>(0x90 + cond));
+  modrm_reg(0, dst);
+}
+
+// SSE escalar
+
+void Assembler::movs_load(SsePrefix prefix, Xmm dst, const Mem &src) {
+  emit(prefix);
+  rex_mem(false, dst, src);
+  emit(0x0F);
+  emit(0x10);
+  modrm_mem(dst, src);
+}
+
+void Assembler::movs_store(SsePrefix prefix, const Mem &dst, Xmm src) {
+  emit(prefix);
+  rex_mem(false, src, dst);
+  emit(0x0F);
+  emit(0x11);
+  modrm_mem(src, dst);
+}
+
+void Assembler::mov_xmm(Xmm dst, Xmm src) {
+  rex(false, dst, 0, src);
+  emit(0x0F);
+  emit(0x28);
+  modrm_reg(dst, src);
+}
+
+void Assembler::sse(SsePrefix prefix, SseOp op, Xmm dst, Xmm src) {
+  emit(prefix);
+  rex(false, dst, 0, src);
+  emit(0x0F);
+  emit(op);
+  modrm_reg(dst, src);
+}
+
+void Assembler::ucomis(bool is_double, Xmm left, Xmm right) {
+  if (is_double)
+    emit(0x66);
+  rex(false, left, 0, right);
+  emit(0x0F);
+  emit(0x2E);
+  modrm_reg(left, right);
+}
+
+void Assembler::movd_to_xmm(Xmm dst, Reg src, bool wide) {
+  emit(0x66);
+  rex(wide, dst, 0, src);
+  emit(0x0F);
+  emit(0x6E);
+  modrm_reg(dst, src);
+}
+
+void Assembler::movd_from_xmm(Reg dst, Xmm src, bool wide) {
+  emit(0x66);
+  rex(wide, src, 0, dst);
+  emit(0x0F);
+  emit(0x7E);
+  modrm_reg(src, dst);
+}
+
+void Assembler::cvtsi2s(SsePrefix prefix, Xmm dst, Reg src, bool wide) {
+  emit(prefix);
+  rex(wide, dst, 0, src);
+  emit(0x0F);
+  emit(0x2A);
+  modrm_reg(dst, src);
+}
+
+void Assembler::cvtts2si(SsePrefix prefix, Reg dst, Xmm src, bool wide) {
+  emit(prefix);
+  rex(wide, dst, 0, src);
+  emit(0x0F);
+  emit(0x2C);
+  modrm_reg(dst, src);
+}
+
+// Controle
+
+void Assembler::jmp(Label target) {
+  emit(0xE9);
+  rel32(target);
+}
+
+void Assembler::jcc(Cond cond, Label target) {
+  emit(0x0F);
+  emit(static_cast<u1>(0x80 + cond));
+  rel32(target);
+}
+
+void Assembler::jmp(Reg target) {
+  rex(false, 0, 0, target);
+  emit(0xFF);
+  modrm_reg(4, target);
+}
+
+void Assembler::call(Reg target) {
+  rex(false, 0, 0, target);
+  emit(0xFF);
+  modrm_reg(2, target);
+}
+
+void Assembler::push(Reg reg) {
+  rex(false, 0, 0, reg);
+  emit(static_cast<u1>(0x50 + (reg & 7)));
+}
+
+void Assembler::pop(Reg reg) {
+  rex(false, 0, 0, reg);
+  emit(static_cast<u1>(0x58 + (reg & 7)));
+}
+
+void Assembler::ret() { emit(0xC3); }
+
+void Assembler::offset32(Label target, Label base) {
+  fixups_.push_back({code_.size(), target, static_cast<int64_t>(base)});
+  emit32(0);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../classfile/classfile_types.h"
+#include <cstddef>
+#include <vector>
+
+// Montador x86-64 mínimo para o JIT: só as instruções que os templates
+// usam, sempre com a forma mais simples de codificar (endereços com disp32,
+// desvios com rel32).
+
+enum Reg : u1 {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+enum Xmm : u1 {
+  XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+  XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15,
+};
+
+// Códigos de condição de jcc/setcc
+enum Cond : u1 {
+  CC_O = 0x0,
+  CC_NO = 0x1,
+  CC_B = 0x2,  // abaixo, sem sinal
+  CC_AE = 0x3, // acima ou igual, sem sinal
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_BE = 0x6,
+  CC_A = 0x7,
+  CC_P = 0xA, // paridade: comparação de ponto flutuante com NaN
+  CC_L = 0xC,
+  CC_GE = 0xD,
+  CC_LE = 0xE,
+  CC_G = 0xF,
+};
+
+// Operações aritméticas de dois operandos: o opcode da forma r/m, r e a
+// extensão /digit da forma com imediato
+enum AluOp : u1 { ALU_ADD, ALU_OR, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+
+enum ShiftOp : u1 { SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+
+// Prefixos de SSE: F3 escalar float, F2 escalar double
+enum SsePrefix : u1 { SSE_SS = 0xF3, SSE_SD = 0xF2 };
+
+enum SseOp : u1 {
+  SSE_ADD = 0x58,
+  SSE_MUL = 0x59,
+  SSE_CVT = 0x5A, // cvtss2sd/cvtsd2ss
+  SSE_SUB = 0x5C,
+  SSE_DIV = 0x5E,
+};
+
+// Operando de memória [base + index * scale + disp]
+struct Mem {
+  Reg base;
+  Reg index;
+  u1 scale; // 1, 2, 4 ou 8; 0 sem índice
+  int32_t disp;
+};
+
+inline Mem mem(Reg base, int32_t disp = 0) { return Mem{base, RAX, 0, disp}; }
+inline Mem mem(Reg base, Reg index, u1 scale, int32_t disp = 0) {
+  return Mem{base, index, scale, disp};
+}
+
+class Assembler {
+public:
+  using Label = size_t;
+
+  Label new_label();
+  void bind(Label label);
+  bool is_bound(Label label) const { return labels_[label] >= 0; }
+
+  // Código com os desvios resolvidos; todo label usado precisa estar ligado
+  std::vector<u1> finish();
+  size_t size() const { return code_.size(); }
+
+  // Movimentos. `size` em bytes; cargas de 1 e 2 bytes estendem para 32
+  // bits, com ou sem sinal, e cargas de 4 bytes zeram os 32 bits altos.
+  void mov(Reg dst, Reg src, bool wide);
+  void mov_imm32(Reg dst, u4 value);
+  void mov_imm64(Reg dst, u8 value);
+  void load(Reg dst, const Mem &src, u1 size, bool sign = false);
+  void store(const Mem &dst, Reg src, u1 size);
+  void movsxd(Reg dst, const Mem &src);
+  void movsxd(Reg dst, Reg src);
+  void lea(Reg dst, Label target); // lea dst, [rip + rel32]
+  void movzx8(Reg dst, Reg src);
+  void movsx8(Reg dst, Reg src);
+  void movzx16(Reg dst, Reg src);
+  void movsx16(Reg dst, Reg src);
+
+  // Aritmética
+  void alu(AluOp op, Reg dst, Reg src, bool wide);
+  void alu_imm(AluOp op, Reg dst, int32_t value, bool wide);
+  void cmp(Reg left, const Mem &right, bool wide);
+  void test(Reg left, Reg right, bool wide);
+  void imul(Reg dst, Reg src, bool wide);
+  void neg(Reg dst, bool wide);
+  void idiv(Reg divisor, bool wide); // rdx:rax / divisor
+  void sign_extend_rax(bool wide);   // cdq / cqo
+  void shift_cl(ShiftOp op, Reg dst, bool wide);
+  void shift_imm(ShiftOp op, Reg dst, u1 count, bool wide);
+  void btc(Reg dst, u1 bit, bool wide);
+  void setcc(Cond cond, Reg dst); // só os 8 bits baixos
+
+  // SSE escalar
+  void movs_load(SsePrefix prefix, Xmm dst, const Mem &src);
+  void movs_store(SsePrefix prefix, const Mem &dst, Xmm src);
+  void mov_xmm(Xmm dst, Xmm src); // movaps
+  void sse(SsePrefix prefix, SseOp op, Xmm dst, Xmm src);
+  void ucomis(bool is_double, Xmm left, Xmm right);
+  void movd_to_xmm(Xmm dst, Reg src, bool wide);   // movd/movq
+  void movd_from_xmm(Reg dst, Xmm src, bool wide); // movd/movq
+  void cvtsi2s(SsePrefix prefix, Xmm dst, Reg src, bool wide);
+  // Com truncamento; NaN e valores fora do intervalo dão o menor inteiro
+  void cvtts2si(SsePrefix prefix, Reg dst, Xmm src, bool wide);
+
+  // Controle
+  void jmp(Label target);
+  void jcc(Cond cond, Label target);
+  void jmp(Reg target);
+  void call(Reg target);
+  void push(Reg reg);
+  void pop(Reg reg);
+  void ret();
+
+  // Dado no meio do código: a distância de `base` até `target` em 32 bits,
+  // para tabelas de desvio
+  void offset32(Label target, Label base);
+
+private:
+  void emit(u1 byte) { code_.push_back(byte); }
+  void emit32(u4 value);
+  void emit64(u8 value);
+  // REX só quando necessário, ou sempre com `force` (registradores de 8
+  // bits spl, bpl, sil e dil)
+  void rex(bool wide, u1 reg, u1 index, u1 base, bool force = false);
+  void rex_mem(bool wide, u1 reg, const Mem &m, bool force = false);
+  void modrm_reg(u1 reg, u1 rm);
+  void modrm_mem(u1 reg, const Mem &m);
+  void rel32(Label target);
+
+  std::vector<u1> code_;
+  std::vector<int64_t> labels_; // posição, -1 enquanto não ligado
+  struct Fixup {
+    size_t at; // início do rel32
+    Label label;
+    int64_t base; // label de origem; -1 para o fim do rel32
+  };
+  std::vector<Fixup> fixups_;
+};